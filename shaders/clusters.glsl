@@ -0,0 +1,35 @@
+// needs ubo.glsl, the grid is a froxel grid from the camera with slices spaced exponentially in depth
+#define LIGHT_CLUSTER_X 16
+#define LIGHT_CLUSTER_Y 9
+#define LIGHT_CLUSTER_Z 24
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTER_X * LIGHT_CLUSTER_Y * LIGHT_CLUSTER_Z)
+#define MAX_LIGHTS_PER_CLUSTER 63
+
+struct LightCluster
+{
+    uint count;
+    uint lights[MAX_LIGHTS_PER_CLUSTER];
+};
+
+// near and far planes of the camera's projection
+vec2 getDepthRange()
+{
+    mat4 projection = ubo.camera.projection;
+    return vec2(projection[3][2] / projection[2][2], projection[3][2] / (projection[2][2] + 1.));
+}
+
+float getSliceDepth(in uint slice)
+{
+    vec2 depthRange = getDepthRange();
+    return depthRange.x * pow(depthRange.y / depthRange.x, float(slice) / LIGHT_CLUSTER_Z);
+}
+
+uint getCluster(in vec2 uv, in float depth)
+{
+    vec2 depthRange = getDepthRange();
+    float slice = log(depth / depthRange.x) / log(depthRange.y / depthRange.x) * LIGHT_CLUSTER_Z;
+
+    uvec3 cell =
+        uvec3(clamp(uv, 0., .999) * vec2(LIGHT_CLUSTER_X, LIGHT_CLUSTER_Y), clamp(slice, 0., LIGHT_CLUSTER_Z - 1.));
+    return cell.x + cell.y * LIGHT_CLUSTER_X + cell.z * LIGHT_CLUSTER_X * LIGHT_CLUSTER_Y;
+}
@@ -0,0 +1,18 @@
+// needs ubo.glsl, what the culling pass and the scene's vertex shaders know of each primitive, mirrors Scene::Instance
+#define MAX_INSTANCES 65536
+#define CULLING_VIEW_COUNT (1 + SHADOW_CASCADE_COUNT) // the camera, then each cascade
+#define HI_Z_MIP_COUNT 6
+
+struct Instance
+{
+    mat4 modelMatrix;
+    mat4 normalMatrix; // material id on normalMatrix[3][3]
+    vec4 boundsMin;    // in world space
+    vec4 boundsMax;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint drawGroup;
+    uint groupFirst;
+    uint isMoved; // since the depth occlusion is tested against was drawn
+};
@@ -8,22 +8,41 @@ layout(location = 0) in v_info i;
 
 layout(location = 0) out vec4 out_color;
 
-layout(set = 1, binding = 0) uniform sampler2D sShadowMap;
+layout(set = 1, binding = 0) uniform sampler2DArray sShadowMap;
 layout(set = 2, binding = 0) uniform sampler2D sPrepass;
-layout(set = 3, binding = 0) uniform sampler2D sTextures[];
-layout(set = 4, binding = 0) uniform sampler2D sNoises[]; // 0 regular noise
-layout(set = 5, binding = 0) uniform samplerCube sCubemaps[];
+layout(set = 3, binding = 0) uniform sampler2D sAmbientOcclusion;
+layout(set = 5, binding = 0) uniform sampler2D sTextures[];
+layout(set = 6, binding = 0) uniform sampler2D sNoises[]; // 0 regular noise
+layout(set = 7, binding = 0) uniform samplerCube sCubemaps[];
 
 #include "ubo.glsl"
 
+#include "clusters.glsl"
+#include "packing.glsl"
+
+layout(std430, set = 4, binding = 0) readonly buffer Clusters
+{
+    LightCluster clusters[];
+};
+
 #define ENV_MAP_MIP_LVL 14
 
-layout(push_constant) uniform Push
+// mirrors Material::Feature
+#define FEATURE_ALBEDO_TEXTURE 1u
+#define FEATURE_METALLIC_ROUGHNESS_TEXTURE 2u
+#define FEATURE_OCCLUSION_TEXTURE 4u
+#define FEATURE_SPECULAR_TEXTURE 8u
+#define FEATURE_ALPHA_MASK 16u
+#define FEATURE_ALPHA_BLEND 32u
+#define FEATURES_AT_RUNTIME 0x80000000u // texture features only, alpha ones are always compiled in
+
+// the features of every material drawn with this permutation, branches on the others compile out
+layout(constant_id = 0) const uint FEATURES = FEATURES_AT_RUNTIME;
+
+bool hasFeature(in uint feature, in int texID)
 {
-    mat4 modelMatrix;
-    mat4 normalMatrix;
+    return (FEATURES & FEATURES_AT_RUNTIME) != 0u ? texID != INVALID_ID : (FEATURES & feature) != 0u;
 }
-push;
 
 vec4 getSky(in vec3 ray, in float mipLevel)
 {
@@ -49,9 +68,15 @@ vec4 getIrradiance(in vec3 ray)
 
 vec3 getNormal()
 {
+    // blended geometry is missing from the prepass, and goes without its normal map
+    if ((FEATURES & FEATURE_ALPHA_BLEND) != 0u)
+    {
+        return normalize(mat3(ubo.camera.inverseView) * i.v_normal);
+    }
+
     vec2 uv = i.c_position.xy / i.c_position.w;
     uv = uv / 2. + .5;
-    return normalize(texture(sPrepass, uv).rgb);
+    return fetchOctahedral(sPrepass, uv, ubo.camera.renderScale);
 }
 
 vec3 getSpecular(in Material material, in vec2 uv)
@@ -60,14 +85,23 @@ vec3 getSpecular(in Material material, in vec2 uv)
     float dielectricF0 = ior > 0. ? pow((ior - 1.) / (ior + 1.), 2) : 0.04;
 
     int specularTexID = material.specularTex;
-    return specularTexID != INVALID_ID ? dielectricF0 * texture(sTextures[specularTexID], uv).rgb
-                                       : dielectricF0 * material.specularColor.rgb;
+    return hasFeature(FEATURE_SPECULAR_TEXTURE, specularTexID)
+               ? dielectricF0 * texture(sTextures[specularTexID], uv).rgb
+               : dielectricF0 * material.specularColor.rgb;
 }
 
 vec3 getAlbedo(in Material material, in vec2 uv)
 {
     int albedoTexID = material.albedoTex;
-    return albedoTexID != INVALID_ID ? texture(sTextures[albedoTexID], uv).rgb : material.albedoColor;
+    return hasFeature(FEATURE_ALBEDO_TEXTURE, albedoTexID) ? texture(sTextures[albedoTexID], uv).rgb
+                                                           : material.albedoColor;
+}
+
+float getAlpha(in Material material, in vec2 uv)
+{
+    int albedoTexID = material.albedoTex;
+    return hasFeature(FEATURE_ALBEDO_TEXTURE, albedoTexID) ? material.alpha * texture(sTextures[albedoTexID], uv).a
+                                                           : material.alpha;
 }
 
 vec3 getPBRParams(in Material material, in vec2 uv)
@@ -78,7 +112,7 @@ vec3 getPBRParams(in Material material, in vec2 uv)
     params.r = material.roughness;
     params.g = material.metallic;
 
-    if (metallicRoughnessTexID != INVALID_ID)
+    if (hasFeature(FEATURE_METALLIC_ROUGHNESS_TEXTURE, metallicRoughnessTexID))
     {
         params.r *= texture(sTextures[metallicRoughnessTexID], uv).g;
         params.g *= texture(sTextures[metallicRoughnessTexID], uv).b;
@@ -87,68 +121,18 @@ vec3 getPBRParams(in Material material, in vec2 uv)
     return params;
 }
 
-vec3 getRandom()
+float getAmbientOcclusion()
 {
-    vec2 uv = i.c_position.xy / i.c_position.w;
-    uv = uv / 2. + .5;
-    vec2 screenSize = textureSize(sPrepass, 0);
-    vec2 noiseSize = textureSize(sNoises[0], 0);
-    return texture(sNoises[0], uv * screenSize / noiseSize).xyz * 2.0 - 1.0;
-}
-
-float computeSSAO(vec3 random, float ssaoRadius)
-{
-    random = normalize(random);
-
-    const vec3 SSAO_DIRECTIONS[16] = {
-        {0.35, 0.20, 0.85},  {-0.30, -0.20, 0.90}, {0.15, -0.35, 0.92}, {-0.10, 0.45, 0.88},
-        {0.50, -0.10, 0.75}, {-0.45, 0.15, 0.70},  {0.20, 0.60, 0.65},  {-0.60, -0.25, 0.60},
-        {0.65, 0.40, 0.55},  {-0.70, 0.30, 0.50},  {0.25, -0.70, 0.45}, {-0.75, -0.35, 0.40},
-        {0.80, 0.10, 0.35},  {-0.20, 0.75, 0.30},  {0.10, -0.80, 0.25}, {-0.85, 0.00, 0.20}};
-
-    float radius = ssaoRadius * (-i.v_position.z / 5.0);
-
-    float occlusion = 0.;
-
-    const float bias = radius * .005f;
-
-    // random rotation
-    vec3 v_normal = normalize(i.v_normal);
-    vec3 v_tangent = normalize(random - v_normal * dot(random, v_normal));
-    vec3 v_bitangent = cross(v_tangent, v_normal);
-    mat3 TBN = mat3(v_tangent, v_bitangent, v_normal);
-
-    float total = 0.f;
-    vec3 bentNormal = vec3(0.f);
-    for (int j = 0; j < 16; j++)
+    // the prepass, and so ssao, only saw what lies behind blended geometry
+    if ((FEATURES & FEATURE_ALPHA_BLEND) != 0u)
     {
-        // sample point in direction
-        vec3 v_sampleDirection = TBN * SSAO_DIRECTIONS[j];
-        if (dot(v_sampleDirection, i.v_normal) < 0.f)
-        {
-            continue;
-        }
-        total += 1.f;
-
-        vec3 v_sample = i.v_position + v_sampleDirection * radius;
-        float v_sampleDepth = -v_sample.z;
-
-        // compare to the true point at xy according to depth texture
-        vec4 c_sample = ubo.camera.projection * vec4(v_sample, 1.);
-        c_sample /= c_sample.w;
-        float v_trueDepth = texture(sPrepass, c_sample.xy * .5 + .5).a;
-        vec3 v_truePos = vec3(v_sample.xy, -v_trueDepth);
-
-        // compare "collision" point to center
-        float dist = length(v_truePos - v_sample);
-        float rangeCheck = 1.0 - smoothstep(0.0, radius, dist);
-
-        // bentNormal = v_sampleDirection * rangeCheck;
-        occlusion += (v_trueDepth < v_sampleDepth - bias ? 1.0 : 0.0) * rangeCheck;
+        return 1.;
     }
 
-    // return normalize(bentNormal);
-    return 1. - occlusion / total;
+    vec2 uv = i.c_position.xy / i.c_position.w;
+    uv = uv / 2. + .5;
+    ivec2 size = textureSize(sAmbientOcclusion, 0);
+    return texture(sAmbientOcclusion, uv * vec2(getRenderExtent(size, ubo.camera.renderScale)) / vec2(size)).r;
 }
 
 float getOcclusion(in Material material, in vec2 uv)
@@ -157,7 +141,7 @@ float getOcclusion(in Material material, in vec2 uv)
 
     int occlusionTexID = material.occlusionTex;
 
-    if (occlusionTexID != INVALID_ID)
+    if (hasFeature(FEATURE_OCCLUSION_TEXTURE, occlusionTexID))
     {
         occlusion = saturate(texture(sTextures[occlusionTexID], uv).r);
     }
@@ -191,8 +175,23 @@ float computeGGX(in float roughness, in float NdotL, in float NdotV)
     return computeGGX1(a2, NdotL) * computeGGX1(a2, NdotV);
 }
 
-float isOccluded(in vec3 sc_position, in vec2 randOffset)
+float isOccluded(in vec2 randOffset)
 {
+    float depth = abs(i.v_position.z);
+    if (depth > ubo.light.sun.cascadeSplits[SHADOW_CASCADE_COUNT - 1])
+    {
+        return 1.;
+    }
+
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADE_COUNT - 1 && depth > ubo.light.sun.cascadeSplits[cascade])
+    {
+        cascade++;
+    }
+
+    vec4 sc_position = ubo.light.sun.cascadeViewProjections[cascade] * vec4(i.w_position, 1.);
+    sc_position.xyz /= sc_position.w;
+
     vec2 uv = 0.5 * sc_position.xy + 0.5;
     vec2 textureSize = textureSize(sShadowMap, 0).xy;
 
@@ -206,8 +205,8 @@ float isOccluded(in vec3 sc_position, in vec2 randOffset)
     {
         vec2 offsetUV = OFFSETS[i] / textureSize * .5;
         vec2 randUV = randOffset + uv + offsetUV;
-        float depth = texture(sShadowMap, randUV).r;
-        if (depth > sc_position.z - 0.001)
+        float shadowDepth = texture(sShadowMap, vec3(randUV, cascade)).r;
+        if (shadowDepth > sc_position.z - 0.001)
         {
             average++;
         }
@@ -216,6 +215,43 @@ float isOccluded(in vec3 sc_position, in vec2 randOffset)
     return pow(average / 9., 2.);
 }
 
+// only the lights overlapping this fragment's cluster, so the cost does not grow with the scene's light count
+vec3 computePunctualLights(in vec3 N, in vec3 V, in vec3 F, in vec3 kD, in vec3 albedo, in float roughness,
+                           in float NdotV)
+{
+    vec2 uv = i.c_position.xy / i.c_position.w;
+    uv = uv / 2. + .5;
+    uint cluster = getCluster(uv, abs(i.v_position.z));
+
+    vec3 color = vec3(0.);
+    for (uint l = 0; l < clusters[cluster].count; l++)
+    {
+        PunctualLight light = ubo.light.punctualLights[clusters[cluster].lights[l]];
+
+        vec3 toLight = light.position - i.w_position;
+        float distance = length(toLight);
+        vec3 L = toLight / distance;
+
+        // KHR_lights_punctual's inverse square falloff, windowed to reach 0 at the light's range
+        float attenuation = saturate(1. - pow(distance / light.range, 4.)) / max(distance * distance, EPS);
+        float spot = saturate(dot(light.direction, -L) * light.spotScale + light.spotOffset);
+        vec3 lightColor = light.color * attenuation * spot * spot;
+
+        vec3 H = normalize(V + L);
+        float NdotL = max(dot(N, L), EPS);
+        float NdotH = max(dot(N, H), 0.);
+
+        float D = computeDGGX(roughness, NdotH);
+        float G = computeGGX(roughness, NdotL, NdotV);
+
+        vec3 Ld = kD * (albedo / PI) * NdotL * lightColor;
+        vec3 Ls = F * ((D * G * F) / (4. * NdotL * NdotV)) * lightColor * NdotL;
+        color += Ld + Ls;
+    }
+
+    return color;
+}
+
 void main()
 {
     int materialID = int(i.materialID + 0.01);
@@ -227,13 +263,21 @@ void main()
     }
     Material material = ubo.materials[materialID];
 
-    vec3 lightColor = ubo.light.sun.color.rgb * ubo.light.sun.color.a;
+    float alpha = 1.;
+    if ((FEATURES & (FEATURE_ALPHA_MASK | FEATURE_ALPHA_BLEND)) != 0u)
+    {
+        alpha = getAlpha(material, i.uv);
+        if ((FEATURES & FEATURE_ALPHA_MASK) != 0u && alpha < material.alphaCutoff)
+        {
+            discard;
+        }
+    }
 
-    vec3 random = getRandom();
+    vec3 lightColor = ubo.light.sun.color.rgb * ubo.light.sun.color.a;
 
     // TEXTURE SAMPLES
     vec3 albedo = getAlbedo(material, i.uv);
-    float occlusion = getOcclusion(material, i.uv) * computeSSAO(random, .1);
+    float occlusion = getOcclusion(material, i.uv) * getAmbientOcclusion();
 
     // PBR PARAMETERS
     vec3 PBRParams = getPBRParams(material, i.uv);
@@ -263,8 +307,6 @@ void main()
     vec3 kD = (1. - kS) * (1. - metallic);
 
     // IBL
-    // vec3 bentNormal = computeSSAO(getRandom(), .05);
-    // bentNormal = (ubo.camera.inverseView * vec4(bentNormal, 0.)).xyz;
     vec4 irradiance = getIrradiance(-N);
 
     vec3 prefittedColor = getSky(-R, roughness).rgb;
@@ -277,8 +319,8 @@ void main()
     vec3 Ld = kD * (albedo / PI) * NdotL * lightColor;
     vec3 Ls = kS * ((D * G * F) / (4. * NdotL * NdotV)) * lightColor * NdotL;
     vec2 randUV = texture(sNoises[0], i.uv).rg;
-    vec3 directColor = (Ld + Ls) * isOccluded(i.sc_position, randUV);
+    vec3 directColor = (Ld + Ls) * isOccluded(randUV);
+    directColor += computePunctualLights(N, V, F, kD, albedo, roughness, NdotV);
 
-    out_color = vec4(directColor + IBLColor, 1.);
-    // out_color = vec4(bentNormal, 1.);
+    out_color = vec4(directColor + IBLColor, alpha);
 }
@@ -0,0 +1,37 @@
+// unit normals folded onto an octahedron, two snorm channels hold them with an even error over the sphere
+vec2 encodeOctahedral(in vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0. ? 1. : -1., n.y >= 0. ? 1. : -1.);
+    return n.z >= 0. ? n.xy : (1. - abs(n.yx)) * signs;
+}
+
+vec3 decodeOctahedral(in vec2 e)
+{
+    vec3 n = vec3(e, 1. - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.);
+    n.xy += vec2(n.x >= 0. ? -t : t, n.y >= 0. ? -t : t);
+    return normalize(n);
+}
+
+// the part of a screen sized texture drawn to, truncated like Graph::GetRenderExtent
+ivec2 getRenderExtent(in ivec2 size, in float renderScale)
+{
+    return max(ivec2(vec2(size) * renderScale), ivec2(1));
+}
+
+// unfiltered, blending encodings across the fold of the octahedron gives unrelated normals
+vec3 fetchOctahedral(in sampler2D sNormals, in vec2 uv, in float renderScale)
+{
+    ivec2 extent = getRenderExtent(textureSize(sNormals, 0), renderScale);
+    return decodeOctahedral(texelFetch(sNormals, clamp(ivec2(uv * vec2(extent)), ivec2(0), extent - 1), 0).rg);
+}
+
+// linear view depth, from a depth buffer rendered with the projection inverseProjection undoes
+float fetchViewDepth(in sampler2D sDepth, in vec2 uv, in mat4 inverseProjection, in float renderScale)
+{
+    ivec2 extent = getRenderExtent(textureSize(sDepth, 0), renderScale);
+    float depth = texelFetch(sDepth, clamp(ivec2(uv * vec2(extent)), ivec2(0), extent - 1), 0).r;
+    vec4 v_position = inverseProjection * vec4(uv * 2. - 1., depth, 1.);
+    return -v_position.z / v_position.w;
+}
@@ -8,7 +8,7 @@ struct v_info
     vec4 c_position;
     vec3 w_ray;
 
-    vec3 sc_position;
+    vec3 w_position;
 
     vec3 m_tangent;
     vec3 m_bitangent;
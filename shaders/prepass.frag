@@ -2,33 +2,42 @@
 #extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_nonuniform_qualifier : require
 
+#include "packing.glsl"
 #include "prepass_lib.glsl"
 
 layout(location = 0) in v_info i;
 
-layout(location = 0) out vec4 out_normal;
+layout(location = 0) out vec2 out_normal; // octahedral, view depth comes from the depth buffer
 
 layout(set = 1, binding = 0) uniform sampler2D sTextures[];
 
 #include "ubo.glsl"
 
-layout(push_constant) uniform Push
-{
-    mat4 modelMatrix;
-    mat4 normalMatrix;
-}
-push;
+// mirrors Material::Feature, only masking matters here
+#define FEATURE_ALPHA_MASK 16u
+
+layout(constant_id = 0) const uint FEATURES = 0u;
 
 void main()
 {
     Material material = ubo.materials[int(i.materialID + 0.01)];
 
+    // only masked permutations discard, opaque ones keep early depth testing
+    if ((FEATURES & FEATURE_ALPHA_MASK) != 0u)
+    {
+        int albedoTexID = material.albedoTex;
+        float alpha = albedoTexID != INVALID_ID ? material.alpha * texture(sTextures[albedoTexID], i.uv).a
+                                                : material.alpha;
+        if (alpha < material.alphaCutoff)
+        {
+            discard;
+        }
+    }
+
     int normalTexID = material.normalTex;
     vec3 normal = normalTexID != INVALID_ID
                       ? i.w_tangentMatrix * normalize(texture(sTextures[normalTexID], i.uv).rgb * 2. - 1.)
                       : i.w_normal;
 
-    float depth = -i.v_position.z;
-
-    out_normal = vec4(normalize(normal), depth);
+    out_normal = encodeOctahedral(normalize(normal));
 }
@@ -13,22 +13,24 @@ layout(location = 0) out v_info o;
 
 #include "ubo.glsl"
 
-layout(push_constant) uniform Push
+#include "instances.glsl"
+
+layout(std430, set = 2, binding = 0) readonly buffer Instances
 {
-    mat4 modelMatrix;
-    mat4 normalMatrix;
-}
-push;
+    Instance instances[];
+};
 
 void main()
 {
-    vec3 w_position = (push.modelMatrix * vec4(i_position, 1.0)).xyz;
-    o.w_normal = mat3(push.normalMatrix) * i_normal;
+    Instance instance = instances[gl_InstanceIndex];
+
+    vec3 w_position = (instance.modelMatrix * vec4(i_position, 1.0)).xyz;
+    o.w_normal = mat3(instance.normalMatrix) * i_normal;
 
-    o.materialID = push.normalMatrix[3][3];
+    o.materialID = instance.normalMatrix[3][3];
     o.uv = i_uv;
 
-    vec3 w_tangent = mat3(push.normalMatrix) * i_tangent.xyz;
+    vec3 w_tangent = mat3(instance.normalMatrix) * i_tangent.xyz;
     vec3 w_bitangent = -cross(o.w_normal, w_tangent) * i_tangent.w;
     o.w_tangentMatrix = mat3(normalize(w_tangent), normalize(w_bitangent), normalize(o.w_normal));
 
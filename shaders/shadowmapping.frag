@@ -1,12 +1,5 @@
 #version 450
 
-layout(push_constant) uniform Push
-{
-    mat4 modelMatrix;
-    mat4 normalMatrix;
-}
-push;
-
 void main()
 {
 }
@@ -1,24 +1,26 @@
 #version 450
 #extension GL_GOOGLE_include_directive : require
 
-layout(location = 0) in vec4 v_tangent;
-layout(location = 1) in vec3 v_position;
-layout(location = 2) in vec3 v_normal;
-layout(location = 3) in vec3 v_color;
-layout(location = 4) in vec2 v_uv;
+layout(location = 1) in vec3 v_position; // the position stream alone, see Mesh::Vertex::GetPositionInputInfo
 
 #include "ubo.glsl"
 
+#include "instances.glsl"
+
+layout(std430, set = 1, binding = 0) readonly buffer Instances
+{
+    Instance instances[];
+};
+
 layout(push_constant) uniform Push
 {
-    mat4 modelMatrix;
-    mat4 normalMatrix;
+    uint cascade;
 }
 push;
 
 void main()
 {
-    vec3 w_position = (push.modelMatrix * vec4(v_position, 1.0)).xyz;
+    vec3 w_position = (instances[gl_InstanceIndex].modelMatrix * vec4(v_position, 1.0)).xyz;
 
-    gl_Position = ubo.light.sun.viewProjection * vec4(w_position, 1.0);
+    gl_Position = ubo.light.sun.cascadeViewProjections[push.cascade] * vec4(w_position, 1.0);
 }
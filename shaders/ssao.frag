@@ -0,0 +1,108 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec2 in_uv;
+
+layout(location = 0) out vec2 out_occlusion; // occlusion, view depth
+
+layout(set = 1, binding = 0) uniform sampler2D sPrepass;
+layout(set = 2, binding = 0) uniform sampler2D sDepth;
+layout(set = 3, binding = 0) uniform sampler2D sHistory;
+layout(set = 4, binding = 0) uniform sampler2D sNoises[]; // 0 regular noise
+
+#include "packing.glsl"
+#include "ubo.glsl"
+
+const vec3 SSAO_DIRECTIONS[16] = {
+    {0.35, 0.20, 0.85},  {-0.30, -0.20, 0.90}, {0.15, -0.35, 0.92}, {-0.10, 0.45, 0.88},
+    {0.50, -0.10, 0.75}, {-0.45, 0.15, 0.70},  {0.20, 0.60, 0.65},  {-0.60, -0.25, 0.60},
+    {0.65, 0.40, 0.55},  {-0.70, 0.30, 0.50},  {0.25, -0.70, 0.45}, {-0.75, -0.35, 0.40},
+    {0.80, 0.10, 0.35},  {-0.20, 0.75, 0.30},  {0.10, -0.80, 0.25}, {-0.85, 0.00, 0.20}};
+
+vec3 getViewPosition(in vec2 uv, in float depth)
+{
+    vec4 v_ray = ubo.camera.inverseProjection * vec4(uv * 2. - 1., 1., 1.);
+    v_ray.xyz /= v_ray.w;
+    return v_ray.xyz / -v_ray.z * depth;
+}
+
+vec3 getRandom()
+{
+    vec2 screenSize = vec2(getRenderExtent(textureSize(sHistory, 0), ubo.camera.renderScale));
+    vec2 noiseSize = textureSize(sNoises[0], 0);
+    // a new rotation every frame, accumulated frames then cover more directions
+    vec2 offset = vec2(ubo.camera.frame % 7u, ubo.camera.frame % 11u) / noiseSize;
+    return texture(sNoises[0], in_uv * screenSize / noiseSize + offset).xyz * 2.0 - 1.0;
+}
+
+float computeSSAO(in vec3 v_position, in vec3 v_normal, in vec3 random)
+{
+    float radius = ubo.ssao.radius * (-v_position.z / 5.0);
+    const float bias = radius * .005f;
+
+    // random rotation
+    vec3 v_tangent = normalize(random - v_normal * dot(random, v_normal));
+    vec3 v_bitangent = cross(v_tangent, v_normal);
+    mat3 TBN = mat3(v_tangent, v_bitangent, v_normal);
+
+    int sampleCount = clamp(ubo.ssao.sampleCount, 1, 16);
+    int first = int((ubo.camera.frame * uint(sampleCount)) % 16u);
+
+    float occlusion = 0.;
+    float total = 0.;
+    for (int j = 0; j < sampleCount; j++)
+    {
+        // sample point in direction
+        vec3 v_sampleDirection = TBN * SSAO_DIRECTIONS[(first + j) % 16];
+        if (dot(v_sampleDirection, v_normal) < 0.)
+        {
+            continue;
+        }
+        total += 1.;
+
+        vec3 v_sample = v_position + v_sampleDirection * radius;
+        float v_sampleDepth = -v_sample.z;
+
+        // compare to the true point at xy according to depth texture
+        vec4 c_sample = ubo.camera.projection * vec4(v_sample, 1.);
+        c_sample /= c_sample.w;
+        float v_trueDepth =
+            fetchViewDepth(sDepth, c_sample.xy * .5 + .5, ubo.camera.inverseProjection, ubo.camera.renderScale);
+        vec3 v_truePos = vec3(v_sample.xy, -v_trueDepth);
+
+        // compare "collision" point to center
+        float dist = length(v_truePos - v_sample);
+        float rangeCheck = 1.0 - smoothstep(0.0, radius, dist);
+
+        occlusion += (v_trueDepth < v_sampleDepth - bias ? 1.0 : 0.0) * rangeCheck;
+    }
+
+    return total > 0. ? 1. - occlusion / total : 1.;
+}
+
+void main()
+{
+    float depth = fetchViewDepth(sDepth, in_uv, ubo.camera.inverseProjection, ubo.camera.renderScale);
+
+    vec3 v_position = getViewPosition(in_uv, depth);
+    vec3 v_normal = normalize(mat3(ubo.camera.view) * fetchOctahedral(sPrepass, in_uv, ubo.camera.renderScale));
+
+    float occlusion = computeSSAO(v_position, v_normal, normalize(getRandom()));
+
+    // reproject into last frame, and keep its result where it saw the same surface
+    vec4 w_position = ubo.camera.inverseView * vec4(v_position, 1.);
+    vec4 c_previous = ubo.camera.previousViewProjection * w_position;
+    vec2 previousUV = c_previous.xy / c_previous.w * .5 + .5;
+
+    // last frame drew to the part of the history its own render scale gave, texels past it are stale
+    vec2 historySize = vec2(textureSize(sHistory, 0));
+    vec2 historyExtent = vec2(getRenderExtent(textureSize(sHistory, 0), ubo.camera.previousRenderScale));
+    vec2 history = texture(sHistory, clamp(previousUV * historyExtent, vec2(.5), historyExtent - .5) / historySize).rg;
+    bool isOnScreen = all(greaterThanEqual(previousUV, vec2(0.))) && all(lessThanEqual(previousUV, vec2(1.)));
+    bool isSameSurface = abs(history.g - c_previous.w) < .05 * c_previous.w;
+
+    float historyWeight = isOnScreen && isSameSurface ? ubo.ssao.historyWeight : 0.;
+
+    out_occlusion = vec2(mix(occlusion, history.r, historyWeight), depth);
+}
@@ -0,0 +1,40 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+layout(location = 0) in vec2 in_uv;
+
+layout(location = 0) out float out_occlusion;
+
+layout(set = 1, binding = 0) uniform sampler2D sOcclusion; // occlusion, view depth
+layout(set = 2, binding = 0) uniform sampler2D sDepth;
+
+#include "packing.glsl"
+#include "ubo.glsl"
+
+void main()
+{
+    float depth = fetchViewDepth(sDepth, in_uv, ubo.camera.inverseProjection, ubo.camera.renderScale);
+
+    ivec2 size = getRenderExtent(textureSize(sOcclusion, 0), ubo.camera.renderScale);
+    vec2 texel = in_uv * vec2(size) - .5;
+    ivec2 base = ivec2(floor(texel));
+    vec2 f = fract(texel);
+
+    const ivec2 OFFSETS[4] = {ivec2(0, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1)};
+
+    // bilinear weights, lowered for low resolution texels of another surface so edges don't bleed
+    float occlusion = 0.;
+    float total = 0.;
+    for (int j = 0; j < 4; j++)
+    {
+        vec2 texelSample = texelFetch(sOcclusion, clamp(base + OFFSETS[j], ivec2(0), size - 1), 0).rg;
+
+        vec2 bilinear = mix(1. - f, f, vec2(OFFSETS[j]));
+        float weight = bilinear.x * bilinear.y / (abs(depth - texelSample.g) / max(depth, 1e-3) + 1e-3);
+
+        occlusion += texelSample.r * weight;
+        total += weight;
+    }
+
+    out_occlusion = total > 0. ? occlusion / total : 1.;
+}
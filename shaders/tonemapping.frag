@@ -2,7 +2,7 @@
 #extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_nonuniform_qualifier : require
 
-layout(set = 0, binding = 0) uniform sampler2D hdrColor;
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput hdrColor;
 
 layout(location = 0) in vec2 in_uv;
 
@@ -23,7 +23,7 @@ vec3 acesToneMap(vec3 color)
 
 void main()
 {
-    vec3 hdrColor = texture(hdrColor, in_uv).rgb;
+    vec3 hdrColor = subpassLoad(hdrColor).rgb;
 
     if (any(isnan(hdrColor)) || any(isinf(hdrColor)))
     {
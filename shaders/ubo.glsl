@@ -1,4 +1,6 @@
 #define INVALID_ID -1
+#define SHADOW_CASCADE_COUNT 4
+#define MAX_PUNCTUAL_LIGHTS 256
 
 struct Camera
 {
@@ -7,14 +9,29 @@ struct Camera
     mat4 projection;
     mat4 inverseView;
     mat4 inverseProjection;
+    mat4 previousViewProjection;
     vec3 w_position;
+    uint frame;
+    float renderScale; // of screen sized textures, the part of them drawn to
+    float previousRenderScale;
 };
 
 struct Sun
 {
     vec3 direction;
     vec4 color;
-    mat4 viewProjection;
+    mat4 cascadeViewProjections[SHADOW_CASCADE_COUNT];
+    vec4 cascadeSplits; // far view depth of each cascade
+};
+
+struct PunctualLight
+{
+    vec3 position;
+    float range;
+    vec3 color; // premultiplied by intensity
+    float spotScale;
+    vec3 direction;
+    float spotOffset;
 };
 
 struct Light
@@ -23,6 +40,15 @@ struct Light
     int skyboxTex;
     int irradianceTex;
     float rotation;
+    int punctualLightCount;
+    PunctualLight punctualLights[MAX_PUNCTUAL_LIGHTS];
+};
+
+struct Ssao
+{
+    float radius;
+    float historyWeight;
+    int sampleCount;
 };
 
 struct Material
@@ -33,7 +59,9 @@ struct Material
     int occlusionTex;
 
     vec3 albedoColor;
+    float alpha;
     vec3 fresnelColor;
+    float alphaCutoff;
     vec4 specularColor; // ior on a
 
     float roughness;
@@ -47,6 +75,7 @@ layout(set = 0, binding = 0) uniform Ubo
 {
     Camera camera;
     Light light;
+    Ssao ssao;
     Material materials[500];
 }
 ubo;
@@ -0,0 +1,12 @@
+# runs both builds of the occlusion buffer test on the same scene, and fails if their results differ
+
+execute_process(COMMAND ${FIRST} --fingerprint OUTPUT_VARIABLE FIRST_FINGERPRINT RESULT_VARIABLE FIRST_RESULT)
+execute_process(COMMAND ${SECOND} --fingerprint OUTPUT_VARIABLE SECOND_FINGERPRINT RESULT_VARIABLE SECOND_RESULT)
+
+if(NOT FIRST_RESULT EQUAL 0 OR NOT SECOND_RESULT EQUAL 0)
+  message(FATAL_ERROR "occlusion buffer fingerprints could not be taken")
+endif()
+
+if(NOT FIRST_FINGERPRINT STREQUAL SECOND_FINGERPRINT)
+  message(FATAL_ERROR "sse and scalar occlusion buffers disagree:\n${FIRST_FINGERPRINT}\n${SECOND_FINGERPRINT}")
+endif()
@@ -0,0 +1,189 @@
+// cpu only checks of the occlusion buffer, built apart from the engine so it runs without a gpu
+// built twice, once with WSP_OCCLUSION_SCALAR, both print the same fingerprint when their paths agree
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <wsp_constants.hpp>
+#include <wsp_occlusion_buffer.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace wsp;
+
+static int failures = 0;
+
+#define expect(expr)                                                                                                   \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(expr))                                                                                                   \
+        {                                                                                                              \
+            std::printf("failed at %s:%d: %s\n", __FILE__, __LINE__, #expr);                                           \
+            failures++;                                                                                                \
+        }                                                                                                              \
+    } while (false)
+
+// looking down -z from the origin, as wide as the buffer
+static glm::mat4 GetViewProjection()
+{
+    glm::mat4 const projection = glm::perspective(glm::radians(60.f),
+                                                  static_cast<float>(OCCLUSION_WIDTH) / OCCLUSION_HEIGHT, .1f, 100.f);
+    glm::mat4 const view = glm::lookAt(glm::vec3{0.f}, glm::vec3{0.f, 0.f, -1.f}, glm::vec3{0.f, 1.f, 0.f});
+    return projection * view;
+}
+
+static Box MakeBox(glm::vec3 const &center, glm::vec3 const &halfExtent)
+{
+    return Box{center - halfExtent, center + halfExtent};
+}
+
+// a square facing the camera at depth z
+struct Quad
+{
+    Quad(float z, float halfSize)
+        : positions{glm::vec3{-halfSize, -halfSize, z}, glm::vec3{halfSize, -halfSize, z},
+                    glm::vec3{halfSize, halfSize, z}, glm::vec3{-halfSize, halfSize, z}},
+          indices{0u, 1u, 2u, 0u, 2u, 3u}
+    {
+    }
+
+    OcclusionBuffer::Occluder GetOccluder() const
+    {
+        return OcclusionBuffer::Occluder{positions, indices, 6u, glm::mat4{1.f}};
+    }
+
+    glm::vec3 positions[4];
+    uint32_t indices[6];
+};
+
+static void TestScreenFillingQuad()
+{
+    OcclusionBuffer occlusionBuffer{};
+    Quad const quad{-10.f, 50.f};
+
+    occlusionBuffer.Rasterize({quad.GetOccluder()}, GetViewProjection());
+
+    expect(occlusionBuffer.GetTriangleCount() == 2u);
+    expect(!occlusionBuffer.IsVisible(MakeBox(glm::vec3{0.f, 0.f, -20.f}, glm::vec3{1.f})));
+    expect(!occlusionBuffer.IsVisible(MakeBox(glm::vec3{5.f, -2.f, -40.f}, glm::vec3{3.f})));
+    expect(occlusionBuffer.IsVisible(MakeBox(glm::vec3{0.f, 0.f, -5.f}, glm::vec3{1.f})));
+    expect(occlusionBuffer.IsVisible(MakeBox(glm::vec3{0.f, 0.f, -10.f}, glm::vec3{1.f}))); // through the quad
+}
+
+static void TestNearPlaneCrossing()
+{
+    OcclusionBuffer occlusionBuffer{};
+    Quad const quad{-10.f, 50.f};
+
+    occlusionBuffer.Rasterize({quad.GetOccluder()}, GetViewProjection());
+
+    // mostly behind the quad, but reaching behind the camera
+    expect(occlusionBuffer.IsVisible(Box{glm::vec3{-1.f, -1.f, -30.f}, glm::vec3{1.f, 1.f, 1.f}}));
+}
+
+// random triangles in front of the camera, and the visibility of random boxes behind them
+static std::string GetFingerprint()
+{
+    std::mt19937 random{7u};
+    std::uniform_real_distribution<float> spread{-20.f, 20.f};
+    std::uniform_real_distribution<float> depth{-60.f, -5.f};
+    std::uniform_real_distribution<float> size{.5f, 8.f};
+
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    for (uint32_t i = 0; i < 600; i++)
+    {
+        glm::vec3 const center{spread(random), spread(random) * .5f, depth(random)};
+        for (uint32_t v = 0; v < 3; v++)
+        {
+            indices.push_back(static_cast<uint32_t>(positions.size()));
+            positions.push_back(center + glm::vec3{spread(random), spread(random), spread(random)} * .3f);
+        }
+    }
+
+    OcclusionBuffer occlusionBuffer{};
+    occlusionBuffer.Rasterize({OcclusionBuffer::Occluder{positions.data(), indices.data(),
+                                                         static_cast<uint32_t>(indices.size()), glm::mat4{1.f}}},
+                              GetViewProjection());
+
+    std::string fingerprint = std::to_string(occlusionBuffer.GetTriangleCount()) + ":";
+    for (uint32_t i = 0; i < 4096; i++)
+    {
+        glm::vec3 const center{spread(random), spread(random) * .5f, depth(random)};
+        fingerprint += occlusionBuffer.IsVisible(MakeBox(center, glm::vec3{size(random)})) ? '1' : '0';
+    }
+
+    return fingerprint;
+}
+
+static void TestSinglePass()
+{
+    std::string const fingerprint = GetFingerprint();
+    size_t const hidden = std::count(fingerprint.begin(), fingerprint.end(), '0');
+    expect(hidden > 0 && hidden < 4096); // not trivially all hidden or all visible
+}
+
+// as many small triangles as a frame allows, over the whole screen
+static void BenchmarkRasterize(uint32_t threadCount)
+{
+    std::mt19937 random{3u};
+    std::uniform_real_distribution<float> spread{-30.f, 30.f};
+    std::uniform_real_distribution<float> depth{-60.f, -5.f};
+    std::uniform_real_distribution<float> offset{-2.f, 2.f};
+
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    for (uint32_t i = 0; i < MAX_OCCLUDER_TRIANGLES; i++)
+    {
+        glm::vec3 const center{spread(random), spread(random) * .5f, depth(random)};
+        for (uint32_t v = 0; v < 3; v++)
+        {
+            indices.push_back(static_cast<uint32_t>(positions.size()));
+            positions.push_back(center + glm::vec3{offset(random), offset(random), offset(random)});
+        }
+    }
+
+    std::vector<OcclusionBuffer::Occluder> const occluders{OcclusionBuffer::Occluder{
+        positions.data(), indices.data(), static_cast<uint32_t>(indices.size()), glm::mat4{1.f}}};
+    glm::mat4 const viewProjection = GetViewProjection();
+
+    OcclusionBuffer occlusionBuffer{threadCount};
+    occlusionBuffer.Rasterize(occluders, viewProjection); // warm up
+
+    uint32_t const runs = 20;
+    auto const start = std::chrono::steady_clock::now();
+    for (uint32_t run = 0; run < runs; run++)
+    {
+        occlusionBuffer.Rasterize(occluders, viewProjection);
+    }
+    std::chrono::duration<float, std::milli> const duration = std::chrono::steady_clock::now() - start;
+
+    std::printf("rasterize: %u triangles, %u on screen, %u threads, %.3f ms\n", MAX_OCCLUDER_TRIANGLES,
+                occlusionBuffer.GetTriangleCount(), threadCount, duration.count() / runs);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && std::strcmp(argv[1], "--fingerprint") == 0)
+    {
+        std::printf("%s\n", GetFingerprint().c_str());
+        return 0;
+    }
+
+    TestScreenFillingQuad();
+    TestNearPlaneCrossing();
+    TestSinglePass();
+
+    BenchmarkRasterize(1u);
+    BenchmarkRasterize(MAX_OCCLUSION_THREADS);
+
+    std::printf("%s\n", failures == 0 ? "passed" : "failed");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#include <wsp_bounds.hpp>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
+
+using namespace wsp;
+
+bool Box::IsEmpty() const
+{
+    return glm::any(glm::greaterThan(min, max));
+}
+
+void Box::Extend(glm::vec3 const &point)
+{
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+void Box::Extend(Box const &box)
+{
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+}
+
+bool Box::Intersects(Box const &box) const
+{
+    return !glm::any(glm::greaterThan(min, box.max)) && !glm::any(glm::lessThan(max, box.min));
+}
+
+Box Box::Transformed(glm::mat4 const &matrix) const
+{
+    if (IsEmpty())
+    {
+        return *this;
+    }
+
+    glm::vec3 const center = (min + max) * .5f;
+    glm::vec3 const halfExtent = (max - min) * .5f;
+
+    glm::vec3 const transformedCenter = glm::vec3{matrix * glm::vec4{center, 1.f}};
+    glm::vec3 const transformedHalfExtent = glm::abs(glm::vec3{matrix[0]}) * halfExtent.x +
+                                            glm::abs(glm::vec3{matrix[1]}) * halfExtent.y +
+                                            glm::abs(glm::vec3{matrix[2]}) * halfExtent.z;
+
+    return Box{transformedCenter - transformedHalfExtent, transformedCenter + transformedHalfExtent};
+}
+
+Ray Ray::Transformed(glm::mat4 const &matrix) const
+{
+    return Ray{glm::vec3{matrix * glm::vec4{origin, 1.f}}, glm::vec3{matrix * glm::vec4{direction, 0.f}}};
+}
+
+Frustum::Frustum(glm::mat4 const &viewProjection)
+{
+    glm::vec4 const rowX{viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]};
+    glm::vec4 const rowY{viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]};
+    glm::vec4 const rowZ{viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]};
+    glm::vec4 const rowW{viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]};
+
+    planes = {rowW + rowX, rowW - rowX, rowW + rowY, rowW - rowY, rowZ, rowW - rowZ};
+}
+
+bool Frustum::Intersects(Box const &box) const
+{
+    if (box.IsEmpty())
+    {
+        return false;
+    }
+
+    for (glm::vec4 const &plane : planes)
+    {
+        // the corner furthest along the plane normal
+        glm::vec3 const corner = glm::mix(box.min, box.max, glm::greaterThanEqual(glm::vec3{plane}, glm::vec3{0.f}));
+
+        if (glm::dot(glm::vec3{plane}, corner) + plane.w < 0.f)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef WSP_BOUNDS
+#define WSP_BOUNDS
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <cfloat>
+
+namespace wsp
+{
+
+struct Box // axis aligned
+{
+    glm::vec3 min{FLT_MAX};
+    glm::vec3 max{-FLT_MAX};
+
+    bool IsEmpty() const;
+    void Extend(glm::vec3 const &point);
+    void Extend(Box const &);
+    bool Intersects(Box const &) const;
+    Box Transformed(glm::mat4 const &) const; // still axis aligned, so it may grow
+};
+
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction; // distances along the ray are in lengths of direction
+
+    Ray Transformed(glm::mat4 const &) const; // distances are kept, the transform being affine
+};
+
+struct Frustum
+{
+    Frustum(glm::mat4 const &viewProjection); // expects [0, 1] depth
+
+    bool Intersects(Box const &) const; // conservative, boxes near the corners may pass
+
+    std::array<glm::vec4, 6> planes; // normals facing inwards
+};
+
+} // namespace wsp
+
+#endif
@@ -0,0 +1,350 @@
+#include <wsp_bvh.hpp>
+
+#include <wsp_devkit.hpp>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+using namespace wsp;
+
+namespace
+{
+
+constexpr uint32_t BIN_COUNT = 16;
+constexpr uint32_t MAX_LEAF_ITEMS = 4;
+constexpr uint32_t MAX_DEPTH = 64;
+
+float GetArea(Box const &box)
+{
+    glm::vec3 const size = box.max - box.min;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+// the distance the ray enters the box at, if it does before distance
+bool Enters(Box const &box, glm::vec3 const &origin, glm::vec3 const &inverseDirection, float distance, float *entry)
+{
+    glm::vec3 const toMin = (box.min - origin) * inverseDirection;
+    glm::vec3 const toMax = (box.max - origin) * inverseDirection;
+
+    glm::vec3 const lows = glm::min(toMin, toMax);
+    glm::vec3 const highs = glm::max(toMin, toMax);
+
+    float const low = std::max(std::max(lows.x, lows.y), std::max(lows.z, 0.f));
+    float const high = std::min(std::min(highs.x, highs.y), std::min(highs.z, distance));
+
+    *entry = low;
+    return low <= high;
+}
+
+} // namespace
+
+Bvh::Bvh(std::vector<Box> const &bounds)
+{
+    _items.reserve(bounds.size());
+
+    std::vector<glm::vec3> centers(bounds.size());
+    for (uint32_t item = 0; item < bounds.size(); item++)
+    {
+        if (!bounds[item].IsEmpty())
+        {
+            _items.push_back(item);
+            centers[item] = (bounds[item].min + bounds[item].max) * .5f;
+        }
+    }
+
+    if (_items.empty())
+    {
+        return;
+    }
+
+    _nodes.reserve(2 * _items.size());
+    _nodes.push_back(Node{Box{}, 0u, static_cast<uint32_t>(_items.size())});
+    Fit(0u, bounds);
+
+    // depth first, splits push their children after the node so that refits can walk back to front
+    std::vector<std::pair<uint32_t, uint32_t>> stack{{0u, 0u}};
+    while (!stack.empty())
+    {
+        auto const [node, depth] = stack.back();
+        stack.pop_back();
+
+        Split(node, bounds, centers);
+        if (_nodes[node].count == 0 && depth + 1 < MAX_DEPTH)
+        {
+            stack.emplace_back(_nodes[node].first, depth + 1);
+            stack.emplace_back(_nodes[node].first + 1, depth + 1);
+        }
+    }
+}
+
+void Bvh::Split(uint32_t node, std::vector<Box> const &bounds, std::vector<glm::vec3> const &centers)
+{
+    uint32_t const first = _nodes[node].first;
+    uint32_t const count = _nodes[node].count;
+    if (count <= 1)
+    {
+        return;
+    }
+
+    Box centerBounds{};
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        centerBounds.Extend(centers[_items[i]]);
+    }
+
+    // binned, the cost of a split is the area of each side times what it holds, plus its own area to traverse it
+    float const area = GetArea(_nodes[node].bounds);
+    float bestCost = area * static_cast<float>(count);
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float const low = centerBounds.min[axis];
+        float const extent = centerBounds.max[axis] - low;
+        if (extent <= 0.f)
+        {
+            continue;
+        }
+
+        std::array<Box, BIN_COUNT> binBounds{};
+        std::array<uint32_t, BIN_COUNT> binCounts{};
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            uint32_t const item = _items[i];
+            uint32_t const bin = std::min(
+                static_cast<uint32_t>((centers[item][axis] - low) / extent * BIN_COUNT), BIN_COUNT - 1);
+            binBounds[bin].Extend(bounds[item]);
+            binCounts[bin]++;
+        }
+
+        // areas and counts left of each split, from a sweep right to left for the other side
+        std::array<float, BIN_COUNT - 1> leftCosts{};
+        Box left{};
+        uint32_t leftCount = 0;
+        for (uint32_t split = 0; split < BIN_COUNT - 1; split++)
+        {
+            left.Extend(binBounds[split]);
+            leftCount += binCounts[split];
+            leftCosts[split] = leftCount > 0 ? GetArea(left) * static_cast<float>(leftCount) : 0.f;
+        }
+
+        Box right{};
+        uint32_t rightCount = 0;
+        for (uint32_t split = BIN_COUNT - 1; split > 0; split--)
+        {
+            right.Extend(binBounds[split]);
+            rightCount += binCounts[split];
+
+            float const cost = area + leftCosts[split - 1] + GetArea(right) * static_cast<float>(rightCount);
+            if (rightCount > 0 && rightCount < count && cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    // a leaf is cheaper, unless it would hold too many items
+    if (bestAxis < 0)
+    {
+        if (count <= MAX_LEAF_ITEMS)
+        {
+            return;
+        }
+
+        // items sharing their center, or no cheaper split, halved by center along the longest axis
+        glm::vec3 const extent = centerBounds.max - centerBounds.min;
+        bestAxis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+        auto const middle = _items.begin() + first + count / 2;
+        std::nth_element(_items.begin() + first, middle, _items.begin() + first + count,
+                         [&](uint32_t a, uint32_t b) { return centers[a][bestAxis] < centers[b][bestAxis]; });
+        bestSplit = count / 2;
+    }
+    else
+    {
+        float const low = centerBounds.min[bestAxis];
+        float const extent = centerBounds.max[bestAxis] - low;
+        auto const middle =
+            std::partition(_items.begin() + first, _items.begin() + first + count, [&](uint32_t item) {
+                uint32_t const bin =
+                    std::min(static_cast<uint32_t>((centers[item][bestAxis] - low) / extent * BIN_COUNT),
+                             BIN_COUNT - 1);
+                return bin < bestSplit;
+            });
+        bestSplit = static_cast<uint32_t>(middle - (_items.begin() + first));
+    }
+
+    uint32_t const leftNode = static_cast<uint32_t>(_nodes.size());
+    _nodes.push_back(Node{Box{}, first, bestSplit});
+    _nodes.push_back(Node{Box{}, first + bestSplit, count - bestSplit});
+    Fit(leftNode, bounds);
+    Fit(leftNode + 1, bounds);
+
+    _nodes[node].first = leftNode;
+    _nodes[node].count = 0;
+}
+
+void Bvh::Fit(uint32_t node, std::vector<Box> const &bounds)
+{
+    Node &fitted = _nodes[node];
+    fitted.bounds = Box{};
+
+    if (fitted.count == 0)
+    {
+        fitted.bounds.Extend(_nodes[fitted.first].bounds);
+        fitted.bounds.Extend(_nodes[fitted.first + 1].bounds);
+        return;
+    }
+
+    for (uint32_t i = fitted.first; i < fitted.first + fitted.count; i++)
+    {
+        fitted.bounds.Extend(bounds[_items[i]]);
+    }
+}
+
+void Bvh::Refit(std::vector<Box> const &bounds)
+{
+    for (uint32_t node = static_cast<uint32_t>(_nodes.size()); node > 0; node--)
+    {
+        Fit(node - 1, bounds);
+    }
+}
+
+bool Bvh::Raycast(Ray const &ray, RayTest const &test, float *distance, uint32_t *item) const
+{
+    check(distance);
+    check(item);
+
+    if (_nodes.empty())
+    {
+        return false;
+    }
+
+    // nudged off 0 along axes it is parallel to, so that slabs stay ordered instead of going nan
+    glm::vec3 direction = ray.direction;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (std::abs(direction[axis]) < 1e-20f)
+        {
+            direction[axis] = std::copysign(1e-20f, direction[axis]);
+        }
+    }
+    glm::vec3 const inverseDirection = 1.f / direction;
+
+    float entry;
+    if (!Enters(_nodes[0].bounds, ray.origin, inverseDirection, *distance, &entry))
+    {
+        return false;
+    }
+
+    bool isHit = false;
+
+    std::vector<std::pair<uint32_t, float>> stack{{0u, entry}};
+    while (!stack.empty())
+    {
+        auto const [index, nodeEntry] = stack.back();
+        stack.pop_back();
+
+        if (nodeEntry > *distance) // a nearer hit was found since it was pushed
+        {
+            continue;
+        }
+
+        Node const &node = _nodes[index];
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                if (test(_items[i], ray, distance))
+                {
+                    *item = _items[i];
+                    isHit = true;
+                }
+            }
+            continue;
+        }
+
+        float leftEntry, rightEntry;
+        bool const isLeftEntered =
+            Enters(_nodes[node.first].bounds, ray.origin, inverseDirection, *distance, &leftEntry);
+        bool const isRightEntered =
+            Enters(_nodes[node.first + 1].bounds, ray.origin, inverseDirection, *distance, &rightEntry);
+
+        // the nearer child is popped first
+        if (isLeftEntered && isRightEntered && leftEntry < rightEntry)
+        {
+            stack.emplace_back(node.first + 1, rightEntry);
+            stack.emplace_back(node.first, leftEntry);
+            continue;
+        }
+        if (isLeftEntered)
+        {
+            stack.emplace_back(node.first, leftEntry);
+        }
+        if (isRightEntered)
+        {
+            stack.emplace_back(node.first + 1, rightEntry);
+        }
+    }
+
+    return isHit;
+}
+
+template <typename Overlaps> void Bvh::Query(Overlaps const &overlaps, std::vector<uint32_t> *items) const
+{
+    check(items);
+
+    if (_nodes.empty())
+    {
+        return;
+    }
+
+    std::vector<uint32_t> stack{0u};
+    while (!stack.empty())
+    {
+        Node const &node = _nodes[stack.back()];
+        stack.pop_back();
+
+        if (!overlaps(node.bounds))
+        {
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            items->insert(items->end(), _items.begin() + node.first, _items.begin() + node.first + node.count);
+        }
+        else
+        {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+    }
+}
+
+void Bvh::Query(Box const &box, std::vector<uint32_t> *items) const
+{
+    Query([&box](Box const &bounds) { return box.Intersects(bounds); }, items);
+}
+
+void Bvh::Query(Frustum const &frustum, std::vector<uint32_t> *items) const
+{
+    Query([&frustum](Box const &bounds) { return frustum.Intersects(bounds); }, items);
+}
+
+bool Bvh::IsEmpty() const
+{
+    return _nodes.empty();
+}
+
+uint32_t Bvh::GetNodeCount() const
+{
+    return static_cast<uint32_t>(_nodes.size());
+}
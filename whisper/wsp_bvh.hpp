@@ -0,0 +1,53 @@
+#ifndef WSP_BVH
+#define WSP_BVH
+
+#include <wsp_bounds.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace wsp
+{
+
+// a bounding volume hierarchy over indexed boxes, split along the surface area heuristic
+class Bvh
+{
+  public:
+    // whether the ray hits the item before *distance, which it then shortens to the hit
+    using RayTest = std::function<bool(uint32_t item, Ray const &, float *distance)>;
+
+    Bvh() = default;
+    Bvh(std::vector<Box> const &bounds); // the items are the indices of bounds, empty boxes are never found
+
+    // the same items moved, the tree keeps its splits so it gets looser the further they go
+    void Refit(std::vector<Box> const &bounds);
+
+    // the nearest item hit within *distance, true if any
+    bool Raycast(Ray const &, RayTest const &, float *distance, uint32_t *item) const;
+    // appends the items of every leaf overlapping, a few of them may not overlap themselves
+    void Query(Box const &, std::vector<uint32_t> *items) const;
+    void Query(Frustum const &, std::vector<uint32_t> *items) const;
+
+    bool IsEmpty() const;
+    uint32_t GetNodeCount() const;
+
+  protected:
+    struct Node
+    {
+        Box bounds;
+        uint32_t first; // into _items on leaves, the left child on others, with the right one after it
+        uint32_t count; // 0 on inner nodes
+    };
+
+    void Split(uint32_t node, std::vector<Box> const &bounds, std::vector<glm::vec3> const &centers);
+    void Fit(uint32_t node, std::vector<Box> const &bounds);
+    template <typename Overlaps> void Query(Overlaps const &, std::vector<uint32_t> *items) const;
+
+    std::vector<Node> _nodes; // children always come after their parent
+    std::vector<uint32_t> _items;
+};
+
+} // namespace wsp
+
+#endif
@@ -4,6 +4,36 @@
 #define MAX_FRAMES_IN_FLIGHT 2
 #define MAX_DYNAMIC_TEXTURES 500
 #define MAX_MATERIALS 500
+#define MAX_RECORDING_THREADS 8
+
+// dynamic resolution, screen sized passes draw to a scaled part of their images
+#define MIN_RENDER_SCALE .5f
+#define RENDER_SCALE_STEP .05f     // cached passes re-record once a step instead of every frame
+#define RENDER_SCALE_SMOOTHING .1f // of the scale the frame budget asks for, per frame
+
+// software occlusion culling, the resolution is a multiple of its 32x4 pixel tiles
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define MAX_OCCLUDER_TRIANGLES 16384 // a frame, from the largest occluders on screen
+#define MAX_OCCLUSION_THREADS 4
+
+// gpu driven culling, of every view against its frustum and of the camera's against last frame's depth
+#define MAX_INSTANCES 65536                           // primitives of a scene, mirrored in instances.glsl
+#define CULLING_VIEW_COUNT (1 + SHADOW_CASCADE_COUNT) // the camera, then each cascade
+#define HI_Z_WIDTH 512
+#define HI_Z_HEIGHT 256
+#define HI_Z_MIP_COUNT 6
+
+#define SHADOW_CASCADE_COUNT 4     // between 2 and 4, mirrored in ubo.glsl
+#define SHADOW_MAP_RESOLUTION 1024 // per cascade
+
+// mirrored in ubo.glsl and clusters.glsl
+#define MAX_PUNCTUAL_LIGHTS 256
+#define LIGHT_CLUSTER_X 16
+#define LIGHT_CLUSTER_Y 9
+#define LIGHT_CLUSTER_Z 24
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTER_X * LIGHT_CLUSTER_Y * LIGHT_CLUSTER_Z)
+#define MAX_LIGHTS_PER_CLUSTER 63 // plus the count, each cluster is 256 bytes
 
 #define INVALID_ID -1
 
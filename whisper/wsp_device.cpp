@@ -9,13 +9,31 @@
 
 #include <imgui_impl_vulkan.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
 #include <set>
 #include <stdexcept>
+#include <string_view>
 
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
 using namespace wsp;
 
+// prepended to the driver's data, whose own header doesn't include the driver version
+struct PipelineCacheHeader
+{
+    uint32_t magic;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+};
+
+static uint32_t const PIPELINE_CACHE_MAGIC{0x57535043}; // WSPC
+
 Device *Device::_instance{nullptr};
 
 Device *Device::Get()
@@ -64,6 +82,8 @@ void Device::Initialize(std::vector<char const *> const requiredExtensions, vk::
 
     vk::detail::defaultDispatchLoaderDynamic.init(instance, _device);
     _debugDispatch.init(instance, _device);
+
+    LoadPipelineCache(PIPELINE_CACHE_FILE);
 }
 
 void Device::Free()
@@ -75,6 +95,16 @@ void Device::Free()
     }
 
     check(_device && "Device: Must initialize device sooner");
+
+    SavePipelineCache(PIPELINE_CACHE_FILE);
+    _device.destroyPipelineCache(_pipelineCache);
+
+    for (auto &[hash, sharedShaderModule] : _shaderModules)
+    {
+        _device.destroyShaderModule(sharedShaderModule.shaderModule);
+    }
+    _shaderModules.clear();
+
     _device.destroyCommandPool(_commandPool);
     _device.destroy();
 
@@ -93,6 +123,113 @@ void Device::PopulateImGuiInitInfo(ImGui_ImplVulkan_InitInfo *initInfo) const
     initInfo->Queue = _graphicsQueue;
 }
 
+void Device::LoadPipelineCache(std::string const &filepath)
+{
+    check(_device && "Device: Must initialize device sooner");
+
+    auto const start = std::chrono::steady_clock::now();
+
+    vk::PhysicalDeviceProperties const properties = _physicalDevice.getProperties();
+
+    std::vector<char> data{};
+    std::ifstream file{filepath, std::ios::ate | std::ios::binary};
+    if (file.is_open())
+    {
+        size_t const fileSize = static_cast<size_t>(file.tellg());
+        std::vector<char> buffer(fileSize);
+
+        file.seekg(0);
+        file.read(buffer.data(), fileSize);
+        file.close();
+
+        PipelineCacheHeader header{};
+        if (fileSize >= sizeof(PipelineCacheHeader))
+        {
+            memcpy(&header, buffer.data(), sizeof(PipelineCacheHeader));
+        }
+
+        // a cache from another device or driver is at best ignored by it, at worst crashes it
+        if (header.magic == PIPELINE_CACHE_MAGIC && header.vendorID == properties.vendorID &&
+            header.deviceID == properties.deviceID && header.driverVersion == properties.driverVersion &&
+            memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0 &&
+            header.dataSize == fileSize - sizeof(PipelineCacheHeader))
+        {
+            data.assign(buffer.begin() + sizeof(PipelineCacheHeader), buffer.end());
+        }
+        else
+        {
+            spdlog::warn("Device: discarding pipeline cache '{}', built by another device or driver", filepath);
+        }
+    }
+
+    vk::PipelineCacheCreateInfo createInfo{};
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.data();
+
+    if (vk::Result const result = _device.createPipelineCache(&createInfo, nullptr, &_pipelineCache);
+        result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Device: failed to create pipeline cache : {}",
+                                             vk::to_string(static_cast<vk::Result>(result))));
+    }
+
+    DebugNameObject(_pipelineCache, vk::ObjectType::ePipelineCache, "<pipeline_cache>");
+
+    _isPipelineCacheWarm = !data.empty();
+
+    std::chrono::duration<float, std::milli> const duration = std::chrono::steady_clock::now() - start;
+    spdlog::info("Device: {} pipeline cache, loaded {} bytes in {:.2f} ms", _isPipelineCacheWarm ? "warm" : "cold",
+                 data.size(), duration.count());
+}
+
+void Device::SavePipelineCache(std::string const &filepath) const
+{
+    check(_device && "Device: Must initialize device sooner");
+
+    size_t dataSize{0};
+    if (vk::Result const result = _device.getPipelineCacheData(_pipelineCache, &dataSize, nullptr);
+        result != vk::Result::eSuccess)
+    {
+        spdlog::warn("Device: failed to get pipeline cache size : {}", vk::to_string(result));
+        return;
+    }
+
+    std::vector<char> data(dataSize);
+    if (vk::Result const result = _device.getPipelineCacheData(_pipelineCache, &dataSize, data.data());
+        result != vk::Result::eSuccess)
+    {
+        spdlog::warn("Device: failed to get pipeline cache data : {}", vk::to_string(result));
+        return;
+    }
+
+    vk::PhysicalDeviceProperties const properties = _physicalDevice.getProperties();
+
+    PipelineCacheHeader header{};
+    header.magic = PIPELINE_CACHE_MAGIC;
+    header.vendorID = properties.vendorID;
+    header.deviceID = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+    header.dataSize = dataSize;
+
+    std::ofstream file{filepath, std::ios::binary | std::ios::trunc};
+    if (!file.is_open())
+    {
+        spdlog::warn("Device: failed to open '{}' to save the pipeline cache", filepath);
+        return;
+    }
+
+    file.write(reinterpret_cast<char const *>(&header), sizeof(PipelineCacheHeader));
+    file.write(data.data(), static_cast<std::streamsize>(dataSize));
+
+    spdlog::info("Device: saved {} bytes of pipeline cache", dataSize);
+}
+
+bool Device::IsPipelineCacheWarm() const
+{
+    return _isPipelineCacheWarm;
+}
+
 void Device::PickPhysicalDevice(std::vector<char const *> const &requiredExtensions, vk::Instance instance,
                                 vk::SurfaceKHR surface)
 {
@@ -130,8 +267,17 @@ void Device::PickPhysicalDevice(std::vector<char const *> const &requiredExtensi
         vk::PhysicalDeviceFeatures supportedFeatures;
         supportedFeatures = device.getFeatures();
 
+        vk::PhysicalDeviceVulkan12Features supportedVulkan12Features{};
+        vk::PhysicalDeviceFeatures2 supportedFeatures2{};
+        supportedFeatures2.pNext = &supportedVulkan12Features;
+        device.getFeatures2(&supportedFeatures2);
+
+        bool const isDrawIndirectSupported = supportedFeatures.multiDrawIndirect &&
+                                             supportedFeatures.drawIndirectFirstInstance &&
+                                             supportedVulkan12Features.drawIndirectCount;
+
         if (indices.isComplete() && areExtensionsSupported && isSwapChainAdequate &&
-            supportedFeatures.samplerAnisotropy)
+            supportedFeatures.samplerAnisotropy && isDrawIndirectSupported)
         {
             _physicalDevice = device;
             break;
@@ -228,6 +374,12 @@ std::vector<vk::PresentModeKHR> Device::GetSurfacePresentModesKHR(vk::SurfaceKHR
     return _physicalDevice.getSurfacePresentModesKHR(surface);
 }
 
+vk::FormatFeatureFlags Device::GetFormatFeatures(vk::Format format) const
+{
+    check(_physicalDevice);
+    return _physicalDevice.getFormatProperties(format).optimalTilingFeatures;
+}
+
 vk::CommandBuffer Device::BeginSingleTimeCommand() const
 {
     check(_device && "Device: Must initialize device sooner");
@@ -297,10 +449,13 @@ void Device::CreateLogicalDevice(std::vector<char const *> const &requiredExtens
     deviceFeatures.samplerAnisotropy = vk::True;
     deviceFeatures.fillModeNonSolid = vk::True;
     deviceFeatures.shaderSampledImageArrayDynamicIndexing = vk::True;
+    deviceFeatures.multiDrawIndirect = vk::True;
+    deviceFeatures.drawIndirectFirstInstance = vk::True;
 
     vk::PhysicalDeviceVulkan12Features vulkan12Features{};
     vulkan12Features.descriptorIndexing = vk::True;
     vulkan12Features.runtimeDescriptorArray = vk::True;
+    vulkan12Features.drawIndirectCount = vk::True;
 
     vk::PhysicalDeviceVulkan11Features vulkan11Features{};
     vulkan11Features.pNext = &vulkan12Features;
@@ -322,6 +477,7 @@ void Device::CreateLogicalDevice(std::vector<char const *> const &requiredExtens
     }
 
     _graphicsQueue = _device.getQueue(indices.graphicsFamily, 0);
+    _graphicsQueueFamilyIndex = indices.graphicsFamily;
     _presentQueue = _device.getQueue(indices.presentFamily, 0);
 
     DebugNameObject(_device, vk::ObjectType::eDevice, name);
@@ -507,6 +663,81 @@ void Device::CreateImageAndBindMemory(vk::ImageCreateInfo const &createInfo, vk:
     DebugNameObject(*imageMemory, vk::ObjectType::eDeviceMemory, name + " device memory");
 }
 
+void Device::CreateImage(vk::ImageCreateInfo const &createInfo, vk::Image *image, std::string const &name) const
+{
+    check(_device && "Device: Must initialize device sooner");
+
+    if (vk::Result const result = _device.createImage(&createInfo, nullptr, image); result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Device: failed to create image <{}> : {}", name,
+                                             vk::to_string(static_cast<vk::Result>(result))));
+    }
+
+    DebugNameObject(*image, vk::ObjectType::eImage, name);
+}
+
+vk::MemoryRequirements Device::GetImageMemoryRequirements(vk::Image image) const
+{
+    check(image != VK_NULL_HANDLE);
+    check(_device && "Device: Must initialize device sooner");
+
+    return _device.getImageMemoryRequirements(image);
+}
+
+void Device::CreateBuffer(vk::BufferCreateInfo const &createInfo, vk::Buffer *buffer, std::string const &name) const
+{
+    check(_device && "Device: Must initialize device sooner");
+
+    if (vk::Result const result = _device.createBuffer(&createInfo, nullptr, buffer); result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Device: failed to create buffer <{}> : {}", name,
+                                             vk::to_string(static_cast<vk::Result>(result))));
+    }
+
+    DebugNameObject(*buffer, vk::ObjectType::eBuffer, name);
+}
+
+vk::MemoryRequirements Device::GetBufferMemoryRequirements(vk::Buffer buffer) const
+{
+    check(buffer != VK_NULL_HANDLE);
+    check(_device && "Device: Must initialize device sooner");
+
+    return _device.getBufferMemoryRequirements(buffer);
+}
+
+void Device::AllocateMemory(vk::MemoryAllocateInfo const &allocInfo, vk::DeviceMemory *deviceMemory,
+                            std::string const &name) const
+{
+    check(_device && "Device: Must initialize device sooner");
+
+    if (vk::Result const result = _device.allocateMemory(&allocInfo, nullptr, deviceMemory);
+        result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Device: failed to allocate memory <{}> : {}", name,
+                                             vk::to_string(static_cast<vk::Result>(result))));
+    }
+
+    DebugNameObject(*deviceMemory, vk::ObjectType::eDeviceMemory, name);
+}
+
+void Device::BindImageMemory(vk::Image image, vk::DeviceMemory deviceMemory, vk::DeviceSize offset) const
+{
+    check(image != VK_NULL_HANDLE);
+    check(deviceMemory != VK_NULL_HANDLE);
+    check(_device && "Device: Must initialize device sooner");
+
+    _device.bindImageMemory(image, deviceMemory, offset);
+}
+
+void Device::BindBufferMemory(vk::Buffer buffer, vk::DeviceMemory deviceMemory, vk::DeviceSize offset) const
+{
+    check(buffer != VK_NULL_HANDLE);
+    check(deviceMemory != VK_NULL_HANDLE);
+    check(_device && "Device: Must initialize device sooner");
+
+    _device.bindBufferMemory(buffer, deviceMemory, offset);
+}
+
 void Device::CreateBufferAndBindMemory(vk::BufferCreateInfo const &createInfo, vk::Buffer *buffer,
                                        vk::DeviceMemory *bufferMemory,
                                        vk::MemoryPropertyFlags const &memoryPropertyFlags,
@@ -728,6 +959,48 @@ void Device::CreateShaderModule(std::vector<char> const &code, vk::ShaderModule
     }
 }
 
+vk::ShaderModule Device::GetShaderModule(std::vector<char> const &code, std::string const &name) const
+{
+    check(_device && "Device: Must initialize device sooner");
+
+    size_t const hash = std::hash<std::string_view>{}(std::string_view{code.data(), code.size()});
+
+    std::unique_lock<std::mutex> lock{_shaderModulesMutex};
+    if (auto const it = _shaderModules.find(hash); it != _shaderModules.end())
+    {
+        it->second.users++;
+        return it->second.shaderModule;
+    }
+
+    vk::ShaderModule shaderModule;
+    CreateShaderModule(code, &shaderModule, name);
+    _shaderModules.emplace(hash, SharedShaderModule{shaderModule, 1u});
+
+    return shaderModule;
+}
+
+void Device::ReleaseShaderModule(vk::ShaderModule shaderModule) const
+{
+    check(_device && "Device: Must initialize device sooner");
+
+    if (shaderModule == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock{_shaderModulesMutex};
+    auto const it = std::find_if(_shaderModules.begin(), _shaderModules.end(), [shaderModule](auto const &entry) {
+        return entry.second.shaderModule == shaderModule;
+    });
+    check(it != _shaderModules.end());
+
+    if (--it->second.users == 0)
+    {
+        _device.destroyShaderModule(shaderModule);
+        _shaderModules.erase(it);
+    }
+}
+
 void Device::CreatePipelineLayout(vk::PipelineLayoutCreateInfo const &createInfo, vk::PipelineLayout *pipelineLayout,
                                   std::string const &name) const
 {
@@ -748,16 +1021,124 @@ void Device::CreateGraphicsPipeline(vk::GraphicsPipelineCreateInfo const &create
 {
     check(_device && "Device: Must initialize device sooner");
 
-    if (vk::Result const result = _device.createGraphicsPipelines(VK_NULL_HANDLE, 1, &createInfo, nullptr, pipeline);
+    if (vk::Result const result = _device.createGraphicsPipelines(_pipelineCache, 1, &createInfo, nullptr, pipeline);
         result != vk::Result::eSuccess)
     {
-        throw std::runtime_error(fmt::format("Device: failed to create pipeline layout <{}> : {}", name,
+        throw std::runtime_error(fmt::format("Device: failed to create graphics pipeline <{}> : {}", name,
                                              vk::to_string(static_cast<vk::Result>(result))));
     }
 
     DebugNameObject(*pipeline, vk::ObjectType::ePipeline, name);
 }
 
+void Device::CreateComputePipeline(vk::ComputePipelineCreateInfo const &createInfo, vk::Pipeline *pipeline,
+                                   std::string const &name) const
+{
+    check(_device && "Device: Must initialize device sooner");
+
+    if (vk::Result const result = _device.createComputePipelines(_pipelineCache, 1, &createInfo, nullptr, pipeline);
+        result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Device: failed to create compute pipeline <{}> : {}", name,
+                                             vk::to_string(static_cast<vk::Result>(result))));
+    }
+
+    DebugNameObject(*pipeline, vk::ObjectType::ePipeline, name);
+}
+
+uint32_t Device::GetGraphicsQueueFamilyIndex() const
+{
+    return _graphicsQueueFamilyIndex;
+}
+
+void Device::CreateCommandPool(vk::CommandPoolCreateInfo const &createInfo, vk::CommandPool *commandPool,
+                               std::string const &name) const
+{
+    check(_device && "Device: Must initialize device sooner");
+
+    if (vk::Result const result = _device.createCommandPool(&createInfo, nullptr, commandPool);
+        result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Device: failed to create command pool <{}> : {}", name,
+                                             vk::to_string(static_cast<vk::Result>(result))));
+    }
+
+    DebugNameObject(*commandPool, vk::ObjectType::eCommandPool, name);
+}
+
+void Device::ResetCommandPool(vk::CommandPool commandPool) const
+{
+    check(commandPool != VK_NULL_HANDLE);
+    check(_device && "Device: Must initialize device sooner");
+
+    _device.resetCommandPool(commandPool, vk::CommandPoolResetFlags{});
+}
+
+void Device::CreateQueryPool(vk::QueryPoolCreateInfo const &createInfo, vk::QueryPool *queryPool,
+                             std::string const &name) const
+{
+    check(_device && "Device: Must initialize device sooner");
+
+    if (vk::Result const result = _device.createQueryPool(&createInfo, nullptr, queryPool);
+        result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Device: failed to create query pool <{}> : {}", name,
+                                             vk::to_string(static_cast<vk::Result>(result))));
+    }
+
+    DebugNameObject(*queryPool, vk::ObjectType::eQueryPool, name);
+}
+
+bool Device::GetQueryPoolResults(vk::QueryPool queryPool, uint32_t firstQuery, uint32_t queryCount,
+                                 uint64_t *results) const
+{
+    check(queryPool != VK_NULL_HANDLE);
+    check(_device && "Device: Must initialize device sooner");
+
+    vk::Result const result =
+        _device.getQueryPoolResults(queryPool, firstQuery, queryCount, queryCount * sizeof(uint64_t), results,
+                                    sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    if (result == vk::Result::eNotReady)
+    {
+        return false;
+    }
+    if (result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Device: failed to get query pool results : {}",
+                                             vk::to_string(static_cast<vk::Result>(result))));
+    }
+
+    return true;
+}
+
+float Device::GetTimestampPeriod() const
+{
+    if (_physicalDevice.getQueueFamilyProperties().at(_graphicsQueueFamilyIndex).timestampValidBits == 0)
+    {
+        return 0.f;
+    }
+
+    return _physicalDevice.getProperties().limits.timestampPeriod;
+}
+
+void Device::AllocateCommandBuffers(vk::CommandBufferAllocateInfo const &allocInfo, vk::CommandBuffer *commandBuffers,
+                                    std::string const &name) const
+{
+    check(_device && "Device: Must initialize device sooner");
+
+    if (vk::Result const result = _device.allocateCommandBuffers(&allocInfo, commandBuffers);
+        result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Device: failed to allocate command buffers <{}> : {}", name,
+                                             vk::to_string(static_cast<vk::Result>(result))));
+    }
+
+    for (uint32_t i = 0; i < allocInfo.commandBufferCount; i++)
+    {
+        DebugNameObject(commandBuffers[i], vk::ObjectType::eCommandBuffer, name);
+    }
+}
+
 void Device::DestroySemaphore(vk::Semaphore *semaphore) const
 {
     check(*semaphore != VK_NULL_HANDLE);
@@ -863,6 +1244,21 @@ void Device::DestroyGraphicsPipeline(vk::Pipeline *pipeline) const
     _device.destroyPipeline(*pipeline, nullptr);
     *pipeline = VK_NULL_HANDLE;
 }
+void Device::DestroyCommandPool(vk::CommandPool *commandPool) const
+{
+    check(*commandPool != VK_NULL_HANDLE);
+    check(_device && "Device: Must initialize device sooner");
+    _device.destroyCommandPool(*commandPool, nullptr);
+    *commandPool = VK_NULL_HANDLE;
+}
+
+void Device::DestroyQueryPool(vk::QueryPool *queryPool) const
+{
+    check(*queryPool != VK_NULL_HANDLE);
+    check(_device && "Device: Must initialize device sooner");
+    _device.destroyQueryPool(*queryPool, nullptr);
+    *queryPool = VK_NULL_HANDLE;
+}
 
 uint32_t Device::FindMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties) const
 {
@@ -879,6 +1275,21 @@ uint32_t Device::FindMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags pro
     throw std::runtime_error("Device: failed to find suitable memory type");
 }
 
+bool Device::HasMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties) const
+{
+    vk::PhysicalDeviceMemoryProperties memProperties = _physicalDevice.getMemoryProperties();
+
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    {
+        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void Device::GetMemoryProperties(vk::PhysicalDeviceMemoryProperties2 *memoryProperties2,
                                  vk::PhysicalDeviceMemoryBudgetPropertiesEXT *budgetProperties) const
 {
@@ -907,6 +1318,15 @@ void Device::FreeCommandBuffers(std::vector<vk::CommandBuffer> *commandBuffers)
     _device.freeCommandBuffers(_commandPool, static_cast<uint32_t>(commandBuffers->size()), commandBuffers->data());
 }
 
+void Device::FreeCommandBuffers(vk::CommandPool commandPool, std::vector<vk::CommandBuffer> *commandBuffers) const
+{
+    check(commandPool != VK_NULL_HANDLE);
+    check(_device && "Device: Must initialize device sooner");
+
+    _device.freeCommandBuffers(commandPool, static_cast<uint32_t>(commandBuffers->size()), commandBuffers->data());
+    commandBuffers->clear();
+}
+
 bool Device::AcquireNextImageKHR(vk::SwapchainKHR swapchain, vk::Semaphore semaphore, vk::Fence fence,
                                  uint32_t *imageIndex, uint64_t timeout) const
 {
@@ -8,6 +8,10 @@
 
 #include <tracy/TracyVulkan.hpp>
 
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
 class ImGui_ImplVulkan_InitInfo;
 
 namespace wsp
@@ -55,6 +59,7 @@ class Device
     vk::SurfaceCapabilitiesKHR GetSurfaceCapabilitiesKHR(vk::SurfaceKHR) const;
     std::vector<vk::SurfaceFormatKHR> GetSurfaceFormatsKHR(vk::SurfaceKHR) const;
     std::vector<vk::PresentModeKHR> GetSurfacePresentModesKHR(vk::SurfaceKHR) const;
+    vk::FormatFeatureFlags GetFormatFeatures(vk::Format) const; // of optimally tiled images
 
     vk::CommandBuffer BeginSingleTimeCommand() const;
     void EndSingleTimeCommand(vk::CommandBuffer commandBuffer) const;
@@ -74,6 +79,13 @@ class Device
     void CreateRenderPass(vk::RenderPassCreateInfo const &, vk::RenderPass *, std::string const &name) const;
     void CreateImageAndBindMemory(vk::ImageCreateInfo const &, vk::Image *, vk::DeviceMemory *,
                                   std::string const &name) const;
+    void CreateImage(vk::ImageCreateInfo const &, vk::Image *, std::string const &name) const;
+    vk::MemoryRequirements GetImageMemoryRequirements(vk::Image) const;
+    void CreateBuffer(vk::BufferCreateInfo const &, vk::Buffer *, std::string const &name) const;
+    vk::MemoryRequirements GetBufferMemoryRequirements(vk::Buffer) const;
+    void AllocateMemory(vk::MemoryAllocateInfo const &, vk::DeviceMemory *, std::string const &name) const;
+    void BindImageMemory(vk::Image, vk::DeviceMemory, vk::DeviceSize offset) const;
+    void BindBufferMemory(vk::Buffer, vk::DeviceMemory, vk::DeviceSize offset) const;
     void CreateBufferAndBindMemory(vk::BufferCreateInfo const &, vk::Buffer *, vk::DeviceMemory *,
                                    vk::MemoryPropertyFlags const &, std::string const &name) const;
     void CopyBuffer(vk::Buffer source, vk::Buffer *destination, uint32_t size) const;
@@ -94,12 +106,27 @@ class Device
     void CreateDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo const &, vk::DescriptorSetLayout *,
                                    std::string const &name) const;
     void CreateShaderModule(std::vector<char> const &code, vk::ShaderModule *, std::string const &name) const;
+    // cached, shared by every pipeline built from the same SPIR-V until each of them releases it
+    vk::ShaderModule GetShaderModule(std::vector<char> const &code, std::string const &name) const;
+    void ReleaseShaderModule(vk::ShaderModule) const;
     void CreatePipelineLayout(vk::PipelineLayoutCreateInfo const &, vk::PipelineLayout *,
                               std::string const &name) const;
     void CreateGraphicsPipeline(vk::GraphicsPipelineCreateInfo const &, vk::Pipeline *, std::string const &name) const;
+    void CreateComputePipeline(vk::ComputePipelineCreateInfo const &, vk::Pipeline *, std::string const &name) const;
+    bool IsPipelineCacheWarm() const;
 
     void AllocateCommandBuffers(std::vector<vk::CommandBuffer> *) const;
     void FreeCommandBuffers(std::vector<vk::CommandBuffer> *) const;
+    void FreeCommandBuffers(vk::CommandPool, std::vector<vk::CommandBuffer> *) const;
+
+    uint32_t GetGraphicsQueueFamilyIndex() const;
+    void CreateCommandPool(vk::CommandPoolCreateInfo const &, vk::CommandPool *, std::string const &name) const;
+    void ResetCommandPool(vk::CommandPool) const;
+    void CreateQueryPool(vk::QueryPoolCreateInfo const &, vk::QueryPool *, std::string const &name) const;
+    bool GetQueryPoolResults(vk::QueryPool, uint32_t firstQuery, uint32_t queryCount, uint64_t *results) const;
+    float GetTimestampPeriod() const; // in nanoseconds, 0 when the graphics queue can't write timestamps
+    void AllocateCommandBuffers(vk::CommandBufferAllocateInfo const &, vk::CommandBuffer *,
+                                std::string const &name) const;
 
     void DestroySemaphore(vk::Semaphore *) const;
     void DestroyFence(vk::Fence *) const;
@@ -116,8 +143,11 @@ class Device
     void DestroyShaderModule(vk::ShaderModule *) const;
     void DestroyPipelineLayout(vk::PipelineLayout *) const;
     void DestroyGraphicsPipeline(vk::Pipeline *) const;
+    void DestroyCommandPool(vk::CommandPool *) const;
+    void DestroyQueryPool(vk::QueryPool *) const;
 
     uint32_t FindMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags) const;
+    bool HasMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags) const;
 
     void GetMemoryProperties(vk::PhysicalDeviceMemoryProperties2 *,
                              vk::PhysicalDeviceMemoryBudgetPropertiesEXT *) const;
@@ -138,10 +168,25 @@ class Device
     vk::Device _device;
     vk::Queue _graphicsQueue;
     vk::Queue _presentQueue;
+    uint32_t _graphicsQueueFamilyIndex;
 
     void CreateCommandPool(vk::PhysicalDevice, vk::SurfaceKHR, std::string const &name);
     vk::CommandPool _commandPool;
 
+    void LoadPipelineCache(std::string const &filepath);
+    void SavePipelineCache(std::string const &filepath) const;
+    vk::PipelineCache _pipelineCache;
+    bool _isPipelineCacheWarm;
+
+    struct SharedShaderModule
+    {
+        vk::ShaderModule shaderModule;
+        uint32_t users;
+    };
+
+    mutable std::mutex _shaderModulesMutex;
+    mutable std::unordered_map<size_t, SharedShaderModule> _shaderModules; // keyed by a hash of their SPIR-V
+
     vk::detail::DispatchLoaderDynamic _debugDispatch;
 
     bool _freed;
@@ -176,6 +221,7 @@ class SafeDeviceAccessor
     friend class Window;
     friend class Graph;
     friend class StaticTextures;
+    friend class StaticBuffer;
     friend class AssetsManager;
     friend class Image;
     friend class Texture;
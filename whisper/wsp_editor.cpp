@@ -1,6 +1,7 @@
 #include <wsp_editor.hpp>
 
 #include <wsp_assets_manager.hpp>
+#include <wsp_bounds.hpp>
 #include <wsp_camera.hpp>
 #include <wsp_constants.hpp>
 #include <wsp_custom_imgui.hpp>
@@ -14,10 +15,14 @@
 #include <wsp_handles.hpp>
 #include <wsp_input_manager.hpp>
 #include <wsp_inputs.hpp>
+#include <wsp_material.hpp>
 #include <wsp_mesh.hpp>
+#include <wsp_occlusion_buffer.hpp>
 #include <wsp_render_manager.hpp>
 #include <wsp_renderer.hpp>
 #include <wsp_scene.hpp>
+#include <wsp_shader_watcher.hpp>
+#include <wsp_static_buffer.hpp>
 #include <wsp_static_utils.hpp>
 #include <wsp_swapchain.hpp>
 #include <wsp_texture.hpp>
@@ -38,9 +43,66 @@
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_handles.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <thread>
+
 using namespace wsp;
 
-Editor::Editor() : _scene{nullptr}
+// the packed formats aren't required to be renderable everywhere, devices lacking them get the reference format
+static vk::Format GetSupportedFormat(vk::Format packed, vk::FormatFeatureFlags required)
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    if ((device->GetFormatFeatures(packed) & required) == required)
+    {
+        return packed;
+    }
+
+    vk::Format const reference = vk::Format::eR16G16B16A16Sfloat;
+    spdlog::warn("Editor: {} can't be rendered to on this device, using {} instead", vk::to_string(packed),
+                 vk::to_string(reference));
+    return reference;
+}
+
+// of the rgb channels, alpha is left out as the target's isn't displayed
+static void MeasureError(std::vector<float> const &measured, std::vector<float> const &reference, float *maxError,
+                         float *psnr)
+{
+    check(measured.size() == reference.size());
+    check(maxError && psnr);
+
+    double squaredErrorSum = 0.;
+    float peak = 1.f; // hdr targets peak above it
+    *maxError = 0.f;
+
+    for (size_t i = 0; i < reference.size(); i++)
+    {
+        if (i % 4u == 3u)
+        {
+            continue;
+        }
+
+        float const error = std::abs(measured[i] - reference[i]);
+        *maxError = std::max(*maxError, error);
+        peak = std::max(peak, reference[i]);
+        squaredErrorSum += static_cast<double>(error) * error;
+    }
+
+    double const meanSquaredError = squaredErrorSum / static_cast<double>(reference.size() / 4u * 3u);
+    *psnr = meanSquaredError > 0. ? static_cast<float>(10. * std::log10(peak * peak / meanSquaredError))
+                                  : std::numeric_limits<float>::infinity();
+}
+
+Editor::Editor()
+    : _viewportCursor{0.f}, _scene{nullptr}, _selectedIndex{-1}, _selectedPrimitive{0}, _pickTime{0.f},
+      _isOcclusionCulling{true}, _isGpuCulling{true}, _isHiZStale{true}, _dirtyShadowMaps{~0u},
+      _shadowMapViewProjections{}, _ssaoRadius{.1f}, _isSsaoTemporal{true}, _isUsingReferenceFormats{false},
+      _comparisonFrames{0u}, _comparisonMaxError{0.f}, _comparisonPsnr{-1.f}, _isResolutionDynamic{false},
+      _frameBudget{16.6f}, _renderScale{1.f}, _previousRenderScale{1.f}, _previousViewProjection{1.f}, _frame{0}
 {
     RenderManager *renderManager = RenderManager::Get();
     check(renderManager);
@@ -49,6 +111,8 @@ Editor::Editor() : _scene{nullptr}
 
     _viewportCamera = std::make_unique<ViewportCamera>(glm::vec3{0.f}, 10.f, glm::vec2{20.f, 0.f});
     _inputManager = std::make_unique<InputManager>(_windowID);
+    _occlusionBuffer = std::make_unique<OcclusionBuffer>(
+        std::clamp(std::thread::hardware_concurrency(), 1u, static_cast<uint32_t>(MAX_OCCLUSION_THREADS)));
 
     _inputManager->AddInput("look", AxisAction{WSP_MOUSE_AXIS_X_RELATIVE, WSP_MOUSE_AXIS_Y_RELATIVE});
     _inputManager->AddInput("left click on", ButtonAction{ButtonAction::Usage::ePressed, {WSP_MOUSE_BUTTON_LEFT}});
@@ -77,6 +141,8 @@ Editor::Editor() : _scene{nullptr}
 
     Graph *graph = renderManager->GetGraph(_windowID);
 
+    _instanceBuffer = std::make_unique<StaticBuffer>(MAX_INSTANCES * sizeof(Scene::Instance), "instances");
+
     _environments.emplace_back(
         "alpes",
         std::make_unique<Environment>(
@@ -127,28 +193,71 @@ Editor::Editor() : _scene{nullptr}
     shadowInfo.format = vk::Format::eD32Sfloat;
     shadowInfo.clear.depthStencil = vk::ClearDepthStencilValue{1.};
     shadowInfo.debugName = "shadowMap";
-    shadowInfo.extent = vk::Extent2D{1024, 1024};
+    shadowInfo.extent = vk::Extent2D{SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION};
+    shadowInfo.arrayLayers = SHADOW_CASCADE_COUNT;
 
     ResourceCreateInfo colorInfo{};
     colorInfo.usage = ResourceUsage::eColor;
-    colorInfo.format = vk::Format::eR16G16B16A16Sfloat;
+    // no alpha, blending only reads the incoming one
+    colorInfo.format = GetSupportedFormat(vk::Format::eB10G11R11UfloatPack32,
+                                          vk::FormatFeatureFlagBits::eColorAttachment |
+                                              vk::FormatFeatureFlagBits::eColorAttachmentBlend);
     colorInfo.debugName = "color";
 
     ResourceCreateInfo depthInfo{};
     depthInfo.usage = ResourceUsage::eDepth;
     depthInfo.format = vk::Format::eD32Sfloat;
     depthInfo.clear.depthStencil = vk::ClearDepthStencilValue{1.};
+    depthInfo.history = true; // the next frame culls against it
     depthInfo.debugName = "depth";
 
     ResourceCreateInfo prepassInfo{};
     prepassInfo.usage = ResourceUsage::eColor;
-    prepassInfo.format = vk::Format::eR16G16B16A16Sfloat;
-    prepassInfo.clear.color = vk::ClearColorValue{0.f, 0.f, 0.f, 1.f};
+    // octahedral normals, view depth comes from the depth buffer
+    prepassInfo.format = GetSupportedFormat(vk::Format::eR16G16Snorm, vk::FormatFeatureFlagBits::eColorAttachment);
+    prepassInfo.clear.color = vk::ClearColorValue{0.f, 0.f, 0.f, 0.f};
     prepassInfo.debugName = "prepass";
 
+    ResourceCreateInfo ssaoInfo{};
+    ssaoInfo.usage = ResourceUsage::eColor;
+    ssaoInfo.format = vk::Format::eR16G16Sfloat; // occlusion, view depth for the upsample
+    ssaoInfo.clear.color = vk::ClearColorValue{1.f, 0.f, 0.f, 0.f};
+    ssaoInfo.screenDivisor = SSAO_SCREEN_DIVISOR;
+    ssaoInfo.history = true;
+    ssaoInfo.debugName = "ssao";
+
+    ResourceCreateInfo ambientOcclusionInfo{};
+    ambientOcclusionInfo.usage = ResourceUsage::eColor;
+    ambientOcclusionInfo.format = vk::Format::eR8Unorm;
+    ambientOcclusionInfo.debugName = "ambient occlusion";
+
+    ResourceCreateInfo lightClustersInfo{};
+    lightClustersInfo.usage = ResourceUsage::eStorageBuffer;
+    lightClustersInfo.size = LIGHT_CLUSTER_COUNT * (1 + MAX_LIGHTS_PER_CLUSTER) * sizeof(uint32_t);
+    lightClustersInfo.debugName = "light clusters";
+
+    ResourceCreateInfo hiZInfo{};
+    hiZInfo.usage = ResourceUsage::eStorageImage;
+    hiZInfo.format = vk::Format::eR32Sfloat;
+    hiZInfo.extent = vk::Extent2D{HI_Z_WIDTH, HI_Z_HEIGHT};
+    hiZInfo.mipLevels = HI_Z_MIP_COUNT;
+    hiZInfo.debugName = "hi-z";
+
+    ResourceCreateInfo drawCommandsInfo{};
+    drawCommandsInfo.usage = ResourceUsage::eStorageBuffer;
+    drawCommandsInfo.size = CULLING_VIEW_COUNT * MAX_INSTANCES * sizeof(vk::DrawIndexedIndirectCommand);
+    drawCommandsInfo.indirect = true;
+    drawCommandsInfo.debugName = "draw commands";
+
+    ResourceCreateInfo drawCountsInfo{};
+    drawCountsInfo.usage = ResourceUsage::eStorageBuffer;
+    drawCountsInfo.size = CULLING_VIEW_COUNT * MAX_INSTANCES * sizeof(uint32_t);
+    drawCountsInfo.indirect = true;
+    drawCountsInfo.debugName = "draw counts";
+
     ResourceCreateInfo postInfo{};
     postInfo.usage = ResourceUsage::eColor;
-    postInfo.format = vk::Format::eR16G16B16A16Sfloat;
+    postInfo.format = vk::Format::eA2B10G10R10UnormPack32; // tone mapped, so within [0, 1]
     postInfo.debugName = "post process";
 
     Resource const shadowResource = graph->NewResource(shadowInfo);
@@ -156,60 +265,231 @@ Editor::Editor() : _scene{nullptr}
     Resource const depthResource = graph->NewResource(depthInfo);
     Resource const postResource = graph->NewResource(postInfo);
     Resource const prepassResource = graph->NewResource(prepassInfo);
+    Resource const ssaoResource = graph->NewResource(ssaoInfo);
+    Resource const ambientOcclusionResource = graph->NewResource(ambientOcclusionInfo);
+    Resource const lightClustersResource = graph->NewResource(lightClustersInfo);
+    Resource const hiZResource = graph->NewResource(hiZInfo);
+    Resource const drawCommandsResource = graph->NewResource(drawCommandsInfo);
+    Resource const drawCountsResource = graph->NewResource(drawCountsInfo);
+
+    // farthest depth of last frame, each mip from the one before
+    for (uint32_t mip = 0; mip < HI_Z_MIP_COUNT; mip++)
+    {
+        PassCreateInfo hiZPassInfo{};
+        hiZPassInfo.reads = {mip == 0 ? graph->GetPrevious(depthResource)
+                                      : graph->GetSubresource(hiZResource, mip - 1)};
+        hiZPassInfo.writes = {graph->GetSubresource(hiZResource, mip)};
+        hiZPassInfo.readsUniform = true;
+        hiZPassInfo.pushConstantSize = sizeof(uint32_t);
+        hiZPassInfo.compFile = "hiz_downsample.comp.spv";
+        hiZPassInfo.debugName = fmt::format("hi-z downsample {}", mip);
+        hiZPassInfo.dispatch = [mip](vk::CommandBuffer commandBuffer, vk::PipelineLayout pipelineLayout) {
+            uint32_t const width = std::max(HI_Z_WIDTH >> mip, 1);
+            uint32_t const height = std::max(HI_Z_HEIGHT >> mip, 1);
+
+            commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(uint32_t), &mip);
+            commandBuffer.dispatch((width + 7) / 8, (height + 7) / 8, 1u);
+        };
+
+        graph->NewPass(hiZPassInfo);
+    }
+
+    PassCreateInfo instanceCullingPassInfo{};
+    instanceCullingPassInfo.reads = {hiZResource};
+    instanceCullingPassInfo.writes = {drawCommandsResource, drawCountsResource};
+    instanceCullingPassInfo.readsUniform = true;
+    instanceCullingPassInfo.staticBuffers = {_instanceBuffer.get()};
+    instanceCullingPassInfo.pushConstantSize = 2 * sizeof(uint32_t);
+    instanceCullingPassInfo.compFile = "instance_culling.comp.spv";
+    instanceCullingPassInfo.debugName = "instance culling";
+    instanceCullingPassInfo.dispatch = [this, graph, drawCountsResource](vk::CommandBuffer commandBuffer,
+                                                                        vk::PipelineLayout pipelineLayout) {
+        uint32_t const instanceCount =
+            _scene && _isGpuCulling ? static_cast<uint32_t>(_scene->GetInstances().size()) : 0u;
+        if (instanceCount == 0)
+        {
+            return;
+        }
+
+        // instances of a group find their command slots by counting up from 0
+        vk::Buffer const counts = graph->GetBuffer(drawCountsResource);
+        commandBuffer.fillBuffer(counts, 0, VK_WHOLE_SIZE, 0u);
+
+        vk::BufferMemoryBarrier barrier{};
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = counts;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+                                      {}, {}, {barrier}, {});
+
+        uint32_t const pushData[] = {instanceCount, _isHiZStale ? 0u : 1u};
+        _isHiZStale = false;
+
+        commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(pushData), pushData);
+        commandBuffer.dispatch((instanceCount + 63) / 64, 1u, 1u);
+    };
+
+    graph->NewPass(instanceCullingPassInfo);
 
     PassCreateInfo prepassPassInfo{};
+    prepassPassInfo.reads = {drawCommandsResource, drawCountsResource};
     prepassPassInfo.writes = {depthResource, prepassResource};
     prepassPassInfo.readsUniform = true;
     prepassPassInfo.vertexInputInfo = Mesh::Vertex::GetVertexInputInfo();
-    prepassPassInfo.pushConstantSize = sizeof(Mesh::PushData);
     prepassPassInfo.staticTextures = {AssetsManager::Get()->GetStaticTextures()};
+    prepassPassInfo.staticBuffers = {_instanceBuffer.get()};
     prepassPassInfo.vertFile = "prepass.vert.spv";
     prepassPassInfo.fragFile = "prepass.frag.spv";
     prepassPassInfo.debugName = "prepass render";
-    prepassPassInfo.execute = [&](vk::CommandBuffer commandBuffer, vk::PipelineLayout pipelineLayout) {
+    prepassPassInfo.permutations = {0u, Material::eAlphaMask};
+    prepassPassInfo.executePermutation = [this, graph, drawCommandsResource, drawCountsResource](
+                                             vk::CommandBuffer commandBuffer, vk::PipelineLayout,
+                                             uint32_t permutation, uint32_t chunk, uint32_t chunkCount) {
         ZoneScopedN("draw calls");
-        if (_scene)
+        if (_scene && _isGpuCulling)
         {
-            _scene->Draw(commandBuffer, pipelineLayout, {});
+            _scene->DrawIndirectPermutationChunk(commandBuffer, graph->GetBuffer(drawCommandsResource),
+                                                 graph->GetBuffer(drawCountsResource), 0u, permutation, chunk,
+                                                 chunkCount, Material::eAlphaMask);
         }
-    };
-
-    graph->NewPass(prepassPassInfo);
-
-    PassCreateInfo shadowMapPassInfo{};
-    shadowMapPassInfo.writes = {shadowResource};
-    shadowMapPassInfo.readsUniform = true;
-    shadowMapPassInfo.vertexInputInfo = Mesh::Vertex::GetVertexInputInfo();
-    shadowMapPassInfo.pushConstantSize = sizeof(Mesh::PushData);
-    shadowMapPassInfo.vertFile = "shadowmapping.vert.spv";
-    shadowMapPassInfo.fragFile = "shadowmapping.frag.spv";
-    shadowMapPassInfo.debugName = "shadowMap render";
-    shadowMapPassInfo.execute = [&](vk::CommandBuffer commandBuffer, vk::PipelineLayout pipelineLayout) {
-        ZoneScopedN("draw calls");
-        if (_scene)
+        else if (_scene)
         {
-            _scene->Draw(commandBuffer, pipelineLayout, {});
+            _scene->DrawPermutationChunk(commandBuffer, permutation, chunk, chunkCount, Material::eAlphaMask,
+                                         _isOcclusionCulling ? _occlusionBuffer.get() : nullptr);
         }
     };
 
-    graph->NewPass(shadowMapPassInfo);
+    Pass const prepassPass = graph->NewPass(prepassPassInfo);
+
+    for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+    {
+        PassCreateInfo shadowMapPassInfo{};
+        shadowMapPassInfo.reads = {drawCommandsResource, drawCountsResource};
+        shadowMapPassInfo.writes = {graph->GetSubresource(shadowResource, 0u, cascade)};
+        shadowMapPassInfo.readsUniform = true;
+        shadowMapPassInfo.staticBuffers = {_instanceBuffer.get()};
+        shadowMapPassInfo.vertexInputInfo = Mesh::Vertex::GetPositionInputInfo();
+        shadowMapPassInfo.pushConstantSize = sizeof(uint32_t); // the cascade
+        shadowMapPassInfo.vertFile = "shadowmapping.vert.spv";
+        shadowMapPassInfo.fragFile = "shadowmapping.frag.spv";
+        shadowMapPassInfo.debugName = fmt::format("shadowMap render {}", cascade);
+        shadowMapPassInfo.executeChunk = [this, graph, cascade, drawCommandsResource, drawCountsResource](
+                                             vk::CommandBuffer commandBuffer, vk::PipelineLayout pipelineLayout,
+                                             uint32_t chunk, uint32_t chunkCount) {
+            ZoneScopedN("draw calls");
+            if (!_scene)
+            {
+                return;
+            }
+
+            commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eAllGraphics, 0, sizeof(uint32_t),
+                                        &cascade);
+
+            if (_isGpuCulling)
+            {
+                _scene->DrawIndirectChunk(commandBuffer, graph->GetBuffer(drawCommandsResource),
+                                          graph->GetBuffer(drawCountsResource), 1u + cascade, chunk, chunkCount);
+            }
+            else
+            {
+                Frustum const culling{_environments[_selectedEnvironment].second->GetCascadeViewProjection(cascade)};
+                _scene->DrawChunk(commandBuffer, chunk, chunkCount, &culling);
+            }
+        };
+        // cascades follow the view, but stay in place while it does not move
+        shadowMapPassInfo.isUpToDate = [this, cascade]() {
+            glm::mat4 const &viewProjection =
+                _environments[_selectedEnvironment].second->GetCascadeViewProjection(cascade);
+            bool const isUpToDate =
+                !(_dirtyShadowMaps & (1u << cascade)) && viewProjection == _shadowMapViewProjections[cascade];
+
+            _dirtyShadowMaps &= ~(1u << cascade);
+            _shadowMapViewProjections[cascade] = viewProjection;
+            return isUpToDate;
+        };
+
+        _shadowMapPasses.push_back(graph->NewPass(shadowMapPassInfo));
+    }
+
+    PassCreateInfo ssaoPassInfo{};
+    ssaoPassInfo.writes = {ssaoResource};
+    ssaoPassInfo.reads = {prepassResource, depthResource, graph->GetPrevious(ssaoResource)};
+    ssaoPassInfo.earlyReads = {depthResource}; // before the mesh passes, which draw more depth over it
+    ssaoPassInfo.passDependencies = {prepassPass};
+    ssaoPassInfo.readsUniform = true;
+    ssaoPassInfo.staticTextures = {AssetsManager::Get()->GetStaticNoises()};
+    ssaoPassInfo.vertFile = "fullscreen.vert.spv";
+    ssaoPassInfo.fragFile = "ssao.frag.spv";
+    ssaoPassInfo.debugName = "ssao render";
+    ssaoPassInfo.recordOnce = true;
+    ssaoPassInfo.execute = [](vk::CommandBuffer commandBuffer, vk::PipelineLayout) {
+        commandBuffer.draw(6u, 1u, 0u, 0u);
+    };
+
+    graph->NewPass(ssaoPassInfo);
+
+    PassCreateInfo ssaoUpsamplePassInfo{};
+    ssaoUpsamplePassInfo.writes = {ambientOcclusionResource};
+    ssaoUpsamplePassInfo.reads = {ssaoResource, depthResource};
+    ssaoUpsamplePassInfo.earlyReads = {depthResource};
+    ssaoUpsamplePassInfo.passDependencies = {prepassPass};
+    ssaoUpsamplePassInfo.readsUniform = true;
+    ssaoUpsamplePassInfo.vertFile = "fullscreen.vert.spv";
+    ssaoUpsamplePassInfo.fragFile = "ssao_upsample.frag.spv";
+    ssaoUpsamplePassInfo.debugName = "ssao upsample render";
+    ssaoUpsamplePassInfo.recordOnce = true;
+    ssaoUpsamplePassInfo.execute = [](vk::CommandBuffer commandBuffer, vk::PipelineLayout) {
+        commandBuffer.draw(6u, 1u, 0u, 0u);
+    };
+
+    graph->NewPass(ssaoUpsamplePassInfo);
+
+    PassCreateInfo lightCullingPassInfo{};
+    lightCullingPassInfo.writes = {lightClustersResource};
+    lightCullingPassInfo.readsUniform = true;
+    lightCullingPassInfo.compFile = "light_culling.comp.spv";
+    lightCullingPassInfo.debugName = "light culling";
+    lightCullingPassInfo.dispatch = [](vk::CommandBuffer commandBuffer, vk::PipelineLayout) {
+        commandBuffer.dispatch((LIGHT_CLUSTER_COUNT + 63) / 64, 1u, 1u);
+    };
+
+    graph->NewPass(lightCullingPassInfo);
 
     PassCreateInfo meshPassInfo{};
-    meshPassInfo.reads = {shadowResource, prepassResource};
+    // draw commands and counts are drawn from rather than bound, mesh.frag's sets are unchanged
+    meshPassInfo.reads = {shadowResource, prepassResource, ambientOcclusionResource, lightClustersResource,
+                          drawCommandsResource, drawCountsResource};
     meshPassInfo.writes = {colorResource, depthResource};
     meshPassInfo.readsUniform = true;
     meshPassInfo.staticTextures = {AssetsManager::Get()->GetStaticTextures(), AssetsManager::Get()->GetStaticNoises(),
                                    AssetsManager::Get()->GetStaticCubemaps()};
+    meshPassInfo.staticBuffers = {_instanceBuffer.get()};
     meshPassInfo.vertexInputInfo = Mesh::Vertex::GetVertexInputInfo();
-    meshPassInfo.pushConstantSize = sizeof(Mesh::PushData);
     meshPassInfo.vertFile = "mesh.vert.spv";
     meshPassInfo.fragFile = "mesh.frag.spv";
     meshPassInfo.debugName = "mesh render";
-    meshPassInfo.execute = [&](vk::CommandBuffer commandBuffer, vk::PipelineLayout pipelineLayout) {
+    for (uint32_t features = 0; features < Material::PERMUTATION_COUNT; features++)
+    {
+        meshPassInfo.permutations.push_back(features);
+    }
+    meshPassInfo.executePermutation = [this, graph, drawCommandsResource, drawCountsResource](
+                                          vk::CommandBuffer commandBuffer, vk::PipelineLayout,
+                                          uint32_t permutation, uint32_t chunk, uint32_t chunkCount) {
         ZoneScopedN("draw calls");
-        if (_scene)
+        if (_scene && _isGpuCulling)
+        {
+            _scene->DrawIndirectPermutationChunk(commandBuffer, graph->GetBuffer(drawCommandsResource),
+                                                 graph->GetBuffer(drawCountsResource), 0u, permutation, chunk,
+                                                 chunkCount);
+        }
+        else if (_scene)
         {
-            _scene->Draw(commandBuffer, pipelineLayout, {});
+            _scene->DrawPermutationChunk(commandBuffer, permutation, chunk, chunkCount, ~0u,
+                                         _isOcclusionCulling ? _occlusionBuffer.get() : nullptr);
         }
     };
 
@@ -223,18 +503,47 @@ Editor::Editor() : _scene{nullptr}
     backgroundPassInfo.vertFile = "background.vert.spv";
     backgroundPassInfo.fragFile = "background.frag.spv";
     backgroundPassInfo.debugName = "background render";
+    backgroundPassInfo.recordOnce = true;
     backgroundPassInfo.execute = [](vk::CommandBuffer commandBuffer, vk::PipelineLayout) {
         commandBuffer.draw(6u, 1u, 0u, 0u);
     };
 
-    graph->NewPass(backgroundPassInfo);
+    Pass const backgroundPass = graph->NewPass(backgroundPassInfo);
+
+    PassCreateInfo blendedPassInfo{};
+    blendedPassInfo.reads = {shadowResource, prepassResource, ambientOcclusionResource, lightClustersResource};
+    blendedPassInfo.writes = {colorResource, depthResource};
+    blendedPassInfo.passDependencies = {backgroundPass};
+    blendedPassInfo.readsUniform = true;
+    blendedPassInfo.blends = true;
+    blendedPassInfo.staticTextures = meshPassInfo.staticTextures;
+    blendedPassInfo.staticBuffers = meshPassInfo.staticBuffers;
+    blendedPassInfo.vertexInputInfo = Mesh::Vertex::GetVertexInputInfo();
+    blendedPassInfo.vertFile = "mesh.vert.spv";
+    blendedPassInfo.fragFile = "mesh.frag.spv";
+    blendedPassInfo.debugName = "blended mesh render";
+    // a single pipeline keeps the back to front order across materials
+    blendedPassInfo.permutations = {Material::eAlphaBlend | Material::eRuntimeFeatures};
+    blendedPassInfo.executePermutation = [this](vk::CommandBuffer commandBuffer, vk::PipelineLayout, uint32_t,
+                                                uint32_t chunk, uint32_t chunkCount) {
+        ZoneScopedN("draw calls");
+        if (_scene)
+        {
+            _scene->DrawBlendedChunk(commandBuffer, chunk, chunkCount,
+                                     _isOcclusionCulling ? _occlusionBuffer.get() : nullptr);
+        }
+    };
+
+    graph->NewPass(blendedPassInfo);
 
     PassCreateInfo postPassInfo{};
     postPassInfo.writes = {postResource};
     postPassInfo.reads = {colorResource};
+    postPassInfo.pixelLocalReads = true;
     postPassInfo.vertFile = "tonemapping.vert.spv";
     postPassInfo.fragFile = "tonemapping.frag.spv";
     postPassInfo.debugName = "tonemapping render";
+    postPassInfo.recordOnce = true;
     postPassInfo.execute = [](vk::CommandBuffer commandBuffer, vk::PipelineLayout) {
         commandBuffer.draw(6u, 1u, 0u, 0u);
     };
@@ -243,7 +552,18 @@ Editor::Editor() : _scene{nullptr}
 
     _rebuild = [graph, postResource]() { graph->Compile(postResource, Graph::eToDescriptorSet); };
 
+    // validation mode, the packed formats are compared against the 64 bits per pixel ones they replaced
+    _useReferenceFormats = [graph, colorInfo, prepassInfo, postInfo, colorResource, prepassResource,
+                            postResource](bool isReference) {
+        vk::Format const reference = vk::Format::eR16G16B16A16Sfloat;
+        graph->SetFormat(colorResource, isReference ? reference : colorInfo.format);
+        graph->SetFormat(prepassResource, isReference ? reference : prepassInfo.format);
+        graph->SetFormat(postResource, isReference ? reference : postInfo.format);
+    };
+
     _rebuild();
+
+    _shaderWatcher = std::make_unique<ShaderWatcher>(SHADER_SOURCE_FILES, SHADER_FILES);
 }
 
 Editor::~Editor()
@@ -251,6 +571,7 @@ Editor::~Editor()
     SafeDeviceAccessor::Get()->WaitIdle();
 
     AssetsManager::Get()->UnloadAll();
+    _instanceBuffer.reset();
 
     ImGui_ImplVulkan_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -295,7 +616,7 @@ void Editor::Render()
                 ImGui::MenuItem("editor preferences", nullptr, &showEditorSettings);
                 if (ImGui::MenuItem("reload shaders"))
                 {
-                    _rebuild();
+                    RenderManager::Get()->GetGraph(_windowID)->ReloadShaders();
                 }
 
                 ImGui::EndMenu();
@@ -352,6 +673,108 @@ void Editor::Render()
             ImGui::EndCombo();
         }
         frost::RenderEditor(frost::Meta<Environment>{}, _environments[_selectedEnvironment].second.get());
+
+        ImGui::SeparatorText("Ambient Occlusion");
+        ImGui::SliderFloat("radius", &_ssaoRadius, .01f, 1.f);
+        ImGui::Checkbox("temporal accumulation", &_isSsaoTemporal);
+
+        ImGui::SeparatorText("Render Targets");
+        if (ImGui::Checkbox("reference formats", &_isUsingReferenceFormats))
+        {
+            _deferredQueue.push_back([this]() {
+                _useReferenceFormats(_isUsingReferenceFormats);
+                _rebuild();
+            });
+        }
+        ImGui::SetItemTooltip("renders color, prepass and post process in R16G16B16A16Sfloat, to compare against");
+
+        ImGui::BeginDisabled(_isUsingReferenceFormats || _comparisonFrames > 0u);
+        if (ImGui::Button("compare"))
+        {
+            _deferredQueue.push_back([this]() { StartComparison(); });
+        }
+        ImGui::EndDisabled();
+        ImGui::SetItemTooltip("measures the packed formats against the reference ones, keep the camera still");
+        if (_comparisonPsnr >= 0.f)
+        {
+            ImGui::SameLine();
+            ImGui::Text("max error %.4f, psnr %.2f dB", _comparisonMaxError, _comparisonPsnr);
+        }
+
+        ImGui::SeparatorText("Recording");
+        bool isRecordingThreaded = RenderManager::Get()->GetGraph(_windowID)->IsRecordingThreaded();
+        if (ImGui::Checkbox("threaded recording", &isRecordingThreaded))
+        {
+            _deferredQueue.push_back([this, isRecordingThreaded]() {
+                RenderManager::Get()->GetGraph(_windowID)->SetThreadedRecording(isRecordingThreaded);
+            });
+        }
+        ImGui::SetItemTooltip("records passes into secondary command buffers on the worker threads, not yet validated "
+                              "under synchronization validation, passes record inline into the frame otherwise");
+
+        ImGui::SeparatorText("Culling");
+        bool isGpuCulling = _isGpuCulling;
+        if (ImGui::Checkbox("gpu culling", &isGpuCulling))
+        {
+            _deferredQueue.push_back([this, isGpuCulling]() { _isGpuCulling = isGpuCulling; });
+        }
+        ImGui::SetItemTooltip("culls every view against its frustum and the camera's against last frame's depth in a "
+                              "compute pass, opaque and masked draws then come from its indirect commands");
+        ImGui::Checkbox("occlusion culling", &_isOcclusionCulling);
+        ImGui::SetItemTooltip("skips the draws hidden behind the largest opaque meshes, rasterized on the cpu, for "
+                              "blended draws and opaque ones without gpu culling");
+        if (_isOcclusionCulling)
+        {
+            ImGui::Text("%u occluder triangles", _occlusionBuffer->GetTriangleCount());
+        }
+
+        ImGui::SeparatorText("Selection");
+        if (_selectedIndex >= 0)
+        {
+            ImGui::Text("draw %d, primitive %u", _selectedIndex, _selectedPrimitive);
+
+            uint32_t const index = static_cast<uint32_t>(_selectedIndex);
+            Transform transform = _scene->GetTransform(index);
+            glm::vec3 position = transform.GetPosition();
+            glm::vec3 scale = transform.GetScale();
+            bool isMoved = ImGui::DragFloat3("position", &position.x, .1f);
+            isMoved |= ImGui::DragFloat3("scale", &scale.x, .01f);
+            if (isMoved)
+            {
+                transform.SetPosition(position);
+                transform.SetScale(scale);
+                _deferredQueue.push_back([this, index, transform]() { SetTransform(index, transform); });
+            }
+        }
+        else
+        {
+            ImGui::TextDisabled("click the viewport to pick");
+        }
+        ImGui::Text("picked in %.3f ms", _pickTime);
+
+        ImGui::SeparatorText("Resolution");
+        bool isResolutionChanged = ImGui::Checkbox("dynamic", &_isResolutionDynamic);
+        if (_isResolutionDynamic)
+        {
+            isResolutionChanged |= ImGui::SliderFloat("frame budget", &_frameBudget, 2.f, 33.3f, "%.1f ms");
+        }
+        else
+        {
+            isResolutionChanged |= ImGui::SliderFloat("render scale", &_renderScale, MIN_RENDER_SCALE, 1.f);
+        }
+        if (isResolutionChanged)
+        {
+            _deferredQueue.push_back([this]() {
+                Graph *graph = RenderManager::Get()->GetGraph(_windowID);
+                graph->SetFrameBudget(_isResolutionDynamic ? _frameBudget : 0.f);
+                if (!_isResolutionDynamic)
+                {
+                    graph->SetRenderScale(_renderScale);
+                }
+            });
+        }
+        Graph const *graph = RenderManager::Get()->GetGraph(_windowID);
+        ImGui::Text("%.2f ms of gpu time at %.0f%%", graph->GetGpuTime(), graph->GetRenderScale() * 100.f);
         ImGui::End();
 
         if (showContentBrowser)
@@ -377,20 +800,105 @@ void Editor::Render()
     RenderManager::Get()->EndRender(commandBuffer, _windowID);
 }
 
+void Editor::StartComparison()
+{
+    RenderManager::Get()->GetGraph(_windowID)->ReadTarget(&_packedPixels);
+
+    _useReferenceFormats(true);
+    _rebuild();
+    _comparisonFrames = FORMAT_COMPARISON_FRAMES;
+}
+
+void Editor::FinishComparison()
+{
+    std::vector<float> referencePixels;
+    RenderManager::Get()->GetGraph(_windowID)->ReadTarget(&referencePixels);
+
+    _useReferenceFormats(_isUsingReferenceFormats);
+    _rebuild();
+
+    if (referencePixels.size() != _packedPixels.size())
+    {
+        spdlog::warn("Editor: the render extent changed while comparing formats, keep the resolution fixed");
+    }
+    else
+    {
+        MeasureError(_packedPixels, referencePixels, &_comparisonMaxError, &_comparisonPsnr);
+        spdlog::info("Editor: packed formats against the reference ones, max error {:.4f}, psnr {:.2f} dB",
+                     _comparisonMaxError, _comparisonPsnr);
+    }
+
+    _packedPixels.clear();
+}
+
 void Editor::Update(double dt)
 {
+    // before deferred changes to it, this is the scale the last frame was drawn at
+    _previousRenderScale = RenderManager::Get()->GetGraph(_windowID)->GetRenderScale();
+
     _inputManager->PollEvents(dt);
 
+    Scene *const movedScene = _scene;
+    std::vector<uint32_t> const movedDraws = std::move(_movedDraws);
+    _movedDraws.clear();
+
     for (std::function<void()> const &func : _deferredQueue)
     {
         func();
     }
     _deferredQueue.clear();
 
+    if (_comparisonFrames > 0u && --_comparisonFrames == 0u)
+    {
+        FinishComparison();
+    }
+
+    // draws moved last frame and not since are in the depth it drew, they're occlusion tested against it again
+    for (uint32_t const index : movedDraws)
+    {
+        if (_scene == movedScene && std::find(_movedDraws.begin(), _movedDraws.end(), index) == _movedDraws.end())
+        {
+            _scene->SettleTransform(index);
+            WriteDrawInstances(index);
+        }
+    }
+
+    if (_scene)
+    {
+        _scene->Refit();
+    }
+
+    if (std::set<std::string> const shaderFiles = _shaderWatcher->PopCompiled(); !shaderFiles.empty())
+    {
+        RenderManager::Get()->GetGraph(_windowID)->ReloadShaders(shaderFiles);
+    }
+
     _deltaTime = dt;
 
+    _previousViewProjection = _viewportCamera->GetCamera()->GetProjection() * _viewportCamera->GetCamera()->GetView();
+    _frame++;
+
     // _viewportCamera->Orbit({40.f * dt, 0.});
     _viewportCamera->Refresh();
+    _environments[_selectedEnvironment].second->FitCascades(*_viewportCamera->GetCamera());
+
+    if (_scene)
+    {
+        _scene->SortBlended(_viewportCamera->GetCamera()->GetPosition());
+    }
+
+    // with gpu culling, only the blended draws are tested against it
+    bool const isOcclusionQueried = _scene && _isOcclusionCulling && (!_isGpuCulling || _scene->HasBlended());
+    if (isOcclusionQueried)
+    {
+        _scene->RenderOccluders(_occlusionBuffer.get(),
+                                _viewportCamera->GetCamera()->GetProjection() * _viewportCamera->GetCamera()->GetView(),
+                                _viewportCamera->GetCamera()->GetPosition());
+    }
+    else if (_occlusionBuffer->GetTriangleCount() > 0u)
+    {
+        _occlusionBuffer->Clear(); // once, so a stale buffer isn't shown
+    }
 }
 
 void Editor::PopulateUbo(ubo::Ubo *ubo) const
@@ -406,11 +914,25 @@ void Editor::PopulateUbo(ubo::Ubo *ubo) const
     ubo->camera.projection = _viewportCamera->GetCamera()->GetProjection();
     ubo->camera.inverseView = glm::inverse(_viewportCamera->GetCamera()->GetView());
     ubo->camera.inverseProjection = glm::inverse(_viewportCamera->GetCamera()->GetProjection());
+    ubo->camera.previousViewProjection = _previousViewProjection;
     ubo->camera.position = _viewportCamera->GetCamera()->GetPosition();
+    ubo->camera.frame = _frame;
+    ubo->camera.renderScale = RenderManager::Get()->GetGraph(_windowID)->GetRenderScale();
+    ubo->camera.previousRenderScale = _previousRenderScale;
+
+    // accumulating over frames lets each one take a quarter of the samples
+    ubo->ssao.radius = _ssaoRadius;
+    ubo->ssao.historyWeight = _isSsaoTemporal ? .9f : 0.f;
+    ubo->ssao.sampleCount = _isSsaoTemporal ? 4 : 16;
 
     check(_environments[_selectedEnvironment].second);
     _environments[_selectedEnvironment].second->PopulateUbo(ubo);
 
+    if (_scene)
+    {
+        _scene->PopulateUbo(ubo);
+    }
+
     auto const &materialInfos = AssetsManager::Get()->GetMaterialInfos();
     memcpy(ubo->materials, materialInfos.data(), materialInfos.size() * sizeof(ubo::Material));
 }
@@ -419,6 +941,7 @@ void Editor::OnLeftClick(double dt, int value)
 {
     if (_isHoveringViewport && value)
     {
+        Pick();
         _viewportCamera->Possess(ViewportCamera::PossessionMode::eOrbit);
         _inputManager->SetMouseCapture(true);
     }
@@ -429,6 +952,79 @@ void Editor::OnLeftClick(double dt, int value)
     }
 }
 
+void Editor::Pick()
+{
+    if (!_scene)
+    {
+        return;
+    }
+
+    check(_viewportCamera);
+    check(_viewportCamera->GetCamera());
+
+    // from the near plane to the far one, so the far plane is at a distance of 1
+    glm::mat4 const inverseViewProjection =
+        glm::inverse(_viewportCamera->GetCamera()->GetProjection() * _viewportCamera->GetCamera()->GetView());
+    glm::vec2 const ndc = _viewportCursor * 2.f - 1.f;
+    glm::vec4 const nearPoint = inverseViewProjection * glm::vec4{ndc, 0.f, 1.f};
+    glm::vec4 const farPoint = inverseViewProjection * glm::vec4{ndc, 1.f, 1.f};
+
+    Ray ray{};
+    ray.origin = glm::vec3{nearPoint} / nearPoint.w;
+    ray.direction = glm::vec3{farPoint} / farPoint.w - ray.origin;
+
+    auto const start = std::chrono::steady_clock::now();
+
+    Scene::Hit hit;
+    bool const isHit = _scene->Raycast(ray, &hit, 1.f);
+
+    std::chrono::duration<float, std::milli> const duration = std::chrono::steady_clock::now() - start;
+    _pickTime = duration.count();
+
+    _selectedIndex = isHit ? static_cast<int>(hit.index) : -1;
+    _selectedPrimitive = isHit ? hit.primitive : 0u;
+}
+
+void Editor::SetTransform(uint32_t index, Transform const &transform)
+{
+    check(_scene);
+
+    _scene->SetTransform(index, transform);
+    WriteDrawInstances(index);
+
+    if (std::find(_movedDraws.begin(), _movedDraws.end(), index) == _movedDraws.end())
+    {
+        _movedDraws.push_back(index);
+    }
+    _dirtyShadowMaps = ~0u;
+}
+
+void Editor::WriteDrawInstances(uint32_t index)
+{
+    check(_scene);
+
+    auto const [first, end] = _scene->GetInstanceRange(index);
+    if (first < end)
+    {
+        _instanceBuffer->WriteRange(&_scene->GetInstances()[first], first * sizeof(Scene::Instance),
+                                    (end - first) * sizeof(Scene::Instance));
+    }
+}
+
+void Editor::WriteInstances()
+{
+    check(_scene);
+
+    std::vector<Scene::Instance> const &instances = _scene->GetInstances();
+    if (!instances.empty())
+    {
+        _instanceBuffer->Write(instances.data(), instances.size() * sizeof(Scene::Instance));
+    }
+
+    _dirtyShadowMaps = ~0u;
+    _isHiZStale = true;
+}
+
 void Editor::OnRightClick(double dt, int value)
 {
     if (_isHoveringViewport && value)
@@ -512,7 +1108,19 @@ void Editor::RenderViewport(bool *show)
 
     ImVec2 const size = ImGui::GetContentRegionAvail();
     static ImVec2 oldSize = ImVec2(10, 10);
-    ImGui::Image((ImTextureID)(graph->GetTargetDescriptorSet().operator VkDescriptorSet()), size);
+
+    ImVec2 const imagePosition = ImGui::GetCursorScreenPos();
+    ImVec2 const mousePosition = ImGui::GetIO().MousePos;
+    if (size.x > 0.f && size.y > 0.f)
+    {
+        _viewportCursor = glm::vec2{(mousePosition.x - imagePosition.x) / size.x,
+                                    (mousePosition.y - imagePosition.y) / size.y};
+    }
+
+    // stretches the part of the target drawn to under the render scale over the whole viewport
+    float const renderScale = graph->GetRenderScale();
+    ImGui::Image((ImTextureID)(graph->GetTargetDescriptorSet().operator VkDescriptorSet()), size, ImVec2{0.f, 0.f},
+                 ImVec2{renderScale, renderScale});
     if (oldSize.x != size.x && oldSize.y != size.y)
     {
         _deferredQueue.push_back([=]() {
@@ -612,6 +1220,9 @@ void Editor::RenderContentBrowser(bool *show)
                                 relativePath.extension().compare(".glb") == 0)
                             {
                                 _scene = assetsManager->ImportGlTF(relativePath);
+                                _selectedIndex = -1;
+                                _movedDraws.clear();
+                                WriteInstances();
 
                                 _viewportCamera->SetOrbitPoint({0.f, 0.f, 0.f});
 
@@ -721,6 +1332,20 @@ void Editor::RenderFrameInfoMenuBar() const
         break; // one heap only
     }
 
+    Graph::PassStats shadowMapStats{};
+    for (Pass const shadowMapPass : _shadowMapPasses)
+    {
+        Graph::PassStats const stats = RenderManager::Get()->GetGraph(_windowID)->GetStats(shadowMapPass);
+        shadowMapStats.runs += stats.runs;
+        shadowMapStats.skips += stats.skips;
+    }
+    uint64_t const shadowMapFrames = shadowMapStats.runs + shadowMapStats.skips;
+
+    ImGui::SameLine();
+    ImGui::TextUnformatted("Shadow map cached:");
+    ImGui::SameLine();
+    ImGui::Text("%.1f%%", shadowMapFrames > 0 ? 100. * shadowMapStats.skips / shadowMapFrames : 0.);
+
     ImGui::SameLine();
     wsp::YellowText(device->GetDeviceName().c_str());
 }
@@ -729,6 +1354,7 @@ void Editor::SelectEnvironment(int i)
 {
     check(i < _environments.size());
     _selectedEnvironment = i;
+    _dirtyShadowMaps = ~0u;
 
     _environments[i].second->Load();
 }
@@ -3,17 +3,25 @@
 
 #include <wsp_devkit.hpp>
 
+#include <wsp_constants.hpp>
 #include <wsp_handles.hpp>
 #include <wsp_typedefs.hpp>
 
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
 #include <vulkan/vulkan.hpp>
 
+#include <array>
 #include <functional>
 #include <memory>
 
 #define REGULAR_FONT 0u
 #define THUMBNAILS_FONT 1u
 
+#define SSAO_SCREEN_DIVISOR 2u // 4u for quarter resolution
+
+#define FORMAT_COMPARISON_FRAMES 8u // rendered in the reference formats before reading back, for history to settle
+
 struct ImFont;
 
 namespace wsp
@@ -48,6 +56,7 @@ class Editor
     static void RenderDockspace();
     void RenderViewport(bool *show);
     bool _isHoveringViewport;
+    glm::vec2 _viewportCursor; // over the viewport image, from 0 to 1
 
     void RenderContentBrowser(bool *show);
     void RenderFrameInfoMenuBar() const;
@@ -63,12 +72,54 @@ class Editor
 
     class Scene *_scene;
 
+    void Pick(); // the scene's nearest primitive under the cursor, through its bvh
+    void SetTransform(uint32_t index, class Transform const &); // of a draw list entry, between frames
+    void WriteInstances(); // the scene's instances, everything drawn from the previous ones is redrawn
+    void WriteDrawInstances(uint32_t index); // a draw list entry's, copied in by the next frame
+    std::vector<uint32_t> _movedDraws;       // by this frame's SetTransform, settled by the next frame
+    int _selectedIndex; // into the scene's draw list, -1 without a selection
+    uint32_t _selectedPrimitive;
+    float _pickTime; // in milliseconds, of the last pick
+
+    std::unique_ptr<class OcclusionBuffer> _occlusionBuffer; // rasterized in Update, tested by the next frame's draws
+    bool _isOcclusionCulling;
+
+    std::unique_ptr<class StaticBuffer> _instanceBuffer; // the scene's instances, written on import and edits
+    bool _isGpuCulling; // changed between frames, the culling pass and the draws must agree on it
+    bool _isHiZStale;   // last frame's depth is of the previous scene
+
+    std::vector<Pass> _shadowMapPasses; // one per cascade
+    uint32_t _dirtyShadowMaps;          // a bit per cascade, on scene or environment changes
+    std::array<glm::mat4, SHADOW_CASCADE_COUNT> _shadowMapViewProjections; // as last rendered
+
     class Sampler *_previewSampler;
 
     std::function<void()> _rebuild;
+    std::unique_ptr<class ShaderWatcher> _shaderWatcher;
 
     double _deltaTime; // dont depend on it, just for rendering fps to editor
 
+    float _ssaoRadius;
+    bool _isSsaoTemporal;
+
+    std::function<void(bool isReference)> _useReferenceFormats;
+    bool _isUsingReferenceFormats; // instead of the packed ones, to validate them
+
+    void StartComparison();           // reads back the packed target, then renders in the reference formats
+    void FinishComparison();          // reads back the reference target, measures the packed one against it
+    std::vector<float> _packedPixels; // held while the reference formats render
+    uint32_t _comparisonFrames;       // left to render in the reference formats, 0 without a comparison
+    float _comparisonMaxError;        // of any color channel, in the target's units
+    float _comparisonPsnr;            // in dB, negative until measured
+
+    bool _isResolutionDynamic;
+    float _frameBudget; // in milliseconds, of gpu time
+    float _renderScale; // when not dynamic
+    float _previousRenderScale;
+
+    glm::mat4 _previousViewProjection;
+    uint32_t _frame;
+
     WindowID _windowID;
 };
 
@@ -5,6 +5,8 @@
 #include <wsp_image.hpp>
 #include <wsp_static_textures.hpp>
 
+#include <glm/common.hpp>
+#include <glm/exponential.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include <spdlog/spdlog.h>
@@ -14,7 +16,8 @@ using namespace wsp;
 Environment::Environment(std::filesystem::path const &skyboxPath, std::filesystem::path const &irradiancePath,
                          glm::vec2 const &sunDirection, glm::vec3 const &color, float sunIntensity)
     : _skyboxPath{skyboxPath}, _irradiancePath{irradiancePath}, _sunDirection{sunDirection}, _sunColor{color},
-      _sunIntensity{sunIntensity}, _shadowMapRadius{30.f}, _skyboxTexture{0}, _irradianceTexture{0}
+      _sunIntensity{sunIntensity}, _shadowMapRadius{30.f}, _cascadeViewProjections{}, _cascadeSplits{0.f},
+      _skyboxTexture{0}, _irradianceTexture{0}
 {
     Refresh();
 }
@@ -68,7 +71,11 @@ void Environment::PopulateUbo(ubo::Ubo *ubo) const
     ubo->light.sun.direction = glm::normalize(_sunSource);
     ubo->light.sun.color = _sunColor;
     ubo->light.sun.intensity = _sunIntensity;
-    ubo->light.sun.viewProjection = _shadowMapCamera.GetProjection() * _shadowMapCamera.GetView();
+    for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+    {
+        ubo->light.sun.cascadeViewProjections[cascade] = _cascadeViewProjections[cascade];
+    }
+    ubo->light.sun.cascadeSplits = _cascadeSplits;
     ubo->light.skybox = staticCubemaps->GetID(_skyboxTexture);
     ubo->light.irradiance = staticCubemaps->GetID(_irradianceTexture);
     ubo->light.rotation = glm::radians(_rotation);
@@ -80,6 +87,80 @@ void Environment::SetShadowMapRadius(float shadowMapRadius)
     Refresh();
 }
 
+void Environment::FitCascades(Camera const &view)
+{
+    glm::mat4 const inverseViewProjection = glm::inverse(view.GetProjection() * view.GetView());
+
+    std::array<glm::vec3, 4> nearCorners;
+    std::array<glm::vec3, 4> farCorners;
+    glm::vec2 const screenCorners[4] = {{-1.f, -1.f}, {1.f, -1.f}, {-1.f, 1.f}, {1.f, 1.f}};
+    for (int i = 0; i < 4; i++)
+    {
+        glm::vec4 const nearCorner = inverseViewProjection * glm::vec4{screenCorners[i], 0.f, 1.f};
+        glm::vec4 const farCorner = inverseViewProjection * glm::vec4{screenCorners[i], 1.f, 1.f};
+        nearCorners[i] = glm::vec3{nearCorner} / nearCorner.w;
+        farCorners[i] = glm::vec3{farCorner} / farCorner.w;
+    }
+
+    float const nearDepth = glm::abs((view.GetView() * glm::vec4{nearCorners[0], 1.f}).z);
+    float const farDepth = glm::abs((view.GetView() * glm::vec4{farCorners[0], 1.f}).z);
+    float const shadowDepth = glm::min(farDepth, _shadowMapRadius);
+
+    Camera sunCamera{};
+    sunCamera.LookTowards(glm::vec3{0.f}, _sunSource);
+
+    float sliceNear = nearDepth;
+    for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+    {
+        // blends uniform and logarithmic splits, leaning logarithmic to keep detail close to the view
+        float const ratio = (cascade + 1.f) / SHADOW_CASCADE_COUNT;
+        float const sliceFar = glm::mix(nearDepth + (shadowDepth - nearDepth) * ratio,
+                                        nearDepth * glm::pow(shadowDepth / nearDepth, ratio), .75f);
+
+        std::array<glm::vec3, 8> corners;
+        glm::vec3 center{0.f};
+        for (int i = 0; i < 4; i++)
+        {
+            corners[i] = glm::mix(nearCorners[i], farCorners[i], (sliceNear - nearDepth) / (farDepth - nearDepth));
+            corners[i + 4] = glm::mix(nearCorners[i], farCorners[i], (sliceFar - nearDepth) / (farDepth - nearDepth));
+            center += corners[i] + corners[i + 4];
+        }
+        center /= 8.f;
+
+        // a bounding sphere keeps the cascade the same size however the view turns
+        float radius = 0.f;
+        for (glm::vec3 const &corner : corners)
+        {
+            radius = glm::max(radius, glm::length(corner - center));
+        }
+        radius = glm::ceil(radius * 16.f) / 16.f;
+
+        // and moving by whole texels only keeps its edges from shimmering
+        float const texelSize = 2.f * radius / SHADOW_MAP_RESOLUTION;
+        glm::vec3 sunCenter = glm::vec3{sunCamera.GetView() * glm::vec4{center, 1.f}};
+        sunCenter.x = glm::floor(sunCenter.x / texelSize) * texelSize;
+        sunCenter.y = glm::floor(sunCenter.y / texelSize) * texelSize;
+        center = glm::vec3{glm::inverse(sunCamera.GetView()) * glm::vec4{sunCenter, 1.f}};
+
+        float const depth = radius + _shadowMapRadius; // casters outside of the slice still reach it
+
+        Camera cascadeCamera{};
+        cascadeCamera.SetOrthographicProjection(-radius, radius, radius, -radius, -depth, depth);
+        cascadeCamera.LookTowards(center, _sunSource);
+
+        _cascadeViewProjections[cascade] = cascadeCamera.GetProjection() * cascadeCamera.GetView();
+        _cascadeSplits[cascade] = sliceFar;
+
+        sliceNear = sliceFar;
+    }
+}
+
+glm::mat4 const &Environment::GetCascadeViewProjection(uint32_t cascade) const
+{
+    check(cascade < SHADOW_CASCADE_COUNT);
+    return _cascadeViewProjections[cascade];
+}
+
 void Environment::Refresh()
 {
     glm::vec3 source =
@@ -94,7 +175,4 @@ void Environment::Refresh()
         glm::normalize(cosX * source + (glm::cross(up, source) * sinX) + (up * glm::dot(up, source) * (1.f - cosX)));
 
     _sunSource = source;
-    _shadowMapCamera.SetOrthographicProjection(-_shadowMapRadius, _shadowMapRadius, _shadowMapRadius, -_shadowMapRadius,
-                                               -_shadowMapRadius, _shadowMapRadius);
-    _shadowMapCamera.LookTowards(glm::vec3{0.f}, _sunSource);
 }
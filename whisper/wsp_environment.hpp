@@ -10,6 +10,7 @@
 #include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 
+#include <array>
 #include <filesystem>
 
 #include <.generated/wsp_environment.generated.hpp>
@@ -30,6 +31,9 @@ class Environment
     void PopulateUbo(ubo::Ubo *) const;
     void SetShadowMapRadius(float);
 
+    void FitCascades(Camera const &view); // every frame, the cascades follow the view
+    glm::mat4 const &GetCascadeViewProjection(uint32_t cascade) const;
+
     WCLASS_BODY$Environment();
 
   protected:
@@ -40,8 +44,9 @@ class Environment
     glm::vec3 _sunSource;
 
     WPROPERTY(eSlider, 1.f, 100.f)
-    float _shadowMapRadius;
-    Camera _shadowMapCamera;
+    float _shadowMapRadius; // how far from the view shadows reach
+    std::array<glm::mat4, SHADOW_CASCADE_COUNT> _cascadeViewProjections;
+    glm::vec4 _cascadeSplits;
 
     WPROPERTY(eColor)
     glm::vec3 _sunColor;
@@ -19,8 +19,12 @@ struct Camera
     glm::mat4 projection;
     glm::mat4 inverseView;
     glm::mat4 inverseProjection;
+    glm::mat4 previousViewProjection; // for reprojecting into last frame
     glm::vec3 position;
-    float _pad0;
+    uint32_t frame;
+    float renderScale{1.f}; // of screen sized images, the part of them drawn to
+    float previousRenderScale{1.f};
+    glm::vec2 _pad0;
 };
 
 struct Sun
@@ -29,7 +33,18 @@ struct Sun
     float _pad0;
     glm::vec3 color{1.f};
     float intensity{10.f}; // will be color.w
-    glm::mat4 viewProjection{};
+    glm::mat4 cascadeViewProjections[SHADOW_CASCADE_COUNT]{};
+    glm::vec4 cascadeSplits{}; // far view depth of each cascade
+};
+
+struct PunctualLight // KHR_lights_punctual point and spot lights
+{
+    glm::vec3 position;
+    float range;
+    glm::vec3 color; // premultiplied by intensity
+    float spotScale; // cone attenuation is saturate(dot(direction, -L) * spotScale + spotOffset)^2
+    glm::vec3 direction;
+    float spotOffset; // 0 and 1 for point lights
 };
 
 struct Light
@@ -38,6 +53,15 @@ struct Light
     int skybox = INVALID_ID;
     int irradiance = INVALID_ID;
     float rotation;
+    int punctualLightCount{0};
+    PunctualLight punctualLights[MAX_PUNCTUAL_LIGHTS];
+};
+
+struct Ssao
+{
+    float radius{.1f};
+    float historyWeight{0.f}; // how much of last frame is kept, 0 without temporal accumulation
+    int sampleCount{16};
     float _pad0;
 };
 
@@ -49,9 +73,9 @@ struct Material
     int occlusionMap = INVALID_ID;
 
     glm::vec3 albedoColor{1.f};
-    float _pad0;
+    float alpha{1.f};
     glm::vec3 fresnelColor{1.f};
-    float _pad1;
+    float alphaCutoff{.5f};
     glm::vec3 specularColor{.04f};
     float ior;
 
@@ -65,6 +89,7 @@ struct Ubo
 {
     Camera camera;
     Light light;
+    Ssao ssao;
     Material materials[MAX_MATERIALS];
 };
 
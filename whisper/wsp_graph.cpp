@@ -9,10 +9,12 @@
 #include <wsp_render_manager.hpp>
 #include <wsp_renderer.hpp>
 #include <wsp_sampler.hpp>
+#include <wsp_static_buffer.hpp>
 #include <wsp_static_textures.hpp>
 #include <wsp_static_utils.hpp>
 #include <wsp_swapchain.hpp>
 #include <wsp_texture.hpp>
+#include <wsp_thread_pool.hpp>
 
 #include <client/TracyScoped.hpp>
 #include <tracy/TracyC.h>
@@ -22,8 +24,14 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
 #include <optional>
 #include <stdexcept>
+#include <string_view>
+#include <thread>
 #ifdef _WIN32
 #include <direct.h>
 #include <io.h>
@@ -41,13 +49,20 @@ uint32_t const Graph::SAMPLER_COLOR_REPEATED{2};
 
 Graph::Graph(uint32_t width, uint32_t height)
     : _passInfos{}, _resourceInfos{}, _passes{}, _resources{}, _target{0}, _width{width}, _height{height}, _uboSize{0},
-      _uboDescriptorSets{}, _uboBuffers{}, _uboDeviceMemories{}, _currentFrameIndex{0}
+      _uboDescriptorSets{}, _uboBuffers{}, _uboDeviceMemories{}, _currentFrameIndex{0}, _timestampPool{},
+      _isTimed{}, _timestampPeriod{0.f}, _gpuTime{0.f}, _frameBudget{0.f}, _renderScale{1.f}, _targetRenderScale{1.f},
+      _isRecordingThreaded{false}
 {
     Device const *device = SafeDeviceAccessor::Get();
     check(device);
 
     BuildSamplers(device);
     BuildDescriptorPool();
+
+    _threadPool = new ThreadPool{std::clamp(std::thread::hardware_concurrency(), 1u, (uint32_t)MAX_RECORDING_THREADS)};
+    _reloadPool = new ThreadPool{1u}; // apart from the recording threads, which Render waits on every frame
+    BuildRecordingContexts();
+    BuildTimestamps();
 }
 
 void Graph::BuildSamplers(Device const *device)
@@ -71,20 +86,27 @@ void Graph::BuildDescriptorPool()
     Device const *device = SafeDeviceAccessor::Get();
     check(device);
 
-    vk::DescriptorPoolSize descriptorPoolSize{};
-    descriptorPoolSize.descriptorCount = MAX_DYNAMIC_TEXTURES;
-    descriptorPoolSize.type = vk::DescriptorType::eCombinedImageSampler;
+    std::array<vk::DescriptorPoolSize, 4> descriptorPoolSizes{};
+    descriptorPoolSizes[0].descriptorCount = MAX_DYNAMIC_TEXTURES;
+    descriptorPoolSizes[0].type = vk::DescriptorType::eCombinedImageSampler;
+    descriptorPoolSizes[1].descriptorCount = MAX_DYNAMIC_TEXTURES;
+    descriptorPoolSizes[1].type = vk::DescriptorType::eInputAttachment;
+    descriptorPoolSizes[2].descriptorCount = MAX_DYNAMIC_TEXTURES;
+    descriptorPoolSizes[2].type = vk::DescriptorType::eStorageImage;
+    descriptorPoolSizes[3].descriptorCount = MAX_DYNAMIC_TEXTURES;
+    descriptorPoolSizes[3].type = vk::DescriptorType::eStorageBuffer;
 
     vk::DescriptorPoolCreateInfo descriptorPoolInfo{};
     descriptorPoolInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
-    descriptorPoolInfo.maxSets = MAX_DYNAMIC_TEXTURES;
-    descriptorPoolInfo.poolSizeCount = 1u;
-    descriptorPoolInfo.pPoolSizes = &descriptorPoolSize;
+    descriptorPoolInfo.maxSets = MAX_DYNAMIC_TEXTURES * static_cast<uint32_t>(descriptorPoolSizes.size());
+    descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());
+    descriptorPoolInfo.pPoolSizes = descriptorPoolSizes.data();
 
     device->CreateDescriptorPool(descriptorPoolInfo, &_descriptorPool, "_graph_descriptor_pool");
 
     std::vector<vk::DescriptorSetLayoutBinding> descriptorSetLayoutBindings{
-        {0u, vk::DescriptorType::eCombinedImageSampler, 1u, {vk::ShaderStageFlagBits::eFragment}}};
+        {0u, vk::DescriptorType::eCombinedImageSampler, 1u,
+         vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute}};
 
     vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
     descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(descriptorSetLayoutBindings.size());
@@ -92,22 +114,255 @@ void Graph::BuildDescriptorPool()
 
     device->CreateDescriptorSetLayout(descriptorSetLayoutInfo, &_descriptorSetLayout, "_graph_descriptor_set_layout");
 
+    descriptorSetLayoutBindings[0].descriptorType = vk::DescriptorType::eInputAttachment;
+    descriptorSetLayoutBindings[0].stageFlags = vk::ShaderStageFlagBits::eFragment;
+
+    device->CreateDescriptorSetLayout(descriptorSetLayoutInfo, &_inputDescriptorSetLayout,
+                                      "_graph_input_descriptor_set_layout");
+
+    descriptorSetLayoutBindings[0].descriptorType = vk::DescriptorType::eStorageImage;
+    descriptorSetLayoutBindings[0].stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+    device->CreateDescriptorSetLayout(descriptorSetLayoutInfo, &_storageImageDescriptorSetLayout,
+                                      "_graph_storage_image_descriptor_set_layout");
+
+    descriptorSetLayoutBindings[0].descriptorType = vk::DescriptorType::eStorageBuffer;
+    descriptorSetLayoutBindings[0].stageFlags =
+        vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment;
+
+    device->CreateDescriptorSetLayout(descriptorSetLayoutInfo, &_storageBufferDescriptorSetLayout,
+                                      "_graph_storage_buffer_descriptor_set_layout");
+
     spdlog::debug("Graph: built descriptor pool");
 }
 
+void Graph::BuildRecordingContexts()
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+    check(_threadPool);
+
+    _recordingContexts.resize(_threadPool->GetThreadCount());
+
+    vk::CommandPoolCreateInfo poolInfo{};
+    poolInfo.queueFamilyIndex = device->GetGraphicsQueueFamilyIndex();
+    poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
+
+    for (uint32_t thread = 0; thread < _recordingContexts.size(); thread++)
+    {
+        RecordingContext &context = _recordingContexts[thread];
+
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            device->CreateCommandPool(poolInfo, &context.commandPools[i],
+                                      fmt::format("<graph_command_pool>({}, {})", thread, i));
+            context.commandBuffers[i].clear();
+            context.usedCommandBuffers[i] = 0;
+        }
+    }
+
+    poolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+    device->CreateCommandPool(poolInfo, &_cachedCommandPool, "<graph_cached_command_pool>");
+
+    spdlog::debug("Graph: built {} recording contexts", _recordingContexts.size());
+}
+
+void Graph::FreeRecordingContexts()
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    for (RecordingContext &context : _recordingContexts)
+    {
+        for (vk::CommandPool &commandPool : context.commandPools)
+        {
+            device->DestroyCommandPool(&commandPool); // frees its command buffers too
+        }
+    }
+    _recordingContexts.clear();
+
+    device->DestroyCommandPool(&_cachedCommandPool);
+
+    spdlog::debug("Graph: freed recording contexts");
+}
+
+void Graph::BuildTimestamps()
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    _timestampPeriod = device->GetTimestampPeriod();
+    if (_timestampPeriod == 0.f)
+    {
+        spdlog::warn("Graph: graphics queue can't write timestamps, the frame budget goes unused");
+        return;
+    }
+
+    vk::QueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.queryType = vk::QueryType::eTimestamp;
+    queryPoolInfo.queryCount = 2u * MAX_FRAMES_IN_FLIGHT;
+
+    device->CreateQueryPool(queryPoolInfo, &_timestampPool, "<graph_timestamp_pool>");
+    _isTimed.fill(false);
+
+    spdlog::debug("Graph: built timestamps");
+}
+
+void Graph::FreeTimestamps()
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    if (_timestampPool != VK_NULL_HANDLE)
+    {
+        device->DestroyQueryPool(&_timestampPool);
+    }
+}
+
+void Graph::MeasureGpuTime()
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    if (!_isTimed[_currentFrameIndex])
+    {
+        return;
+    }
+
+    std::array<uint64_t, 2> timestamps{};
+    if (device->GetQueryPoolResults(_timestampPool, 2u * _currentFrameIndex, 2u, timestamps.data()) &&
+        timestamps[1] >= timestamps[0])
+    {
+        _gpuTime = static_cast<float>(timestamps[1] - timestamps[0]) * _timestampPeriod / 1e6f;
+    }
+}
+
+void Graph::AdjustRenderScale()
+{
+    if (_frameBudget <= 0.f || _gpuTime <= 0.f)
+    {
+        return;
+    }
+
+    // the cost of a frame mostly follows its pixel count, the square of the scale
+    float const scale = std::clamp(_renderScale * std::sqrt(_frameBudget / _gpuTime), MIN_RENDER_SCALE, 1.f);
+    _targetRenderScale += (scale - _targetRenderScale) * RENDER_SCALE_SMOOTHING;
+
+    if (std::abs(_targetRenderScale - _renderScale) < RENDER_SCALE_STEP)
+    {
+        return;
+    }
+
+    _renderScale = std::clamp(std::round(_targetRenderScale / RENDER_SCALE_STEP) * RENDER_SCALE_STEP,
+                              MIN_RENDER_SCALE, 1.f);
+    ApplyRenderScale();
+}
+
+void Graph::SetRenderScale(float renderScale)
+{
+    renderScale = std::clamp(renderScale, MIN_RENDER_SCALE, 1.f);
+    _targetRenderScale = renderScale;
+
+    if (renderScale == _renderScale)
+    {
+        return;
+    }
+
+    _renderScale = renderScale;
+    ApplyRenderScale();
+}
+
+float Graph::GetRenderScale() const
+{
+    return _renderScale;
+}
+
+void Graph::SetFrameBudget(float milliseconds)
+{
+    _frameBudget = std::max(milliseconds, 0.f);
+}
+
+void Graph::SetThreadedRecording(bool isRecordingThreaded)
+{
+    _isRecordingThreaded = isRecordingThreaded;
+}
+
+bool Graph::IsRecordingThreaded() const
+{
+    return _isRecordingThreaded;
+}
+
+float Graph::GetGpuTime() const
+{
+    return _gpuTime;
+}
+
+vk::Extent2D Graph::GetTargetExtent() const
+{
+    return GetRenderExtent(_target);
+}
+
+void Graph::ApplyRenderScale()
+{
+    for (Pass const pass : _orderedPasses)
+    {
+        if (IsCompute(pass) || !IsScreenSized(_passInfos[pass.index].writes.at(0)))
+        {
+            continue;
+        }
+
+        PassHolder &passHolder = _passes[pass.index];
+        vk::Extent2D const extent = GetRenderExtent(pass);
+
+        passHolder.viewport.width = static_cast<float>(extent.width);
+        passHolder.viewport.height = static_cast<float>(extent.height);
+        passHolder.scissor.extent = extent;
+
+        if (passHolder.subpass == 0)
+        {
+            for (vk::RenderPassBeginInfo &renderPassBeginInfo : passHolder.renderPassBeginInfo)
+            {
+                renderPassBeginInfo.renderArea.extent = extent;
+            }
+        }
+
+        // cached command buffers hold the previous viewport, cached passes only drew the previous area
+        passHolder.isCacheValid.fill(false);
+        if (IsCached(pass))
+        {
+            passHolder.pendingRuns = MAX_FRAMES_IN_FLIGHT;
+        }
+    }
+
+    spdlog::debug("Graph: render scale set to {:.2f}", _renderScale);
+}
+
 Graph::~Graph()
 {
     Device const *device = SafeDeviceAccessor::Get();
     check(device);
 
+    delete _reloadPool;
+    for (auto const &[pass, pipelineHolder] : _reloadedPipelines)
+    {
+        RetirePipeline(pipelineHolder);
+    }
+
     device->WaitIdle();
 
     Reset();
 
+    FreeRecordingContexts();
+    FreeTimestamps();
+    delete _threadPool;
+
     delete _depthSampler;
     delete _colorSampler;
 
     device->DestroyDescriptorSetLayout(&_descriptorSetLayout);
+    device->DestroyDescriptorSetLayout(&_inputDescriptorSetLayout);
+    device->DestroyDescriptorSetLayout(&_storageImageDescriptorSetLayout);
+    device->DestroyDescriptorSetLayout(&_storageBufferDescriptorSetLayout);
     device->DestroyDescriptorPool(&_descriptorPool);
 
     spdlog::info("Graph: freed");
@@ -119,8 +374,85 @@ Resource Graph::NewResource(ResourceCreateInfo const &createInfo)
     return Resource{(uint32_t)_resourceInfos.size() - 1};
 }
 
+Resource Graph::GetSubresource(Resource resource, uint32_t mip, uint32_t layer)
+{
+    check(!IsSubresource(resource) && !IsBuffer(resource));
+
+    ResourceCreateInfo const &createInfo = _resourceInfos[resource.index];
+    if (mip >= createInfo.mipLevels || layer >= createInfo.arrayLayers)
+    {
+        throw std::runtime_error(
+            fmt::format("Graph: '{}' has no mip {} in layer {}", createInfo.debugName, mip, layer));
+    }
+
+    for (uint32_t index = 0; index < _resourceInfos.size(); index++)
+    {
+        ResourceCreateInfo const &subresourceInfo = _resourceInfos[index];
+        if (subresourceInfo.parent == resource.index && !subresourceInfo.previous && subresourceInfo.mip == mip &&
+            subresourceInfo.layer == layer)
+        {
+            return Resource{index};
+        }
+    }
+
+    ResourceCreateInfo subresourceInfo = createInfo;
+    subresourceInfo.mipLevels = 1u;
+    subresourceInfo.arrayLayers = 1u;
+    subresourceInfo.parent = resource.index;
+    subresourceInfo.mip = mip;
+    subresourceInfo.layer = layer;
+    subresourceInfo.debugName = fmt::format("{}[{}][{}]", createInfo.debugName, mip, layer);
+
+    _resourceInfos.push_back(subresourceInfo);
+    return Resource{(uint32_t)_resourceInfos.size() - 1};
+}
+
+Resource Graph::GetPrevious(Resource resource)
+{
+    check(!IsSubresource(resource));
+
+    ResourceCreateInfo const &createInfo = _resourceInfos[resource.index];
+    if (!createInfo.history || IsBuffer(resource))
+    {
+        throw std::runtime_error(
+            fmt::format("Graph: '{}' must be an image resource with history to be read at the previous frame",
+                        createInfo.debugName));
+    }
+
+    for (uint32_t index = 0; index < _resourceInfos.size(); index++)
+    {
+        if (_resourceInfos[index].parent == resource.index && _resourceInfos[index].previous)
+        {
+            return Resource{index};
+        }
+    }
+
+    ResourceCreateInfo previousInfo = createInfo;
+    previousInfo.history = false;
+    previousInfo.parent = resource.index;
+    previousInfo.previous = true;
+    previousInfo.debugName = fmt::format("{}@previous", createInfo.debugName);
+
+    _resourceInfos.push_back(previousInfo);
+    return Resource{(uint32_t)_resourceInfos.size() - 1};
+}
+
+void Graph::SetFormat(Resource resource, vk::Format format)
+{
+    check(!IsSubresource(resource) && !IsBuffer(resource));
+
+    for (uint32_t index = 0; index < _resourceInfos.size(); index++)
+    {
+        if (index == resource.index || _resourceInfos[index].parent == resource.index)
+        {
+            _resourceInfos[index].format = format;
+        }
+    }
+}
+
 Pass Graph::NewPass(PassCreateInfo const &createInfo)
 {
+    _reloadPool->Wait(); // reloads read pass infos
     _passInfos.push_back(createInfo);
     _passes.push_back({});
     return Pass{(uint32_t)_passInfos.size() - 1};
@@ -149,6 +481,15 @@ void Graph::FindDependencies(std::set<Resource> *validResources, std::set<Pass>
 
     visitingStack.insert(resource);
     validResources->insert(resource);
+    if (IsSubresource(resource))
+    {
+        validResources->insert(GetParent(resource)); // for its images, its other subresources may go unused
+    }
+    if (IsPrevious(resource))
+    {
+        // whatever is read next frame has to be written this frame
+        FindDependencies(validResources, validPasses, GetParent(resource), visitingStack);
+    }
 
     for (Pass const writer : _resources[resource.index].writers)
     {
@@ -187,23 +528,126 @@ void Graph::FindDependencies(std::set<Resource> *validResources, std::set<Pass>
 
 void Graph::Compile(Resource target, GraphUsage usage)
 {
-    Device const *device = SafeDeviceAccessor::Get();
-    check(device);
+    ZoneScopedN("compile graph");
 
-    device->WaitIdle();
+    _reloadPool->Wait();
 
     _target = target;
     _usage = usage;
 
-    Reset();
+    ResourceCreateInfo const &targetInfo = _resourceInfos[target.index];
+    if (IsStorage(target) || IsSubresource(target) || targetInfo.mipLevels > 1u || targetInfo.arrayLayers > 1u)
+    {
+        throw std::runtime_error(
+            fmt::format("Graph: target '{}' must be a color or depth resource of one mip", targetInfo.debugName));
+    }
+
+    // everything built by the previous compile is kept unless what it was built from changed
+    _resources.resize(_resourceInfos.size());
+    for (ResourceHolder &resource : _resources)
+    {
+        resource.writers.clear();
+        resource.readers.clear();
+        resource.subresources.clear();
+    }
+    for (uint32_t resource = 0; resource < _resourceInfos.size(); resource++)
+    {
+        if (IsSubresource(Resource{resource}))
+        {
+            _resources[GetParent(Resource{resource}).index].subresources.emplace_back(resource);
+        }
+    }
+    for (PassHolder &pass : _passes)
+    {
+        pass.dependencies.clear();
+    }
 
     for (uint32_t pass = 0; pass < _passInfos.size(); pass++)
     {
         PassCreateInfo const &passInfo = _passInfos[pass];
 
-        if (!(passInfo.writes.empty() ||
+        for (Resource const resource : passInfo.writes)
+        {
+            ResourceCreateInfo const &resourceInfo = _resourceInfos[resource.index];
+            if (IsPrevious(resource))
+            {
+                throw std::runtime_error(fmt::format("Graph: pass '{}' cannot write '{}', last frame is read only",
+                                                     passInfo.debugName, resourceInfo.debugName));
+            }
+            if (resourceInfo.mipLevels > 1u || resourceInfo.arrayLayers > 1u)
+            {
+                throw std::runtime_error(
+                    fmt::format("Graph: pass '{}' can only write a single mip and layer of '{}', see GetSubresource",
+                                passInfo.debugName, resourceInfo.debugName));
+            }
+        }
+
+        if (IsCompute(Pass{pass}))
+        {
+            if (!passInfo.dispatch || passInfo.pixelLocalReads || passInfo.blends)
+            {
+                throw std::runtime_error(fmt::format(
+                    "Graph: compute pass '{}' needs a dispatch and cannot read at its own pixels or blend",
+                    passInfo.debugName));
+            }
+
+            for (Resource const resource : passInfo.writes)
+            {
+                // a storage write is bound for loads too, reading it through a second binding would race
+                if (!IsStorage(resource) ||
+                    std::find(passInfo.reads.begin(), passInfo.reads.end(), resource) != passInfo.reads.end())
+                {
+                    throw std::runtime_error(
+                        fmt::format("Graph: compute pass '{}' can only write '{}' as storage it doesn't also read",
+                                    passInfo.debugName, _resourceInfos[resource.index].debugName));
+                }
+            }
+        }
+        else
+        {
+            for (Resource const resource : passInfo.writes)
+            {
+                if (IsStorage(resource))
+                {
+                    throw std::runtime_error(fmt::format("Graph: graphics pass '{}' cannot write storage '{}'",
+                                                         passInfo.debugName, _resourceInfos[resource.index].debugName));
+                }
+            }
+            for (Resource const resource : passInfo.reads)
+            {
+                if (passInfo.pixelLocalReads && IsStorage(resource))
+                {
+                    throw std::runtime_error(
+                        fmt::format("Graph: pass '{}' cannot read storage '{}' at its own pixels",
+                                    passInfo.debugName, _resourceInfos[resource.index].debugName));
+                }
+            }
+        }
+
+        for (Resource const resource : passInfo.earlyReads)
+        {
+            if (std::find(passInfo.reads.begin(), passInfo.reads.end(), resource) == passInfo.reads.end() ||
+                passInfo.passDependencies.empty())
+            {
+                throw std::runtime_error(
+                    fmt::format("Graph: pass '{}' reads '{}' early, it must read it and depend on a pass writing it",
+                                passInfo.debugName, _resourceInfos[resource.index].debugName));
+            }
+        }
+
+        bool const hasPermutations = !passInfo.permutations.empty();
+        if (hasPermutations != static_cast<bool>(passInfo.executePermutation) ||
+            (hasPermutations && IsCompute(Pass{pass})))
+        {
+            throw std::runtime_error(fmt::format(
+                "Graph: pass '{}' needs both permutations and executePermutation, on its graphics pipeline",
+                passInfo.debugName));
+        }
+
+        if (!IsCompute(Pass{pass}) &&
+            !(passInfo.writes.empty() ||
               std::all_of(passInfo.writes.begin() + 1, passInfo.writes.end(), [&](Resource resource) {
-                  return _resourceInfos[resource.index].extent == _resourceInfos[passInfo.writes[0].index].extent;
+                  return GetExtent(resource) == GetExtent(passInfo.writes[0]);
               })))
         {
             std::ostringstream oss;
@@ -211,6 +655,24 @@ void Graph::Compile(Resource target, GraphUsage usage)
             throw std::runtime_error(oss.str());
         }
 
+        if (passInfo.pixelLocalReads &&
+            std::any_of(passInfo.reads.begin(), passInfo.reads.end(),
+                        [&](Resource resource) { return IsPrevious(resource); }))
+        {
+            throw std::runtime_error(
+                fmt::format("Graph: pass '{}' cannot read last frame at its own pixels", passInfo.debugName));
+        }
+
+        if (passInfo.pixelLocalReads &&
+            !std::all_of(passInfo.reads.begin(), passInfo.reads.end(), [&](Resource resource) {
+                return GetExtent(resource) == GetExtent(passInfo.writes.at(0));
+            }))
+        {
+            std::ostringstream oss;
+            oss << "Graph: pass " << pass << " reads at its own pixels from resources of another resolution";
+            throw std::runtime_error(oss.str());
+        }
+
         for (Resource const resource : passInfo.reads)
         {
             check(_resourceInfos.size() > resource.index);
@@ -220,7 +682,10 @@ void Graph::Compile(Resource target, GraphUsage usage)
         {
             check(_resourceInfos.size() > resource.index);
             _resources[resource.index].writers.emplace_back(pass);
-            _passes[pass].rebuildOnChange = true;
+            if (IsSubresource(resource)) // the parent is written through its subresources
+            {
+                _resources[GetParent(resource).index].writers.emplace_back(pass);
+            }
         }
         for (Pass const dependency : passInfo.passDependencies)
         {
@@ -228,58 +693,277 @@ void Graph::Compile(Resource target, GraphUsage usage)
         }
     }
 
-    _validPasses.clear();
-    _validResources.clear();
+    for (uint32_t resource = 0; resource < _resources.size(); resource++)
+    {
+        // passes writing apart subresources of it do not overwrite each other
+        std::vector<Pass> const &writers = _resources[resource].writers;
+        auto const cached = std::find_if(writers.begin(), writers.end(), [&](Pass writer) { return IsCached(writer); });
+        bool const isWrittenDirectly = std::any_of(writers.begin(), writers.end(), [&](Pass writer) {
+            std::vector<Resource> const &writes = _passInfos[writer.index].writes;
+            return std::find(writes.begin(), writes.end(), Resource{resource}) != writes.end();
+        });
+        if (cached != writers.end() && writers.size() > 1 && isWrittenDirectly)
+        {
+            throw std::runtime_error(fmt::format("Graph: '{}' can only be written by '{}', which can be skipped",
+                                                 _resourceInfos[resource].debugName,
+                                                 _passInfos[cached->index].debugName));
+        }
+    }
+
+    std::set<Resource> validResources{};
+    std::set<Pass> validPasses{};
     std::set<std::variant<Resource, Pass>> visitingStack{};
 
-    FindDependencies(&_validResources, &_validPasses, target, visitingStack);
+    FindDependencies(&validResources, &validPasses, target, visitingStack);
 
     std::ostringstream oss;
     oss << "Graph: dependencies : ";
-    for (Resource const resource : _validResources)
+    for (Resource const resource : validResources)
     {
         oss << _resourceInfos[resource.index].debugName << ", ";
     }
-    for (Pass const pass : _validPasses)
+    for (Pass const pass : validPasses)
     {
         oss << _passInfos[pass.index].debugName << ", ";
     }
     spdlog::info("{0}", oss.str());
 
-    KhanFindOrder(_validResources, _validPasses);
-
-    _requestsUniform = false;
-
     for (Pass const pass : _validPasses)
     {
-        if (_passInfos[pass.index].readsUniform)
+        if (validPasses.find(pass) == validPasses.end())
         {
-            if (_uboSize == 0)
-            {
-                throw std::runtime_error("Graph: Pass {0} reads uniform, but no uniform buffer size was set");
-            }
+            Free(pass);
+        }
+    }
+    for (Resource const resource : _validResources)
+    {
+        if (validResources.find(resource) == validResources.end())
+        {
+            Free(resource);
+        }
+    }
+    _validPasses = validPasses;
+    _validResources = validResources;
+
+    KhanFindOrder(_validResources, _validPasses);
+    FindLifetimes();
+    FindSubpasses();
+
+    _requestsUniform = false;
+
+    for (Pass const pass : _validPasses)
+    {
+        if (_passInfos[pass.index].readsUniform)
+        {
+            if (_uboSize == 0)
+            {
+                throw std::runtime_error("Graph: Pass {0} reads uniform, but no uniform buffer size was set");
+            }
 
             _requestsUniform = true;
         }
     }
-    if (_requestsUniform)
+    if (_requestsUniform && _uboDescriptorPool == VK_NULL_HANDLE)
     {
         BuildUbo();
     }
 
+    // a memory block is repacked as a whole, so a changed resource takes the ones aliasing it along
+    std::set<uint32_t> changedBlocks{};
+    for (Resource const resource : _validResources)
+    {
+        ResourceHolder const &resourceHolder = _resources[resource.index];
+        if (IsSubresource(resource))
+        {
+            continue;
+        }
+
+        bool const isInfoChanged = IsBuffer(resource) ? GetBufferInfo(resource) != resourceHolder.bufferInfo
+                                                      : GetImageInfo(resource) != resourceHolder.imageInfo;
+        if (IsBuilt(resource) &&
+            (isInfoChanged || resourceHolder.lifetime != resourceHolder.packedLifetime ||
+             IsTransient(resource) != resourceHolder.isPackedTransient))
+        {
+            changedBlocks.insert(resourceHolder.memoryBlock);
+        }
+    }
+
+    std::vector<Resource> resourcesToBuild{};
+    std::set<uint32_t> unusedBlocks{};
+    for (uint32_t block = 0; block < _memoryBlocks.size(); block++)
+    {
+        unusedBlocks.insert(block);
+    }
+    for (Resource const resource : _validResources)
+    {
+        ResourceHolder const &resourceHolder = _resources[resource.index];
+
+        if (IsSubresource(resource))
+        {
+            continue;
+        }
+        else if (!IsBuilt(resource))
+        {
+            resourcesToBuild.push_back(resource);
+        }
+        else if (changedBlocks.find(resourceHolder.memoryBlock) != changedBlocks.end())
+        {
+            Free(resource);
+            resourcesToBuild.push_back(resource);
+        }
+        else
+        {
+            unusedBlocks.erase(resourceHolder.memoryBlock);
+        }
+    }
+    FreeMemory(unusedBlocks);
+
+    // subresources only hold views, rebuilt along with their parent's images
+    std::vector<Resource> subresourcesToBuild{};
     for (Resource const resource : _validResources)
+    {
+        ResourceHolder const &resourceHolder = _resources[resource.index];
+
+        if (!IsSubresource(resource))
+        {
+            continue;
+        }
+        else if (resourceHolder.textures[0] == nullptr)
+        {
+            subresourcesToBuild.push_back(resource);
+        }
+        else if (GetImageInfo(resource) != resourceHolder.imageInfo ||
+                 std::find(resourcesToBuild.begin(), resourcesToBuild.end(), GetParent(resource)) !=
+                     resourcesToBuild.end())
+        {
+            Free(resource);
+            subresourcesToBuild.push_back(resource);
+        }
+    }
+
+    for (Resource const resource : resourcesToBuild)
     {
         Build(resource);
     }
+    if (!resourcesToBuild.empty())
+    {
+        BuildMemory(resourcesToBuild);
+    }
+    for (Resource const resource : resourcesToBuild)
+    {
+        BuildViews(resource);
+    }
+    for (Resource const resource : subresourcesToBuild)
+    {
+        _resources[resource.index].imageInfo = GetImageInfo(resource);
+        BuildViews(resource);
+    }
+
+    std::map<Resource, std::vector<vk::ImageLayout>> previousKeptLayouts{};
+    for (Resource const resource : _validResources)
+    {
+        previousKeptLayouts[resource] = _resources[resource.index].keptLayouts;
+    }
+
+    BuildBarriers();
+    spdlog::debug("{}", DumpBarrierPlan());
+
+    // kept images keep what the last frame drew, unless they were just built or the plan now leaves them elsewhere
+    std::set<Resource> changedResources{resourcesToBuild.begin(), resourcesToBuild.end()};
+    for (Resource const resource : _validResources)
+    {
+        if (IsSubresource(resource) || !IsKept(resource) || IsBuffer(resource))
+        {
+            continue;
+        }
+
+        if (changedResources.find(resource) != changedResources.end() ||
+            previousKeptLayouts[resource] != _resources[resource.index].keptLayouts)
+        {
+            changedResources.insert(resource);
+            if (std::find(_keptToClear.begin(), _keptToClear.end(), resource) == _keptToClear.end())
+            {
+                _keptToClear.push_back(resource);
+            }
+        }
+    }
+
+    // and cached passes only draw again once something they use changed
+    auto const isChanged = [&](Resource resource) { return changedResources.count(GetParent(resource)) > 0; };
+    for (Pass const pass : _validPasses)
+    {
+        PassCreateInfo const &passInfo = _passInfos[pass.index];
+        if (IsCached(pass) && (std::any_of(passInfo.reads.begin(), passInfo.reads.end(), isChanged) ||
+                               std::any_of(passInfo.writes.begin(), passInfo.writes.end(), isChanged)))
+        {
+            _passes[pass.index].pendingRuns = MAX_FRAMES_IN_FLIGHT;
+        }
+    }
+
     for (Pass const pass : _validPasses)
     {
         Build(pass);
-        BuildPipeline(pass);
     }
+    // pipelines are independent of each other and the device's caches are thread safe, so they're built concurrently
+    std::vector<Pass> const passes{_validPasses.begin(), _validPasses.end()};
+    std::vector<vk::Pipeline> previousPipelines(passes.size());
+    std::vector<float> durations(passes.size());
+
+    auto const start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < passes.size(); i++)
+    {
+        previousPipelines[i] = _passes[passes[i].index].pipeline.pipeline;
+
+        _threadPool->Push([this, &passes, &durations, i](uint32_t) {
+            ZoneScopedN("build pipeline");
+
+            auto const passStart = std::chrono::steady_clock::now();
+            BuildPipeline(passes[i]);
+            durations[i] =
+                std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - passStart).count();
+        });
+    }
+    _threadPool->Wait();
+
+    std::chrono::duration<float, std::milli> const duration = std::chrono::steady_clock::now() - start;
+
+    uint32_t builtPipelines = 0;
+    for (uint32_t i = 0; i < passes.size(); i++)
+    {
+        PassHolder &passHolder = _passes[passes[i].index];
+
+        std::array<std::vector<vk::DescriptorSet>, MAX_FRAMES_IN_FLIGHT> const descriptorSets =
+            passHolder.descriptorSets;
+
+        BuildBindList(passes[i]);
+        BuildCachedCommandBuffers(passes[i]);
+
+        bool const isPipelineBuilt = previousPipelines[i] != passHolder.pipeline.pipeline;
+        if (isPipelineBuilt || descriptorSets != passHolder.descriptorSets)
+        {
+            passHolder.isCacheValid.fill(false);
+        }
+
+        if (isPipelineBuilt)
+        {
+            builtPipelines++;
+            spdlog::debug("Graph: built '{}' pipeline in {:.2f} ms", _passInfos[passes[i].index].debugName,
+                          durations[i]);
+        }
+    }
+
+    if (builtPipelines > 0)
+    {
+        Device const *device = SafeDeviceAccessor::Get();
+        check(device);
 
-    spdlog::info("Graph: compiled");
+        spdlog::info("Graph: built {} pipelines in {:.2f} ms on {} threads from a {} pipeline cache", builtPipelines,
+                     duration.count(), _threadPool->GetThreadCount(), device->IsPipelineCacheWarm() ? "warm" : "cold");
+    }
 
-    return;
+    spdlog::info("Graph: compiled, rebuilt {} of {} resources", resourcesToBuild.size() + subresourcesToBuild.size(),
+                 _validResources.size());
 }
 
 Image *Graph::GetTargetImage() const
@@ -292,6 +976,132 @@ Image *Graph::GetTargetImage() const
     return _resources[_target.index].images[_currentFrameIndex];
 }
 
+vk::Buffer Graph::GetBuffer(Resource resource) const
+{
+    check(IsBuffer(resource));
+
+    return _resources[resource.index].buffers[_currentFrameIndex];
+}
+
+void Graph::ReadTarget(std::vector<float> *rgba) const
+{
+    check(rgba);
+
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    vk::Format const format = vk::Format::eR32G32B32A32Sfloat;
+    if (!(device->GetFormatFeatures(format) & vk::FormatFeatureFlagBits::eBlitDst))
+    {
+        throw std::runtime_error(fmt::format("Graph: can't blit to {} to read the target back", vk::to_string(format)));
+    }
+
+    vk::Extent2D const extent = GetTargetExtent();
+    vk::Image const target = _resources[_target.index].images[_currentFrameIndex]->GetImage();
+    vk::ImageLayout const targetLayout = _usage == GraphUsage::eToTransfer ? vk::ImageLayout::eTransferSrcOptimal
+                                                                           : vk::ImageLayout::eShaderReadOnlyOptimal;
+
+    // whatever the target's format, it's blitted into floats first
+    vk::ImageCreateInfo imageInfo{};
+    imageInfo.imageType = vk::ImageType::e2D;
+    imageInfo.format = format;
+    imageInfo.extent = vk::Extent3D{extent.width, extent.height, 1u};
+    imageInfo.mipLevels = 1u;
+    imageInfo.arrayLayers = 1u;
+    imageInfo.samples = vk::SampleCountFlagBits::e1;
+    imageInfo.tiling = vk::ImageTiling::eOptimal;
+    imageInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc;
+    imageInfo.sharingMode = vk::SharingMode::eExclusive;
+    imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+
+    vk::Image image;
+    vk::DeviceMemory imageMemory;
+    device->CreateImageAndBindMemory(imageInfo, &image, &imageMemory, "target_readback");
+
+    vk::DeviceSize const size = static_cast<vk::DeviceSize>(extent.width) * extent.height * 4u * sizeof(float);
+
+    vk::BufferCreateInfo bufferInfo{};
+    bufferInfo.size = size;
+    bufferInfo.usage = vk::BufferUsageFlagBits::eTransferDst;
+
+    vk::Buffer buffer;
+    vk::DeviceMemory bufferMemory;
+    device->CreateBufferAndBindMemory(
+        bufferInfo, &buffer, &bufferMemory,
+        {vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent}, "target_readback");
+
+    device->WaitIdle();
+    vk::CommandBuffer const commandBuffer = device->BeginSingleTimeCommand();
+
+    vk::ImageSubresourceRange range{};
+    range.aspectMask = vk::ImageAspectFlagBits::eColor;
+    range.levelCount = 1u;
+    range.layerCount = 1u;
+
+    vk::ImageMemoryBarrier targetBarrier{};
+    targetBarrier.srcAccessMask = vk::AccessFlagBits::eMemoryWrite;
+    targetBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+    targetBarrier.oldLayout = targetLayout;
+    targetBarrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+    targetBarrier.srcQueueFamilyIndex = vk::QueueFamilyIgnored;
+    targetBarrier.dstQueueFamilyIndex = vk::QueueFamilyIgnored;
+    targetBarrier.image = target;
+    targetBarrier.subresourceRange = range;
+
+    vk::ImageMemoryBarrier imageBarrier = targetBarrier;
+    imageBarrier.srcAccessMask = {};
+    imageBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+    imageBarrier.oldLayout = vk::ImageLayout::eUndefined;
+    imageBarrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+    imageBarrier.image = image;
+
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer, {},
+                                  {}, {}, {targetBarrier, imageBarrier});
+
+    vk::ImageSubresourceLayers const layers{vk::ImageAspectFlagBits::eColor, 0u, 0u, 1u};
+    vk::Offset3D const end{static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height), 1};
+
+    vk::ImageBlit blit{};
+    blit.srcSubresource = layers;
+    blit.srcOffsets[1] = end;
+    blit.dstSubresource = layers;
+    blit.dstOffsets[1] = end;
+    commandBuffer.blitImage(target, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal,
+                            {blit}, vk::Filter::eNearest);
+
+    imageBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    imageBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+    imageBarrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+    imageBarrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+
+    targetBarrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
+    targetBarrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+    targetBarrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+    targetBarrier.newLayout = targetLayout;
+
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eAllCommands, {},
+                                  {}, {}, {targetBarrier, imageBarrier});
+
+    vk::BufferImageCopy copy{};
+    copy.imageSubresource = layers;
+    copy.imageExtent = imageInfo.extent;
+    commandBuffer.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, buffer, {copy});
+
+    device->EndSingleTimeCommand(commandBuffer);
+
+    void *mappedMemory;
+    device->MapMemory(bufferMemory, &mappedMemory);
+    rgba->resize(static_cast<size_t>(size / sizeof(float)));
+    memcpy(rgba->data(), mappedMemory, size);
+    device->UnmapMemory(bufferMemory);
+
+    device->DestroyBuffer(&buffer);
+    device->FreeDeviceMemory(&bufferMemory);
+    device->DestroyImage(&image);
+    device->FreeDeviceMemory(&imageMemory);
+}
+
 vk::DescriptorSet Graph::GetTargetDescriptorSet() const
 {
     if (_usage != GraphUsage::eToDescriptorSet)
@@ -307,21 +1117,65 @@ void Graph::ChangeUsage(GraphUsage usage)
     Compile(_target, usage);
 }
 
+static size_t HashShaderCode(std::vector<char> const &vertCode, std::vector<char> const &fragCode)
+{
+    std::hash<std::string_view> const hash{};
+    return hash(std::string_view{vertCode.data(), vertCode.size()}) * 31u +
+           hash(std::string_view{fragCode.data(), fragCode.size()});
+}
+
 void Graph::BuildPipeline(Pass pass)
+{
+    PassCreateInfo const &passInfo = _passInfos[pass.index];
+    PassHolder &passHolder = _passes[pass.index];
+    PipelineHolder const &pipelineHolder = passHolder.pipeline;
+
+    if (IsCompute(pass))
+    {
+        std::vector<char> const compCode = ReadShaderFile(passInfo.compFile);
+
+        if (pipelineHolder.pipeline != VK_NULL_HANDLE && pipelineHolder.codeHash == HashShaderCode(compCode, {}))
+        {
+            return;
+        }
+
+        FreePipeline(pass);
+        passHolder.pipeline = CreateComputePipeline(pass, compCode);
+        return;
+    }
+
+    std::vector<char> const vertCode = ReadShaderFile(passInfo.vertFile);
+    std::vector<char> const fragCode = ReadShaderFile(passInfo.fragFile);
+
+    if (pipelineHolder.pipeline != VK_NULL_HANDLE &&
+        pipelineHolder.renderPass == _passes[GetOwner(pass).index].renderPass &&
+        pipelineHolder.subpass == passHolder.subpass && pipelineHolder.codeHash == HashShaderCode(vertCode, fragCode))
+    {
+        return;
+    }
+
+    FreePipeline(pass);
+    passHolder.pipeline = CreatePipeline(pass, vertCode, fragCode);
+}
+
+Graph::PipelineHolder Graph::CreatePipeline(Pass pass, std::vector<char> const &vertCode,
+                                            std::vector<char> const &fragCode) const
 {
     Device const *device = SafeDeviceAccessor::Get();
     check(device);
 
     PassCreateInfo const &passInfo = _passInfos[pass.index];
+    PassHolder const &passHolder = _passes[pass.index];
 
-    std::vector<char> const vertCode = ReadShaderFile(passInfo.vertFile);
-    std::vector<char> const fragCode = ReadShaderFile(passInfo.fragFile);
+    PipelineHolder pipelineHolder{};
+    pipelineHolder.renderPass = _passes[GetOwner(pass).index].renderPass;
+    pipelineHolder.subpass = passHolder.subpass;
+    pipelineHolder.codeHash = HashShaderCode(vertCode, fragCode);
 
-    PipelineHolder &pipelineHolder = _passes[pass.index].pipeline;
-    device->CreateShaderModule(vertCode, &pipelineHolder.vertShaderModule,
-                               passInfo.debugName + "_vertex_shader_module");
-    device->CreateShaderModule(fragCode, &pipelineHolder.fragShaderModule,
-                               passInfo.debugName + "_fragment_shader_module");
+    // shared by every graph through the device, unchanged shaders don't create new modules
+    pipelineHolder.vertShaderModule = device->GetShaderModule(vertCode, passInfo.debugName + "_vertex_shader_module");
+    pipelineHolder.fragShaderModule =
+        device->GetShaderModule(fragCode, passInfo.debugName + "_fragment_shader_module");
 
     vk::PipelineShaderStageCreateInfo shaderStages[2];
     shaderStages[0].stage = vk::ShaderStageFlagBits::eVertex;
@@ -385,12 +1239,15 @@ void Graph::BuildPipeline(Pass pass)
             vk::PipelineColorBlendAttachmentState colorBlendAttachment{};
             colorBlendAttachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
                                                   vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
-            colorBlendAttachment.blendEnable = vk::False;
-            colorBlendAttachment.srcColorBlendFactor = vk::BlendFactor::eOne;
-            colorBlendAttachment.dstColorBlendFactor = vk::BlendFactor::eZero;
+            colorBlendAttachment.blendEnable = passInfo.blends ? vk::True : vk::False;
+            colorBlendAttachment.srcColorBlendFactor =
+                passInfo.blends ? vk::BlendFactor::eSrcAlpha : vk::BlendFactor::eOne;
+            colorBlendAttachment.dstColorBlendFactor =
+                passInfo.blends ? vk::BlendFactor::eOneMinusSrcAlpha : vk::BlendFactor::eZero;
             colorBlendAttachment.colorBlendOp = vk::BlendOp::eAdd;
             colorBlendAttachment.srcAlphaBlendFactor = vk::BlendFactor::eOne;
-            colorBlendAttachment.dstAlphaBlendFactor = vk::BlendFactor::eZero;
+            colorBlendAttachment.dstAlphaBlendFactor =
+                passInfo.blends ? vk::BlendFactor::eOneMinusSrcAlpha : vk::BlendFactor::eZero;
             colorBlendAttachment.alphaBlendOp = vk::BlendOp::eAdd;
 
             colorBlendAttachments.push_back(colorBlendAttachment);
@@ -398,7 +1255,7 @@ void Graph::BuildPipeline(Pass pass)
         else if (resourceInfo.usage == ResourceUsage::eDepth)
         {
             depthStencilInfo.depthTestEnable = vk::True;
-            depthStencilInfo.depthWriteEnable = vk::True;
+            depthStencilInfo.depthWriteEnable = passInfo.blends ? vk::False : vk::True;
             depthStencilInfo.depthCompareOp = vk::CompareOp::eLessOrEqual;
         }
     }
@@ -419,20 +1276,7 @@ void Graph::BuildPipeline(Pass pass)
     dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
     dynamicStateInfo.flags = vk::PipelineDynamicStateCreateFlagBits{};
 
-    std::vector<vk::DescriptorSetLayout> descriptorSetLayouts;
-
-    if (passInfo.readsUniform)
-    {
-        descriptorSetLayouts.push_back(_uboDescriptorSetLayout);
-    }
-    for (uint32_t i = 0; i < passInfo.reads.size(); ++i)
-    {
-        descriptorSetLayouts.push_back(_descriptorSetLayout);
-    }
-    for (StaticTextures const *staticTextures : passInfo.staticTextures)
-    {
-        descriptorSetLayouts.push_back(staticTextures->GetDescriptorSetLayout());
-    }
+    std::vector<vk::DescriptorSetLayout> const descriptorSetLayouts = GetDescriptorSetLayouts(pass);
 
     vk::PipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
@@ -467,905 +1311,2787 @@ void Graph::BuildPipeline(Pass pass)
     pipelineInfo.pDynamicState = &dynamicStateInfo;
 
     pipelineInfo.layout = pipelineHolder.pipelineLayout;
-    pipelineInfo.renderPass = _passes[pass.index].renderPass;
-    pipelineInfo.subpass = 0u;
+    pipelineInfo.renderPass = pipelineHolder.renderPass;
+    pipelineInfo.subpass = pipelineHolder.subpass;
 
     pipelineInfo.basePipelineIndex = -1;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    device->CreateGraphicsPipeline(pipelineInfo, &pipelineHolder.pipeline, passInfo.debugName + "_graphics_pipeline");
-
-    spdlog::debug("Graph: built {0} pipeline", passInfo.debugName);
-}
-
-void Graph::FlushUbo(void *ubo)
-{
-    if (!_requestsUniform)
+    if (passInfo.permutations.empty())
     {
-        return;
+        device->CreateGraphicsPipeline(pipelineInfo, &pipelineHolder.pipeline,
+                                       passInfo.debugName + "_graphics_pipeline");
+        return pipelineHolder;
     }
 
-    if (_uboSize == 0)
+    vk::SpecializationMapEntry const specializationEntry{0u, 0u, sizeof(uint32_t)};
+    for (size_t i = 0; i < passInfo.permutations.size(); i++)
     {
-        spdlog::warn("Graph: flushing ubo in a graph which doesn't include one");
-        return;
-    }
-    check(ubo);
+        vk::SpecializationInfo const specializationInfo{1u, &specializationEntry, sizeof(uint32_t),
+                                                        &passInfo.permutations[i]};
+        shaderStages[0].pSpecializationInfo = &specializationInfo;
+        shaderStages[1].pSpecializationInfo = &specializationInfo;
 
-    Device const *device = SafeDeviceAccessor::Get();
-    check(device);
-
-    memcpy(_uboMappedMemories[_currentFrameIndex], ubo, _uboSize);
+        vk::Pipeline pipeline;
+        device->CreateGraphicsPipeline(
+            pipelineInfo, &pipeline,
+            fmt::format("{}_graphics_pipeline_{}", passInfo.debugName, passInfo.permutations[i]));
 
-    vk::MappedMemoryRange mappedRange = {};
-    mappedRange.memory = _uboDeviceMemories[_currentFrameIndex];
-    mappedRange.offset = 0u;
-    mappedRange.size = _uboSize;
+        if (i == 0)
+        {
+            pipelineHolder.pipeline = pipeline;
+        }
+        else
+        {
+            pipelineHolder.permutationPipelines.push_back(pipeline);
+        }
+    }
 
-    device->FlushMappedMemoryRange(mappedRange);
+    return pipelineHolder;
 }
 
-void Graph::Render(vk::CommandBuffer commandBuffer, uint32_t frameIndex)
+Graph::PipelineHolder Graph::CreateComputePipeline(Pass pass, std::vector<char> const &compCode) const
 {
-    ZoneScopedN("graph render");
-
-    _currentFrameIndex = frameIndex;
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
 
-    extern TracyVkCtx TRACY_CTX;
-    TracyVkZone(TRACY_CTX, commandBuffer, "graph");
+    PassCreateInfo const &passInfo = _passInfos[pass.index];
 
-    if (_populateUbo)
-    {
-        ZoneScopedN("populate ubo");
-        void *ubo = _populateUbo();
-        FlushUbo(ubo);
-    }
+    PipelineHolder pipelineHolder{};
+    pipelineHolder.codeHash = HashShaderCode(compCode, {});
+    pipelineHolder.compShaderModule =
+        device->GetShaderModule(compCode, passInfo.debugName + "_compute_shader_module");
 
-    for (Pass const pass : _orderedPasses)
-    {
-        ZoneScopedN("run passes");
+    std::vector<vk::DescriptorSetLayout> const descriptorSetLayouts = GetDescriptorSetLayouts(pass);
 
-        PassHolder const &passHolder = _passes[pass.index];
+    vk::PipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 0u;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
-        int i = 0;
-        for (std::array<vk::ImageMemoryBarrier, MAX_FRAMES_IN_FLIGHT> const &barriers : passHolder.imageMemoryBarriers)
-        {
-            vk::ImageMemoryBarrier const &barrier = barriers[_currentFrameIndex];
+    vk::PushConstantRange pushConstantRange{};
+    if (passInfo.pushConstantSize > 0)
+    {
+        pushConstantRange.size = passInfo.pushConstantSize;
+        pushConstantRange.offset = 0u;
+        pushConstantRange.stageFlags = vk::ShaderStageFlagBits::eCompute;
 
-            commandBuffer.pipelineBarrier(
-                vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eColorAttachmentOutput,
-                vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests |
-                    vk::PipelineStageFlagBits::eFragmentShader,
-                vk::DependencyFlagBits::eByRegion, 0, nullptr, 0, nullptr, 1, &barrier);
+        pipelineLayoutInfo.pushConstantRangeCount = 1u;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    }
 
-            i++;
-        }
+    device->CreatePipelineLayout(pipelineLayoutInfo, &pipelineHolder.pipelineLayout,
+                                 passInfo.debugName + "<pipeline_layout>");
 
-        commandBuffer.beginRenderPass(passHolder.renderPassBeginInfo[_currentFrameIndex], vk::SubpassContents::eInline);
+    vk::ComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.stage.stage = vk::ShaderStageFlagBits::eCompute;
+    pipelineInfo.stage.module = pipelineHolder.compShaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineHolder.pipelineLayout;
 
-        PassCreateInfo const &passInfo = _passInfos[pass.index];
+    pipelineInfo.basePipelineIndex = -1;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-        extern TracyVkCtx TRACY_CTX;
-        TracyVkZoneTransient(TRACY_CTX, __tracy, commandBuffer, passInfo.debugName.c_str(), true);
+    device->CreateComputePipeline(pipelineInfo, &pipelineHolder.pipeline, passInfo.debugName + "_compute_pipeline");
 
-        commandBuffer.setViewport(0, 1, &passHolder.viewport);
-        commandBuffer.setScissor(0, 1, &passHolder.scissor);
+    return pipelineHolder;
+}
 
-        uint32_t offset = 0;
+std::vector<vk::DescriptorSetLayout> Graph::GetDescriptorSetLayouts(Pass pass) const
+{
+    PassCreateInfo const &passInfo = _passInfos[pass.index];
 
-        if (passInfo.readsUniform)
-        {
-            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, passHolder.pipeline.pipelineLayout,
-                                             offset, 1u, &_uboDescriptorSets[_currentFrameIndex], 0u, nullptr);
-            offset++;
-        }
-        if (passInfo.reads.size() > 0)
-        {
-            std::vector<vk::DescriptorSet> descriptorSets;
-            descriptorSets.reserve(passInfo.reads.size());
+    std::vector<vk::DescriptorSetLayout> descriptorSetLayouts;
 
-            for (Resource const resource : passInfo.reads)
+    if (passInfo.readsUniform)
+    {
+        descriptorSetLayouts.push_back(_uboDescriptorSetLayout);
+    }
+    for (Resource const resource : passInfo.reads)
+    {
+        if (IsDrawnFrom(resource, pass))
+        {
+            continue;
+        }
+
+        if (IsBuffer(resource))
+        {
+            descriptorSetLayouts.push_back(_storageBufferDescriptorSetLayout);
+        }
+        else
+        {
+            descriptorSetLayouts.push_back(passInfo.pixelLocalReads ? _inputDescriptorSetLayout
+                                                                    : _descriptorSetLayout);
+        }
+    }
+    if (IsCompute(pass)) // storage writes are bound after the reads, graphics passes draw to theirs instead
+    {
+        for (Resource const resource : passInfo.writes)
+        {
+            descriptorSetLayouts.push_back(IsBuffer(resource) ? _storageBufferDescriptorSetLayout
+                                                              : _storageImageDescriptorSetLayout);
+        }
+    }
+    for (StaticTextures const *staticTextures : passInfo.staticTextures)
+    {
+        descriptorSetLayouts.push_back(staticTextures->GetDescriptorSetLayout());
+    }
+    for (StaticBuffer const *staticBuffer : passInfo.staticBuffers)
+    {
+        descriptorSetLayouts.push_back(staticBuffer->GetDescriptorSetLayout());
+    }
+
+    return descriptorSetLayouts;
+}
+
+void Graph::FreePipeline(Pass pass)
+{
+    PipelineHolder &pipelineHolder = _passes[pass.index].pipeline;
+
+    if (pipelineHolder.pipeline == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    RetirePipeline(pipelineHolder);
+    pipelineHolder = {};
+}
+
+void Graph::RetirePipeline(PipelineHolder const &pipelineHolder)
+{
+    Retire([pipelineHolder](Device const *device) mutable {
+        device->DestroyPipelineLayout(&pipelineHolder.pipelineLayout);
+        device->DestroyGraphicsPipeline(&pipelineHolder.pipeline);
+        for (vk::Pipeline &pipeline : pipelineHolder.permutationPipelines)
+        {
+            device->DestroyGraphicsPipeline(&pipeline);
+        }
+        device->ReleaseShaderModule(pipelineHolder.vertShaderModule);
+        device->ReleaseShaderModule(pipelineHolder.fragShaderModule);
+        device->ReleaseShaderModule(pipelineHolder.compShaderModule);
+    });
+}
+
+void Graph::ReloadShaders()
+{
+    std::set<std::string> shaderFiles{};
+    for (Pass const pass : _validPasses)
+    {
+        PassCreateInfo const &passInfo = _passInfos[pass.index];
+
+        if (IsCompute(pass))
+        {
+            shaderFiles.insert(passInfo.compFile);
+            continue;
+        }
+
+        shaderFiles.insert(passInfo.vertFile);
+        shaderFiles.insert(passInfo.fragFile);
+    }
+
+    ReloadShaders(shaderFiles);
+}
+
+void Graph::ReloadShaders(std::set<std::string> const &shaderFiles)
+{
+    for (Pass const pass : _validPasses)
+    {
+        PassCreateInfo const &passInfo = _passInfos[pass.index];
+
+        bool const isChanged = IsCompute(pass) ? shaderFiles.count(passInfo.compFile) > 0
+                                               : shaderFiles.count(passInfo.vertFile) > 0 ||
+                                                     shaderFiles.count(passInfo.fragFile) > 0;
+        if (!isChanged)
+        {
+            continue;
+        }
+
+        // only reads what Compile writes, which waits for these jobs first
+        _reloadPool->Push([this, pass](uint32_t) {
+            ZoneScopedN("reload pipeline");
+
+            PassCreateInfo const &passInfo = _passInfos[pass.index];
+
+            try
+            {
+                PipelineHolder pipelineHolder{};
+                if (IsCompute(pass))
+                {
+                    pipelineHolder = CreateComputePipeline(pass, ReadShaderFile(passInfo.compFile));
+                }
+                else
+                {
+                    std::vector<char> const vertCode = ReadShaderFile(passInfo.vertFile);
+                    std::vector<char> const fragCode = ReadShaderFile(passInfo.fragFile);
+
+                    pipelineHolder = CreatePipeline(pass, vertCode, fragCode);
+                }
+
+                std::unique_lock<std::mutex> lock{_reloadMutex};
+                _reloadedPipelines.emplace_back(pass, pipelineHolder);
+            }
+            catch (std::exception const &exception)
+            {
+                spdlog::error("Graph: failed to reload '{}' pipeline : {}", passInfo.debugName, exception.what());
+            }
+        });
+    }
+}
+
+void Graph::SwapReloadedPipelines()
+{
+    std::vector<std::pair<Pass, PipelineHolder>> reloadedPipelines{};
+    {
+        std::unique_lock<std::mutex> lock{_reloadMutex};
+        reloadedPipelines.swap(_reloadedPipelines);
+    }
+
+    for (auto const &[pass, pipelineHolder] : reloadedPipelines)
+    {
+        PassHolder &passHolder = _passes[pass.index];
+
+        // a compile may have rebuilt the render pass it was made for, or the same shaders already
+        if (_validPasses.find(pass) == _validPasses.end() ||
+            pipelineHolder.renderPass != _passes[GetOwner(pass).index].renderPass ||
+            pipelineHolder.subpass != passHolder.subpass || pipelineHolder.codeHash == passHolder.pipeline.codeHash)
+        {
+            RetirePipeline(pipelineHolder);
+            continue;
+        }
+
+        FreePipeline(pass);
+        passHolder.pipeline = pipelineHolder;
+        passHolder.isCacheValid.fill(false);
+
+        spdlog::info("Graph: swapped in reloaded '{}' pipeline", _passInfos[pass.index].debugName);
+    }
+}
+
+void Graph::FlushUbo(void *ubo)
+{
+    if (!_requestsUniform)
+    {
+        return;
+    }
+
+    if (_uboSize == 0)
+    {
+        spdlog::warn("Graph: flushing ubo in a graph which doesn't include one");
+        return;
+    }
+    check(ubo);
+
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    memcpy(_uboMappedMemories[_currentFrameIndex], ubo, _uboSize);
+
+    vk::MappedMemoryRange mappedRange = {};
+    mappedRange.memory = _uboDeviceMemories[_currentFrameIndex];
+    mappedRange.offset = 0u;
+    mappedRange.size = _uboSize;
+
+    device->FlushMappedMemoryRange(mappedRange);
+}
+
+void Graph::Render(vk::CommandBuffer commandBuffer, uint32_t frameIndex)
+{
+    ZoneScopedN("graph render");
+
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    _currentFrameIndex = frameIndex;
+
+    // the swapchain waited on this frame's fence, one more frame in flight is done with what was retired
+    FreeRetired(false);
+    SwapReloadedPipelines();
+
+    // and on the timestamps this frame index wrote last time, the scale is then settled before recording
+    MeasureGpuTime();
+    AdjustRenderScale();
+
+    extern TracyVkCtx TRACY_CTX;
+    TracyVkZone(TRACY_CTX, commandBuffer, "graph");
+
+    if (_timestampPool != VK_NULL_HANDLE)
+    {
+        commandBuffer.resetQueryPool(_timestampPool, 2u * _currentFrameIndex, 2u);
+        commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, _timestampPool, 2u * _currentFrameIndex);
+    }
+
+    if (_populateUbo)
+    {
+        ZoneScopedN("populate ubo");
+        void *ubo = _populateUbo();
+        FlushUbo(ubo);
+    }
+
+    ClearKept(commandBuffer);
+
+    // edits to static buffers land ahead of every pass binding them
+    std::set<StaticBuffer const *> staticBuffers{};
+    for (Pass const pass : _orderedPasses)
+    {
+        staticBuffers.insert(_passInfos[pass.index].staticBuffers.begin(), _passInfos[pass.index].staticBuffers.end());
+    }
+    for (StaticBuffer const *staticBuffer : staticBuffers)
+    {
+        staticBuffer->Flush(commandBuffer, static_cast<int>(_currentFrameIndex));
+    }
+
+    for (Pass const pass : _orderedPasses)
+    {
+        PassHolder &passHolder = _passes[pass.index];
+        if (!IsCached(pass))
+        {
+            continue;
+        }
+
+        if (!_passInfos[pass.index].isUpToDate())
+        {
+            passHolder.pendingRuns = MAX_FRAMES_IN_FLIGHT;
+        }
+
+        passHolder.isSkipped = passHolder.pendingRuns == 0;
+        if (passHolder.isSkipped)
+        {
+            passHolder.stats.skips++;
+        }
+        else
+        {
+            passHolder.pendingRuns--;
+        }
+    }
+
+    {
+        ZoneScopedN("record passes");
+
+        // the swapchain waited on this frame's fence, nothing recorded from these pools is in flight anymore
+        for (RecordingContext &context : _recordingContexts)
+        {
+            device->ResetCommandPool(context.commandPools[_currentFrameIndex]);
+            context.usedCommandBuffers[_currentFrameIndex] = 0;
+        }
+
+        for (Pass const pass : _orderedPasses)
+        {
+            PassHolder &passHolder = _passes[pass.index];
+
+            if (IsCompute(pass) || passHolder.isSkipped)
+            {
+                continue; // dispatched straight into the frame's command buffer, or not at all
+            }
+
+            if (IsRecordedOnce(pass))
+            {
+                vk::CommandBuffer const cachedCommandBuffer = passHolder.cachedCommandBuffers[_currentFrameIndex];
+
+                if (!IsCacheValid(pass))
+                {
+                    Record(pass, 0u, 1u, cachedCommandBuffer);
+
+                    std::vector<uint32_t> &cachedVersions = passHolder.cachedVersions[_currentFrameIndex];
+                    cachedVersions.clear();
+                    for (StaticTextures const *staticTextures : _passInfos[pass.index].staticTextures)
+                    {
+                        cachedVersions.push_back(staticTextures->GetVersion());
+                    }
+                    passHolder.isCacheValid[_currentFrameIndex] = true;
+
+                    spdlog::debug("Graph: recorded '{}' for frame {}", _passInfos[pass.index].debugName,
+                                  _currentFrameIndex);
+                }
+
+                passHolder.secondaryCommandBuffers.resize(1u);
+                passHolder.secondaryCommandBuffers[0] = cachedCommandBuffer;
+                continue;
+            }
+
+            if (!_isRecordingThreaded)
+            {
+                continue; // recorded inline while running passes
+            }
+
+            uint32_t const chunkCount = GetChunkCount(pass);
+            passHolder.secondaryCommandBuffers.resize(chunkCount);
+
+            for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+            {
+                _threadPool->Push([this, pass, chunk, chunkCount](uint32_t threadIndex) {
+                    vk::CommandBuffer const secondaryCommandBuffer = NextSecondaryCommandBuffer(threadIndex);
+                    Record(pass, chunk, chunkCount, secondaryCommandBuffer);
+                    _passes[pass.index].secondaryCommandBuffers[chunk] = secondaryCommandBuffer;
+                });
+            }
+        }
+
+        _threadPool->Wait();
+    }
+
+    for (Pass const pass : _orderedPasses)
+    {
+        ZoneScopedN("run passes");
+
+        PassHolder &passHolder = _passes[pass.index];
+        PassCreateInfo const &passInfo = _passInfos[pass.index];
+
+        TracyVkZoneTransient(TRACY_CTX, __tracy, commandBuffer, passInfo.debugName.c_str(), true);
+
+        passHolder.stats.runs += passHolder.isSkipped ? 0u : 1u;
+
+        if (passHolder.subpass == 0)
+        {
+            std::vector<vk::ImageMemoryBarrier> const &barriers = passHolder.imageMemoryBarriers[_currentFrameIndex];
+            std::vector<vk::BufferMemoryBarrier> const &bufferBarriers =
+                passHolder.bufferMemoryBarriers[_currentFrameIndex];
+            if (passHolder.srcStageMask) // execution only when waiting on compute reads ahead of its subpasses
+            {
+                commandBuffer.pipelineBarrier(passHolder.srcStageMask, passHolder.dstStageMask, {}, 0, nullptr,
+                                              static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+                                              static_cast<uint32_t>(barriers.size()), barriers.data());
+            }
+
+            if (passHolder.isSkipped)
+            {
+                continue; // its barriers still move its writes along, their layouts don't change their contents
+            }
+
+            if (IsCompute(pass))
+            {
+                Dispatch(pass, commandBuffer);
+                continue;
+            }
+
+            commandBuffer.beginRenderPass(passHolder.renderPassBeginInfo[_currentFrameIndex], GetContents(pass));
+        }
+        else
+        {
+            commandBuffer.nextSubpass(GetContents(pass));
+        }
+
+        if (GetContents(pass) == vk::SubpassContents::eInline)
+        {
+            RecordCommands(pass, 0u, 1u, commandBuffer);
+        }
+        else
+        {
+            commandBuffer.executeCommands(static_cast<uint32_t>(passHolder.secondaryCommandBuffers.size()),
+                                          passHolder.secondaryCommandBuffers.data());
+        }
+
+        uint32_t const next = passHolder.order + 1;
+        if (next == _orderedPasses.size() || _passes[_orderedPasses[next].index].subpass == 0)
+        {
+            commandBuffer.endRenderPass();
+        }
+    }
+
+    if (_timestampPool != VK_NULL_HANDLE)
+    {
+        commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, _timestampPool,
+                                     2u * _currentFrameIndex + 1u);
+        _isTimed[_currentFrameIndex] = true;
+    }
+}
+
+Graph::PassStats Graph::GetStats(Pass pass) const
+{
+    return _passes.at(pass.index).stats;
+}
+
+vk::SubpassContents Graph::GetContents(Pass pass) const
+{
+    return _isRecordingThreaded || IsRecordedOnce(pass) ? vk::SubpassContents::eSecondaryCommandBuffers
+                                                        : vk::SubpassContents::eInline;
+}
+
+bool Graph::IsRecordedOnce(Pass pass) const
+{
+    PassCreateInfo const &passInfo = _passInfos[pass.index];
+    return passInfo.recordOnce && !passInfo.executeChunk && !passInfo.executePermutation && !IsCompute(pass);
+}
+
+bool Graph::IsCacheValid(Pass pass) const
+{
+    PassHolder const &passHolder = _passes[pass.index];
+
+    if (!passHolder.isCacheValid[_currentFrameIndex])
+    {
+        return false;
+    }
+
+    std::vector<uint32_t> const &cachedVersions = passHolder.cachedVersions[_currentFrameIndex];
+    std::vector<StaticTextures const *> const &staticTextures = _passInfos[pass.index].staticTextures;
+
+    // writing to a bound descriptor set invalidates the command buffers it was recorded in
+    for (size_t i = 0; i < staticTextures.size(); i++)
+    {
+        if (cachedVersions[i] != staticTextures[i]->GetVersion())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint32_t Graph::GetChunkCount(Pass pass) const
+{
+    if (_passInfos[pass.index].executeChunk || _passInfos[pass.index].executePermutation)
+    {
+        return static_cast<uint32_t>(_recordingContexts.size());
+    }
+
+    return 1u;
+}
+
+vk::CommandBuffer Graph::NextSecondaryCommandBuffer(uint32_t threadIndex)
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    check(threadIndex < _recordingContexts.size());
+    RecordingContext &context = _recordingContexts[threadIndex];
+
+    std::vector<vk::CommandBuffer> &commandBuffers = context.commandBuffers[_currentFrameIndex];
+    uint32_t &usedCommandBuffers = context.usedCommandBuffers[_currentFrameIndex];
+
+    if (usedCommandBuffers == commandBuffers.size())
+    {
+        vk::CommandBufferAllocateInfo allocInfo{};
+        allocInfo.level = vk::CommandBufferLevel::eSecondary;
+        allocInfo.commandPool = context.commandPools[_currentFrameIndex];
+        allocInfo.commandBufferCount = 1u;
+
+        vk::CommandBuffer commandBuffer;
+        device->AllocateCommandBuffers(
+            allocInfo, &commandBuffer,
+            fmt::format("<graph_secondary_command_buffer>({}, {})", threadIndex, _currentFrameIndex));
+
+        commandBuffers.push_back(commandBuffer);
+    }
+
+    return commandBuffers[usedCommandBuffers++];
+}
+
+void Graph::Record(Pass pass, uint32_t chunk, uint32_t chunkCount, vk::CommandBuffer commandBuffer)
+{
+    PassHolder const &passHolder = _passes[pass.index];
+    PassHolder const &ownerHolder = _passes[GetOwner(pass).index];
+    PassCreateInfo const &passInfo = _passInfos[pass.index];
+
+    vk::CommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.renderPass = ownerHolder.renderPass;
+    inheritanceInfo.subpass = passHolder.subpass;
+    inheritanceInfo.framebuffer = ownerHolder.frameBuffers[_currentFrameIndex];
+
+    vk::CommandBufferBeginInfo beginInfo{};
+    beginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    if (!IsRecordedOnce(pass))
+    {
+        beginInfo.flags |= vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+    }
+
+    if (vk::Result const result = commandBuffer.begin(&beginInfo); result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Graph: failed to begin secondary command buffer for <{}> : {}",
+                                             passInfo.debugName, vk::to_string(result)));
+    }
+
+    RecordCommands(pass, chunk, chunkCount, commandBuffer);
+
+    commandBuffer.end();
+}
+
+void Graph::RecordCommands(Pass pass, uint32_t chunk, uint32_t chunkCount, vk::CommandBuffer commandBuffer) const
+{
+    ZoneScopedN("record pass");
+
+    PassHolder const &passHolder = _passes[pass.index];
+    PassCreateInfo const &passInfo = _passInfos[pass.index];
+
+    commandBuffer.setViewport(0, 1, &passHolder.viewport);
+    commandBuffer.setScissor(0, 1, &passHolder.scissor);
+
+    std::vector<vk::DescriptorSet> const &descriptorSets = passHolder.descriptorSets[_currentFrameIndex];
+    if (!descriptorSets.empty())
+    {
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, passHolder.pipeline.pipelineLayout, 0u,
+                                         static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0u,
+                                         nullptr);
+    }
+
+    if (passInfo.executePermutation)
+    {
+        for (size_t i = 0; i < passInfo.permutations.size(); i++)
+        {
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                                       i == 0 ? passHolder.pipeline.pipeline
+                                              : passHolder.pipeline.permutationPipelines[i - 1]);
+            passInfo.executePermutation(commandBuffer, passHolder.pipeline.pipelineLayout, passInfo.permutations[i],
+                                        chunk, chunkCount);
+        }
+    }
+    else
+    {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, passHolder.pipeline.pipeline);
+
+        if (passInfo.executeChunk)
+        {
+            passInfo.executeChunk(commandBuffer, passHolder.pipeline.pipelineLayout, chunk, chunkCount);
+        }
+        else
+        {
+            passInfo.execute(commandBuffer, passHolder.pipeline.pipelineLayout);
+        }
+    }
+}
+
+void Graph::Dispatch(Pass pass, vk::CommandBuffer commandBuffer) const
+{
+    ZoneScopedN("dispatch pass");
+
+    PassHolder const &passHolder = _passes[pass.index];
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, passHolder.pipeline.pipeline);
+
+    std::vector<vk::DescriptorSet> const &descriptorSets = passHolder.descriptorSets[_currentFrameIndex];
+    if (!descriptorSets.empty())
+    {
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, passHolder.pipeline.pipelineLayout, 0u,
+                                         static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0u,
+                                         nullptr);
+    }
+
+    _passInfos[pass.index].dispatch(commandBuffer, passHolder.pipeline.pipelineLayout);
+}
+
+void Graph::Reset()
+{
+    ZoneScopedN("resetting graph");
+    spdlog::debug("Graph: resetting began...");
+
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    if (_uboDescriptorPool != VK_NULL_HANDLE)
+    {
+        FreeUbo();
+    }
+
+    for (Resource const resource : _validResources)
+    {
+        Free(resource);
+    }
+    for (Pass const pass : _validPasses)
+    {
+        Free(pass);
+    }
+
+    std::set<uint32_t> memoryBlocks{};
+    for (uint32_t block = 0; block < _memoryBlocks.size(); block++)
+    {
+        memoryBlocks.insert(block);
+    }
+    FreeMemory(memoryBlocks);
+
+    FreeRetired(true);
+
+    _validResources.clear();
+    _validPasses.clear();
+    _orderedPasses.clear();
+
+    spdlog::debug("Graph: resetting complete...");
+}
+
+void Graph::Free(Resource resource)
+{
+    check(_validResources.find(resource) != _validResources.end());
+
+    ResourceHolder &resourceHolder = _resources[resource.index];
+
+    Retire([descriptorPool = _descriptorPool, descriptorSets = resourceHolder.descriptorSets,
+            inputDescriptorSets = resourceHolder.inputDescriptorSets,
+            storageDescriptorSets = resourceHolder.storageDescriptorSets, images = resourceHolder.images,
+            textures = resourceHolder.textures, buffers = resourceHolder.buffers](Device const *device) mutable {
+        for (std::array<vk::DescriptorSet, MAX_FRAMES_IN_FLIGHT> *sets :
+             {&descriptorSets, &inputDescriptorSets, &storageDescriptorSets})
+        {
+            for (vk::DescriptorSet &descriptorSet : *sets)
+            {
+                if (descriptorSet != VK_NULL_HANDLE)
+                {
+                    device->FreeDescriptorSet(descriptorPool, &descriptorSet);
+                }
+            }
+        }
+        for (Texture *texture : textures)
+        {
+            delete texture;
+        }
+        for (Image *image : images)
+        {
+            delete image;
+        }
+        for (vk::Buffer &buffer : buffers)
+        {
+            if (buffer != VK_NULL_HANDLE)
+            {
+                device->DestroyBuffer(&buffer);
+            }
+        }
+    });
+
+    resourceHolder.descriptorSets = {};
+    resourceHolder.inputDescriptorSets = {};
+    resourceHolder.storageDescriptorSets = {};
+    resourceHolder.images = {};
+    resourceHolder.textures = {};
+    resourceHolder.buffers = {};
+    resourceHolder.imageInfo = vk::ImageCreateInfo{};
+    resourceHolder.bufferInfo = vk::BufferCreateInfo{};
+
+    spdlog::debug("Graph: freed resource '{}'", _resourceInfos[resource.index].debugName);
+}
+
+void Graph::Free(Pass pass)
+{
+    check(_validPasses.find(pass) != _validPasses.end());
+
+    PassHolder &passHolder = _passes[pass.index];
+
+    FreePipeline(pass);
+    FreeRenderPass(pass);
+
+    passHolder.transitions.clear();
+    for (std::vector<vk::ImageMemoryBarrier> &imageMemoryBarriers : passHolder.imageMemoryBarriers)
+    {
+        imageMemoryBarriers.clear();
+    }
+    for (std::vector<vk::BufferMemoryBarrier> &bufferMemoryBarriers : passHolder.bufferMemoryBarriers)
+    {
+        bufferMemoryBarriers.clear();
+    }
+
+    if (!passHolder.cachedCommandBuffers.empty())
+    {
+        Retire([commandPool = _cachedCommandPool,
+                commandBuffers = passHolder.cachedCommandBuffers](Device const *device) mutable {
+            device->FreeCommandBuffers(commandPool, &commandBuffers);
+        });
+        passHolder.cachedCommandBuffers.clear();
+    }
+    passHolder.isCacheValid.fill(false);
+
+    spdlog::debug("Graph: freed pass '{}'", _passInfos[pass.index].debugName);
+}
+
+void Graph::FreeRenderPass(Pass pass)
+{
+    PassHolder &passHolder = _passes[pass.index];
+
+    if (passHolder.renderPass == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    Retire([renderPass = passHolder.renderPass,
+            frameBuffers = passHolder.frameBuffers](Device const *device) mutable {
+        for (vk::Framebuffer &frameBuffer : frameBuffers)
+        {
+            device->DestroyFramebuffer(&frameBuffer);
+        }
+        device->DestroyRenderPass(&renderPass);
+    });
+
+    passHolder.renderPass = VK_NULL_HANDLE;
+    passHolder.frameBuffers = {};
+    passHolder.renderPassDescription = {};
+    passHolder.frameBufferViews = {};
+    passHolder.frameBufferExtent = vk::Extent2D{};
+}
+
+void Graph::FreeMemory(std::set<uint32_t> const &memoryBlocks)
+{
+    if (memoryBlocks.empty())
+    {
+        return;
+    }
+
+    std::vector<MemoryBlock> keptBlocks{};
+    std::vector<uint32_t> newIndices(_memoryBlocks.size(), UINT32_MAX);
+
+    for (uint32_t block = 0; block < _memoryBlocks.size(); block++)
+    {
+        if (memoryBlocks.find(block) == memoryBlocks.end())
+        {
+            newIndices[block] = static_cast<uint32_t>(keptBlocks.size());
+            keptBlocks.push_back(_memoryBlocks[block]);
+            continue;
+        }
+
+        Retire([memories = _memoryBlocks[block].memories](Device const *device) mutable {
+            for (vk::DeviceMemory &deviceMemory : memories)
+            {
+                device->FreeDeviceMemory(&deviceMemory);
+            }
+        });
+    }
+
+    _memoryBlocks = std::move(keptBlocks);
+
+    for (uint32_t resource = 0; resource < _resources.size(); resource++)
+    {
+        if (IsBuilt(Resource{resource}))
+        {
+            ResourceHolder &resourceHolder = _resources[resource];
+            check(newIndices[resourceHolder.memoryBlock] != UINT32_MAX);
+            resourceHolder.memoryBlock = newIndices[resourceHolder.memoryBlock];
+        }
+    }
+
+    spdlog::debug("Graph: freed {} memory blocks", memoryBlocks.size());
+}
+
+void Graph::Retire(std::function<void(Device const *)> const &destroy)
+{
+    std::unique_lock<std::mutex> lock{_retiredMutex}; // pipelines are replaced from worker threads
+    _retired.emplace_back(MAX_FRAMES_IN_FLIGHT, destroy);
+}
+
+void Graph::FreeRetired(bool all)
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    for (auto it = _retired.begin(); it != _retired.end();)
+    {
+        if (all || --it->first == 0)
+        {
+            it->second(device);
+            it = _retired.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
+
+void Graph::KhanFindOrder(std::set<Resource> const &resources, std::set<Pass> const &passes)
+{
+    _orderedPasses.clear();
+
+    std::map<Resource, int> resourceDegrees{};
+    std::map<Pass, int> passDegrees{};
+
+    for (Resource const resource : resources)
+    {
+        // a parent can be in use for some of its subresources only, it waits on the writers that run
+        std::vector<Pass> const &writers = _resources[resource.index].writers;
+        resourceDegrees[resource] =
+            std::count_if(writers.begin(), writers.end(), [&passes](Pass writer) { return passes.count(writer); });
+    }
+
+    for (Pass const pass : passes)
+    {
+        PassCreateInfo const &passInfo = _passInfos[pass.index];
+        passDegrees[pass] += passInfo.reads.size() - passInfo.earlyReads.size() + passInfo.passDependencies.size();
+
+        for (Pass const overwriter : GetOverwriters(pass))
+        {
+            if (passes.count(overwriter))
+            {
+                passDegrees[overwriter]++;
+            }
+        }
+    }
+
+    while (passDegrees.size() > 0 && resourceDegrees.size() > 0)
+    {
+        bool progress = false;
+
+        for (auto it = resourceDegrees.begin(); it != resourceDegrees.end();)
+        {
+            if (it->second == 0)
+            {
+                ResourceHolder const &resourceHolder = _resources[it->first.index];
+                for (Pass const reader : resourceHolder.readers)
+                {
+                    if (!IsReadEarly(it->first, reader))
+                    {
+                        passDegrees.at(reader)--;
+                    }
+                }
+                it = resourceDegrees.erase(it);
+                progress = true;
+            }
+            else
+            {
+                it++;
+            }
+        }
+        for (auto it = passDegrees.begin(); it != passDegrees.end();)
+        {
+            if (it->second == 0)
+            {
+                PassCreateInfo const &passInfo = _passInfos[it->first.index];
+                for (Resource const writey : passInfo.writes)
+                {
+                    resourceDegrees.at(writey)--;
+                    if (IsSubresource(writey))
+                    {
+                        resourceDegrees.at(GetParent(writey))--;
+                    }
+                }
+                PassHolder const &passHolder = _passes[it->first.index];
+                for (Pass const dependant : passHolder.dependencies)
+                {
+                    passDegrees.at(dependant)--;
+                }
+                for (Pass const overwriter : GetOverwriters(it->first))
+                {
+                    if (passes.count(overwriter))
+                    {
+                        passDegrees.at(overwriter)--;
+                    }
+                }
+                _orderedPasses.push_back(it->first);
+                it = passDegrees.erase(it);
+                progress = true;
+            }
+            else
+            {
+                it++;
+            }
+        }
+        if (progress == false)
+        {
+            std::ostringstream oss;
+            oss << "Graph: circular dependency found! cannot compile: ";
+            for (auto const &[resource, degree] : resourceDegrees)
+            {
+                ResourceCreateInfo const &resourceInfo = _resourceInfos[resource.index];
+                oss << resourceInfo.debugName << ": " << degree << ", ";
+            }
+            for (auto const &[pass, degree] : passDegrees)
+            {
+                PassCreateInfo const &passInfo = _passInfos[pass.index];
+                oss << passInfo.debugName << ": " << degree << ", ";
+            }
+            throw std::runtime_error(oss.str());
+        }
+    }
+
+    std::ostringstream oss;
+    oss << "Graph: pass order selected: ";
+    for (int i = 0; i < _orderedPasses.size(); i++)
+    {
+        PassCreateInfo const &passInfo = _passInfos[_orderedPasses[i].index];
+
+        if (i != 0)
+        {
+            oss << " -> ";
+        }
+        oss << passInfo.debugName;
+    }
+    spdlog::info("{0}", oss.str());
+}
+
+void Graph::FindLifetimes()
+{
+    std::vector<uint32_t> order(_passInfos.size(), UINT32_MAX);
+    for (uint32_t i = 0; i < _orderedPasses.size(); i++)
+    {
+        order[_orderedPasses[i].index] = i;
+    }
+
+    auto const byOrder = [&order](Pass a, Pass b) { return order[a.index] < order[b.index]; };
+
+    for (Resource const resource : _validResources)
+    {
+        ResourceHolder &resourceHolder = _resources[resource.index];
+
+        // declaration order isn't execution order, the first writer to run is the one that clears
+        std::sort(resourceHolder.writers.begin(), resourceHolder.writers.end(), byOrder);
+        std::sort(resourceHolder.readers.begin(), resourceHolder.readers.end(), byOrder);
+
+        resourceHolder.lifetime = {UINT32_MAX, 0u};
+
+        for (std::vector<Pass> const *users : {&resourceHolder.writers, &resourceHolder.readers})
+        {
+            for (Pass const user : *users)
             {
-                descriptorSets.push_back(_resources[resource.index].descriptorSets[_currentFrameIndex]);
+                if (order[user.index] == UINT32_MAX)
+                {
+                    continue;
+                }
+
+                resourceHolder.lifetime.first = std::min(resourceHolder.lifetime.first, order[user.index]);
+                resourceHolder.lifetime.second = std::max(resourceHolder.lifetime.second, order[user.index]);
             }
+        }
+    }
+
+    // a parent's images are live for as long as any of its subresources is
+    for (Resource const resource : _validResources)
+    {
+        std::pair<uint32_t, uint32_t> const &lifetime = _resources[resource.index].lifetime;
+        if (!IsSubresource(resource) || lifetime.first == UINT32_MAX)
+        {
+            continue;
+        }
+
+        std::pair<uint32_t, uint32_t> &parentLifetime = _resources[GetParent(resource).index].lifetime;
+        parentLifetime.first = std::min(parentLifetime.first, lifetime.first);
+        parentLifetime.second = std::max(parentLifetime.second, lifetime.second);
+    }
+}
+
+void Graph::FindSubpasses()
+{
+    for (uint32_t i = 0; i < _orderedPasses.size(); i++)
+    {
+        Pass const pass = _orderedPasses[i];
+        PassHolder &passHolder = _passes[pass.index];
+
+        passHolder.order = i;
+        passHolder.subpass = 0;
+        passHolder.subpasses = {pass};
+
+        if (i == 0)
+        {
+            continue;
+        }
+
+        Pass const owner = _orderedPasses[i - 1 - _passes[_orderedPasses[i - 1].index].subpass];
+        if (!CanMerge(owner, pass))
+        {
+            continue;
+        }
+
+        PassHolder &ownerHolder = _passes[owner.index];
+
+        passHolder.subpass = static_cast<uint32_t>(ownerHolder.subpasses.size());
+        passHolder.subpasses.clear();
+        ownerHolder.subpasses.push_back(pass);
+
+        spdlog::info("Graph: merged '{}' into the render pass of '{}' as subpass {}", _passInfos[pass.index].debugName,
+                     _passInfos[owner.index].debugName, passHolder.subpass);
+    }
+
+    // attachments of a render pass are all live for as long as it runs
+    for (Resource const resource : _validResources)
+    {
+        std::pair<uint32_t, uint32_t> &lifetime = _resources[resource.index].lifetime;
+        if (lifetime.first == UINT32_MAX)
+        {
+            continue;
+        }
+
+        PassHolder const &first = _passes[_orderedPasses[lifetime.first].index];
+        PassHolder const &last = _passes[_orderedPasses[lifetime.second].index];
+        PassHolder const &lastOwner = _passes[_orderedPasses[last.order - last.subpass].index];
+
+        lifetime.first = first.order - first.subpass;
+        lifetime.second = lastOwner.order + static_cast<uint32_t>(lastOwner.subpasses.size()) - 1;
+    }
+}
+
+bool Graph::CanMerge(Pass owner, Pass pass) const
+{
+    PassCreateInfo const &passInfo = _passInfos[pass.index];
+
+    if (IsCompute(owner) || IsCompute(pass) || IsCached(owner) || IsCached(pass) || GetExtent(owner) != GetExtent(pass))
+    {
+        return false;
+    }
+
+    // a render pass has one render area, which only scales for screen sized passes
+    if (IsScreenSized(_passInfos[owner.index].writes.at(0)) != IsScreenSized(passInfo.writes.at(0)))
+    {
+        return false;
+    }
+
+    // compared by parent, sampling every mip of an image conflicts with drawing to one of them
+    std::set<Resource> attachments{};
+    std::set<Resource> sampled{};
+    for (Pass const subpass : _passes[owner.index].subpasses)
+    {
+        PassCreateInfo const &subpassInfo = _passInfos[subpass.index];
+
+        for (Resource const resource : subpassInfo.writes)
+        {
+            attachments.insert(GetParent(resource));
+        }
+        for (Resource const resource : subpassInfo.reads)
+        {
+            (subpassInfo.pixelLocalReads ? attachments : sampled).insert(GetParent(resource));
+        }
+    }
+
+    // sampling needs a barrier outside of the render pass, so nothing sampled can be an attachment in it
+    bool sharesAttachment = false;
+    for (Resource const resource : passInfo.writes)
+    {
+        if (sampled.count(GetParent(resource)))
+        {
+            return false;
+        }
+        sharesAttachment |= attachments.count(GetParent(resource)) > 0;
+    }
+    for (Resource const resource : passInfo.reads)
+    {
+        if ((passInfo.pixelLocalReads ? sampled : attachments).count(GetParent(resource)))
+        {
+            return false;
+        }
+        sharesAttachment |= attachments.count(GetParent(resource)) > 0;
+    }
+
+    return sharesAttachment;
+}
+
+bool Graph::IsTransient(Resource resource) const
+{
+    // the target is read after the graph is done with it, kept resources by the next frames
+    return resource != _target && !IsKept(resource) && _resources[resource.index].lifetime.first != UINT32_MAX;
+}
+
+bool Graph::IsMemoryless(Resource resource) const
+{
+    // contents never leave the one render pass using them, tilers can keep them on chip
+    ResourceHolder const &resourceHolder = _resources[resource.index];
+
+    if (resource == _target || resourceHolder.lifetime.first == UINT32_MAX || IsStorage(resource) ||
+        IsSubresource(resource) || !resourceHolder.subresources.empty() || IsKept(resource))
+    {
+        return false;
+    }
+    for (Pass const reader : resourceHolder.readers)
+    {
+        if (!_passInfos[reader.index].pixelLocalReads)
+        {
+            return false;
+        }
+    }
+
+    PassHolder const &owner = _passes[_orderedPasses[resourceHolder.lifetime.first].index];
+    return resourceHolder.lifetime.second == owner.order + owner.subpasses.size() - 1;
+}
+
+vk::ImageCreateInfo Graph::GetImageInfo(Resource resource)
+{
+    ResourceCreateInfo const &createInfo = _resourceInfos[resource.index];
+    vk::Extent2D const extent = GetExtent(resource);
+
+    vk::ImageCreateInfo imageInfo{};
+    imageInfo.imageType = vk::ImageType::e2D;
+    imageInfo.mipLevels = createInfo.mipLevels;
+    imageInfo.arrayLayers = createInfo.arrayLayers;
+    imageInfo.samples = vk::SampleCountFlagBits::e1;
+    imageInfo.format = createInfo.format;
+    imageInfo.tiling = vk::ImageTiling::eOptimal;
+    imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+    imageInfo.extent = vk::Extent3D{extent.width, extent.height, 1u};
+    imageInfo.usage = GetImageUsage(resource);
+
+    for (Resource const subresource : _resources[resource.index].subresources)
+    {
+        imageInfo.usage |= GetImageUsage(subresource);
+    }
+
+    return imageInfo;
+}
+
+vk::ImageUsageFlags Graph::GetImageUsage(Resource resource)
+{
+    ResourceCreateInfo const &createInfo = _resourceInfos[resource.index];
+
+    vk::ImageUsageFlags usage{};
+
+    ResourceHolder const &resourceHolder = _resources[resource.index];
+    if (resourceHolder.writers.size() > 0)
+    {
+        switch (createInfo.usage)
+        {
+        case ResourceUsage::eColor:
+            usage |= vk::ImageUsageFlagBits::eColorAttachment;
+            break;
+        case ResourceUsage::eDepth:
+            usage |= vk::ImageUsageFlagBits::eDepthStencilAttachment;
+            break;
+        case ResourceUsage::eStorageImage:
+            usage |= vk::ImageUsageFlagBits::eStorage;
+            break;
+        case ResourceUsage::eStorageBuffer:
+            check(false && "Graph: storage buffers have no image");
+            break;
+        }
+    }
+    if (IsSampled(resource))
+    {
+        usage |= vk::ImageUsageFlagBits::eSampled;
+    }
+    if (resource == _target)
+    {
+        usage |= vk::ImageUsageFlagBits::eTransferSrc; // blitted to the swapchain, or read back
+    }
+    if (IsReadAsInput(resource))
+    {
+        usage |= vk::ImageUsageFlagBits::eInputAttachment;
+    }
+    if (IsKept(resource))
+    {
+        usage |= vk::ImageUsageFlagBits::eTransferDst; // cleared before the first frame finds it
+    }
+    if (IsMemoryless(resource))
+    {
+        usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+    }
+
+    return usage;
+}
+
+void Graph::Build(Resource resource)
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    ResourceCreateInfo const &createInfo = _resourceInfos[resource.index];
+    ResourceHolder &resourceHolder = _resources[resource.index];
+
+    if (IsBuffer(resource))
+    {
+        if (createInfo.size == 0)
+        {
+            throw std::runtime_error(fmt::format("Graph: storage buffer '{}' has no size", createInfo.debugName));
+        }
+
+        resourceHolder.bufferInfo = GetBufferInfo(resource);
+
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            device->CreateBuffer(resourceHolder.bufferInfo, &resourceHolder.buffers[i],
+                                 createInfo.debugName + std::string("_buffer"));
+        }
+    }
+    else
+    {
+        resourceHolder.imageInfo = GetImageInfo(resource);
+
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            resourceHolder.images[i] =
+                new Image(device, resourceHolder.imageInfo, createInfo.debugName + std::string("_image"), false);
+        }
+    }
+
+    spdlog::debug("Graph: built <{0}> resource", createInfo.debugName);
+}
+
+vk::BufferCreateInfo Graph::GetBufferInfo(Resource resource) const
+{
+    vk::BufferCreateInfo bufferInfo{};
+    bufferInfo.size = _resourceInfos[resource.index].size;
+    bufferInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+    if (_resourceInfos[resource.index].indirect) // counts are cleared with fillBuffer before being written
+    {
+        bufferInfo.usage |= vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst;
+    }
+    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
 
-            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, passHolder.pipeline.pipelineLayout,
-                                             offset, descriptorSets.size(), descriptorSets.data(), 0u, nullptr);
+    return bufferInfo;
+}
 
-            offset += passInfo.reads.size();
-        }
+vk::MemoryRequirements Graph::GetMemoryRequirements(Resource resource) const
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
 
-        for (StaticTextures const *staticTextures : passInfo.staticTextures)
-        {
-            vk::DescriptorSet const staticDescriptorSet = staticTextures->GetDescriptorSet();
-            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, passHolder.pipeline.pipelineLayout,
-                                             offset, 1u, &staticDescriptorSet, 0u, nullptr);
-            offset++;
-        }
+    ResourceHolder const &resourceHolder = _resources[resource.index];
 
-        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, passHolder.pipeline.pipeline);
-        passInfo.execute(commandBuffer, passHolder.pipeline.pipelineLayout);
-        commandBuffer.endRenderPass();
+    if (IsBuffer(resource))
+    {
+        return device->GetBufferMemoryRequirements(resourceHolder.buffers[0]);
     }
+    return resourceHolder.images[0]->GetMemoryRequirements(device);
 }
 
-void Graph::Reset()
+void Graph::BuildMemory(std::vector<Resource> const &resources)
 {
-    ZoneScopedN("resetting graph");
-    spdlog::debug("Graph: resetting began...");
-
     Device const *device = SafeDeviceAccessor::Get();
     check(device);
 
-    if (_uboDescriptorPool != VK_NULL_HANDLE)
+    std::vector<std::pair<Resource, vk::MemoryRequirements>> requirements{};
+    requirements.reserve(resources.size());
+
+    for (Resource const resource : resources)
     {
-        FreeUbo();
+        requirements.emplace_back(resource, GetMemoryRequirements(resource));
     }
 
-    for (ResourceHolder &resource : _resources)
+    // largest first, so that smaller resources slot into blocks instead of growing them
+    std::stable_sort(requirements.begin(), requirements.end(),
+                     [](auto const &a, auto const &b) { return a.second.size > b.second.size; });
+
+    // blocks kept from a previous compile are already packed, new resources only alias among themselves
+    size_t const firstBlock = _memoryBlocks.size();
+
+    for (auto const &[resource, memoryRequirements] : requirements)
     {
-        resource.writers.clear();
-        resource.readers.clear();
+        ResourceHolder &resourceHolder = _resources[resource.index];
+        bool const isTransient = IsTransient(resource);
+        bool const isScreenSized = _resourceInfos[resource.index].extent == vk::Extent2D{0, 0};
+
+        vk::MemoryPropertyFlags properties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+        if (IsMemoryless(resource) &&
+            device->HasMemoryType(memoryRequirements.memoryTypeBits,
+                                  properties | vk::MemoryPropertyFlagBits::eLazilyAllocated))
+        {
+            properties |= vk::MemoryPropertyFlagBits::eLazilyAllocated;
+        }
+
+        auto const fits = [&](MemoryBlock const &memoryBlock) {
+            if (!isTransient || !memoryBlock.isShared || memoryBlock.isScreenSized != isScreenSized ||
+                memoryBlock.properties != properties ||
+                !(memoryBlock.memoryTypeBits & memoryRequirements.memoryTypeBits))
+            {
+                return false;
+            }
+
+            return std::none_of(memoryBlock.lifetimes.begin(), memoryBlock.lifetimes.end(),
+                                [&](std::pair<uint32_t, uint32_t> const &lifetime) {
+                                    return lifetime.first <= resourceHolder.lifetime.second &&
+                                           resourceHolder.lifetime.first <= lifetime.second;
+                                });
+        };
+
+        auto it = std::find_if(_memoryBlocks.begin() + firstBlock, _memoryBlocks.end(), fits);
+        if (it == _memoryBlocks.end())
+        {
+            MemoryBlock memoryBlock{};
+            memoryBlock.properties = properties;
+            memoryBlock.isShared = isTransient;
+            memoryBlock.isScreenSized = isScreenSized;
+
+            _memoryBlocks.push_back(memoryBlock);
+            it = std::prev(_memoryBlocks.end());
+        }
+
+        it->size = std::max(it->size, memoryRequirements.size);
+        it->memoryTypeBits &= memoryRequirements.memoryTypeBits;
+        it->lifetimes.push_back(resourceHolder.lifetime);
+
+        resourceHolder.memoryBlock = static_cast<uint32_t>(std::distance(_memoryBlocks.begin(), it));
+        resourceHolder.packedLifetime = resourceHolder.lifetime;
+        resourceHolder.isPackedTransient = isTransient;
     }
-    for (PassHolder &pass : _passes)
+
+    for (size_t block = firstBlock; block < _memoryBlocks.size(); block++)
     {
-        pass.dependencies.clear();
+        MemoryBlock &memoryBlock = _memoryBlocks[block];
+
+        vk::MemoryAllocateInfo allocInfo{};
+        allocInfo.allocationSize = memoryBlock.size;
+        allocInfo.memoryTypeIndex = device->FindMemoryType(memoryBlock.memoryTypeBits, memoryBlock.properties);
+
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            device->AllocateMemory(allocInfo, &memoryBlock.memories[i],
+                                   fmt::format("<graph_memory_block>({}, {})", block, i));
+        }
+    }
+
+    for (Resource const resource : resources)
+    {
+        ResourceHolder &resourceHolder = _resources[resource.index];
+        MemoryBlock const &memoryBlock = _memoryBlocks[resourceHolder.memoryBlock];
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            if (IsBuffer(resource))
+            {
+                device->BindBufferMemory(resourceHolder.buffers[i], memoryBlock.memories[i], 0u);
+            }
+            else
+            {
+                resourceHolder.images[i]->BindMemory(device, memoryBlock.memories[i], 0u);
+            }
+        }
     }
 
+    vk::DeviceSize dedicatedSize = 0;
     for (Resource const resource : _validResources)
     {
-        Free(resource);
+        if (!IsSubresource(resource))
+        {
+            dedicatedSize += GetMemoryRequirements(resource).size;
+        }
     }
-    for (Pass const pass : _validPasses)
+    vk::DeviceSize aliasedSize = 0;
+    for (MemoryBlock const &memoryBlock : _memoryBlocks)
     {
-        Free(pass);
+        aliasedSize += memoryBlock.size;
     }
 
-    _passes.clear();
-    _passes.resize(_passInfos.size(), {});
-    _resources.clear();
-    _resources.resize(_resourceInfos.size(), {});
-
-    spdlog::debug("Graph: resetting complete...");
+    float const mebibyte = 1024.f * 1024.f;
+    spdlog::info("Graph: render targets use {:.1f} MiB in {} memory blocks ({:.1f} MiB without aliasing)",
+                 aliasedSize * MAX_FRAMES_IN_FLIGHT / mebibyte, _memoryBlocks.size(),
+                 dedicatedSize * MAX_FRAMES_IN_FLIGHT / mebibyte);
 }
 
-void Graph::Free(Resource resource)
+void Graph::BuildViews(Resource resource)
 {
     Device const *device = SafeDeviceAccessor::Get();
     check(device);
 
-    check(_validResources.find(resource) != _validResources.end());
+    ResourceCreateInfo const &createInfo = _resourceInfos[resource.index];
 
-    ResourceHolder &resourceHolder = _resources[resource.index];
+    if (!IsBuffer(resource)) // storage buffers are bound whole, without a view
+    {
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            ResourceHolder &resourceHolder = _resources[resource.index];
+
+            Texture::CreateInfo textureCreateInfo{};
+            textureCreateInfo.pImage = GetImage(resource, i);
+            textureCreateInfo.name = createInfo.debugName;
+            textureCreateInfo.pSampler = _colorSampler;
+            textureCreateInfo.baseMipLevel = createInfo.mip;
+            textureCreateInfo.mipLevels = createInfo.mipLevels;
+            textureCreateInfo.baseArrayLayer = createInfo.layer;
+            textureCreateInfo.arrayLayers = createInfo.arrayLayers;
+
+            if (createInfo.usage == ResourceUsage::eDepth)
+            {
+                textureCreateInfo.depth = true;
+                textureCreateInfo.pSampler = _depthSampler;
+            }
+
+            resourceHolder.textures[i] = new Texture(device, textureCreateInfo);
+        }
+    }
+
+    BuildDescriptors(resource);
+
+    spdlog::debug("Graph: built <{0}> views", createInfo.debugName);
+}
+
+bool Graph::RenderPassDescription::operator==(RenderPassDescription const &other) const
+{
+    return attachments == other.attachments && attachmentDescriptions == other.attachmentDescriptions &&
+           colorReferences == other.colorReferences && depthReferences == other.depthReferences &&
+           inputReferences == other.inputReferences && preserveAttachments == other.preserveAttachments &&
+           dependencies == other.dependencies;
+}
+
+Graph::RenderPassDescription Graph::DescribeRenderPass(Pass pass) const
+{
+    PassHolder const &passHolder = _passes[pass.index];
+    check(passHolder.subpass == 0);
+
+    std::vector<Pass> const &subpasses = passHolder.subpasses;
+    uint32_t const lastOrder = passHolder.order + static_cast<uint32_t>(subpasses.size()) - 1;
+
+    // every resource drawn to or read as input by one of the subpasses, in order of first use
+    RenderPassDescription description{};
+    std::vector<Resource> &attachments = description.attachments;
+    std::vector<vk::AttachmentDescription> &attachmentDescriptions = description.attachmentDescriptions;
+    std::vector<std::pair<uint32_t, uint32_t>> attachmentSpans{}; // first and last subpass using it
+    std::vector<ResourceAccess> lastAccesses{};
+
+    auto const useAttachment = [&](Resource resource, uint32_t subpass, ResourceAccess const &access) {
+        auto const it = std::find(attachments.begin(), attachments.end(), resource);
+        if (it != attachments.end())
+        {
+            uint32_t const index = static_cast<uint32_t>(std::distance(attachments.begin(), it));
+
+            attachmentDescriptions[index].finalLayout = access.layout;
+            attachmentSpans[index].second = subpass;
+            lastAccesses[index] = access;
+
+            return vk::AttachmentReference{index, access.layout};
+        }
+
+        ResourceHolder const &resourceHolder = _resources[resource.index];
+
+        // only the first writer starts from scratch, and only passes after this render pass need what's stored
+        bool const isCleared = !resourceHolder.writers.empty() && resourceHolder.writers.front() == subpasses[subpass];
+        bool const isStored = resource == _target || IsKept(GetParent(resource)) ||
+                              _resources[GetParent(resource).index].lifetime.second > lastOrder;
+
+        vk::AttachmentDescription attachment{};
+        attachment.format = _resourceInfos[resource.index].format;
+        attachment.samples = vk::SampleCountFlagBits::e1;
+        attachment.loadOp = isCleared ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
+        attachment.storeOp = isStored ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+        attachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+        attachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+        // layout transitions into the render pass happen in the barrier plan
+        attachment.initialLayout = access.layout;
+        attachment.finalLayout = access.layout;
+
+        attachments.push_back(resource);
+        attachmentDescriptions.push_back(attachment);
+        attachmentSpans.emplace_back(subpass, subpass);
+        lastAccesses.push_back(access);
+
+        return vk::AttachmentReference{static_cast<uint32_t>(attachments.size() - 1), access.layout};
+    };
 
-    for (vk::DescriptorSet &descriptorSet : resourceHolder.descriptorSets)
+    description.colorReferences.resize(subpasses.size());
+    description.depthReferences.resize(subpasses.size(),
+                                       vk::AttachmentReference{VK_ATTACHMENT_UNUSED, vk::ImageLayout::eUndefined});
+    description.inputReferences.resize(subpasses.size());
+
+    for (uint32_t subpass = 0; subpass < subpasses.size(); subpass++)
     {
-        device->FreeDescriptorSet(_descriptorPool, &descriptorSet);
+        Pass const member = subpasses[subpass];
+        PassCreateInfo const &memberInfo = _passInfos[member.index];
+
+        if (memberInfo.pixelLocalReads)
+        {
+            for (Resource const resource : memberInfo.reads)
+            {
+                description.inputReferences[subpass].push_back(
+                    useAttachment(resource, subpass, GetReadAccess(resource, member)));
+            }
+        }
+
+        for (Resource const resource : memberInfo.writes)
+        {
+            vk::AttachmentReference const reference =
+                useAttachment(resource, subpass, GetWriteAccess(resource, member));
+
+            switch (_resourceInfos[resource.index].usage)
+            {
+            case ResourceUsage::eColor:
+                description.colorReferences[subpass].push_back(reference);
+                break;
+            case ResourceUsage::eDepth:
+                description.depthReferences[subpass] = reference;
+                break;
+            default: // graphics passes never write storage
+                break;
+            }
+        }
     }
-    resourceHolder.descriptorSets = {};
 
-    for (Image *image : resourceHolder.images)
+    description.dependencies = passHolder.subpassDependencies;
+
+    // the render pass hands the target over to whatever consumes the graph
+    Pass const targetWriter = _resources[_target.index].writers.back();
+    if (auto const it = std::find(attachments.begin(), attachments.end(), _target);
+        it != attachments.end() && std::find(subpasses.begin(), subpasses.end(), targetWriter) != subpasses.end())
     {
-        delete image;
+        uint32_t const index = static_cast<uint32_t>(std::distance(attachments.begin(), it));
+
+        vk::SubpassDependency subpassDependency{};
+        subpassDependency.srcSubpass = attachmentSpans[index].second;
+        subpassDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+        subpassDependency.srcStageMask = lastAccesses[index].stageMask;
+        subpassDependency.srcAccessMask = lastAccesses[index].accessMask;
+
+        if (_usage == GraphUsage::eToTransfer)
+        {
+            attachmentDescriptions[index].finalLayout = vk::ImageLayout::eTransferSrcOptimal;
+            subpassDependency.dstStageMask = vk::PipelineStageFlagBits::eTransfer;
+            subpassDependency.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+        }
+        else
+        {
+            attachmentDescriptions[index].finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+            subpassDependency.dstStageMask = vk::PipelineStageFlagBits::eFragmentShader;
+            subpassDependency.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+        }
+
+        description.dependencies.push_back(subpassDependency);
     }
-    resourceHolder.images = {};
 
-    for (Texture *texture : resourceHolder.textures)
+    description.preserveAttachments.resize(subpasses.size());
+
+    for (uint32_t index = 0; index < attachments.size(); index++)
     {
-        delete texture;
+        auto const references = [index](std::vector<vk::AttachmentReference> const &attachmentReferences) {
+            return std::any_of(attachmentReferences.begin(), attachmentReferences.end(),
+                               [index](vk::AttachmentReference const &reference) {
+                                   return reference.attachment == index;
+                               });
+        };
+
+        for (uint32_t subpass = attachmentSpans[index].first + 1; subpass < attachmentSpans[index].second; subpass++)
+        {
+            if (!references(description.colorReferences[subpass]) &&
+                !references(description.inputReferences[subpass]) &&
+                description.depthReferences[subpass].attachment != index)
+            {
+                description.preserveAttachments[subpass].push_back(index);
+            }
+        }
     }
-    resourceHolder.textures = {};
 
-    spdlog::debug("Graph: freed resource '{}'", _resourceInfos[resource.index].debugName);
+    return description;
 }
 
-void Graph::Free(Pass pass)
+void Graph::Build(Pass pass)
 {
     Device const *device = SafeDeviceAccessor::Get();
     check(device);
 
-    check(_validPasses.find(pass) != _validPasses.end());
-
+    PassCreateInfo const &createInfo = _passInfos[pass.index];
     PassHolder &passHolder = _passes[pass.index];
 
-    PipelineHolder &pipelineHolder = passHolder.pipeline;
-    device->DestroyShaderModule(&pipelineHolder.vertShaderModule);
-    device->DestroyShaderModule(&pipelineHolder.fragShaderModule);
-    device->DestroyPipelineLayout(&pipelineHolder.pipelineLayout);
-    device->DestroyGraphicsPipeline(&pipelineHolder.pipeline);
-
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    if (IsCompute(pass))
     {
-        vk::Framebuffer &framebuffer = passHolder.frameBuffers[i];
-        device->DestroyFramebuffer(&framebuffer);
+        return; // dispatched outside of render passes, it only needs its pipeline
     }
 
-    passHolder.imageMemoryBarriers.clear();
+    vk::Extent2D const extent = GetExtent(pass);
+    vk::Extent2D const renderExtent = GetRenderExtent(pass);
 
-    vk::RenderPass &renderPass = passHolder.renderPass;
-    device->DestroyRenderPass(&renderPass);
+    passHolder.viewport.x = 0.f;
+    passHolder.viewport.y = 0.f;
+    passHolder.viewport.width = static_cast<float>(renderExtent.width); // WARN: important fix, need to send to tauri
+    passHolder.viewport.height = static_cast<float>(renderExtent.height);
+    passHolder.viewport.minDepth = 0.f;
+    passHolder.viewport.maxDepth = 1.f;
 
-    spdlog::debug("Graph: freed pass '{}'", _passInfos[pass.index].debugName);
-}
+    passHolder.scissor.offset = vk::Offset2D{0, 0};
+    passHolder.scissor.extent = renderExtent;
 
-void Graph::KhanFindOrder(std::set<Resource> const &resources, std::set<Pass> const &passes)
-{
-    _orderedPasses.clear();
+    if (passHolder.subpass != 0)
+    {
+        FreeRenderPass(pass); // in case it owned one before being merged into another
+        return;
+    }
 
-    std::map<Resource, int> resourceDegrees{};
-    std::map<Pass, int> passDegrees{};
+    RenderPassDescription description = DescribeRenderPass(pass);
+    bool const isRenderPassChanged =
+        passHolder.renderPass == VK_NULL_HANDLE || description != passHolder.renderPassDescription;
 
-    for (Resource const resource : resources)
+    if (isRenderPassChanged)
     {
-        resourceDegrees[resource] = _resources[resource.index].writers.size();
+        FreeRenderPass(pass);
+
+        std::vector<vk::SubpassDescription> subpassDescriptions(passHolder.subpasses.size());
+
+        for (uint32_t subpass = 0; subpass < subpassDescriptions.size(); subpass++)
+        {
+            vk::SubpassDescription &subpassDescription = subpassDescriptions[subpass];
+            subpassDescription.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+            subpassDescription.colorAttachmentCount =
+                static_cast<uint32_t>(description.colorReferences[subpass].size());
+            subpassDescription.pColorAttachments = description.colorReferences[subpass].data();
+            subpassDescription.pDepthStencilAttachment = &description.depthReferences[subpass];
+            subpassDescription.inputAttachmentCount =
+                static_cast<uint32_t>(description.inputReferences[subpass].size());
+            subpassDescription.pInputAttachments = description.inputReferences[subpass].data();
+            subpassDescription.preserveAttachmentCount =
+                static_cast<uint32_t>(description.preserveAttachments[subpass].size());
+            subpassDescription.pPreserveAttachments = description.preserveAttachments[subpass].data();
+        }
+
+        vk::RenderPassCreateInfo renderPassCreateInfo{};
+        renderPassCreateInfo.attachmentCount = description.attachmentDescriptions.size();
+        renderPassCreateInfo.pAttachments = description.attachmentDescriptions.data();
+        renderPassCreateInfo.subpassCount = subpassDescriptions.size();
+        renderPassCreateInfo.pSubpasses = subpassDescriptions.data();
+        renderPassCreateInfo.dependencyCount = description.dependencies.size();
+        renderPassCreateInfo.pDependencies = description.dependencies.data();
+
+        device->CreateRenderPass(renderPassCreateInfo, &passHolder.renderPass, createInfo.debugName + "<render_pass>");
+        passHolder.renderPassDescription = std::move(description);
+
+        spdlog::debug("Graph: built {0} render pass with {1} subpasses", createInfo.debugName,
+                      passHolder.subpasses.size());
     }
 
-    for (Pass const pass : passes)
+    std::vector<Resource> const &attachments = passHolder.renderPassDescription.attachments;
+
+    std::array<std::vector<vk::ImageView>, MAX_FRAMES_IN_FLIGHT> frameBufferViews{};
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
-        PassCreateInfo const &passInfo = _passInfos[pass.index];
-        passDegrees[pass] = passInfo.reads.size() + passInfo.passDependencies.size();
+        for (Resource const resource : attachments)
+        {
+            frameBufferViews[i].push_back(_resources[resource.index].textures[i]->GetImageView());
+        }
     }
 
-    while (passDegrees.size() > 0 && resourceDegrees.size() > 0)
+    // resizing or rebuilding an attachment only needs new framebuffers
+    if (isRenderPassChanged || frameBufferViews != passHolder.frameBufferViews ||
+        extent != passHolder.frameBufferExtent)
     {
-        bool progress = false;
-
-        for (auto it = resourceDegrees.begin(); it != resourceDegrees.end();)
+        if (!isRenderPassChanged)
         {
-            if (it->second == 0)
-            {
-                ResourceHolder const &resourceHolder = _resources[it->first.index];
-                for (Pass const reader : resourceHolder.readers)
+            Retire([frameBuffers = passHolder.frameBuffers](Device const *device) mutable {
+                for (vk::Framebuffer &frameBuffer : frameBuffers)
                 {
-                    passDegrees.at(reader)--;
+                    device->DestroyFramebuffer(&frameBuffer);
                 }
-                it = resourceDegrees.erase(it);
-                progress = true;
-            }
-            else
-            {
-                it++;
-            }
+            });
         }
-        for (auto it = passDegrees.begin(); it != passDegrees.end();)
+
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
         {
-            if (it->second == 0)
-            {
-                PassCreateInfo const &passInfo = _passInfos[it->first.index];
-                for (Resource const writey : passInfo.writes)
-                {
-                    resourceDegrees.at(writey)--;
-                }
-                PassHolder const &passHolder = _passes[it->first.index];
-                for (Pass const dependant : passHolder.dependencies)
-                {
-                    passDegrees.at(dependant)--;
-                }
-                _orderedPasses.push_back(it->first);
-                it = passDegrees.erase(it);
-                progress = true;
-            }
-            else
-            {
-                it++;
-            }
+            vk::FramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.renderPass = passHolder.renderPass;
+            framebufferInfo.attachmentCount = frameBufferViews[i].size();
+            framebufferInfo.pAttachments = frameBufferViews[i].data();
+            framebufferInfo.width = extent.width;
+            framebufferInfo.height = extent.height;
+            framebufferInfo.layers = 1;
+
+            device->CreateFramebuffer(framebufferInfo, &passHolder.frameBuffers[i],
+                                      createInfo.debugName + "<framebuffer>");
         }
-        if (progress == false)
+
+        passHolder.frameBufferViews = frameBufferViews;
+        passHolder.frameBufferExtent = extent;
+
+        for (Pass const member : passHolder.subpasses) // recorded against the previous framebuffers
         {
-            std::ostringstream oss;
-            oss << "Graph: circular dependency found! cannot compile: ";
-            for (auto const &[resource, degree] : resourceDegrees)
-            {
-                ResourceCreateInfo const &resourceInfo = _resourceInfos[resource.index];
-                oss << resourceInfo.debugName << ": " << degree << ", ";
-            }
-            for (auto const &[pass, degree] : passDegrees)
-            {
-                PassCreateInfo const &passInfo = _passInfos[pass.index];
-                oss << passInfo.debugName << ": " << degree << ", ";
-            }
-            throw std::runtime_error(oss.str());
+            _passes[member.index].isCacheValid.fill(false);
         }
+
+        spdlog::debug("Graph: built {0} framebuffers", createInfo.debugName);
+    }
+
+    std::vector<vk::ClearValue> &clearValues = passHolder.clearValues;
+    clearValues.clear();
+    for (Resource const resource : attachments)
+    {
+        clearValues.push_back(_resourceInfos[resource.index].clear);
+    }
+
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        vk::RenderPassBeginInfo renderPassBeginInfo{};
+        renderPassBeginInfo.renderPass = passHolder.renderPass;
+        renderPassBeginInfo.framebuffer = passHolder.frameBuffers[i];
+        renderPassBeginInfo.renderArea.offset = vk::Offset2D{0, 0};
+        renderPassBeginInfo.renderArea.extent = renderExtent;
+        renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassBeginInfo.pClearValues = clearValues.data();
+
+        passHolder.renderPassBeginInfo[i] = renderPassBeginInfo;
     }
+}
+
+void Graph::BuildUbo()
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    check(_uboSize != 0);
+    std::vector<vk::DescriptorPoolSize> descriptorPoolSizes = {
+        {vk::DescriptorType::eUniformBuffer, MAX_FRAMES_IN_FLIGHT}};
+
+    vk::DescriptorPoolCreateInfo descriptorPoolInfo{};
+    descriptorPoolInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+    descriptorPoolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+    descriptorPoolInfo.poolSizeCount = (uint32_t)descriptorPoolSizes.size();
+    descriptorPoolInfo.pPoolSizes = descriptorPoolSizes.data();
+
+    device->CreateDescriptorPool(descriptorPoolInfo, &_uboDescriptorPool, "<graph_ubo_descriptor_pool>");
+
+    std::vector<vk::DescriptorSetLayoutBinding> descriptorSetLayoutBindings{
+        {0, vk::DescriptorType::eUniformBuffer, 1,
+         vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute}};
+
+    vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
+    descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(descriptorSetLayoutBindings.size());
+    descriptorSetLayoutInfo.pBindings = descriptorSetLayoutBindings.data();
+
+    device->CreateDescriptorSetLayout(descriptorSetLayoutInfo, &_uboDescriptorSetLayout,
+                                      "<graph_ubo_descriptor_set_layout>");
 
-    std::ostringstream oss;
-    oss << "Graph: pass order selected: ";
-    for (int i = 0; i < _orderedPasses.size(); i++)
+    std::vector<vk::WriteDescriptorSet> writeDescriptors{};
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
-        PassCreateInfo const &passInfo = _passInfos[_orderedPasses[i].index];
+        vk::Buffer uboBuffer;
+        vk::DeviceMemory uboDeviceMemory;
+        void *uboMappedMemories = nullptr;
 
-        if (i != 0)
-        {
-            oss << " -> ";
-        }
-        oss << passInfo.debugName;
+        vk::BufferCreateInfo createInfo;
+        createInfo.size = _uboSize;
+        createInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer;
+
+        device->CreateBufferAndBindMemory(createInfo, &uboBuffer, &uboDeviceMemory,
+                                          {vk::MemoryPropertyFlagBits::eHostVisible},
+                                          fmt::format("<ubo_buffer>({})", i));
+
+        _uboBuffers[i] = uboBuffer;
+        _uboDeviceMemories[i] = uboDeviceMemory;
+
+        device->MapMemory(uboDeviceMemory, &uboMappedMemories);
+
+        _uboMappedMemories[i] = uboMappedMemories;
+
+        vk::DescriptorSet descriptorSet;
+
+        vk::DescriptorSetAllocateInfo setAllocInfo{};
+        setAllocInfo.descriptorPool = _uboDescriptorPool;
+        setAllocInfo.descriptorSetCount = 1u;
+        setAllocInfo.pSetLayouts = &_uboDescriptorSetLayout;
+
+        device->AllocateDescriptorSet(setAllocInfo, &descriptorSet, "<ubo_descriptor_set>" + std::to_string(i));
+
+        vk::DescriptorBufferInfo bufferInfo{};
+        bufferInfo.offset = 0u;
+        bufferInfo.buffer = uboBuffer;
+        bufferInfo.range = _uboSize;
+
+        vk::WriteDescriptorSet writeDescriptor{};
+        writeDescriptor.dstSet = descriptorSet;
+        writeDescriptor.dstBinding = 0u;
+        writeDescriptor.dstArrayElement = 0u;
+        writeDescriptor.descriptorType = vk::DescriptorType::eUniformBuffer;
+        writeDescriptor.descriptorCount = 1u;
+        writeDescriptor.pBufferInfo = &bufferInfo;
+
+        writeDescriptors.push_back(writeDescriptor);
+
+        _uboDescriptorSets[i] = descriptorSet;
     }
-    spdlog::info("{0}", oss.str());
+
+    device->UpdateDescriptorSets(writeDescriptors);
+
+    spdlog::debug("Graph: built ubo");
 }
 
-void Graph::Build(Resource resource)
+void Graph::FreeUbo()
 {
     Device const *device = SafeDeviceAccessor::Get();
     check(device);
 
-    ResourceCreateInfo const &createInfo = _resourceInfos[resource.index];
-
-    vk::ImageCreateInfo imageInfo{};
-    imageInfo.imageType = vk::ImageType::e2D;
-    imageInfo.mipLevels = 1u;
-    imageInfo.arrayLayers = 1u;
-    imageInfo.samples = vk::SampleCountFlagBits::e1;
-    imageInfo.format = createInfo.format;
-    imageInfo.tiling = vk::ImageTiling::eOptimal;
-    imageInfo.initialLayout = vk::ImageLayout::eUndefined;
-    imageInfo.mipLevels = 1u;
-    imageInfo.samples = vk::SampleCountFlagBits::e1;
-    imageInfo.arrayLayers = 1u;
-
-    if (createInfo.extent == vk::Extent2D{0, 0})
-    {
-        imageInfo.extent = vk::Extent3D{(uint32_t)_width, (uint32_t)_height, 1u};
-    }
-    else
+    for (vk::DescriptorSet &uboDescriptorSet : _uboDescriptorSets)
     {
-        imageInfo.extent = vk::Extent3D{createInfo.extent.width, createInfo.extent.height, 1u};
+        device->FreeDescriptorSet(_uboDescriptorPool, &uboDescriptorSet);
     }
+    device->DestroyDescriptorPool(&_uboDescriptorPool);
+    device->DestroyDescriptorSetLayout(&_uboDescriptorSetLayout);
 
-    ResourceHolder const &resourceHolder = _resources[resource.index];
-    if (resourceHolder.writers.size() > 0)
+    for (vk::DeviceMemory &deviceMemory : _uboDeviceMemories)
     {
-        switch (createInfo.usage)
-        {
-        case ResourceUsage::eColor:
-            imageInfo.usage |= vk::ImageUsageFlagBits::eColorAttachment;
-            break;
-        case ResourceUsage::eDepth:
-            imageInfo.usage |= vk::ImageUsageFlagBits::eDepthStencilAttachment;
-            break;
-        }
+        device->UnmapMemory(deviceMemory);
+        device->FreeDeviceMemory(&deviceMemory);
     }
-    if (IsSampled(resource))
+    for (vk::Buffer &buffer : _uboBuffers)
     {
-        imageInfo.usage |= vk::ImageUsageFlagBits::eSampled;
+        device->DestroyBuffer(&buffer);
     }
-    else
+
+    spdlog::debug("Graph: Freed ubo");
+}
+
+void Graph::BuildDescriptors(Resource resource)
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    ResourceCreateInfo const &resourceInfo = _resourceInfos[resource.index];
+
+    bool const isSampled = IsSampled(resource);
+    bool const isReadAsInput = IsReadAsInput(resource);
+    bool const isStorage = IsStorage(resource) && resourceInfo.mipLevels == 1u; // storage views hold a single mip
+
+    if (!isSampled && !isReadAsInput && !isStorage)
     {
-        if (resource == _target)
-        {
-            imageInfo.usage |= vk::ImageUsageFlagBits::eTransferSrc;
-        }
+        return;
     }
+    check(_validResources.find(resource) != _validResources.end());
 
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
         ResourceHolder &resourceHolder = _resources[resource.index];
 
-        resourceHolder.images[i] = new Image(device, imageInfo, createInfo.debugName + std::string("_image"));
-
-        Texture::CreateInfo textureCreateInfo{};
-        textureCreateInfo.pImage = resourceHolder.images[i];
-        textureCreateInfo.name = createInfo.debugName;
-        textureCreateInfo.pSampler = _colorSampler;
-
-        if (createInfo.usage == ResourceUsage::eDepth)
+        if (isSampled)
         {
-            textureCreateInfo.depth = true;
-            textureCreateInfo.pSampler = _depthSampler;
-        }
+            vk::DescriptorSet descriptorSet;
 
-        resourceHolder.textures[i] = new Texture(device, textureCreateInfo);
-    }
+            vk::DescriptorSetAllocateInfo setAllocInfo{};
+            setAllocInfo.descriptorPool = _descriptorPool;
+            setAllocInfo.descriptorSetCount = 1u;
+            setAllocInfo.pSetLayouts = &_descriptorSetLayout;
 
-    if (IsSampled(resource))
-    {
-        BuildDescriptors(resource);
-    }
+            device->AllocateDescriptorSet(setAllocInfo, &descriptorSet, resourceInfo.debugName + "<descriptor_set>");
 
-    spdlog::debug("Graph: built <{0}> resource", createInfo.debugName);
-}
+            vk::DescriptorImageInfo imageInfo{};
+            imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+            imageInfo.imageView = resourceHolder.textures[i]->GetImageView();
 
-void Graph::Build(Pass pass)
-{
-    Device const *device = SafeDeviceAccessor::Get();
-    check(device);
+            if (resourceInfo.usage == ResourceUsage::eDepth)
+            {
+                imageInfo.sampler = _depthSampler->GetSampler();
+            }
+            else
+            {
+                imageInfo.sampler = _colorSampler->GetSampler();
+            }
 
-    PassCreateInfo const &createInfo = _passInfos[pass.index];
-    PassHolder &passHolder = _passes[pass.index];
+            vk::WriteDescriptorSet writeDescriptor{};
+            writeDescriptor.dstSet = descriptorSet;
+            writeDescriptor.dstBinding = 0u;
+            writeDescriptor.dstArrayElement = 0u;
+            writeDescriptor.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+            writeDescriptor.descriptorCount = 1u;
+            writeDescriptor.pImageInfo = &imageInfo;
 
-    vk::Extent2D outResolution{(uint32_t)_width, (uint32_t)_height};
+            device->UpdateDescriptorSets({writeDescriptor});
 
-    std::vector<vk::AttachmentReference> colorAttachmentReferences{};
-    std::optional<vk::AttachmentReference> depthAttachmentReference{};
-    colorAttachmentReferences.reserve(createInfo.writes.size());
+            resourceHolder.descriptorSets[i] = descriptorSet;
+        }
 
-    std::vector<vk::AttachmentDescription> attachmentDescriptions{};
-    attachmentDescriptions.reserve(createInfo.writes.size());
+        if (isReadAsInput)
+        {
+            vk::DescriptorSet descriptorSet;
 
-    bool absoluteFirstWriter = true;
-    bool absoluteLastWriter = true;
+            vk::DescriptorSetAllocateInfo setAllocInfo{};
+            setAllocInfo.descriptorPool = _descriptorPool;
+            setAllocInfo.descriptorSetCount = 1u;
+            setAllocInfo.pSetLayouts = &_inputDescriptorSetLayout;
 
-    int i = 0;
-    for (Resource const resource : createInfo.writes)
-    {
-        ResourceCreateInfo const &resourceInfo = _resourceInfos[resource.index];
+            device->AllocateDescriptorSet(setAllocInfo, &descriptorSet,
+                                          resourceInfo.debugName + "<input_descriptor_set>");
 
-        if (resourceInfo.extent != vk::Extent2D{0, 0})
-        {
-            outResolution = resourceInfo.extent;
-        }
+            vk::DescriptorImageInfo imageInfo{};
+            imageInfo.imageLayout = resourceInfo.usage == ResourceUsage::eDepth
+                                        ? vk::ImageLayout::eDepthStencilReadOnlyOptimal
+                                        : vk::ImageLayout::eShaderReadOnlyOptimal;
+            imageInfo.imageView = resourceHolder.textures[i]->GetImageView();
 
-        ResourceHolder const &resourceHolder = _resources[resource.index];
+            vk::WriteDescriptorSet writeDescriptor{};
+            writeDescriptor.dstSet = descriptorSet;
+            writeDescriptor.dstBinding = 0u;
+            writeDescriptor.dstArrayElement = 0u;
+            writeDescriptor.descriptorType = vk::DescriptorType::eInputAttachment;
+            writeDescriptor.descriptorCount = 1u;
+            writeDescriptor.pImageInfo = &imageInfo;
 
-        bool firstWriter = false;
-        bool nextIsRead = false;
+            device->UpdateDescriptorSets({writeDescriptor});
 
-        if (resourceHolder.writers[0] == pass)
-        {
-            firstWriter = true;
+            resourceHolder.inputDescriptorSets[i] = descriptorSet;
         }
-        if (resourceHolder.writers[resourceHolder.writers.size() - 1] == pass && IsSampled(resource))
+
+        if (isStorage)
         {
-            nextIsRead = true;
-        }
+            vk::DescriptorSet descriptorSet;
 
-        absoluteFirstWriter &= firstWriter;
-        absoluteLastWriter &= !nextIsRead;
+            vk::DescriptorSetAllocateInfo setAllocInfo{};
+            setAllocInfo.descriptorPool = _descriptorPool;
+            setAllocInfo.descriptorSetCount = 1u;
+            setAllocInfo.pSetLayouts =
+                IsBuffer(resource) ? &_storageBufferDescriptorSetLayout : &_storageImageDescriptorSetLayout;
 
-        std::array<vk::ImageMemoryBarrier, MAX_FRAMES_IN_FLIGHT> imageMemoryBarriers;
-        vk::ImageMemoryBarrier imageMemoryBarrier{};
+            device->AllocateDescriptorSet(setAllocInfo, &descriptorSet,
+                                          resourceInfo.debugName + "<storage_descriptor_set>");
 
-        imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-        imageMemoryBarrier.subresourceRange.levelCount = 1;
-        imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-        imageMemoryBarrier.subresourceRange.layerCount = 1;
-        imageMemoryBarrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-        imageMemoryBarrier.srcQueueFamilyIndex = vk::QueueFamilyIgnored;
-        imageMemoryBarrier.dstQueueFamilyIndex = vk::QueueFamilyIgnored;
-        imageMemoryBarrier.oldLayout = vk::ImageLayout::eColorAttachmentOptimal;
-        imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
-        imageMemoryBarrier.newLayout = vk::ImageLayout::eColorAttachmentOptimal;
-        imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+            vk::DescriptorImageInfo imageInfo{};
+            vk::DescriptorBufferInfo bufferInfo{};
 
-        if (resourceInfo.usage == ResourceUsage::eDepth)
-        {
-            imageMemoryBarrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
-            imageMemoryBarrier.oldLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
-            imageMemoryBarrier.newLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
-            imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-            imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-        }
+            vk::WriteDescriptorSet writeDescriptor{};
+            writeDescriptor.dstSet = descriptorSet;
+            writeDescriptor.dstBinding = 0u;
+            writeDescriptor.dstArrayElement = 0u;
+            writeDescriptor.descriptorCount = 1u;
 
-        if (!firstWriter && !nextIsRead)
-        {
-            for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+            if (IsBuffer(resource))
+            {
+                bufferInfo.buffer = resourceHolder.buffers[i];
+                bufferInfo.offset = 0u;
+                bufferInfo.range = VK_WHOLE_SIZE;
+
+                writeDescriptor.descriptorType = vk::DescriptorType::eStorageBuffer;
+                writeDescriptor.pBufferInfo = &bufferInfo;
+            }
+            else
             {
-                imageMemoryBarrier.image = _resources[resource.index].images[i]->GetImage();
+                imageInfo.imageLayout = vk::ImageLayout::eGeneral;
+                imageInfo.imageView = resourceHolder.textures[i]->GetImageView();
 
-                imageMemoryBarriers[i] = imageMemoryBarrier;
+                writeDescriptor.descriptorType = vk::DescriptorType::eStorageImage;
+                writeDescriptor.pImageInfo = &imageInfo;
             }
 
-            passHolder.imageMemoryBarriers.push_back(imageMemoryBarriers);
+            device->UpdateDescriptorSets({writeDescriptor});
+
+            resourceHolder.storageDescriptorSets[i] = descriptorSet;
         }
+    }
 
-        vk::AttachmentDescription attachment = {};
-        attachment.format = resourceInfo.format;
-        attachment.samples = vk::SampleCountFlagBits::e1;
-        attachment.loadOp = vk::AttachmentLoadOp::eClear;
-        attachment.initialLayout = vk::ImageLayout::eUndefined;
+    spdlog::debug("Graph: built descriptors for '{}'", resourceInfo.debugName);
+}
+
+void Graph::BuildBindList(Pass pass)
+{
+    PassCreateInfo const &passInfo = _passInfos[pass.index];
+    PassHolder &passHolder = _passes[pass.index];
 
-        vk::AttachmentReference attachmentRef = {};
-        attachmentRef.attachment = i;
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        std::vector<vk::DescriptorSet> &descriptorSets = passHolder.descriptorSets[i];
+        descriptorSets.clear();
 
-        switch (resourceInfo.usage)
+        if (passInfo.readsUniform)
         {
-        case ResourceUsage::eColor:
-            imageMemoryBarrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-            if (!firstWriter)
-            {
-                attachment.loadOp = vk::AttachmentLoadOp::eLoad;
-                attachment.initialLayout = vk::ImageLayout::eColorAttachmentOptimal;
-            }
-            attachment.storeOp = vk::AttachmentStoreOp::eStore;
-            if (nextIsRead)
-            {
-                attachment.finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-            }
-            else
+            descriptorSets.push_back(_uboDescriptorSets[i]);
+        }
+        for (Resource const resource : passInfo.reads)
+        {
+            if (IsDrawnFrom(resource, pass))
             {
-                attachment.finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
+                continue;
             }
 
-            attachmentRef.layout = vk::ImageLayout::eColorAttachmentOptimal;
-
-            colorAttachmentReferences.push_back(attachmentRef);
-            break;
-        case ResourceUsage::eDepth:
-            imageMemoryBarrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
-            if (!firstWriter)
+            ResourceHolder const &resourceHolder = _resources[resource.index];
+            if (IsBuffer(resource))
             {
-                attachment.loadOp = vk::AttachmentLoadOp::eLoad;
-                attachment.initialLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+                descriptorSets.push_back(resourceHolder.storageDescriptorSets[i]);
             }
-            attachment.storeOp = vk::AttachmentStoreOp::eDontCare;
-            if (nextIsRead)
+            else
             {
-                attachment.finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+                descriptorSets.push_back(passInfo.pixelLocalReads ? resourceHolder.inputDescriptorSets[i]
+                                                                  : resourceHolder.descriptorSets[i]);
             }
-            else
+        }
+        if (IsCompute(pass))
+        {
+            for (Resource const resource : passInfo.writes)
             {
-                attachment.finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+                descriptorSets.push_back(_resources[resource.index].storageDescriptorSets[i]);
             }
-
-            attachmentRef.layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
-
-            depthAttachmentReference = attachmentRef;
-            break;
         }
-
-        if (resource == _target && _usage == GraphUsage::eToTransfer)
+        for (StaticTextures const *staticTextures : passInfo.staticTextures)
         {
-            attachment.finalLayout = vk::ImageLayout::eTransferSrcOptimal;
+            descriptorSets.push_back(staticTextures->GetDescriptorSet());
+        }
+        for (StaticBuffer const *staticBuffer : passInfo.staticBuffers)
+        {
+            descriptorSets.push_back(staticBuffer->GetDescriptorSet());
         }
-
-        attachmentDescriptions.push_back(attachment);
-        i++;
     }
+}
 
-    vk::SubpassDescription subpass = {};
-    subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
-    subpass.colorAttachmentCount = colorAttachmentReferences.size();
-    subpass.pColorAttachments = colorAttachmentReferences.data();
-    subpass.pDepthStencilAttachment =
-        depthAttachmentReference.has_value() ? &depthAttachmentReference.value() : nullptr;
-
-    std::vector<vk::SubpassDependency> dependencies{};
-
-    if (absoluteFirstWriter)
+void Graph::BuildCachedCommandBuffers(Pass pass)
+{
+    if (!IsRecordedOnce(pass))
     {
-        vk::SubpassDependency subpassDependency;
-
-        subpassDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        subpassDependency.dstSubpass = 0;
-        subpassDependency.srcStageMask =
-            vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests;
-        subpassDependency.dstStageMask =
-            vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests;
-        subpassDependency.srcAccessMask = vk::AccessFlagBits::eNone;
-        subpassDependency.dstAccessMask =
-            vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-
-        dependencies.push_back(subpassDependency);
+        return;
     }
 
-    if (absoluteLastWriter)
-    {
-        vk::SubpassDependency subpassDependency;
-
-        subpassDependency.srcSubpass = 0;
-        subpassDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
-        subpassDependency.srcStageMask =
-            vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests;
-        subpassDependency.dstStageMask = vk::PipelineStageFlagBits::eFragmentShader;
-        subpassDependency.srcAccessMask =
-            vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-        subpassDependency.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
 
-        dependencies.push_back(subpassDependency);
+    PassHolder &passHolder = _passes[pass.index];
+    if (!passHolder.cachedCommandBuffers.empty())
+    {
+        return; // kept from a previous compile, re-recorded once invalidated
     }
 
-    vk::RenderPassCreateInfo renderPassCreateInfo{};
-    renderPassCreateInfo.attachmentCount = attachmentDescriptions.size();
-    renderPassCreateInfo.pAttachments = attachmentDescriptions.data();
-    renderPassCreateInfo.subpassCount = 1;
-    renderPassCreateInfo.pSubpasses = &subpass;
-    renderPassCreateInfo.dependencyCount = dependencies.size();
-    renderPassCreateInfo.pDependencies = dependencies.data();
+    vk::CommandBufferAllocateInfo allocInfo{};
+    allocInfo.level = vk::CommandBufferLevel::eSecondary;
+    allocInfo.commandPool = _cachedCommandPool;
+    allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
 
-    vk::RenderPass renderPass;
-    device->CreateRenderPass(renderPassCreateInfo, &renderPass, createInfo.debugName + "<render_pass>");
-    passHolder.renderPass = renderPass;
+    passHolder.cachedCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    device->AllocateCommandBuffers(allocInfo, passHolder.cachedCommandBuffers.data(),
+                                   _passInfos[pass.index].debugName + "<cached_command_buffer>");
+    passHolder.isCacheValid.fill(false);
+}
 
-    std::vector<vk::ClearValue> &clearValues = passHolder.clearValues;
-    clearValues.clear();
-    clearValues.reserve(createInfo.writes.size());
+void Graph::Resize(uint32_t width, uint32_t height)
+{
+    spdlog::debug("Graph: resizing from {}x{} to {}x{}", _width, _height, width, height);
 
-    for (Resource const resource : createInfo.writes)
-    {
-        clearValues.push_back(_resourceInfos[resource.index].clear);
-    }
+    _width = width;
+    _height = height;
 
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    if (_validResources.empty())
     {
-        std::vector<vk::ImageView> imageViews{};
-        for (Resource const resource : createInfo.writes)
-        {
-            imageViews.push_back(_resources[resource.index].textures[i]->GetImageView());
-        }
-
-        vk::FramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.renderPass = passHolder.renderPass;
-        framebufferInfo.attachmentCount = imageViews.size();
-        framebufferInfo.pAttachments = imageViews.data();
-        framebufferInfo.width = outResolution.width;
-        framebufferInfo.height = outResolution.height;
-        framebufferInfo.layers = 1;
+        return; // not compiled yet, the new size is picked up then
+    }
 
-        vk::Framebuffer framebuffer;
-        device->CreateFramebuffer(framebufferInfo, &framebuffer, createInfo.debugName + "<framebuffer>");
-        passHolder.frameBuffers[i] = framebuffer;
+    // only screen sized resources and the framebuffers holding them see a difference
+    Compile(_target, _usage);
 
-        vk::RenderPassBeginInfo renderPassBeginInfo{};
-        renderPassBeginInfo.renderPass = passHolder.renderPass;
-        renderPassBeginInfo.framebuffer = framebuffer;
+    spdlog::debug("Graph: resized to {}x{}", _width, _height);
+}
 
-        renderPassBeginInfo.renderArea.offset = vk::Offset2D{0, 0};
+void Graph::OnResizeCallback(void *graph, uint32_t width, uint32_t height)
+{
+    check(graph);
+    reinterpret_cast<Graph *>(graph)->Resize(width, height);
+}
 
-        if (ResourceCreateInfo const &resourceInfo = _resourceInfos[createInfo.writes.at(0).index];
-            resourceInfo.extent != vk::Extent2D{0u, 0u})
-        {
-            renderPassBeginInfo.renderArea.extent = resourceInfo.extent;
-        }
-        else
-        {
-            renderPassBeginInfo.renderArea.extent = vk::Extent2D{uint32_t(_width), (uint32_t)_height};
-        }
+bool Graph::IsSampled(Resource resource)
+{
+    if (IsBuffer(resource))
+    {
+        return false;
+    }
 
-        renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        renderPassBeginInfo.pClearValues = clearValues.data();
+    std::vector<Pass> const &readers = _resources[resource.index].readers;
+    bool const isSampledByPass = std::any_of(readers.begin(), readers.end(), [this](Pass reader) {
+        return !_passInfos[reader.index].pixelLocalReads;
+    });
 
-        passHolder.renderPassBeginInfo[i] = renderPassBeginInfo;
+    if (_usage == eToTransfer)
+    {
+        return isSampledByPass && resource != _target;
     }
+    return isSampledByPass || resource == _target;
+}
 
-    vk::Viewport viewport{};
-    viewport.x = 0.f;
-    viewport.y = 0.f;
-    viewport.minDepth = 0.f;
-    viewport.maxDepth = 1.f;
+bool Graph::IsReadAsInput(Resource resource) const
+{
+    std::vector<Pass> const &readers = _resources[resource.index].readers;
+    return std::any_of(readers.begin(), readers.end(),
+                       [this](Pass reader) { return _passInfos[reader.index].pixelLocalReads; });
+}
 
-    vk::Rect2D scissor{};
-    scissor.offset = vk::Offset2D{0, 0};
+bool Graph::IsStorage(Resource resource) const
+{
+    ResourceUsage const usage = _resourceInfos[resource.index].usage;
+    return usage == ResourceUsage::eStorageImage || usage == ResourceUsage::eStorageBuffer;
+}
 
-    if (ResourceCreateInfo const &resourceInfo = _resourceInfos[createInfo.writes.at(0).index];
-        resourceInfo.extent != vk::Extent2D{0u, 0u})
-    {
-        viewport.width = resourceInfo.extent.width; // WARN: important fix, need to send to tauri
-        viewport.height = resourceInfo.extent.height;
-        scissor.extent = resourceInfo.extent;
-    }
-    else
-    {
-        viewport.width = static_cast<float>(_width);
-        viewport.height = static_cast<float>(_height);
-        scissor.extent = vk::Extent2D{(uint32_t)_width, (uint32_t)_height};
-    }
+bool Graph::IsBuffer(Resource resource) const
+{
+    return _resourceInfos[resource.index].usage == ResourceUsage::eStorageBuffer;
+}
 
-    passHolder.viewport = viewport;
-    passHolder.scissor = scissor;
+bool Graph::IsDrawnFrom(Resource resource, Pass pass) const
+{
+    return IsBuffer(resource) && _resourceInfos[resource.index].indirect && !IsCompute(pass);
+}
 
-    spdlog::debug("Graph: built {0} pass", createInfo.debugName);
+bool Graph::IsBuilt(Resource resource) const
+{
+    ResourceHolder const &resourceHolder = _resources[resource.index];
+    return resourceHolder.images[0] != nullptr || resourceHolder.buffers[0] != VK_NULL_HANDLE;
 }
 
-void Graph::BuildUbo()
+bool Graph::IsCompute(Pass pass) const
 {
-    Device const *device = SafeDeviceAccessor::Get();
-    check(device);
+    return !_passInfos[pass.index].compFile.empty();
+}
 
-    check(_uboSize != 0);
-    std::vector<vk::DescriptorPoolSize> descriptorPoolSizes = {
-        {vk::DescriptorType::eUniformBuffer, MAX_FRAMES_IN_FLIGHT}};
+bool Graph::IsCached(Pass pass) const
+{
+    return static_cast<bool>(_passInfos[pass.index].isUpToDate);
+}
 
-    vk::DescriptorPoolCreateInfo descriptorPoolInfo{};
-    descriptorPoolInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
-    descriptorPoolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
-    descriptorPoolInfo.poolSizeCount = (uint32_t)descriptorPoolSizes.size();
-    descriptorPoolInfo.pPoolSizes = descriptorPoolSizes.data();
+bool Graph::IsKept(Resource resource) const
+{
+    // history is read by the next frame, what cached passes write is read until they run again
+    std::vector<Pass> const &writers = _resources[resource.index].writers;
+    return _resourceInfos[resource.index].history ||
+           std::any_of(writers.begin(), writers.end(), [this](Pass writer) { return IsCached(writer); });
+}
 
-    device->CreateDescriptorPool(descriptorPoolInfo, &_uboDescriptorPool, "<graph_ubo_descriptor_pool>");
+bool Graph::IsSubresource(Resource resource) const
+{
+    return _resourceInfos[resource.index].parent != UINT32_MAX;
+}
 
-    std::vector<vk::DescriptorSetLayoutBinding> descriptorSetLayoutBindings{
-        {0, vk::DescriptorType::eUniformBuffer, 1, {vk::ShaderStageFlagBits::eAllGraphics}}};
+bool Graph::IsPrevious(Resource resource) const
+{
+    return _resourceInfos[resource.index].previous;
+}
 
-    vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
-    descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(descriptorSetLayoutBindings.size());
-    descriptorSetLayoutInfo.pBindings = descriptorSetLayoutBindings.data();
+bool Graph::IsReadEarly(Resource resource, Pass pass) const
+{
+    std::vector<Resource> const &earlyReads = _passInfos[pass.index].earlyReads;
+    return std::find(earlyReads.begin(), earlyReads.end(), resource) != earlyReads.end();
+}
 
-    device->CreateDescriptorSetLayout(descriptorSetLayoutInfo, &_uboDescriptorSetLayout,
-                                      "<graph_ubo_descriptor_set_layout>");
+std::vector<Pass> Graph::GetOverwriters(Pass pass) const
+{
+    PassCreateInfo const &passInfo = _passInfos[pass.index];
 
-    std::vector<vk::WriteDescriptorSet> writeDescriptors{};
-    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    std::vector<Pass> overwriters{};
+    for (Resource const resource : passInfo.earlyReads)
     {
-        vk::Buffer uboBuffer;
-        vk::DeviceMemory uboDeviceMemory;
-        void *uboMappedMemories = nullptr;
-
-        vk::BufferCreateInfo createInfo;
-        createInfo.size = _uboSize;
-        createInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer;
-
-        device->CreateBufferAndBindMemory(createInfo, &uboBuffer, &uboDeviceMemory,
-                                          {vk::MemoryPropertyFlagBits::eHostVisible},
-                                          fmt::format("<ubo_buffer>({})", i));
+        for (Pass const writer : _resources[resource.index].writers)
+        {
+            if (std::find(passInfo.passDependencies.begin(), passInfo.passDependencies.end(), writer) ==
+                passInfo.passDependencies.end())
+            {
+                overwriters.push_back(writer);
+            }
+        }
+    }
 
-        _uboBuffers[i] = uboBuffer;
-        _uboDeviceMemories[i] = uboDeviceMemory;
+    return overwriters;
+}
 
-        device->MapMemory(uboDeviceMemory, &uboMappedMemories);
+Resource Graph::GetParent(Resource resource) const
+{
+    return IsSubresource(resource) ? Resource{_resourceInfos[resource.index].parent} : resource;
+}
 
-        _uboMappedMemories[i] = uboMappedMemories;
+Image *Graph::GetImage(Resource resource, int frameIndex) const
+{
+    // frames run in order, so last frame's images are the ones of the frame index before
+    if (IsPrevious(resource))
+    {
+        frameIndex = (frameIndex + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT;
+    }
 
-        vk::DescriptorSet descriptorSet;
+    return _resources[GetParent(resource).index].images[frameIndex];
+}
 
-        vk::DescriptorSetAllocateInfo setAllocInfo{};
-        setAllocInfo.descriptorPool = _uboDescriptorPool;
-        setAllocInfo.descriptorSetCount = 1u;
-        setAllocInfo.pSetLayouts = &_uboDescriptorSetLayout;
+vk::Extent2D Graph::GetExtent(Pass pass) const
+{
+    return GetExtent(_passInfos[pass.index].writes.at(0));
+}
 
-        device->AllocateDescriptorSet(setAllocInfo, &descriptorSet, "<ubo_descriptor_set>" + std::to_string(i));
+vk::Extent2D Graph::GetExtent(Resource resource) const
+{
+    ResourceCreateInfo const &createInfo = _resourceInfos[resource.index];
 
-        vk::DescriptorBufferInfo bufferInfo{};
-        bufferInfo.offset = 0u;
-        bufferInfo.buffer = uboBuffer;
-        bufferInfo.range = _uboSize;
+    vk::Extent2D const extent = !IsScreenSized(resource)
+                                    ? createInfo.extent
+                                    : vk::Extent2D{std::max(_width / createInfo.screenDivisor, 1u),
+                                                   std::max(_height / createInfo.screenDivisor, 1u)};
+    return vk::Extent2D{std::max(extent.width >> createInfo.mip, 1u), std::max(extent.height >> createInfo.mip, 1u)};
+}
 
-        vk::WriteDescriptorSet writeDescriptor{};
-        writeDescriptor.dstSet = descriptorSet;
-        writeDescriptor.dstBinding = 0u;
-        writeDescriptor.dstArrayElement = 0u;
-        writeDescriptor.descriptorType = vk::DescriptorType::eUniformBuffer;
-        writeDescriptor.descriptorCount = 1u;
-        writeDescriptor.pBufferInfo = &bufferInfo;
+bool Graph::IsScreenSized(Resource resource) const
+{
+    return _resourceInfos[resource.index].extent == vk::Extent2D{0u, 0u};
+}
 
-        writeDescriptors.push_back(writeDescriptor);
+vk::Extent2D Graph::GetRenderExtent(Pass pass) const
+{
+    return GetRenderExtent(_passInfos[pass.index].writes.at(0));
+}
 
-        _uboDescriptorSets[i] = descriptorSet;
+vk::Extent2D Graph::GetRenderExtent(Resource resource) const
+{
+    vk::Extent2D const extent = GetExtent(resource);
+    if (!IsScreenSized(resource))
+    {
+        return extent;
     }
 
-    device->UpdateDescriptorSets(writeDescriptors);
+    // truncated like getRenderExtent in packing.glsl, which finds the part shaders sample
+    return vk::Extent2D{std::max(static_cast<uint32_t>(static_cast<float>(extent.width) * _renderScale), 1u),
+                        std::max(static_cast<uint32_t>(static_cast<float>(extent.height) * _renderScale), 1u)};
+}
 
-    spdlog::debug("Graph: built ubo");
+Pass Graph::GetOwner(Pass pass) const
+{
+    PassHolder const &passHolder = _passes[pass.index];
+    return _orderedPasses[passHolder.order - passHolder.subpass];
 }
 
-void Graph::FreeUbo()
+Graph::ResourceAccess Graph::GetReadAccess(Resource resource, Pass pass) const
 {
-    Device const *device = SafeDeviceAccessor::Get();
-    check(device);
+    ResourceAccess access{};
+    access.layout = IsBuffer(resource) ? vk::ImageLayout::eGeneral : vk::ImageLayout::eShaderReadOnlyOptimal;
+    access.stageMask = vk::PipelineStageFlagBits::eFragmentShader;
+    access.accessMask = vk::AccessFlagBits::eShaderRead;
 
-    for (vk::DescriptorSet &uboDescriptorSet : _uboDescriptorSets)
+    if (IsCompute(pass))
     {
-        device->FreeDescriptorSet(_uboDescriptorPool, &uboDescriptorSet);
+        access.stageMask = vk::PipelineStageFlagBits::eComputeShader;
     }
-    device->DestroyDescriptorPool(&_uboDescriptorPool);
-    device->DestroyDescriptorSetLayout(&_uboDescriptorSetLayout);
-
-    for (vk::DeviceMemory &deviceMemory : _uboDeviceMemories)
+    else if (IsDrawnFrom(resource, pass))
     {
-        device->UnmapMemory(deviceMemory);
-        device->FreeDeviceMemory(&deviceMemory);
+        access.stageMask = vk::PipelineStageFlagBits::eDrawIndirect;
+        access.accessMask = vk::AccessFlagBits::eIndirectCommandRead;
     }
-    for (vk::Buffer &buffer : _uboBuffers)
+    else if (IsBuffer(resource))
     {
-        device->DestroyBuffer(&buffer);
+        access.stageMask |= vk::PipelineStageFlagBits::eVertexShader;
     }
 
-    spdlog::debug("Graph: Freed ubo");
+    if (_passInfos[pass.index].pixelLocalReads)
+    {
+        access.accessMask = vk::AccessFlagBits::eInputAttachmentRead;
+        if (_resourceInfos[resource.index].usage == ResourceUsage::eDepth)
+        {
+            access.layout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+        }
+    }
+
+    return access;
 }
 
-void Graph::BuildDescriptors(Resource resource)
+Graph::ResourceAccess Graph::GetWriteAccess(Resource resource, Pass pass) const
 {
-    Device const *device = SafeDeviceAccessor::Get();
-    check(device);
-
-    ResourceCreateInfo const &resourceInfo = _resourceInfos[resource.index];
-
-    check(IsSampled(resource));
-    check(_validResources.find(resource) != _validResources.end());
+    ResourceAccess access{};
 
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    switch (_resourceInfos[resource.index].usage)
     {
-        vk::DescriptorSet descriptorSet;
+    case ResourceUsage::eColor:
+        access.layout = vk::ImageLayout::eColorAttachmentOptimal;
+        access.stageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+        access.accessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+        if (_resources[resource.index].writers[0] != pass) // loads what the previous writer left
+        {
+            access.accessMask |= vk::AccessFlagBits::eColorAttachmentRead;
+        }
+        break;
+    case ResourceUsage::eDepth:
+        access.layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+        access.stageMask =
+            vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+        access.accessMask =
+            vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+        break;
+    case ResourceUsage::eStorageImage:
+    case ResourceUsage::eStorageBuffer:
+        access.layout = vk::ImageLayout::eGeneral;
+        access.stageMask = vk::PipelineStageFlagBits::eComputeShader;
+        access.accessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        break;
+    }
 
-        vk::DescriptorSetAllocateInfo setAllocInfo{};
-        setAllocInfo.descriptorPool = _descriptorPool;
-        setAllocInfo.descriptorSetCount = 1u;
-        setAllocInfo.pSetLayouts = &_descriptorSetLayout;
+    return access;
+}
 
-        device->AllocateDescriptorSet(setAllocInfo, &descriptorSet, resourceInfo.debugName + "<descriptor_set>");
+void Graph::BuildBarriers()
+{
+    vk::AccessFlags const writeAccesses =
+        vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+        vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite;
 
-        ResourceHolder &resourceHolder = _resources[resource.index];
+    std::vector<std::vector<ResourceAccess>> resourceAccesses{};
+    std::vector<std::vector<uint32_t>> lastUsers{};
 
-        vk::DescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-        imageInfo.imageView = resourceHolder.textures[i]->GetImageView();
+    // kept images start a frame as the last one left them, and history images swap roles every frame, so the plan is
+    // made a second time starting from how the first ends
+    for (int planning = 0; planning < 2; planning++)
+    {
+        std::vector<std::vector<ResourceAccess>> const endAccesses = std::move(resourceAccesses);
 
-        if (resourceInfo.usage == ResourceUsage::eDepth)
+        // resources start every frame undefined, the last frame to use the same images was fenced
+        // state is tracked on parents, per mip and layer, so subresources and whole image reads see each other
+        resourceAccesses.assign(_resourceInfos.size(), {});
+        lastUsers.assign(_resourceInfos.size(), {});
+        for (uint32_t resource = 0; resource < _resourceInfos.size(); resource++)
         {
-            imageInfo.sampler = _depthSampler->GetSampler();
+            ResourceCreateInfo const &resourceInfo = _resourceInfos[resource];
+            resourceAccesses[resource].resize(resourceInfo.mipLevels * resourceInfo.arrayLayers);
+            lastUsers[resource].resize(resourceInfo.mipLevels * resourceInfo.arrayLayers, UINT32_MAX);
         }
-        else
+        // on first use, a resource waits on every use of whichever resource last used its memory block
+        std::vector<ResourceAccess> blockAccesses(_memoryBlocks.size());
+        std::vector<uint32_t> blockUsers(_memoryBlocks.size(), UINT32_MAX);
+
+        for (Resource const resource : _validResources)
         {
-            imageInfo.sampler = _colorSampler->GetSampler();
-        }
+            if (endAccesses.empty() || IsSubresource(resource) || !IsKept(resource) || IsBuffer(resource))
+            {
+                continue;
+            }
 
-        vk::WriteDescriptorSet writeDescriptor{};
-        writeDescriptor.dstSet = descriptorSet;
-        writeDescriptor.dstBinding = 0u;
-        writeDescriptor.dstArrayElement = 0u;
-        writeDescriptor.descriptorType = vk::DescriptorType::eCombinedImageSampler;
-        writeDescriptor.descriptorCount = 1u;
-        writeDescriptor.pImageInfo = &imageInfo;
+            std::vector<vk::ImageLayout> &keptLayouts = _resources[resource.index].keptLayouts;
+            keptLayouts.clear();
+            for (ResourceAccess const &endAccess : endAccesses[resource.index])
+            {
+                keptLayouts.push_back(endAccess.layout);
+            }
 
-        device->UpdateDescriptorSets({writeDescriptor});
+            if (!_resourceInfos[resource.index].history)
+            {
+                resourceAccesses[resource.index] = endAccesses[resource.index]; // the same images, as last left
+            }
+        }
+        for (Resource const resource : _validResources)
+        {
+            if (!IsPrevious(resource) || endAccesses.empty())
+            {
+                continue;
+            }
 
-        resourceHolder.descriptorSets[i] = descriptorSet;
-    }
+            // last frame's current images are read as previous, and written over once last frame's reads are done
+            Resource const current = GetParent(resource);
+            resourceAccesses[resource.index] = endAccesses[current.index];
+            for (uint32_t i = 0; i < resourceAccesses[current.index].size(); i++)
+            {
+                resourceAccesses[current.index][i].stageMask = endAccesses[resource.index][i].stageMask;
+            }
+        }
 
-    spdlog::debug("Graph: built descriptors for '{}'", resourceInfo.debugName);
-}
+        for (Pass const pass : _orderedPasses)
+        {
+            PassCreateInfo const &passInfo = _passInfos[pass.index];
+            PassHolder const &passHolder = _passes[pass.index];
+            PassHolder &owner = _passes[_orderedPasses[passHolder.order - passHolder.subpass].index];
 
-void Graph::Resize(uint32_t width, uint32_t height)
-{
-    spdlog::debug("Graph: resizing from {}x{} to {}x{}", _width, _height, width, height);
+            if (passHolder.subpass == 0)
+            {
+                owner.transitions.clear();
+                owner.srcStageMask = vk::PipelineStageFlags{};
+                owner.dstStageMask = vk::PipelineStageFlags{};
+                owner.subpassDependencies.clear();
+            }
 
-    Device const *device = SafeDeviceAccessor::Get();
-    check(device);
+            std::vector<std::pair<Resource, ResourceAccess>> uses{};
+            uses.reserve(passInfo.reads.size() + passInfo.writes.size());
+            for (Resource const resource : passInfo.reads)
+            {
+                uses.emplace_back(resource, GetReadAccess(resource, pass));
+            }
+            for (Resource const resource : passInfo.writes)
+            {
+                uses.emplace_back(resource, GetWriteAccess(resource, pass));
+            }
 
-    device->WaitIdle();
+            for (auto const &[resource, access] : uses)
+            {
+                Resource const parent = IsPrevious(resource) ? resource : GetParent(resource);
+                ResourceCreateInfo const &resourceInfo = _resourceInfos[resource.index];
+                ResourceCreateInfo const &parentInfo = _resourceInfos[parent.index];
+                uint32_t const memoryBlock = _resources[GetParent(resource).index].memoryBlock;
+                ResourceAccess &blockAccess = blockAccesses[memoryBlock];
+                ResourceAccess const blockPrevious = blockAccess;
+
+                vk::ImageSubresourceRange range{};
+                range.aspectMask = resourceInfo.usage == ResourceUsage::eDepth ? vk::ImageAspectFlagBits::eDepth
+                                                                               : vk::ImageAspectFlagBits::eColor;
+                range.baseMipLevel = resourceInfo.mip;
+                range.levelCount = resourceInfo.mipLevels;
+                range.baseArrayLayer = resourceInfo.layer;
+                range.layerCount = resourceInfo.arrayLayers;
+
+                for (uint32_t i = 0; i < range.levelCount * range.layerCount; i++)
+                {
+                    uint32_t const mip = range.baseMipLevel + i % range.levelCount;
+                    uint32_t const layer = range.baseArrayLayer + i / range.levelCount;
+                    ResourceAccess &resourceAccess = resourceAccesses[parent.index][layer * parentInfo.mipLevels + mip];
+                    uint32_t &lastUser = lastUsers[parent.index][layer * parentInfo.mipLevels + mip];
+
+                    ResourceAccess previous = resourceAccess;
+                    if (previous.layout == vk::ImageLayout::eUndefined && !previous.stageMask)
+                    {
+                        previous.stageMask = blockPrevious.stageMask;
+                        previous.accessMask = blockPrevious.accessMask;
+                    }
+
+                    // reads following reads in the same layout need nothing
+                    bool const hazard = (previous.accessMask & writeAccesses) || (access.accessMask & writeAccesses);
+                    // buffers have no layout to transition, only hazards to wait on
+                    bool const needsSync =
+                        (previous.layout != access.layout && !IsBuffer(resource)) || (previous.stageMask && hazard);
+
+                    if (needsSync && lastUser != UINT32_MAX && lastUser >= owner.order)
+                    {
+                        // both uses are in the same render pass, which transitions between its subpasses itself
+                        uint32_t const srcSubpass = _passes[_orderedPasses[lastUser].index].subpass;
+
+                        auto it = std::find_if(owner.subpassDependencies.begin(), owner.subpassDependencies.end(),
+                                               [&](vk::SubpassDependency const &dependency) {
+                                                   return dependency.srcSubpass == srcSubpass &&
+                                                          dependency.dstSubpass == passHolder.subpass;
+                                               });
+                        if (it == owner.subpassDependencies.end())
+                        {
+                            vk::SubpassDependency subpassDependency{};
+                            subpassDependency.srcSubpass = srcSubpass;
+                            subpassDependency.dstSubpass = passHolder.subpass;
+                            subpassDependency.dependencyFlags = vk::DependencyFlagBits::eByRegion;
+
+                            owner.subpassDependencies.push_back(subpassDependency);
+                            it = std::prev(owner.subpassDependencies.end());
+                        }
+
+                        // compute reads before the render pass can't be named by a subpass dependency, the barrier
+                        // ahead of the render pass waits on them instead
+                        vk::PipelineStageFlags graphicsStages =
+                            previous.stageMask & ~vk::PipelineStageFlags{vk::PipelineStageFlagBits::eComputeShader};
+                        if (graphicsStages != previous.stageMask)
+                        {
+                            owner.srcStageMask |= vk::PipelineStageFlagBits::eComputeShader;
+                            owner.dstStageMask |= access.stageMask;
+                        }
+                        if (!graphicsStages)
+                        {
+                            graphicsStages = vk::PipelineStageFlagBits::eTopOfPipe;
+                        }
+
+                        it->srcStageMask |= graphicsStages;
+                        it->dstStageMask |= access.stageMask;
+                        it->srcAccessMask |= previous.accessMask & writeAccesses;
+                        it->dstAccessMask |= access.accessMask;
+                    }
+                    else if (needsSync)
+                    {
+                        vk::ImageSubresourceRange mipRange = range;
+                        mipRange.baseMipLevel = mip;
+                        mipRange.levelCount = 1u;
+                        mipRange.baseArrayLayer = layer;
+                        mipRange.layerCount = 1u;
+
+                        Transition transition{parent, previous, access, mipRange};
+                        transition.from.accessMask &= writeAccesses; // only writes have to be made available
+                        if (!transition.from.stageMask)
+                        {
+                            transition.from.stageMask = vk::PipelineStageFlagBits::eTopOfPipe;
+                        }
+
+                        owner.srcStageMask |= transition.from.stageMask;
+                        owner.dstStageMask |= transition.to.stageMask;
+
+                        // neighbouring mips of a layer leaving the same state share one barrier
+                        Transition *last = owner.transitions.empty() ? nullptr : &owner.transitions.back();
+                        if (last && last->resource == parent && last->from == transition.from &&
+                            last->to == transition.to && last->range.baseArrayLayer == layer &&
+                            last->range.baseMipLevel + last->range.levelCount == mip)
+                        {
+                            last->range.levelCount++;
+                        }
+                        else
+                        {
+                            owner.transitions.push_back(transition);
+                        }
+                    }
+
+                    // reads following reads add up, so that the next write waits on every one of them
+                    if (!needsSync && resourceAccess.stageMask)
+                    {
+                        resourceAccess.stageMask |= access.stageMask;
+                        resourceAccess.accessMask |= access.accessMask;
+                    }
+                    else
+                    {
+                        resourceAccess = access;
+                    }
+                    lastUser = passHolder.order;
+                }
 
-    _width = width;
-    _height = height;
+                if (blockUsers[memoryBlock] == parent.index)
+                {
+                    blockAccess.stageMask |= access.stageMask;
+                    blockAccess.accessMask |= access.accessMask;
+                }
+                else
+                {
+                    blockAccess = access;
+                    blockUsers[memoryBlock] = parent.index;
+                }
+            }
+
+            // the render pass writing the target last hands it over in the layout of whatever consumes the graph
+            if (!IsCompute(pass) && !IsSubresource(_target) && pass == _resources[_target.index].writers.back())
+            {
+                ResourceAccess handedOver{};
+                if (_usage == GraphUsage::eToTransfer)
+                {
+                    handedOver.layout = vk::ImageLayout::eTransferSrcOptimal;
+                    handedOver.stageMask = vk::PipelineStageFlagBits::eTransfer;
+                    handedOver.accessMask = vk::AccessFlagBits::eTransferRead;
+                }
+                else
+                {
+                    handedOver.layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+                    handedOver.stageMask = vk::PipelineStageFlagBits::eFragmentShader;
+                    handedOver.accessMask = vk::AccessFlagBits::eShaderRead;
+                }
+                std::fill(resourceAccesses[_target.index].begin(), resourceAccesses[_target.index].end(), handedOver);
+            }
+        }
+    }
 
-    std::vector<Resource> resourcesToRebuild;
-    resourcesToRebuild.reserve(_validResources.size());
-    std::vector<Pass> passesToRebuild;
-    passesToRebuild.reserve(_validPasses.size());
+    uint32_t barrierCount = 0;
+    uint32_t transitionCount = 0;
 
-    for (Resource const resource : _validResources)
+    for (Pass const pass : _orderedPasses)
     {
-        ResourceCreateInfo const &resourceInfo = _resourceInfos[resource.index];
+        PassHolder &passHolder = _passes[pass.index];
 
-        if (resourceInfo.extent == vk::Extent2D{0, 0})
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
         {
-            Free(resource);
-            resourcesToRebuild.push_back(resource);
+            std::vector<vk::ImageMemoryBarrier> &imageMemoryBarriers = passHolder.imageMemoryBarriers[i];
+            std::vector<vk::BufferMemoryBarrier> &bufferMemoryBarriers = passHolder.bufferMemoryBarriers[i];
+            imageMemoryBarriers.clear();
+            bufferMemoryBarriers.clear();
+
+            for (Transition const &transition : passHolder.transitions)
+            {
+                if (IsBuffer(transition.resource))
+                {
+                    vk::BufferMemoryBarrier bufferMemoryBarrier{};
+                    bufferMemoryBarrier.srcAccessMask = transition.from.accessMask;
+                    bufferMemoryBarrier.dstAccessMask = transition.to.accessMask;
+                    bufferMemoryBarrier.srcQueueFamilyIndex = vk::QueueFamilyIgnored;
+                    bufferMemoryBarrier.dstQueueFamilyIndex = vk::QueueFamilyIgnored;
+                    bufferMemoryBarrier.buffer = _resources[transition.resource.index].buffers[i];
+                    bufferMemoryBarrier.offset = 0u;
+                    bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+
+                    bufferMemoryBarriers.push_back(bufferMemoryBarrier);
+                    continue;
+                }
+
+                vk::ImageMemoryBarrier imageMemoryBarrier{};
+                imageMemoryBarrier.srcAccessMask = transition.from.accessMask;
+                imageMemoryBarrier.dstAccessMask = transition.to.accessMask;
+                imageMemoryBarrier.oldLayout = transition.from.layout;
+                imageMemoryBarrier.newLayout = transition.to.layout;
+                imageMemoryBarrier.srcQueueFamilyIndex = vk::QueueFamilyIgnored;
+                imageMemoryBarrier.dstQueueFamilyIndex = vk::QueueFamilyIgnored;
+                imageMemoryBarrier.image = GetImage(transition.resource, i)->GetImage();
+                imageMemoryBarrier.subresourceRange = transition.range;
+
+                imageMemoryBarriers.push_back(imageMemoryBarrier);
+            }
         }
+
+        barrierCount += passHolder.transitions.empty() ? 0u : 1u;
+        transitionCount += static_cast<uint32_t>(passHolder.transitions.size());
     }
-    for (Pass const pass : _validPasses)
-    {
-        PassHolder const &passHolder = _passes[pass.index];
 
-        if (passHolder.rebuildOnChange)
+    spdlog::debug("Graph: built {} barriers covering {} transitions", barrierCount, transitionCount);
+}
+
+void Graph::ClearKept(vk::CommandBuffer commandBuffer)
+{
+    // the first frame finds kept images in the layouts a frame leaves them in, they start cleared there
+    std::vector<Resource> kept{};
+    for (Resource const resource : _keptToClear)
+    {
+        if (_validResources.find(resource) != _validResources.end() && IsBuilt(resource))
         {
-            Free(pass);
-            passesToRebuild.push_back(pass);
+            kept.push_back(resource);
         }
     }
+    _keptToClear.clear();
 
-    for (Resource const resource : resourcesToRebuild)
+    if (kept.empty())
     {
-        Build(resource);
+        return;
     }
 
-    for (Pass const pass : passesToRebuild)
+    // nothing in flight has used the images of any frame yet, so all of them are cleared at once
+    for (Resource const resource : kept)
     {
-        Build(pass);
-        BuildPipeline(pass);
+        ResourceCreateInfo const &createInfo = _resourceInfos[resource.index];
+        std::vector<vk::ImageLayout> const &keptLayouts = _resources[resource.index].keptLayouts;
+
+        vk::ImageSubresourceRange range{};
+        range.aspectMask = createInfo.usage == ResourceUsage::eDepth ? vk::ImageAspectFlagBits::eDepth
+                                                                     : vk::ImageAspectFlagBits::eColor;
+        range.levelCount = createInfo.mipLevels;
+        range.layerCount = createInfo.arrayLayers;
+
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            vk::ImageMemoryBarrier imageMemoryBarrier{};
+            imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eMemoryWrite;
+            imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+            imageMemoryBarrier.oldLayout = vk::ImageLayout::eUndefined;
+            imageMemoryBarrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+            imageMemoryBarrier.srcQueueFamilyIndex = vk::QueueFamilyIgnored;
+            imageMemoryBarrier.dstQueueFamilyIndex = vk::QueueFamilyIgnored;
+            imageMemoryBarrier.image = _resources[resource.index].images[i]->GetImage();
+            imageMemoryBarrier.subresourceRange = range;
+
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer,
+                                          {}, {}, {}, imageMemoryBarrier);
+
+            if (createInfo.usage == ResourceUsage::eDepth)
+            {
+                commandBuffer.clearDepthStencilImage(imageMemoryBarrier.image, vk::ImageLayout::eTransferDstOptimal,
+                                                     createInfo.clear.depthStencil, range);
+            }
+            else
+            {
+                commandBuffer.clearColorImage(imageMemoryBarrier.image, vk::ImageLayout::eTransferDstOptimal,
+                                              createInfo.clear.color, range);
+            }
+
+            std::vector<vk::ImageMemoryBarrier> layoutBarriers{};
+            for (uint32_t layer = 0; layer < createInfo.arrayLayers; layer++)
+            {
+                for (uint32_t mip = 0; mip < createInfo.mipLevels; mip++)
+                {
+                    vk::ImageLayout const keptLayout = keptLayouts.at(layer * createInfo.mipLevels + mip);
+                    if (keptLayout == vk::ImageLayout::eUndefined) // never used by a frame
+                    {
+                        continue;
+                    }
+
+                    vk::ImageMemoryBarrier layoutBarrier = imageMemoryBarrier;
+                    layoutBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+                    layoutBarrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+                    layoutBarrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+                    layoutBarrier.newLayout = keptLayout;
+                    layoutBarrier.subresourceRange.baseMipLevel = mip;
+                    layoutBarrier.subresourceRange.levelCount = 1u;
+                    layoutBarrier.subresourceRange.baseArrayLayer = layer;
+                    layoutBarrier.subresourceRange.layerCount = 1u;
+
+                    layoutBarriers.push_back(layoutBarrier);
+                }
+            }
+
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands,
+                                          {}, {}, {}, layoutBarriers);
+        }
     }
 
-    spdlog::debug("Graph: resized to {}x{}", _width, _height, width, height);
+    spdlog::debug("Graph: cleared {} kept resources", kept.size());
 }
 
-void Graph::OnResizeCallback(void *graph, uint32_t width, uint32_t height)
+std::string Graph::DumpBarrierPlan() const
 {
-    check(graph);
-    reinterpret_cast<Graph *>(graph)->Resize(width, height);
-}
+    std::ostringstream oss;
+    oss << "Graph: barrier plan";
 
-bool Graph::IsSampled(Resource resource)
-{
-    if (_usage == eToTransfer)
+    for (Pass const pass : _orderedPasses)
     {
-        return _resources[resource.index].readers.size() > 0 && resource != _target;
+        PassHolder const &passHolder = _passes[pass.index];
+
+        oss << "\n  '" << _passInfos[pass.index].debugName << "' ";
+
+        if (passHolder.subpass != 0)
+        {
+            PassHolder const &owner = _passes[_orderedPasses[passHolder.order - passHolder.subpass].index];
+
+            oss << "subpass " << passHolder.subpass;
+            for (vk::SubpassDependency const &dependency : owner.subpassDependencies)
+            {
+                if (dependency.dstSubpass == passHolder.subpass)
+                {
+                    oss << "\n    from subpass " << dependency.srcSubpass << " "
+                        << vk::to_string(dependency.srcStageMask) << " -> " << vk::to_string(dependency.dstStageMask)
+                        << ", " << vk::to_string(dependency.srcAccessMask) << " -> "
+                        << vk::to_string(dependency.dstAccessMask);
+                }
+            }
+            continue;
+        }
+
+        if (passHolder.transitions.empty())
+        {
+            oss << "no barrier";
+            continue;
+        }
+
+        oss << vk::to_string(passHolder.srcStageMask) << " -> " << vk::to_string(passHolder.dstStageMask);
+        for (Transition const &transition : passHolder.transitions)
+        {
+            ResourceCreateInfo const &resourceInfo = _resourceInfos[transition.resource.index];
+
+            oss << "\n    <" << resourceInfo.debugName << "> ";
+            if (resourceInfo.mipLevels > 1u || resourceInfo.arrayLayers > 1u)
+            {
+                vk::ImageSubresourceRange const &range = transition.range;
+                oss << "mips " << range.baseMipLevel << "-" << range.baseMipLevel + range.levelCount - 1 << " layer "
+                    << range.baseArrayLayer << " ";
+            }
+            oss << vk::to_string(transition.from.layout) << " -> " << vk::to_string(transition.to.layout) << ", "
+                << vk::to_string(transition.from.accessMask) << " -> " << vk::to_string(transition.to.accessMask);
+        }
     }
-    return _resources[resource.index].readers.size() > 0 || resource == _target;
+
+    return oss.str();
 }
@@ -6,7 +6,10 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <functional>
+#include <mutex>
 #include <set>
+#include <string>
 #include <variant>
 
 namespace wsp
@@ -35,27 +38,64 @@ class Graph
     void SetUboSize(uint32_t uboSize);
     void SetPopulateUboFunction(std::function<void *()>);
     [[nodiscard]] Resource NewResource(const struct ResourceCreateInfo &);
+    // one mip and layer of a resource, which passes can read and write on its own
+    [[nodiscard]] Resource GetSubresource(Resource, uint32_t mip, uint32_t layer = 0u);
+    // last frame's contents of a history resource, read only
+    [[nodiscard]] Resource GetPrevious(Resource);
+    void SetFormat(Resource, vk::Format); // taken into account on the next Compile
     Pass NewPass(const struct PassCreateInfo &);
 
     void Compile(Resource target, GraphUsage);
     void Render(vk::CommandBuffer, uint32_t frameIndex);
 
     class Image *GetTargetImage() const;
+    void ReadTarget(std::vector<float> *rgba) const; // of the last frame, waits on the device, for validation
+    vk::Buffer GetBuffer(Resource) const; // of the frame being rendered, for passes drawing from indirect buffers
     vk::DescriptorSet GetTargetDescriptorSet() const;
 
+    void ReloadShaders(); // rebuilds pipelines in the background, swapped in on a later Render
+    void ReloadShaders(std::set<std::string> const &shaderFiles);
+
     void ChangeUsage(GraphUsage);
     void Resize(uint32_t width, uint32_t height);
     static void OnResizeCallback(void *, uint32_t width, uint32_t height);
 
+    // screen sized passes draw to the top left of their images, which keep their size
+    void SetRenderScale(float);
+    float GetRenderScale() const;
+    void SetFrameBudget(float milliseconds); // the render scale then follows the gpu time, 0 holds it
+    float GetGpuTime() const;                // in milliseconds, of the last finished frame
+    vk::Extent2D GetTargetExtent() const;    // the part of the target drawn to
+
+    // into secondary command buffers on the worker threads, instead of inline into the frame's, off by default
+    void SetThreadedRecording(bool);
+    bool IsRecordingThreaded() const;
+
+    std::string DumpBarrierPlan() const;
+
+    struct PassStats
+    {
+        uint64_t runs{0};
+        uint64_t skips{0}; // frames it was up to date on
+    };
+    PassStats GetStats(Pass) const;
+
   protected:
     void FlushUbo(void *ubo);
 
     struct PipelineHolder
     {
-        vk::ShaderModule vertShaderModule;
+        vk::ShaderModule vertShaderModule; // all shared through the device, released along with the pipeline
         vk::ShaderModule fragShaderModule;
+        vk::ShaderModule compShaderModule;
         vk::PipelineLayout pipelineLayout;
-        vk::Pipeline pipeline;
+        vk::Pipeline pipeline;                          // the first permutation on passes with permutations
+        std::vector<vk::Pipeline> permutationPipelines; // the others, in order
+
+        // what the pipeline was built against, a recompile keeps it while these match
+        vk::RenderPass renderPass;
+        uint32_t subpass{0};
+        size_t codeHash{0};
     };
 
     struct ResourceHolder
@@ -63,9 +103,71 @@ class Graph
         std::array<class Image *, MAX_FRAMES_IN_FLIGHT> images;
         std::array<class Texture *, MAX_FRAMES_IN_FLIGHT> textures;
         std::array<vk::DescriptorSet, MAX_FRAMES_IN_FLIGHT> descriptorSets;
+        std::array<vk::DescriptorSet, MAX_FRAMES_IN_FLIGHT> inputDescriptorSets;
+        std::array<vk::DescriptorSet, MAX_FRAMES_IN_FLIGHT> storageDescriptorSets;
+        std::array<vk::Buffer, MAX_FRAMES_IN_FLIGHT> buffers; // instead of images, for storage buffers
 
-        std::vector<Pass> writers{};
+        std::vector<Pass> writers{}; // sorted in execution order once compiled
         std::vector<Pass> readers{};
+        std::vector<Resource> subresources{}; // views into this resource's images
+        std::vector<vk::ImageLayout> keptLayouts{}; // per mip and layer, the layouts a frame leaves kept images in
+
+        std::pair<uint32_t, uint32_t> lifetime{}; // first and last render pass using it, as indices into _orderedPasses
+        uint32_t memoryBlock{0};
+
+        // what the images were built from and packed with, a recompile keeps them while these match
+        vk::ImageCreateInfo imageInfo{};
+        vk::BufferCreateInfo bufferInfo{};
+        std::pair<uint32_t, uint32_t> packedLifetime{};
+        bool isPackedTransient{false};
+    };
+
+    struct MemoryBlock // backs every resource of a frame index whose lifetimes never overlap
+    {
+        vk::DeviceSize size{0};
+        uint32_t memoryTypeBits{~0u};
+        vk::MemoryPropertyFlags properties{vk::MemoryPropertyFlagBits::eDeviceLocal};
+        bool isShared{true};
+        bool isScreenSized{false}; // resizing only repacks these
+        std::vector<std::pair<uint32_t, uint32_t>> lifetimes{};
+        std::array<vk::DeviceMemory, MAX_FRAMES_IN_FLIGHT> memories{};
+    };
+
+    struct ResourceAccess // layout, stages and accesses of one use of a resource, buffers stay eGeneral
+    {
+        vk::ImageLayout layout{vk::ImageLayout::eUndefined};
+        vk::PipelineStageFlags stageMask{};
+        vk::AccessFlags accessMask{};
+
+        bool operator==(ResourceAccess const &other) const
+        {
+            return layout == other.layout && stageMask == other.stageMask && accessMask == other.accessMask;
+        }
+    };
+
+    struct Transition
+    {
+        Resource resource; // never a subresource, range picks the mips and layers
+        ResourceAccess from;
+        ResourceAccess to;
+        vk::ImageSubresourceRange range;
+    };
+
+    struct RenderPassDescription // everything a render pass is created from
+    {
+        std::vector<Resource> attachments{};
+        std::vector<vk::AttachmentDescription> attachmentDescriptions{};
+        std::vector<std::vector<vk::AttachmentReference>> colorReferences{};
+        std::vector<vk::AttachmentReference> depthReferences{}; // VK_ATTACHMENT_UNUSED without depth
+        std::vector<std::vector<vk::AttachmentReference>> inputReferences{};
+        std::vector<std::vector<uint32_t>> preserveAttachments{};
+        std::vector<vk::SubpassDependency> dependencies{};
+
+        bool operator==(RenderPassDescription const &) const;
+        bool operator!=(RenderPassDescription const &other) const
+        {
+            return !(*this == other);
+        }
     };
 
     struct PassHolder
@@ -79,27 +181,129 @@ class Graph
                                  // GIGA SHADER Unity approach?
         std::vector<vk::ClearValue> clearValues;
 
-        bool rebuildOnChange{false};
         std::vector<Pass> dependencies{};
-        std::vector<std::array<vk::ImageMemoryBarrier, MAX_FRAMES_IN_FLIGHT>> imageMemoryBarriers{};
+
+        uint32_t order{0};   // index into _orderedPasses
+        uint32_t subpass{0}; // within its render pass, which is built and owned by the pass at subpass 0
+        std::vector<Pass> subpasses{};                            // on the owner, every pass of the render pass
+        std::vector<vk::SubpassDependency> subpassDependencies{}; // on the owner
+
+        // on the owner, what its render pass and framebuffers were built from
+        RenderPassDescription renderPassDescription{};
+        std::array<std::vector<vk::ImageView>, MAX_FRAMES_IN_FLIGHT> frameBufferViews{};
+        vk::Extent2D frameBufferExtent{};
+
+        std::vector<Transition> transitions{}; // on the owner, as a single pipelineBarrier before its render pass
+        vk::PipelineStageFlags srcStageMask{};
+        vk::PipelineStageFlags dstStageMask{};
+        std::array<std::vector<vk::ImageMemoryBarrier>, MAX_FRAMES_IN_FLIGHT> imageMemoryBarriers{};
+        std::array<std::vector<vk::BufferMemoryBarrier>, MAX_FRAMES_IN_FLIGHT> bufferMemoryBarriers{};
+
+        std::vector<vk::CommandBuffer> secondaryCommandBuffers{}; // one per chunk, re-recorded every frame
+        std::array<std::vector<vk::DescriptorSet>, MAX_FRAMES_IN_FLIGHT> descriptorSets{}; // bound from set 0
+
+        std::vector<vk::CommandBuffer> cachedCommandBuffers{}; // one per frame in flight, for recordOnce passes
+        std::array<std::vector<uint32_t>, MAX_FRAMES_IN_FLIGHT> cachedVersions{}; // static textures at record time
+        std::array<bool, MAX_FRAMES_IN_FLIGHT> isCacheValid{};
+
+        uint32_t pendingRuns{0}; // for passes with isUpToDate, every frame in flight has images to bring up to date
+        bool isSkipped{false};
+        PassStats stats{};
+    };
+
+    struct RecordingContext // one per worker thread, only ever touched by that thread while recording
+    {
+        std::array<vk::CommandPool, MAX_FRAMES_IN_FLIGHT> commandPools;
+        std::array<std::vector<vk::CommandBuffer>, MAX_FRAMES_IN_FLIGHT> commandBuffers;
+        std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> usedCommandBuffers;
     };
 
     bool IsSampled(Resource);
+    bool IsReadAsInput(Resource) const;
+    bool IsStorage(Resource) const;
+    bool IsBuffer(Resource) const;
+    bool IsDrawnFrom(Resource, Pass) const; // an indirect buffer a graphics pass reads, never bound
+    bool IsBuilt(Resource) const;
+    bool IsCompute(Pass) const;
+    bool IsCached(Pass) const;
+    bool IsKept(Resource) const;
+    bool IsSubresource(Resource) const;
+    bool IsPrevious(Resource) const;
+    bool IsReadEarly(Resource, Pass) const;
+    std::vector<Pass> GetOverwriters(Pass) const; // the writers of its early reads that wait on it
+    Resource GetParent(Resource) const; // itself if it isn't a subresource
+    class Image *GetImage(Resource, int frameIndex) const;
+
+    vk::Extent2D GetExtent(Pass) const;
+    vk::Extent2D GetExtent(Resource) const;
+    bool IsScreenSized(Resource) const;
+    vk::Extent2D GetRenderExtent(Pass) const;
+    vk::Extent2D GetRenderExtent(Resource) const; // under the render scale
+    void ApplyRenderScale();
+    Pass GetOwner(Pass) const;
+    ResourceAccess GetReadAccess(Resource, Pass) const;
+    ResourceAccess GetWriteAccess(Resource, Pass) const;
 
     void KhanFindOrder(std::set<Resource> const &, std::set<Pass> const &);
 
+    void FindLifetimes();
+    void FindSubpasses();
+    bool CanMerge(Pass owner, Pass) const;
+    bool IsTransient(Resource) const;
+    bool IsMemoryless(Resource) const;
+
+    vk::ImageCreateInfo GetImageInfo(Resource);
+    vk::ImageUsageFlags GetImageUsage(Resource);
+    vk::BufferCreateInfo GetBufferInfo(Resource) const;
+    vk::MemoryRequirements GetMemoryRequirements(Resource) const;
+    RenderPassDescription DescribeRenderPass(Pass) const;
+
     void Build(Resource);
+    void BuildMemory(std::vector<Resource> const &);
+    void BuildViews(Resource);
     void Build(Pass);
+    void BuildBarriers();
+    void ClearKept(vk::CommandBuffer);
     void BuildUbo();
     void FreeUbo();
 
     void Free(Resource);
     void Free(Pass);
+    void FreePipeline(Pass);
+    void RetirePipeline(PipelineHolder const &);
+    void FreeRenderPass(Pass);
+    void FreeMemory(std::set<uint32_t> const &memoryBlocks);
+
+    // destroyed once every frame in flight that may still use it has been waited on, instead of waiting idle
+    void Retire(std::function<void(class Device const *)> const &destroy);
+    void FreeRetired(bool all);
 
     void BuildPipeline(Pass);
+    PipelineHolder CreatePipeline(Pass, std::vector<char> const &vertCode, std::vector<char> const &fragCode) const;
+    PipelineHolder CreateComputePipeline(Pass, std::vector<char> const &compCode) const;
+    std::vector<vk::DescriptorSetLayout> GetDescriptorSetLayouts(Pass) const; // in the order BuildBindList binds
+    void SwapReloadedPipelines();
     void BuildSamplers(class Device const *);
     void BuildDescriptorPool();
     void BuildDescriptors(Resource);
+    void BuildRecordingContexts();
+    void FreeRecordingContexts();
+    void BuildTimestamps();
+    void FreeTimestamps();
+    void MeasureGpuTime();
+    void AdjustRenderScale();
+
+    void BuildBindList(Pass);
+    void BuildCachedCommandBuffers(Pass);
+    bool IsRecordedOnce(Pass) const;
+    vk::SubpassContents GetContents(Pass) const; // of its subpass, inline unless recorded into secondaries
+    bool IsCacheValid(Pass) const;
+
+    uint32_t GetChunkCount(Pass) const;
+    vk::CommandBuffer NextSecondaryCommandBuffer(uint32_t threadIndex);
+    void Record(Pass, uint32_t chunk, uint32_t chunkCount, vk::CommandBuffer); // begins and ends a secondary
+    void RecordCommands(Pass, uint32_t chunk, uint32_t chunkCount, vk::CommandBuffer) const;
+    void Dispatch(Pass, vk::CommandBuffer) const;
 
     void FindDependencies(std::set<Resource> *validResources, std::set<Pass> *validPasses, Resource pass,
                           std::set<std::variant<Resource, Pass>> &visitingStack);
@@ -124,9 +328,25 @@ class Graph
     std::set<Resource> _validResources;
     std::set<Pass> _validPasses;
     std::vector<Pass> _orderedPasses;
+    std::vector<MemoryBlock> _memoryBlocks;
+    std::vector<Resource> _keptToClear; // built by a Compile since the last frame, which clears them first
 
     vk::DescriptorPool _descriptorPool;
     vk::DescriptorSetLayout _descriptorSetLayout;
+    vk::DescriptorSetLayout _inputDescriptorSetLayout;
+    vk::DescriptorSetLayout _storageImageDescriptorSetLayout;
+    vk::DescriptorSetLayout _storageBufferDescriptorSetLayout;
+
+    class ThreadPool *_threadPool;
+    std::vector<RecordingContext> _recordingContexts;
+    vk::CommandPool _cachedCommandPool;
+
+    std::vector<std::pair<uint32_t, std::function<void(class Device const *)>>> _retired; // frames left, destroy
+    std::mutex _retiredMutex;
+
+    class ThreadPool *_reloadPool;
+    std::mutex _reloadMutex;
+    std::vector<std::pair<Pass, PipelineHolder>> _reloadedPipelines;
 
     bool _requestsUniform;
     uint32_t _uboSize;
@@ -139,6 +359,16 @@ class Graph
 
     uint32_t _width, _height;
     uint32_t _currentFrameIndex; // only accurate when calling FlushUbo to update
+
+    vk::QueryPool _timestampPool;                    // a start and an end per frame in flight
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> _isTimed; // whether its timestamps were written
+    float _timestampPeriod;
+    float _gpuTime;
+    float _frameBudget;
+    float _renderScale;
+    float _targetRenderScale; // smoothed, _renderScale follows it in steps
+
+    bool _isRecordingThreaded;
 };
 
 } // namespace wsp
@@ -51,27 +51,55 @@ struct Resource
 struct PassCreateInfo
 {
     std::vector<class StaticTextures const *> staticTextures{};
+    std::vector<class StaticBuffer const *> staticBuffers{}; // bound after the static textures
     std::vector<Resource> reads{};
     std::vector<Resource> writes{};
     bool readsUniform{false};
+    // reads are declared as subpassInput and only loaded at the shaded pixel, so they are bound as input
+    // attachments and the pass can become a subpass of the render pass that wrote them
+    bool pixelLocalReads{false};
+    // color writes are alpha blended over what they hold, depth writes are tested against but left untouched
+    bool blends{false};
 
     std::vector<Pass> passDependencies{};
+    // reads of resources later passes write again, seen as the passes in passDependencies left them, and their
+    // other writers wait on this pass instead of the other way around
+    std::vector<Resource> earlyReads{};
 
     uint32_t pushConstantSize{0};
 
     std::string vertFile;
     std::string fragFile;
+    // when set, the pass is a compute pass: it runs dispatch outside of any render pass and binds its writes as
+    // storage, vertFile, fragFile and execute are ignored
+    std::string compFile;
 
     std::string debugName{""};
 
     std::function<void(vk::CommandBuffer, vk::PipelineLayout)> execute;
+    // when set, replaces execute and lets the graph split recording across its worker threads
+    std::function<void(vk::CommandBuffer, vk::PipelineLayout, uint32_t chunk, uint32_t chunkCount)> executeChunk;
+    // execute only depends on compile-time state, so it is recorded once per frame index and replayed
+    bool recordOnce{false};
+    // called every frame, while it returns true the pass is skipped and what it writes keeps its contents
+    std::function<bool()> isUpToDate;
+    // values of specialization constant 0 in both shaders, a pipeline is built for each of them
+    std::vector<uint32_t> permutations{};
+    // with permutations, replaces execute and executeChunk, called once per permutation with its pipeline bound
+    std::function<void(vk::CommandBuffer, vk::PipelineLayout, uint32_t permutation, uint32_t chunk,
+                       uint32_t chunkCount)>
+        executePermutation;
     vk::PipelineVertexInputStateCreateInfo vertexInputInfo{{}, 0, nullptr, 0, nullptr};
+
+    std::function<void(vk::CommandBuffer, vk::PipelineLayout)> dispatch;
 };
 
 enum ResourceUsage
 {
     eColor,
     eDepth,
+    eStorageImage,  // written by compute passes, sampled by any pass
+    eStorageBuffer, // read and written by compute passes, read by graphics passes
 };
 
 struct ResourceCreateInfo
@@ -79,7 +107,18 @@ struct ResourceCreateInfo
     // for regular resources
     vk::Format format;
     vk::Extent2D extent{0, 0}; // {0, 0} to follow screen extent
+    uint32_t screenDivisor{1u}; // when following screen extent, how many times smaller
     vk::ClearValue clear;
+    // each mip halves the extent, passes write single mips and layers through Graph::GetSubresource
+    uint32_t mipLevels{1u};
+    uint32_t arrayLayers{1u};
+    bool history{false}; // keeps last frame's contents, which passes read through Graph::GetPrevious
+
+    // for storage buffers
+    vk::DeviceSize size{0};
+    // holds draw commands or counts, graphics passes reading it draw from it through Graph::GetBuffer instead of
+    // binding it
+    bool indirect{false};
 
     ResourceUsage usage;
 
@@ -88,6 +127,10 @@ struct ResourceCreateInfo
     friend class Graph;
 
   protected:
+    uint32_t parent{UINT32_MAX}; // on subresources, the resource whose image they view
+    uint32_t mip{0u};
+    uint32_t layer{0u};
+    bool previous{false}; // on previous frame handles, the parent is the resource of the current frame
 };
 
 class StaticTextureAllocator
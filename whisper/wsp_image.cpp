@@ -15,7 +15,8 @@
 using namespace wsp;
 
 Image::Image(Device const *device, CreateInfo const &createInfo)
-    : _name{createInfo.filepath.filename().string()}, _cubemap{createInfo.cubemap}
+    : _name{createInfo.filepath.filename().string()}, _cubemap{createInfo.cubemap},
+      _arrayLayers{createInfo.cubemap ? 6u : 1u}
 {
     check(device);
 
@@ -86,7 +87,8 @@ Image::Image(Device const *device, CreateInfo const &createInfo)
                  FormatToString(_format), width, height, channels, size);
 }
 
-Image::Image(Device const *device, vk::ImageCreateInfo const &createInfo, std::string const &name)
+Image::Image(Device const *device, vk::ImageCreateInfo const &createInfo, std::string const &name,
+             bool allocateMemory)
     : _name{""}, _format{createInfo.format}
 {
     check(device);
@@ -94,8 +96,16 @@ Image::Image(Device const *device, vk::ImageCreateInfo const &createInfo, std::s
     _cubemap = createInfo.arrayLayers == 6u && createInfo.flags & vk::ImageCreateFlagBits::eCubeCompatible;
     _format = createInfo.format;
     _mipLevels = createInfo.mipLevels;
+    _arrayLayers = createInfo.arrayLayers;
 
-    device->CreateImageAndBindMemory(createInfo, &_image, &_deviceMemory, name);
+    if (allocateMemory)
+    {
+        device->CreateImageAndBindMemory(createInfo, &_image, &_deviceMemory, name);
+    }
+    else
+    {
+        device->CreateImage(createInfo, &_image, name);
+    }
 }
 
 Image::~Image()
@@ -104,11 +114,29 @@ Image::~Image()
     check(device);
 
     device->DestroyImage(&_image);
-    device->FreeDeviceMemory(&_deviceMemory);
+    if (_deviceMemory != VK_NULL_HANDLE)
+    {
+        device->FreeDeviceMemory(&_deviceMemory);
+    }
 
     spdlog::debug("Image: <{}> freed", GetName());
 }
 
+vk::MemoryRequirements Image::GetMemoryRequirements(Device const *device) const
+{
+    check(device);
+
+    return device->GetImageMemoryRequirements(_image);
+}
+
+void Image::BindMemory(Device const *device, vk::DeviceMemory deviceMemory, vk::DeviceSize offset)
+{
+    check(device);
+    check(_deviceMemory == VK_NULL_HANDLE);
+
+    device->BindImageMemory(_image, deviceMemory, offset);
+}
+
 void Image::GenerateMipmaps(Device const *device, vk::Format format, int32_t width, int32_t height, uint32_t mipLevels,
                             uint32_t layerCount)
 {
@@ -389,3 +417,8 @@ uint32_t Image::GetMipLevels() const
 {
     return _mipLevels;
 }
+
+uint32_t Image::GetArrayLayers() const
+{
+    return _arrayLayers;
+}
@@ -37,11 +37,17 @@ class Image
     std::string GetName() const;
     bool IsCubemap() const;
     uint32_t GetMipLevels() const;
+    uint32_t GetArrayLayers() const;
 
     friend class Graph;
 
   protected:
-    Image(class Device const *, vk::ImageCreateInfo const &createInfo, std::string const &name);
+    Image(class Device const *, vk::ImageCreateInfo const &createInfo, std::string const &name,
+          bool allocateMemory = true);
+
+    // for images created without memory, which then live in memory owned by someone else
+    vk::MemoryRequirements GetMemoryRequirements(class Device const *) const;
+    void BindMemory(class Device const *, vk::DeviceMemory, vk::DeviceSize offset);
 
     void GenerateMipmaps(class Device const *, vk::Format, int32_t width, int32_t height, uint32_t mipLevels,
                          uint32_t layerCount = 1);
@@ -62,6 +68,7 @@ class Image
 
     bool _cubemap;
     uint32_t _mipLevels;
+    uint32_t _arrayLayers;
 };
 
 } // namespace wsp
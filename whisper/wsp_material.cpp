@@ -13,6 +13,8 @@
 
 using namespace wsp;
 
+uint32_t const Material::PERMUTATION_COUNT{1u << 5};
+
 void Material::PropagateFormatFromGlTF(cgltf_material const *material, cgltf_texture const *pTexture,
                                        std::vector<Texture::CreateInfo> *createInfos)
 {
@@ -80,6 +82,7 @@ Material::CreateInfo Material::GetCreateInfoFromGlTF(cgltf_material const *mater
         createInfo.metallic = material->pbr_metallic_roughness.metallic_factor;
         createInfo.roughness = material->pbr_metallic_roughness.roughness_factor;
         createInfo.albedoColor = *(glm::vec3 *)(material->pbr_metallic_roughness.base_color_factor);
+        createInfo.alpha = material->pbr_metallic_roughness.base_color_factor[3];
 
         createInfo.metallicRoughness = getTexture(material->pbr_metallic_roughness.metallic_roughness_texture.texture);
 
@@ -100,6 +103,20 @@ Material::CreateInfo Material::GetCreateInfoFromGlTF(cgltf_material const *mater
         createInfo.anisotropy = material->anisotropy.anisotropy_strength;
     }
 
+    switch (material->alpha_mode)
+    {
+    case cgltf_alpha_mode_mask:
+        createInfo.alphaMode = eMask;
+        createInfo.alphaCutoff = material->alpha_cutoff;
+        break;
+    case cgltf_alpha_mode_blend:
+        createInfo.alphaMode = eBlend;
+        break;
+    default:
+        createInfo.alphaMode = eOpaque;
+        break;
+    }
+
     createInfo.normal = getTexture(material->normal_texture.texture);
     createInfo.occlusion = getTexture(material->occlusion_texture.texture);
 
@@ -112,7 +129,8 @@ Material::Material(CreateInfo const &createInfo)
       _specularTexture{createInfo.specular}, _albedoColor{createInfo.albedoColor},
       _fresnelColor{createInfo.fresnelColor}, _specularColor{createInfo.specularColor},
       _roughness{createInfo.roughness}, _metallic{createInfo.metallic}, _anisotropy{createInfo.anisotropy},
-      _ior{createInfo.ior}, _name{createInfo.name}
+      _ior{createInfo.ior}, _alpha{createInfo.alpha}, _alphaCutoff{createInfo.alphaCutoff},
+      _alphaMode{createInfo.alphaMode}, _name{createInfo.name}
 {
     spdlog::debug("Material: <{}>", _name);
 }
@@ -135,6 +153,47 @@ void Material::GetInfo(ubo::Material *info) const
     info->roughness = _roughness;
     info->metallic = _metallic;
     info->anisotropy = _anisotropy;
+    info->alpha = _alpha;
+    info->alphaCutoff = _alphaCutoff;
+}
+
+uint32_t Material::GetFeatures() const
+{
+    StaticTextures const *staticTextures = AssetsManager::Get()->GetStaticTextures();
+    check(staticTextures);
+
+    uint32_t features{0};
+    if (staticTextures->GetID(_albedoTexture) != INVALID_ID)
+    {
+        features |= eAlbedoTexture;
+    }
+    if (staticTextures->GetID(_metallicRoughnessTexture) != INVALID_ID)
+    {
+        features |= eMetallicRoughnessTexture;
+    }
+    if (staticTextures->GetID(_occlusionTexture) != INVALID_ID)
+    {
+        features |= eOcclusionTexture;
+    }
+    if (staticTextures->GetID(_specularTexture) != INVALID_ID)
+    {
+        features |= eSpecularTexture;
+    }
+    if (_alphaMode == eMask)
+    {
+        features |= eAlphaMask;
+    }
+    else if (_alphaMode == eBlend)
+    {
+        features |= eAlphaBlend;
+    }
+
+    return features;
+}
+
+Material::AlphaMode Material::GetAlphaMode() const
+{
+    return _alphaMode;
 }
 
 int Material::GetID() const
@@ -21,6 +21,13 @@ WCLASS()
 class Material
 {
   public:
+    enum AlphaMode // glTF alphaMode, decides which draw list and pipeline a primitive goes through
+    {
+        eOpaque,
+        eMask,
+        eBlend,
+    };
+
     struct CreateInfo
     {
         TextureID albedo{};
@@ -33,6 +40,10 @@ class Material
         glm::vec3 fresnelColor{};
         glm::vec3 specularColor{.04};
 
+        AlphaMode alphaMode{eOpaque};
+        float alpha{1.};
+        float alphaCutoff{.5};
+
         float roughness{0.};
         float metallic{0.};
         float anisotropy{0.};
@@ -41,6 +52,18 @@ class Material
         std::string name{""};
     };
 
+    enum Feature : uint32_t // mesh.frag is specialized on these, compiling out what a material doesn't use
+    {
+        eAlbedoTexture = 1u << 0,
+        eMetallicRoughnessTexture = 1u << 1,
+        eOcclusionTexture = 1u << 2,
+        eSpecularTexture = 1u << 3,
+        eAlphaMask = 1u << 4,         // discards under the alpha cutoff, so only masked geometry loses early-Z
+        eAlphaBlend = 1u << 5,        // never bucketed, blended geometry is drawn sorted in its own pass
+        eRuntimeFeatures = 1u << 31,  // texture features are checked per material instead of compiled in
+    };
+    static uint32_t const PERMUTATION_COUNT; // every combination of texture features and alpha mask
+
     static void PropagateFormatFromGlTF(cgltf_material const *, cgltf_texture const *pTexture,
                                         std::vector<Texture::CreateInfo> *);
     static CreateInfo GetCreateInfoFromGlTF(cgltf_material const *, cgltf_texture const *pTexture,
@@ -49,6 +72,8 @@ class Material
     Material(CreateInfo const &);
 
     void GetInfo(ubo::Material *) const;
+    uint32_t GetFeatures() const;
+    AlphaMode GetAlphaMode() const;
 
     int GetID() const;
     void SetID(int ID);
@@ -88,6 +113,12 @@ class Material
     float _anisotropy;
     WPROPERTY(eSlider, 0.f, 100.f)
     float _ior;
+    WPROPERTY(eSlider, 0.f, 1.f)
+    float _alpha;
+    WPROPERTY(eSlider, 0.f, 1.f)
+    float _alphaCutoff;
+
+    AlphaMode const _alphaMode;
 };
 
 } // namespace wsp
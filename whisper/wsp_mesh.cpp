@@ -18,6 +18,7 @@
 #define CGLTF_IMPLEMENTATION
 #include <cgltf.h>
 
+#include <cmath>
 #include <stdexcept>
 
 using namespace wsp;
@@ -165,77 +166,94 @@ Mesh *Mesh::BuildGlTF(Device const *device, cgltf_mesh const *mesh, cgltf_materi
     return new Mesh{device, vertices, indices, primitives, name};
 }
 
-Mesh::Mesh(Device const *device, std::vector<Vertex> const &vertices, std::vector<uint32_t> const &indices,
-           std::vector<Primitive> const &primitives, std::string const &name)
-    : _name{name}, _primitives{primitives}
+static void CreateDeviceLocalBuffer(Device const *device, void const *data, uint32_t size,
+                                    vk::BufferUsageFlags usage, vk::Buffer *buffer, vk::DeviceMemory *deviceMemory,
+                                    std::string const &name)
 {
-    check(device);
+    vk::Buffer stagingBuffer;
+    vk::DeviceMemory stagingDeviceMemory;
 
-    ZoneScopedN("build mesh");
+    vk::BufferCreateInfo stagingBufferInfo{};
+    stagingBufferInfo.size = size;
+    stagingBufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
 
-    { // index buffer
-        uint32_t const bufferSize = sizeof(uint32_t) * indices.size();
+    device->CreateBufferAndBindMemory(
+        stagingBufferInfo, &stagingBuffer, &stagingDeviceMemory,
+        {vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent}, name + "_staging");
 
-        vk::Buffer stagingBuffer;
-        vk::DeviceMemory stagingDeviceMemory;
+    void *mappedMemory;
+    device->MapMemory(stagingDeviceMemory, &mappedMemory);
+    memcpy(mappedMemory, data, size);
 
-        vk::BufferCreateInfo stagingBufferInfo{};
-        stagingBufferInfo.size = bufferSize;
-        stagingBufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+    vk::BufferCreateInfo bufferInfo{};
+    bufferInfo.size = size;
+    bufferInfo.usage = usage | vk::BufferUsageFlagBits::eTransferDst;
 
-        device->CreateBufferAndBindMemory(
-            stagingBufferInfo, &stagingBuffer, &stagingDeviceMemory,
-            {vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent},
-            _name + std::string("_index_staging_buffer"));
+    device->CreateBufferAndBindMemory(bufferInfo, buffer, deviceMemory, {vk::MemoryPropertyFlagBits::eDeviceLocal},
+                                      name);
 
-        void *mappedMemory;
-        device->MapMemory(stagingDeviceMemory, &mappedMemory);
-        memcpy(mappedMemory, indices.data(), bufferSize);
+    device->CopyBuffer(stagingBuffer, buffer, size);
+    device->DestroyBuffer(&stagingBuffer);
+    device->FreeDeviceMemory(&stagingDeviceMemory);
+}
 
-        vk::BufferCreateInfo bufferInfo{};
-        bufferInfo.size = bufferSize;
-        bufferInfo.usage = {vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst};
+Mesh::Mesh(Device const *device, std::vector<Vertex> const &vertices, std::vector<uint32_t> const &indices,
+           std::vector<Primitive> const &primitives, std::string const &name)
+    : _name{name}, _primitives{primitives}, _indices{indices}
+{
+    check(device);
 
-        device->CreateBufferAndBindMemory(bufferInfo, &_indexBuffer, &_indexDeviceMemory,
-                                          {vk::MemoryPropertyFlagBits::eDeviceLocal},
-                                          name + std::string("_index_buffer"));
+    ZoneScopedN("build mesh");
 
-        device->CopyBuffer(stagingBuffer, &_indexBuffer, bufferSize);
-        device->DestroyBuffer(&stagingBuffer);
-        device->FreeDeviceMemory(&stagingDeviceMemory);
+    for (Vertex const &vertex : vertices)
+    {
+        _bounds.Extend(vertex.position);
     }
 
-    { // vertex buffer
-        uint32_t const bufferSize = sizeof(Vertex) * vertices.size();
-        vk::Buffer stagingBuffer;
-        vk::DeviceMemory stagingDeviceMemory;
-
-        vk::BufferCreateInfo stagingBufferInfo{};
-        stagingBufferInfo.size = bufferSize;
-        stagingBufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
-
-        device->CreateBufferAndBindMemory(
-            stagingBufferInfo, &stagingBuffer, &stagingDeviceMemory,
-            {vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent},
-            _name + std::string("_vertex_staging_buffer"));
-
-        void *mappedMemory;
-        device->MapMemory(stagingDeviceMemory, &mappedMemory);
-        memcpy(mappedMemory, vertices.data(), bufferSize);
+    for (Primitive &primitive : _primitives)
+    {
+        for (uint32_t i = 0; i < primitive.vertexCount; i++)
+        {
+            primitive.bounds.Extend(vertices[primitive.vertexOffset + i].position);
+        }
+    }
 
-        vk::BufferCreateInfo bufferInfo{};
-        bufferInfo.size = bufferSize;
-        bufferInfo.usage = {vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst};
+    CreateDeviceLocalBuffer(device, indices.data(), sizeof(uint32_t) * indices.size(),
+                            vk::BufferUsageFlagBits::eIndexBuffer, &_indexBuffer, &_indexDeviceMemory,
+                            _name + "_index_buffer");
 
-        device->CreateBufferAndBindMemory(bufferInfo, &_vertexBuffer, &_vertexDeviceMemory,
-                                          {vk::MemoryPropertyFlagBits::eDeviceLocal},
-                                          _name + std::string("_vertex_buffer"));
+    // split in two streams, so depth only passes fetch positions alone
+    std::vector<Attributes> attributes{};
+    _positions.reserve(vertices.size());
+    attributes.reserve(vertices.size());
+    for (Vertex const &vertex : vertices)
+    {
+        _positions.push_back(vertex.position);
+        attributes.push_back(Attributes{vertex.tangent, vertex.normal, vertex.color, vertex.uv});
+    }
 
-        device->CopyBuffer(stagingBuffer, &_vertexBuffer, bufferSize);
-        device->DestroyBuffer(&stagingBuffer);
-        device->FreeDeviceMemory(&stagingDeviceMemory);
+    _triangleBvhs.reserve(_primitives.size());
+    for (Primitive const &primitive : _primitives)
+    {
+        std::vector<Box> triangles(primitive.indexCount / 3);
+        for (uint32_t triangle = 0; triangle < triangles.size(); triangle++)
+        {
+            for (uint32_t corner = 0; corner < 3; corner++)
+            {
+                uint32_t const index = _indices[primitive.indexOffset + 3 * triangle + corner];
+                triangles[triangle].Extend(_positions[primitive.vertexOffset + index]);
+            }
+        }
+        _triangleBvhs.emplace_back(triangles);
     }
 
+    CreateDeviceLocalBuffer(device, _positions.data(), sizeof(glm::vec3) * _positions.size(),
+                            vk::BufferUsageFlagBits::eVertexBuffer, &_positionBuffer, &_positionDeviceMemory,
+                            _name + "_position_buffer");
+    CreateDeviceLocalBuffer(device, attributes.data(), sizeof(Attributes) * attributes.size(),
+                            vk::BufferUsageFlagBits::eVertexBuffer, &_attributeBuffer, &_attributeDeviceMemory,
+                            _name + "_attribute_buffer");
+
     spdlog::info("Mesh: <{}>, {} vertices, {} indices, {} primitives", _name, vertices.size(), indices.size(),
                  _primitives.size());
 }
@@ -245,8 +263,10 @@ Mesh::~Mesh()
     Device const *device = SafeDeviceAccessor::Get();
     check(device);
 
-    device->DestroyBuffer(&_vertexBuffer);
-    device->FreeDeviceMemory(&_vertexDeviceMemory);
+    device->DestroyBuffer(&_positionBuffer);
+    device->FreeDeviceMemory(&_positionDeviceMemory);
+    device->DestroyBuffer(&_attributeBuffer);
+    device->FreeDeviceMemory(&_attributeDeviceMemory);
 
     device->DestroyBuffer(&_indexBuffer);
     device->FreeDeviceMemory(&_indexDeviceMemory);
@@ -257,20 +277,23 @@ Mesh::~Mesh()
 vk::PipelineVertexInputStateCreateInfo Mesh::Vertex::GetVertexInputInfo()
 {
     static std::vector<vk::VertexInputBindingDescription> bindingDescriptions = []() {
-        std::vector<vk::VertexInputBindingDescription> desc(1);
+        std::vector<vk::VertexInputBindingDescription> desc(2);
         desc[0].binding = 0;
-        desc[0].stride = sizeof(Vertex);
+        desc[0].stride = sizeof(glm::vec3);
         desc[0].inputRate = vk::VertexInputRate::eVertex;
+        desc[1].binding = 1;
+        desc[1].stride = sizeof(Attributes);
+        desc[1].inputRate = vk::VertexInputRate::eVertex;
         return desc;
     }();
 
     static std::vector<vk::VertexInputAttributeDescription> attributeDescriptions = []() {
         std::vector<vk::VertexInputAttributeDescription> attrs;
-        attrs.emplace_back(0, 0, vk::Format::eR32G32B32A32Sfloat, offsetof(Vertex, tangent));
-        attrs.emplace_back(1, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, position));
-        attrs.emplace_back(2, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal));
-        attrs.emplace_back(3, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, color));
-        attrs.emplace_back(4, 0, vk::Format::eR32G32Sfloat, offsetof(Vertex, uv));
+        attrs.emplace_back(0, 1, vk::Format::eR32G32B32A32Sfloat, offsetof(Attributes, tangent));
+        attrs.emplace_back(1, 0, vk::Format::eR32G32B32Sfloat, 0);
+        attrs.emplace_back(2, 1, vk::Format::eR32G32B32Sfloat, offsetof(Attributes, normal));
+        attrs.emplace_back(3, 1, vk::Format::eR32G32B32Sfloat, offsetof(Attributes, color));
+        attrs.emplace_back(4, 1, vk::Format::eR32G32Sfloat, offsetof(Attributes, uv));
         return attrs;
     }();
 
@@ -286,6 +309,21 @@ vk::PipelineVertexInputStateCreateInfo Mesh::Vertex::GetVertexInputInfo()
     return vertexInputInfo;
 }
 
+vk::PipelineVertexInputStateCreateInfo Mesh::Vertex::GetPositionInputInfo()
+{
+    static vk::VertexInputBindingDescription const bindingDescription{0, sizeof(glm::vec3),
+                                                                      vk::VertexInputRate::eVertex};
+    static vk::VertexInputAttributeDescription const attributeDescription{1, 0, vk::Format::eR32G32B32Sfloat, 0};
+
+    vk::PipelineVertexInputStateCreateInfo info{};
+    info.vertexAttributeDescriptionCount = 1u;
+    info.vertexBindingDescriptionCount = 1u;
+    info.pVertexAttributeDescriptions = &attributeDescription;
+    info.pVertexBindingDescriptions = &bindingDescription;
+
+    return info;
+}
+
 struct IndexKey
 {
     int v, n, t, m;
@@ -315,10 +353,11 @@ bool Mesh::Vertex::operator==(Vertex const &other) const
 
 void Mesh::Bind(vk::CommandBuffer commandBuffer) const
 {
-    vk::Buffer buffers[] = {_vertexBuffer};
-    vk::DeviceSize offsets[] = {0};
+    // position only pipelines don't consume binding 1, binding it anyway costs no fetches
+    vk::Buffer buffers[] = {_positionBuffer, _attributeBuffer};
+    vk::DeviceSize offsets[] = {0, 0};
 
-    commandBuffer.bindVertexBuffers(0, 1, buffers, offsets);
+    commandBuffer.bindVertexBuffers(0, 2, buffers, offsets);
 }
 
 void Mesh::Draw(vk::CommandBuffer commandBuffer, vk::PipelineLayout pipelineLayout, Transform const &transform) const
@@ -331,6 +370,34 @@ void Mesh::Draw(vk::CommandBuffer commandBuffer, vk::PipelineLayout pipelineLayo
     }
 }
 
+void Mesh::DrawPrimitive(vk::CommandBuffer commandBuffer, vk::PipelineLayout pipelineLayout, Transform const &transform,
+                         uint32_t primitive) const
+{
+    check(primitive < _primitives.size());
+
+    PushConstant(_primitives[primitive], transform, commandBuffer, pipelineLayout);
+    commandBuffer.bindIndexBuffer(_indexBuffer, 0, vk::IndexType::eUint32);
+    commandBuffer.drawIndexed(_primitives[primitive].indexCount, 1, _primitives[primitive].indexOffset,
+                              _primitives[primitive].vertexOffset, 0);
+}
+
+void Mesh::DrawInstance(vk::CommandBuffer commandBuffer, uint32_t primitive, uint32_t instance) const
+{
+    check(primitive < _primitives.size());
+
+    commandBuffer.bindIndexBuffer(_indexBuffer, 0, vk::IndexType::eUint32);
+    commandBuffer.drawIndexed(_primitives[primitive].indexCount, 1, _primitives[primitive].indexOffset,
+                              _primitives[primitive].vertexOffset, instance);
+}
+
+void Mesh::DrawIndirect(vk::CommandBuffer commandBuffer, vk::Buffer commands, vk::DeviceSize offset,
+                        vk::Buffer counts, vk::DeviceSize countOffset, uint32_t maxDrawCount) const
+{
+    commandBuffer.bindIndexBuffer(_indexBuffer, 0, vk::IndexType::eUint32);
+    commandBuffer.drawIndexedIndirectCount(commands, offset, counts, countOffset, maxDrawCount,
+                                           sizeof(vk::DrawIndexedIndirectCommand));
+}
+
 void Mesh::PushConstant(Primitive const &primitive, Transform const &transform, vk::CommandBuffer commandBuffer,
                         vk::PipelineLayout pipelineLayout) const
 {
@@ -343,3 +410,75 @@ void Mesh::PushConstant(Primitive const &primitive, Transform const &transform,
 
     commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eAllGraphics, 0, sizeof(PushData), &pushData);
 }
+
+Box const &Mesh::GetBounds() const
+{
+    return _bounds;
+}
+
+std::vector<Mesh::Primitive> const &Mesh::GetPrimitives() const
+{
+    return _primitives;
+}
+
+std::vector<glm::vec3> const &Mesh::GetPositions() const
+{
+    return _positions;
+}
+
+std::vector<uint32_t> const &Mesh::GetIndices() const
+{
+    return _indices;
+}
+
+bool Mesh::Raycast(uint32_t primitive, Ray const &ray, float *distance) const
+{
+    check(primitive < _primitives.size());
+    check(distance);
+
+    Primitive const &hitPrimitive = _primitives[primitive];
+
+    // moller trumbore, both faces count since materials may be double sided
+    Bvh::RayTest const intersects = [&](uint32_t triangle, Ray const &modelRay, float *nearest) {
+        uint32_t const first = hitPrimitive.indexOffset + 3 * triangle;
+        glm::vec3 const &a = _positions[hitPrimitive.vertexOffset + _indices[first]];
+        glm::vec3 const &b = _positions[hitPrimitive.vertexOffset + _indices[first + 1]];
+        glm::vec3 const &c = _positions[hitPrimitive.vertexOffset + _indices[first + 2]];
+
+        glm::vec3 const ab = b - a;
+        glm::vec3 const ac = c - a;
+        glm::vec3 const p = glm::cross(modelRay.direction, ac);
+        float const determinant = glm::dot(ab, p);
+        if (determinant == 0.f)
+        {
+            return false;
+        }
+
+        float const inverseDeterminant = 1.f / determinant;
+        glm::vec3 const toOrigin = modelRay.origin - a;
+        float const u = glm::dot(toOrigin, p) * inverseDeterminant;
+        if (u < 0.f || u > 1.f)
+        {
+            return false;
+        }
+
+        glm::vec3 const q = glm::cross(toOrigin, ab);
+        float const v = glm::dot(modelRay.direction, q) * inverseDeterminant;
+        if (v < 0.f || u + v > 1.f)
+        {
+            return false;
+        }
+
+        float const t = glm::dot(ac, q) * inverseDeterminant;
+        if (t < 0.f || t >= *nearest)
+        {
+            return false;
+        }
+
+        *nearest = t;
+        return true;
+    };
+
+    uint32_t triangle;
+    return _triangleBvhs[primitive].Raycast(ray, intersects, distance, &triangle);
+}
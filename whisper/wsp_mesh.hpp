@@ -6,6 +6,8 @@
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 
+#include <wsp_bounds.hpp>
+#include <wsp_bvh.hpp>
 #include <wsp_drawable.hpp>
 #include <wsp_typedefs.hpp>
 #include <wsp_types/slot_map.hpp>
@@ -31,11 +33,21 @@ class Mesh : public Drawable
         glm::vec3 color;
         glm::vec2 uv;
 
-        static vk::PipelineVertexInputStateCreateInfo GetVertexInputInfo();
+        static vk::PipelineVertexInputStateCreateInfo GetVertexInputInfo();   // both streams
+        static vk::PipelineVertexInputStateCreateInfo GetPositionInputInfo(); // positions alone, at location 1
 
         bool operator==(Vertex const &other) const;
     };
 
+    // what Vertex holds besides its position, uploaded as a second stream
+    struct Attributes
+    {
+        glm::vec4 tangent;
+        glm::vec3 normal;
+        glm::vec3 color;
+        glm::vec2 uv;
+    };
+
     struct PushData
     {
         glm::mat4 modelMatrix;
@@ -50,6 +62,7 @@ class Mesh : public Drawable
         uint32_t indexOffset;
         uint32_t vertexCount;
         uint32_t vertexOffset;
+        Box bounds{}; // in model space
     };
 
     static Mesh *BuildGlTF(class Device const *, cgltf_mesh const *, cgltf_material const *pMaterial,
@@ -64,16 +77,38 @@ class Mesh : public Drawable
 
     virtual void Bind(vk::CommandBuffer) const override;
     virtual void Draw(vk::CommandBuffer, vk::PipelineLayout, class Transform const &) const override;
+    void DrawPrimitive(vk::CommandBuffer, vk::PipelineLayout, class Transform const &, uint32_t primitive) const;
+    // for shaders reading their matrices and material from an instance buffer instead of push constants
+    void DrawInstance(vk::CommandBuffer, uint32_t primitive, uint32_t instance) const;
+    // up to maxDrawCount vk::DrawIndexedIndirectCommand of this mesh, as many as the count buffer holds
+    void DrawIndirect(vk::CommandBuffer, vk::Buffer commands, vk::DeviceSize offset, vk::Buffer counts,
+                      vk::DeviceSize countOffset, uint32_t maxDrawCount) const;
 
     void PushConstant(Primitive const &, class Transform const &, vk::CommandBuffer, vk::PipelineLayout) const;
 
+    Box const &GetBounds() const; // in model space
+    std::vector<Primitive> const &GetPrimitives() const;
+    // kept on the cpu for occlusion culling, indices are relative to their primitive's vertexOffset
+    std::vector<glm::vec3> const &GetPositions() const;
+    std::vector<uint32_t> const &GetIndices() const;
+
+    // the nearest triangle of the primitive hit within *distance, for a ray in model space
+    bool Raycast(uint32_t primitive, Ray const &, float *distance) const;
+
   private:
     std::string _name;
 
     std::vector<Primitive> _primitives;
+    Box _bounds;
+
+    std::vector<glm::vec3> _positions;
+    std::vector<uint32_t> _indices;
+    std::vector<Bvh> _triangleBvhs; // one per primitive, over the triangles of its indices
 
-    vk::Buffer _vertexBuffer;
-    vk::DeviceMemory _vertexDeviceMemory;
+    vk::Buffer _positionBuffer;
+    vk::DeviceMemory _positionDeviceMemory;
+    vk::Buffer _attributeBuffer;
+    vk::DeviceMemory _attributeDeviceMemory;
 
     vk::Buffer _indexBuffer;
     vk::DeviceMemory _indexDeviceMemory;
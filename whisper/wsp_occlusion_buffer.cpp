@@ -0,0 +1,479 @@
+#include <wsp_occlusion_buffer.hpp>
+
+#include <wsp_constants.hpp>
+#include <wsp_devkit.hpp>
+#include <wsp_thread_pool.hpp>
+
+#include <glm/common.hpp>
+#include <glm/vec4.hpp>
+
+#include <tracy/Tracy.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+
+// WSP_OCCLUSION_SCALAR forces the scalar path, to compare both
+#if (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)) && !defined(WSP_OCCLUSION_SCALAR)
+#define WSP_OCCLUSION_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace wsp;
+
+static constexpr uint32_t TILE_WIDTH{32}; // a bit of a uint32_t per pixel of a row
+static constexpr uint32_t TILE_HEIGHT{4}; // a row per lane of a 128 bit register
+static constexpr uint32_t TILE_COLUMNS{OCCLUSION_WIDTH / TILE_WIDTH};
+static constexpr uint32_t TILE_ROWS{OCCLUSION_HEIGHT / TILE_HEIGHT};
+
+static_assert(OCCLUSION_WIDTH % TILE_WIDTH == 0 && OCCLUSION_HEIGHT % TILE_HEIGHT == 0,
+              "OcclusionBuffer: resolution must be a multiple of the tile size");
+
+OcclusionBuffer::OcclusionBuffer(uint32_t threadCount)
+    : _threadPool{nullptr}, _viewProjection{1.f}, _isRasterized{false}, _triangleCount{0}
+{
+    check(threadCount > 0);
+
+    if (threadCount > 1)
+    {
+        _threadPool = new ThreadPool{threadCount};
+    }
+
+    // padded, so the last tiles can be loaded four at a time
+    _referenceDepths.resize(TILE_COLUMNS * TILE_ROWS + 3);
+    _workingDepths.resize(TILE_COLUMNS * TILE_ROWS);
+    _masks.resize(TILE_COLUMNS * TILE_ROWS * TILE_HEIGHT);
+
+    Clear();
+}
+
+OcclusionBuffer::~OcclusionBuffer()
+{
+    delete _threadPool;
+}
+
+void OcclusionBuffer::Clear()
+{
+    std::fill(_referenceDepths.begin(), _referenceDepths.end(), 1.f); // the far plane hides nothing
+    std::fill(_workingDepths.begin(), _workingDepths.end(), 0.f);
+    std::fill(_masks.begin(), _masks.end(), 0u);
+
+    _isRasterized = false;
+    _triangleCount = 0;
+}
+
+void OcclusionBuffer::Run(uint32_t jobCount, std::function<void(uint32_t job)> const &job) const
+{
+    if (!_threadPool)
+    {
+        for (uint32_t i = 0; i < jobCount; i++)
+        {
+            job(i);
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        _threadPool->Push([&job, i](uint32_t) { job(i); });
+    }
+    _threadPool->Wait();
+}
+
+void OcclusionBuffer::Rasterize(std::vector<Occluder> const &occluders, glm::mat4 const &viewProjection)
+{
+    ZoneScopedN("rasterize occluders");
+
+    Clear();
+    _viewProjection = viewProjection;
+
+    uint32_t const jobCount = _threadPool ? _threadPool->GetThreadCount() : 1u;
+
+    // each job sets up a share of the occluders into its own list
+    std::vector<std::vector<Triangle>> triangles(jobCount);
+    Run(jobCount, [&](uint32_t job) {
+        size_t const begin = occluders.size() * job / jobCount;
+        size_t const end = occluders.size() * (job + 1) / jobCount;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            Setup(occluders[i], &triangles[job]);
+        }
+    });
+
+    for (std::vector<Triangle> const &jobTriangles : triangles)
+    {
+        _triangleCount += static_cast<uint32_t>(jobTriangles.size());
+    }
+
+    // then owns a band of tile rows, which no other job writes to
+    Run(jobCount, [&](uint32_t job) {
+        uint32_t const firstTileRow = TILE_ROWS * job / jobCount;
+        uint32_t const endTileRow = TILE_ROWS * (job + 1) / jobCount;
+
+        for (std::vector<Triangle> const &jobTriangles : triangles)
+        {
+            for (Triangle const &triangle : jobTriangles)
+            {
+                RasterizeTriangle(triangle, firstTileRow, endTileRow);
+            }
+        }
+    });
+
+    _isRasterized = true;
+}
+
+static glm::vec3 ToScreen(glm::vec4 const &clip)
+{
+    glm::vec3 const ndc = glm::vec3{clip} / clip.w;
+    return glm::vec3{(ndc.x * .5f + .5f) * OCCLUSION_WIDTH, (ndc.y * .5f + .5f) * OCCLUSION_HEIGHT, ndc.z};
+}
+
+void OcclusionBuffer::Setup(Occluder const &occluder, std::vector<Triangle> *triangles) const
+{
+    check(triangles);
+
+    glm::mat4 const modelViewProjection = _viewProjection * occluder.modelMatrix;
+
+    for (uint32_t i = 0; i + 2 < occluder.indexCount; i += 3)
+    {
+        std::array<glm::vec4, 3> clip;
+        for (uint32_t v = 0; v < 3; v++)
+        {
+            clip[v] = modelViewProjection * glm::vec4{occluder.positions[occluder.indices[i + v]], 1.f};
+        }
+
+        // clipped against the near plane only, screen bounds clamp the rest while rasterizing
+        std::array<glm::vec3, 4> polygon;
+        uint32_t count = 0;
+        for (uint32_t v = 0; v < 3; v++)
+        {
+            glm::vec4 const &a = clip[v];
+            glm::vec4 const &b = clip[(v + 1) % 3];
+
+            if (a.z >= 0.f)
+            {
+                polygon[count++] = ToScreen(a);
+            }
+            if ((a.z >= 0.f) != (b.z >= 0.f))
+            {
+                polygon[count++] = ToScreen(glm::mix(a, b, a.z / (a.z - b.z)));
+            }
+        }
+
+        for (uint32_t v = 1; v + 1 < count; v++)
+        {
+            glm::vec3 const &a = polygon[0];
+            glm::vec3 const &b = polygon[v];
+            glm::vec3 const &c = polygon[v + 1];
+
+            // front faces are clockwise, as the pipelines cull them
+            if ((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y) <= 0.f)
+            {
+                continue;
+            }
+
+            triangles->push_back(Triangle{{a, b, c}});
+        }
+    }
+}
+
+// bits first to end - 1 of a row, both relative to the tile
+static uint32_t SpanMask(int first, int end)
+{
+    first = std::clamp(first, 0, static_cast<int>(TILE_WIDTH));
+    end = std::clamp(end, 0, static_cast<int>(TILE_WIDTH));
+
+    if (first >= end)
+    {
+        return 0u;
+    }
+
+    uint32_t const endMask = end == static_cast<int>(TILE_WIDTH) ? ~0u : (1u << end) - 1u;
+    return endMask & ~((1u << first) - 1u);
+}
+
+void OcclusionBuffer::RasterizeTriangle(Triangle const &triangle, uint32_t firstTileRow, uint32_t endTileRow)
+{
+    glm::vec3 const &v0 = triangle.vertices[0];
+    glm::vec3 const &v1 = triangle.vertices[1];
+    glm::vec3 const &v2 = triangle.vertices[2];
+
+    float const width = static_cast<float>(OCCLUSION_WIDTH);
+    float const height = static_cast<float>(OCCLUSION_HEIGHT);
+
+    // clamped as floats first, clipping only happened against the near plane
+    int const minX = static_cast<int>(std::floor(std::clamp(std::min({v0.x, v1.x, v2.x}), 0.f, width)));
+    int const endX = static_cast<int>(std::ceil(std::clamp(std::max({v0.x, v1.x, v2.x}), 0.f, width)));
+    int const minY = static_cast<int>(std::floor(std::clamp(std::min({v0.y, v1.y, v2.y}), 0.f, height)));
+    int const endY = static_cast<int>(std::ceil(std::clamp(std::max({v0.y, v1.y, v2.y}), 0.f, height)));
+
+    uint32_t const firstRow = std::max(static_cast<uint32_t>(minY) / TILE_HEIGHT, firstTileRow);
+    uint32_t const endRow = std::min((static_cast<uint32_t>(endY) + TILE_HEIGHT - 1) / TILE_HEIGHT, endTileRow);
+    if (minX >= endX || firstRow >= endRow)
+    {
+        return;
+    }
+
+    // a x + b y + c, positive inside of each edge
+    std::array<glm::vec3, 3> edges;
+    for (uint32_t e = 0; e < 3; e++)
+    {
+        glm::vec3 const &a = triangle.vertices[e];
+        glm::vec3 const &b = triangle.vertices[(e + 1) % 3];
+        edges[e] = glm::vec3{a.y - b.y, b.x - a.x, 0.f};
+
+        // from the same end whichever way it runs, a shared edge is exactly negated and leaves no pixel out
+        glm::vec3 const &origin = a.x < b.x || (a.x == b.x && a.y < b.y) ? a : b;
+        edges[e].z = -(edges[e].x * origin.x + edges[e].y * origin.y);
+    }
+
+    // depth is linear in screen space, its farthest over a tile is at one of its corners
+    float const area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    float const depthX = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    float const depthY = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+    float const maxDepth = std::max({v0.z, v1.z, v2.z});
+
+    uint32_t const firstColumn = static_cast<uint32_t>(minX) / TILE_WIDTH;
+    uint32_t const endColumn = (static_cast<uint32_t>(endX) + TILE_WIDTH - 1) / TILE_WIDTH;
+
+    for (uint32_t row = firstRow; row < endRow; row++)
+    {
+        float const y = static_cast<float>(row * TILE_HEIGHT);
+
+        // per row of the tile, the pixels whose centers lie inside every edge, first to end - 1
+        alignas(16) std::array<int32_t, TILE_HEIGHT> spanFirsts;
+        alignas(16) std::array<int32_t, TILE_HEIGHT> spanEnds;
+
+#ifdef WSP_OCCLUSION_SSE
+        __m128 const centersY = _mm_add_ps(_mm_set1_ps(y), _mm_set_ps(3.5f, 2.5f, 1.5f, .5f));
+        __m128 lower = _mm_set1_ps(-1.f);
+        __m128 upper = _mm_set1_ps(width + 1.f);
+
+        for (glm::vec3 const &edge : edges)
+        {
+            // the edge crosses each row at x = -(b y + c) / a
+            __m128 const offsets = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edge.y), centersY), _mm_set1_ps(edge.z));
+            if (edge.x > 0.f)
+            {
+                lower = _mm_max_ps(lower, _mm_div_ps(offsets, _mm_set1_ps(-edge.x)));
+            }
+            else if (edge.x < 0.f)
+            {
+                upper = _mm_min_ps(upper, _mm_div_ps(offsets, _mm_set1_ps(-edge.x)));
+            }
+            else // horizontal, rows are all in or all out
+            {
+                __m128 const isOutside = _mm_cmplt_ps(offsets, _mm_setzero_ps());
+                lower = _mm_or_ps(_mm_andnot_ps(isOutside, lower), _mm_and_ps(isOutside, _mm_set1_ps(width + 1.f)));
+            }
+        }
+
+        lower = _mm_sub_ps(_mm_min_ps(lower, _mm_set1_ps(width + 1.f)), _mm_set1_ps(.5f));
+        upper = _mm_sub_ps(_mm_max_ps(upper, _mm_set1_ps(-1.f)), _mm_set1_ps(.5f));
+
+        // ceil and floor out of truncation, a true comparison is -1
+        __m128i const truncatedLower = _mm_cvttps_epi32(lower);
+        __m128i const truncatedUpper = _mm_cvttps_epi32(upper);
+        __m128i const firsts = _mm_sub_epi32(
+            truncatedLower, _mm_castps_si128(_mm_cmplt_ps(_mm_cvtepi32_ps(truncatedLower), lower)));
+        __m128i const lasts = _mm_add_epi32(
+            truncatedUpper, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(truncatedUpper), upper)));
+
+        _mm_store_si128(reinterpret_cast<__m128i *>(spanFirsts.data()), firsts);
+        _mm_store_si128(reinterpret_cast<__m128i *>(spanEnds.data()), _mm_add_epi32(lasts, _mm_set1_epi32(1)));
+#else
+        for (uint32_t r = 0; r < TILE_HEIGHT; r++)
+        {
+            float const centerY = y + static_cast<float>(r) + .5f;
+            float lower = -1.f;
+            float upper = width + 1.f;
+
+            for (glm::vec3 const &edge : edges)
+            {
+                float const offset = edge.y * centerY + edge.z;
+                if (edge.x > 0.f)
+                {
+                    lower = std::max(lower, offset / -edge.x);
+                }
+                else if (edge.x < 0.f)
+                {
+                    upper = std::min(upper, offset / -edge.x);
+                }
+                else if (offset < 0.f)
+                {
+                    lower = width + 1.f;
+                }
+            }
+
+            spanFirsts[r] = static_cast<int32_t>(std::ceil(std::min(lower, width + 1.f) - .5f));
+            spanEnds[r] = static_cast<int32_t>(std::floor(std::max(upper, -1.f) - .5f)) + 1;
+        }
+#endif
+
+        for (uint32_t column = firstColumn; column < endColumn; column++)
+        {
+            int const x = static_cast<int>(column * TILE_WIDTH);
+
+            uint32_t coverage[TILE_HEIGHT];
+            uint32_t isCovered = 0u;
+            for (uint32_t r = 0; r < TILE_HEIGHT; r++)
+            {
+                coverage[r] = SpanMask(spanFirsts[r] - x, spanEnds[r] - x);
+                isCovered |= coverage[r];
+            }
+
+            if (!isCovered)
+            {
+                continue;
+            }
+
+            float const cornerX = static_cast<float>(depthX > 0.f ? x + static_cast<int>(TILE_WIDTH) : x);
+            float const cornerY = depthY > 0.f ? y + static_cast<float>(TILE_HEIGHT) : y;
+            float const depth =
+                std::min(maxDepth, v0.z + depthX * (cornerX - v0.x) + depthY * (cornerY - v0.y));
+
+            UpdateTile(row * TILE_COLUMNS + column, coverage, depth);
+        }
+    }
+}
+
+void OcclusionBuffer::UpdateTile(uint32_t tile, uint32_t const coverage[4], float depth)
+{
+    float &referenceDepth = _referenceDepths[tile];
+    float &workingDepth = _workingDepths[tile];
+    uint32_t *mask = &_masks[tile * TILE_HEIGHT];
+
+    if (depth >= referenceDepth)
+    {
+        return; // behind what already covers the whole tile
+    }
+
+#ifdef WSP_OCCLUSION_SSE
+    __m128i const full = _mm_set1_epi32(-1);
+    __m128i const covered = _mm_loadu_si128(reinterpret_cast<__m128i const *>(coverage));
+    bool const isTriangleCovering = _mm_movemask_epi8(_mm_cmpeq_epi32(covered, full)) == 0xFFFF;
+#else
+    bool const isTriangleCovering = (coverage[0] & coverage[1] & coverage[2] & coverage[3]) == ~0u;
+#endif
+
+    if (isTriangleCovering)
+    {
+        referenceDepth = depth;
+        if (workingDepth >= referenceDepth) // the working layer is hidden now
+        {
+            workingDepth = 0.f;
+            std::fill(mask, mask + TILE_HEIGHT, 0u);
+        }
+        return;
+    }
+
+    workingDepth = std::max(workingDepth, depth);
+
+#ifdef WSP_OCCLUSION_SSE
+    __m128i const merged = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(mask)), covered);
+    bool const isWorkingCovering = _mm_movemask_epi8(_mm_cmpeq_epi32(merged, full)) == 0xFFFF;
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(mask), merged);
+#else
+    uint32_t merged = ~0u;
+    for (uint32_t r = 0; r < TILE_HEIGHT; r++)
+    {
+        mask[r] |= coverage[r];
+        merged &= mask[r];
+    }
+    bool const isWorkingCovering = merged == ~0u;
+#endif
+
+    // once the working layer covers the tile, it becomes the reference
+    if (isWorkingCovering)
+    {
+        referenceDepth = workingDepth;
+        workingDepth = 0.f;
+        std::fill(mask, mask + TILE_HEIGHT, 0u);
+    }
+}
+
+bool OcclusionBuffer::IsVisible(Box const &box) const
+{
+    if (!_isRasterized)
+    {
+        return true;
+    }
+
+    if (box.IsEmpty())
+    {
+        return false;
+    }
+
+    glm::vec2 minScreen{FLT_MAX};
+    glm::vec2 maxScreen{-FLT_MAX};
+    float nearestDepth = FLT_MAX;
+
+    for (uint32_t corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 const point{corner & 1u ? box.max.x : box.min.x, corner & 2u ? box.max.y : box.min.y,
+                              corner & 4u ? box.max.z : box.min.z};
+        glm::vec4 const clip = _viewProjection * glm::vec4{point, 1.f};
+
+        if (clip.z < 0.f)
+        {
+            return true; // crosses the near plane, nothing in front of it to compare against
+        }
+
+        glm::vec3 const screen = ToScreen(clip);
+        minScreen = glm::min(minScreen, glm::vec2{screen});
+        maxScreen = glm::max(maxScreen, glm::vec2{screen});
+        nearestDepth = std::min(nearestDepth, screen.z);
+    }
+
+    // a pixel of margin, sampling pixel centers lets occluders reach a little past their edges
+    float const width = static_cast<float>(OCCLUSION_WIDTH);
+    float const height = static_cast<float>(OCCLUSION_HEIGHT);
+    int const minX = static_cast<int>(std::floor(std::clamp(minScreen.x - 1.f, 0.f, width)));
+    int const endX = static_cast<int>(std::ceil(std::clamp(maxScreen.x + 1.f, 0.f, width)));
+    int const minY = static_cast<int>(std::floor(std::clamp(minScreen.y - 1.f, 0.f, height)));
+    int const endY = static_cast<int>(std::ceil(std::clamp(maxScreen.y + 1.f, 0.f, height)));
+
+    if (minX >= endX || minY >= endY)
+    {
+        return false; // off screen
+    }
+
+    uint32_t const firstColumn = static_cast<uint32_t>(minX) / TILE_WIDTH;
+    uint32_t const lastColumn = static_cast<uint32_t>(endX - 1) / TILE_WIDTH;
+
+    for (uint32_t row = static_cast<uint32_t>(minY) / TILE_HEIGHT; row <= static_cast<uint32_t>(endY - 1) / TILE_HEIGHT;
+         row++)
+    {
+        uint32_t const first = row * TILE_COLUMNS + firstColumn;
+        uint32_t const last = row * TILE_COLUMNS + lastColumn;
+
+#ifdef WSP_OCCLUSION_SSE
+        __m128 const nearest = _mm_set1_ps(nearestDepth);
+        for (uint32_t tile = first; tile <= last; tile += 4)
+        {
+            int const lanes = (1 << std::min(last - tile + 1, 4u)) - 1;
+            if (_mm_movemask_ps(_mm_cmplt_ps(nearest, _mm_loadu_ps(&_referenceDepths[tile]))) & lanes)
+            {
+                return true;
+            }
+        }
+#else
+        for (uint32_t tile = first; tile <= last; tile++)
+        {
+            if (nearestDepth < _referenceDepths[tile])
+            {
+                return true;
+            }
+        }
+#endif
+    }
+
+    return false;
+}
+
+uint32_t OcclusionBuffer::GetTriangleCount() const
+{
+    return _triangleCount;
+}
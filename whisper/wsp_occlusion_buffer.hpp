@@ -0,0 +1,67 @@
+#ifndef WSP_OCCLUSION_BUFFER
+#define WSP_OCCLUSION_BUFFER
+
+#include <wsp_bounds.hpp>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace wsp
+{
+
+// a coarse depth buffer the cpu rasterizes a few large occluders into, to skip the draws they hide
+// masked occlusion style, tiles keep the coverage of what was drawn to them and the farthest depth of what covers them
+class OcclusionBuffer
+{
+  public:
+    struct Occluder
+    {
+        glm::vec3 const *positions;
+        uint32_t const *indices; // triangles, into positions
+        uint32_t indexCount;
+        glm::mat4 modelMatrix;
+    };
+
+    OcclusionBuffer(uint32_t threadCount = 1u);
+    ~OcclusionBuffer();
+
+    OcclusionBuffer(OcclusionBuffer const &) = delete;
+    OcclusionBuffer &operator=(OcclusionBuffer const &) = delete;
+
+    void Clear(); // everything is visible until the next Rasterize
+    void Rasterize(std::vector<Occluder> const &, glm::mat4 const &viewProjection); // expects [0, 1] depth
+    bool IsVisible(Box const &) const; // in world space, seen from the last Rasterize's view
+
+    uint32_t GetTriangleCount() const; // rasterized by the last Rasterize, once clipped and back faces culled
+
+  protected:
+    struct Triangle
+    {
+        glm::vec3 vertices[3]; // in pixels, with their depth, clockwise on screen
+    };
+
+    void Run(uint32_t jobCount, std::function<void(uint32_t job)> const &) const;
+
+    void Setup(Occluder const &, std::vector<Triangle> *) const;
+    void RasterizeTriangle(Triangle const &, uint32_t firstTileRow, uint32_t endTileRow);
+    void UpdateTile(uint32_t tile, uint32_t const coverage[4], float depth);
+
+    class ThreadPool *_threadPool; // null when single threaded
+
+    glm::mat4 _viewProjection;
+    bool _isRasterized;
+    uint32_t _triangleCount;
+
+    // per tile, laid out apart so tests compare a few tiles at once
+    std::vector<float> _referenceDepths; // farthest depth of the last layer to cover the tile whole
+    std::vector<float> _workingDepths;   // farthest depth of the layer covering it so far
+    std::vector<uint32_t> _masks;        // that layer's coverage, a row of 32 pixels each
+};
+
+} // namespace wsp
+
+#endif
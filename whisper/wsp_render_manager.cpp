@@ -172,13 +172,25 @@ void RenderManager::CreateInstance()
 #ifndef NDEBUG
     vk::DebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
 
+    // the graph's barriers are checked for hazards too, not only for layouts
+    vk::ValidationFeatureEnableEXT const enabledValidationFeatures[] = {
+        vk::ValidationFeatureEnableEXT::eSynchronizationValidation};
+    vk::ValidationFeaturesEXT validationFeatures{};
+    validationFeatures.enabledValidationFeatureCount = 1u;
+    validationFeatures.pEnabledValidationFeatures = enabledValidationFeatures;
+
     // Only enable validation layers if they're available
     if (CheckValidationLayerSupport())
     {
-        spdlog::info("RenderManager: Validation layers enabled");
+        spdlog::info("RenderManager: Validation layers enabled, with synchronization validation");
         createInfo.enabledLayerCount = static_cast<uint32_t>(_validationLayers.size());
         createInfo.ppEnabledLayerNames = _validationLayers.data();
 
+        // provided by the validation layer itself
+        extensions.push_back(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME);
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
         debugCreateInfo.messageSeverity = vk::DebugUtilsMessageSeverityFlagBitsEXT::eInfo |
                                           vk::DebugUtilsMessageSeverityFlagBitsEXT::eWarning |
                                           vk::DebugUtilsMessageSeverityFlagBitsEXT::eError;
@@ -186,7 +198,8 @@ void RenderManager::CreateInstance()
                                       vk::DebugUtilsMessageTypeFlagBitsEXT::eValidation |
                                       vk::DebugUtilsMessageTypeFlagBitsEXT::ePerformance;
         debugCreateInfo.pfnUserCallback = DebugCallback;
-        createInfo.pNext = &debugCreateInfo;
+        validationFeatures.pNext = &debugCreateInfo; // the messenger's own create info takes no chain
+        createInfo.pNext = &validationFeatures;
     }
     else
     {
@@ -312,11 +325,13 @@ vk::CommandBuffer RenderManager::BeginRender(WindowID windowID, bool blit)
 
     if (blit)
     {
-        Image *image = windowRenderer.renderer->GetGraph()->GetTargetImage();
+        Graph const *graph = windowRenderer.renderer->GetGraph();
+        Image *image = graph->GetTargetImage();
 
         check(image);
 
-        windowRenderer.window->SwapchainOpen(commandBuffer, image->GetImage());
+        // the blit upscales what the graph drew under its render scale
+        windowRenderer.window->SwapchainOpen(commandBuffer, image->GetImage(), graph->GetTargetExtent());
     }
     else
     {
@@ -88,7 +88,7 @@ Sampler::Sampler(Device const *device, Sampler::CreateInfo const &createInfo)
     samplerCreateInfo.compareEnable = createInfo.depth;
     samplerCreateInfo.mipmapMode = createInfo.mipmapMode;
     samplerCreateInfo.minLod = 0.f;
-    samplerCreateInfo.maxLod = 7.f;
+    samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE; // views already bound the mips that can be sampled
 
     _sampler = device->CreateSampler(samplerCreateInfo, "sampler");
 }
@@ -1,24 +1,44 @@
 #include <wsp_scene.hpp>
 
 #include <wsp_assets_manager.hpp>
+#include <wsp_bounds.hpp>
 #include <wsp_constants.hpp>
+#include <wsp_material.hpp>
 #include <wsp_mesh.hpp>
+#include <wsp_occlusion_buffer.hpp>
 
 #include <cgltf.h>
 
+#include <glm/common.hpp>
+#include <glm/exponential.hpp>
+#include <glm/geometric.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/matrix.hpp>
+#include <glm/trigonometric.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <tracy/Tracy.hpp>
+
+#include <algorithm>
+#include <map>
+
 using namespace wsp;
 
+static_assert(sizeof(Scene::Instance) == 192, "Scene: Instance must match its std430 layout in instances.glsl");
+
 Scene *Scene::BuildGlTF(cgltf_scene const *scene, cgltf_mesh const *pMesh, std::vector<MeshID> const &meshes)
 {
     check(scene);
     check(pMesh);
 
     std::vector<std::pair<Transform, MeshID>> drawList;
+    std::vector<ubo::PunctualLight> lights;
 
     for (int i = 0; i < scene->nodes_count; i++)
     {
         std::function<void(cgltf_node * node, Transform const &parent)> const explore =
-            [&drawList, &meshes, &pMesh, &explore](cgltf_node *node, Transform const &parent) {
+            [&drawList, &lights, &meshes, &pMesh, &explore](cgltf_node *node, Transform const &parent) {
                 Transform transform{};
                 MeshID mesh{INVALID_ID};
 
@@ -49,6 +69,32 @@ Scene *Scene::BuildGlTF(cgltf_scene const *scene, cgltf_mesh const *pMesh, std::
                     drawList.emplace_back(transform, mesh);
                 }
 
+                // directional lights are left to the environment's sun
+                if (node->light && node->light->type != cgltf_light_type_directional)
+                {
+                    cgltf_light const *light = node->light;
+                    glm::mat4 const matrix = transform.GetMatrix();
+
+                    ubo::PunctualLight punctualLight{};
+                    punctualLight.position = glm::vec3{matrix[3]};
+                    punctualLight.color = *(glm::vec3 *)&(light->color) * light->intensity;
+                    punctualLight.direction = glm::normalize(glm::vec3{matrix * glm::vec4{0.f, 0.f, -1.f, 0.f}});
+                    // without a range, the light is cut off once it falls under a hundredth of its intensity
+                    punctualLight.range = light->range > 0.f ? light->range : 10.f * glm::sqrt(light->intensity);
+                    punctualLight.spotScale = 0.f;
+                    punctualLight.spotOffset = 1.f;
+
+                    if (light->type == cgltf_light_type_spot)
+                    {
+                        float const innerCos = glm::cos(light->spot_inner_cone_angle);
+                        float const outerCos = glm::cos(light->spot_outer_cone_angle);
+                        punctualLight.spotScale = 1.f / glm::max(innerCos - outerCos, .001f);
+                        punctualLight.spotOffset = -outerCos * punctualLight.spotScale;
+                    }
+
+                    lights.push_back(punctualLight);
+                }
+
                 for (int i = 0; i < node->children_count; i++)
                 {
                     explore(node->children[i], transform);
@@ -58,31 +104,512 @@ Scene *Scene::BuildGlTF(cgltf_scene const *scene, cgltf_mesh const *pMesh, std::
         explore(scene->nodes[i], Transform{});
     }
 
-    return new Scene(drawList);
+    if (lights.size() > MAX_PUNCTUAL_LIGHTS)
+    {
+        spdlog::warn("Scene: {} punctual lights, only the first {} are lit, see constants.hpp", lights.size(),
+                     MAX_PUNCTUAL_LIGHTS);
+        lights.resize(MAX_PUNCTUAL_LIGHTS);
+    }
+
+    return new Scene(drawList, lights);
 }
 
-Scene::Scene(std::vector<std::pair<Transform, MeshID>> const &drawList)
+Scene::Scene(std::vector<std::pair<Transform, MeshID>> const &drawList, std::vector<ubo::PunctualLight> const &lights)
+    : _lights{lights}, _isBvhStale{false}
 {
     _drawList.reserve(drawList.size());
     _drawList.assign(drawList.begin(), drawList.end());
+
+    AssetsManager const *assetsManager = AssetsManager::Get();
+
+    _permutationDrawLists.resize(Material::PERMUTATION_COUNT);
+    _firstBounds.resize(_drawList.size(), 0u);
+
+    std::map<std::pair<uint32_t, MeshID>, uint32_t> groups; // features and mesh, to their index in _drawGroups
+    bool isTruncated = false;
+
+    for (uint32_t i = 0; i < _drawList.size(); i++)
+    {
+        _firstBounds[i] = static_cast<uint32_t>(_primitiveBounds.size());
+
+        Mesh const *mesh = assetsManager->GetMesh(_drawList[i].second);
+        if (!mesh)
+        {
+            continue;
+        }
+
+        std::vector<Mesh::Primitive> const &primitives = mesh->GetPrimitives();
+        if (_primitiveBounds.size() + primitives.size() > MAX_INSTANCES)
+        {
+            isTruncated = true;
+            continue;
+        }
+
+        glm::mat4 const matrix = _drawList[i].first.GetMatrix();
+        glm::mat4 const normalMatrix{_drawList[i].first.GetNormalMatrix()};
+
+        for (uint32_t primitive = 0; primitive < primitives.size(); primitive++)
+        {
+            _primitiveBounds.push_back(primitives[primitive].bounds.Transformed(matrix));
+            _instanceDraws.push_back(i);
+
+            Material const *material = assetsManager->GetMaterial(primitives[primitive].material);
+            uint32_t const features = material ? material->GetFeatures() : 0u;
+
+            auto const [group, isNew] = groups.try_emplace({features, _drawList[i].second},
+                                                           static_cast<uint32_t>(_drawGroups.size()));
+            if (isNew)
+            {
+                _drawGroups.push_back(DrawGroup{_drawList[i].second, features, 0u, 0u});
+            }
+            _drawGroups[group->second].instanceCount++;
+
+            Instance instance{};
+            instance.modelMatrix = matrix;
+            instance.normalMatrix = normalMatrix;
+            instance.normalMatrix[3][3] = material ? material->GetID() : INVALID_ID;
+            instance.boundsMin = glm::vec4{_primitiveBounds.back().min, 1.f};
+            instance.boundsMax = glm::vec4{_primitiveBounds.back().max, 1.f};
+            instance.indexCount = primitives[primitive].indexCount;
+            instance.firstIndex = primitives[primitive].indexOffset;
+            instance.vertexOffset = static_cast<int32_t>(primitives[primitive].vertexOffset);
+            instance.drawGroup = group->second;
+            _instances.push_back(instance);
+
+            if (features & Material::eAlphaBlend)
+            {
+                _blendedDrawList.emplace_back(i, primitive);
+            }
+            else
+            {
+                _permutationDrawLists[features].emplace_back(i, primitive);
+            }
+
+            // masked primitives have holes, only solid ones hide what's behind them
+            if (!(features & (Material::eAlphaMask | Material::eAlphaBlend)) && primitives[primitive].indexCount > 0)
+            {
+                _occluders.emplace_back(i, primitive);
+            }
+        }
+    }
+
+    if (isTruncated)
+    {
+        spdlog::warn("Scene: more than {} primitives, the meshes past them are left out, see constants.hpp",
+                     MAX_INSTANCES);
+    }
+
+    // each group's commands follow the previous group's, its instances write them in whatever order they pass
+    uint32_t groupFirst = 0u;
+    for (DrawGroup &drawGroup : _drawGroups)
+    {
+        drawGroup.groupFirst = groupFirst;
+        groupFirst += drawGroup.instanceCount;
+    }
+    for (Instance &instance : _instances)
+    {
+        instance.groupFirst = _drawGroups[instance.drawGroup].groupFirst;
+    }
+
+    _instanceBvh = Bvh{_primitiveBounds};
 }
 
-void Scene::Bind(vk::CommandBuffer commandBuffer) const
+void Scene::DrawPermutationChunk(vk::CommandBuffer commandBuffer, uint32_t permutation, uint32_t chunk,
+                                 uint32_t chunkCount, uint32_t featureMask, OcclusionBuffer const *occlusion) const
 {
+    check(chunkCount > 0 && chunk < chunkCount);
+    check((permutation & featureMask) < _permutationDrawLists.size());
+
+    for (uint32_t features = 0; features < _permutationDrawLists.size(); features++)
+    {
+        if ((features & featureMask) == permutation)
+        {
+            DrawListChunk(commandBuffer, _permutationDrawLists[features], chunk, chunkCount, occlusion);
+        }
+    }
+}
+
+void Scene::DrawBlendedChunk(vk::CommandBuffer commandBuffer, uint32_t chunk, uint32_t chunkCount,
+                             OcclusionBuffer const *occlusion) const
+{
+    check(chunkCount > 0 && chunk < chunkCount);
+
+    DrawListChunk(commandBuffer, _blendedDrawList, chunk, chunkCount, occlusion);
 }
 
-void Scene::Draw(vk::CommandBuffer commandBuffer, vk::PipelineLayout pipelineLayout, class Transform const &) const
+void Scene::DrawIndirectPermutationChunk(vk::CommandBuffer commandBuffer, vk::Buffer commands, vk::Buffer counts,
+                                         uint32_t view, uint32_t permutation, uint32_t chunk, uint32_t chunkCount,
+                                         uint32_t featureMask) const
 {
+    check(chunkCount > 0 && chunk < chunkCount);
+    check((permutation & featureMask) < _permutationDrawLists.size());
+
+    std::vector<uint32_t> groups;
+    for (uint32_t group = 0; group < _drawGroups.size(); group++)
+    {
+        uint32_t const features = _drawGroups[group].features;
+        if (!(features & Material::eAlphaBlend) && (features & featureMask) == permutation)
+        {
+            groups.push_back(group);
+        }
+    }
+
+    DrawGroupsChunk(commandBuffer, commands, counts, view, groups, chunk, chunkCount);
+}
+
+void Scene::DrawIndirectChunk(vk::CommandBuffer commandBuffer, vk::Buffer commands, vk::Buffer counts, uint32_t view,
+                              uint32_t chunk, uint32_t chunkCount) const
+{
+    check(chunkCount > 0 && chunk < chunkCount);
+
+    std::vector<uint32_t> groups(_drawGroups.size());
+    for (uint32_t group = 0; group < _drawGroups.size(); group++)
+    {
+        groups[group] = group;
+    }
+
+    DrawGroupsChunk(commandBuffer, commands, counts, view, groups, chunk, chunkCount);
+}
+
+void Scene::SortBlended(glm::vec3 const &viewPosition)
+{
+    AssetsManager const *assetsManager = AssetsManager::Get();
+
+    std::vector<float> distances(_drawList.size(), 0.f);
+    for (auto const &[index, primitive] : _blendedDrawList)
+    {
+        auto const &[transform, meshID] = _drawList[index];
+
+        Mesh const *mesh = assetsManager->GetMesh(meshID);
+        if (mesh)
+        {
+            Box const bounds = mesh->GetBounds().Transformed(transform.GetMatrix());
+            glm::vec3 const offset = (bounds.min + bounds.max) * .5f - viewPosition;
+            distances[index] = glm::dot(offset, offset);
+        }
+    }
+
+    // stable, so a mesh's own primitives keep their authored order
+    std::stable_sort(_blendedDrawList.begin(), _blendedDrawList.end(),
+                     [&](auto const &a, auto const &b) { return distances[a.first] > distances[b.first]; });
+}
+
+void Scene::RenderOccluders(OcclusionBuffer *occlusionBuffer, glm::mat4 const &viewProjection,
+                            glm::vec3 const &viewPosition) const
+{
+    check(occlusionBuffer);
+
+    ZoneScopedN("render occluders");
+
     AssetsManager const *assetsManager = AssetsManager::Get();
+    Frustum const frustum{viewProjection};
+
+    // roughly their size on screen, with the nearest point of their bounds for distance
+    std::vector<std::pair<float, uint32_t>> candidates;
+    for (uint32_t i = 0; i < _occluders.size(); i++)
+    {
+        auto const &[index, primitive] = _occluders[i];
+        Box const &bounds = _primitiveBounds[_firstBounds[index] + primitive];
+
+        if (!frustum.Intersects(bounds))
+        {
+            continue;
+        }
+
+        glm::vec3 const size = bounds.max - bounds.min;
+        glm::vec3 const offset = glm::clamp(viewPosition, bounds.min, bounds.max) - viewPosition;
+        candidates.emplace_back(glm::dot(size, size) / glm::max(glm::dot(offset, offset), 1e-4f), i);
+    }
 
-    for (auto const &[transform, meshID] : _drawList)
+    std::sort(candidates.begin(), candidates.end(), [](auto const &a, auto const &b) { return a.first > b.first; });
+
+    std::vector<OcclusionBuffer::Occluder> occluders;
+    uint32_t triangleCount = 0;
+    for (auto const &[score, i] : candidates)
     {
+        auto const &[index, primitive] = _occluders[i];
+        auto const &[transform, meshID] = _drawList[index];
+
         Mesh const *mesh = assetsManager->GetMesh(meshID);
+        check(mesh);
+
+        Mesh::Primitive const &meshPrimitive = mesh->GetPrimitives()[primitive];
+        if (triangleCount + meshPrimitive.indexCount / 3 > MAX_OCCLUDER_TRIANGLES)
+        {
+            continue; // a smaller one may still fit
+        }
+        triangleCount += meshPrimitive.indexCount / 3;
+
+        occluders.push_back(OcclusionBuffer::Occluder{mesh->GetPositions().data() + meshPrimitive.vertexOffset,
+                                                      mesh->GetIndices().data() + meshPrimitive.indexOffset,
+                                                      meshPrimitive.indexCount, transform.GetMatrix()});
+    }
+
+    occlusionBuffer->Rasterize(occluders, viewProjection);
+}
+
+void Scene::DrawListChunk(vk::CommandBuffer commandBuffer, std::vector<std::pair<uint32_t, uint32_t>> const &drawList,
+                          uint32_t chunk, uint32_t chunkCount, OcclusionBuffer const *occlusion) const
+{
+    AssetsManager const *assetsManager = AssetsManager::Get();
+
+    size_t const begin = drawList.size() * chunk / chunkCount;
+    size_t const end = drawList.size() * (chunk + 1) / chunkCount;
+
+    Mesh const *boundMesh = nullptr;
+    for (size_t i = begin; i < end; i++)
+    {
+        auto const &[index, primitive] = drawList[i];
+        uint32_t const instance = _firstBounds[index] + primitive;
+        if (occlusion && !occlusion->IsVisible(_primitiveBounds[instance]))
+        {
+            continue;
+        }
+
+        Mesh const *mesh = assetsManager->GetMesh(_drawList[index].second);
 
         if (mesh)
+        {
+            if (mesh != boundMesh) // a mesh's primitives are bucketed next to each other when they share features
+            {
+                mesh->Bind(commandBuffer);
+                boundMesh = mesh;
+            }
+            mesh->DrawInstance(commandBuffer, primitive, instance);
+        }
+    }
+}
+
+void Scene::DrawGroupsChunk(vk::CommandBuffer commandBuffer, vk::Buffer commands, vk::Buffer counts, uint32_t view,
+                            std::vector<uint32_t> const &groups, uint32_t chunk, uint32_t chunkCount) const
+{
+    AssetsManager const *assetsManager = AssetsManager::Get();
+
+    size_t const begin = groups.size() * chunk / chunkCount;
+    size_t const end = groups.size() * (chunk + 1) / chunkCount;
+
+    vk::DeviceSize const viewFirst = static_cast<vk::DeviceSize>(view) * MAX_INSTANCES;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        DrawGroup const &drawGroup = _drawGroups[groups[i]];
+
+        Mesh const *mesh = assetsManager->GetMesh(drawGroup.mesh);
+        check(mesh);
+
+        mesh->Bind(commandBuffer);
+        mesh->DrawIndirect(commandBuffer, commands,
+                           (viewFirst + drawGroup.groupFirst) * sizeof(vk::DrawIndexedIndirectCommand), counts,
+                           (viewFirst + groups[i]) * sizeof(uint32_t), drawGroup.instanceCount);
+    }
+}
+
+void Scene::PopulateUbo(ubo::Ubo *ubo) const
+{
+    check(ubo);
+    check(_lights.size() <= MAX_PUNCTUAL_LIGHTS);
+
+    std::copy(_lights.begin(), _lights.end(), ubo->light.punctualLights);
+    ubo->light.punctualLightCount = static_cast<int>(_lights.size());
+}
+
+bool Scene::Raycast(Ray const &ray, Hit *hit, float distance) const
+{
+    check(hit);
+
+    ZoneScopedN("scene raycast");
+
+    AssetsManager const *assetsManager = AssetsManager::Get();
+
+    // in model space, the ray keeps its distances so hits compare across instances
+    Bvh::RayTest const intersects = [&](uint32_t instance, Ray const &worldRay, float *nearest) {
+        uint32_t const index = _instanceDraws[instance];
+        auto const &[transform, meshID] = _drawList[index];
+
+        Mesh const *mesh = assetsManager->GetMesh(meshID);
+        if (!mesh)
+        {
+            return false;
+        }
+
+        Ray const modelRay = worldRay.Transformed(glm::inverse(transform.GetMatrix()));
+        return mesh->Raycast(instance - _firstBounds[index], modelRay, nearest);
+    };
+
+    uint32_t instance;
+    if (!_instanceBvh.Raycast(ray, intersects, &distance, &instance))
+    {
+        return false;
+    }
+
+    hit->index = _instanceDraws[instance];
+    hit->primitive = instance - _firstBounds[hit->index];
+    hit->distance = distance;
+    return true;
+}
+
+void Scene::Query(Box const &box, std::vector<uint32_t> *instances) const
+{
+    check(instances);
+
+    size_t const first = instances->size();
+    _instanceBvh.Query(box, instances);
+    instances->erase(std::remove_if(instances->begin() + first, instances->end(),
+                                    [&](uint32_t instance) { return !box.Intersects(_primitiveBounds[instance]); }),
+                     instances->end());
+}
+
+void Scene::Query(Frustum const &frustum, std::vector<uint32_t> *instances) const
+{
+    check(instances);
+
+    size_t const first = instances->size();
+    _instanceBvh.Query(frustum, instances);
+    instances->erase(
+        std::remove_if(instances->begin() + first, instances->end(),
+                       [&](uint32_t instance) { return !frustum.Intersects(_primitiveBounds[instance]); }),
+        instances->end());
+}
+
+void Scene::SetTransform(uint32_t index, Transform const &transform)
+{
+    check(index < _drawList.size());
+
+    _drawList[index].first = transform;
+
+    Mesh const *mesh = AssetsManager::Get()->GetMesh(_drawList[index].second);
+    if (!mesh)
+    {
+        return;
+    }
+
+    glm::mat4 const matrix = transform.GetMatrix();
+    glm::mat4 const normalMatrix{transform.GetNormalMatrix()};
+
+    auto const [firstInstance, endInstance] = GetInstanceRange(index);
+
+    std::vector<Mesh::Primitive> const &primitives = mesh->GetPrimitives();
+    for (uint32_t instance = firstInstance; instance < endInstance; instance++)
+    {
+        _primitiveBounds[instance] = primitives[instance - firstInstance].bounds.Transformed(matrix);
+
+        Instance &moved = _instances[instance];
+        float const materialID = moved.normalMatrix[3][3];
+        moved.modelMatrix = matrix;
+        moved.normalMatrix = normalMatrix;
+        moved.normalMatrix[3][3] = materialID;
+        moved.boundsMin = glm::vec4{_primitiveBounds[instance].min, 1.f};
+        moved.boundsMax = glm::vec4{_primitiveBounds[instance].max, 1.f};
+        moved.isMoved = 1u;
+    }
+
+    _isBvhStale = true;
+}
+
+void Scene::SettleTransform(uint32_t index)
+{
+    auto const [firstInstance, endInstance] = GetInstanceRange(index);
+    for (uint32_t instance = firstInstance; instance < endInstance; instance++)
+    {
+        _instances[instance].isMoved = 0u;
+    }
+}
+
+void Scene::Refit()
+{
+    if (_isBvhStale)
+    {
+        _instanceBvh.Refit(_primitiveBounds);
+        _isBvhStale = false;
+    }
+}
+
+std::pair<uint32_t, uint32_t> Scene::GetInstanceRange(uint32_t index) const
+{
+    check(index < _drawList.size());
+
+    uint32_t const end =
+        index + 1 < _drawList.size() ? _firstBounds[index + 1] : static_cast<uint32_t>(_instances.size());
+    return {_firstBounds[index], end};
+}
+
+Transform const &Scene::GetTransform(uint32_t index) const
+{
+    check(index < _drawList.size());
+
+    return _drawList[index].first;
+}
+
+std::vector<Scene::Instance> const &Scene::GetInstances() const
+{
+    return _instances;
+}
+
+bool Scene::HasBlended() const
+{
+    return !_blendedDrawList.empty();
+}
+
+void Scene::Bind(vk::CommandBuffer commandBuffer) const
+{
+}
+
+void Scene::Draw(vk::CommandBuffer commandBuffer, vk::PipelineLayout, class Transform const &) const
+{
+    DrawChunk(commandBuffer, 0u, 1u);
+}
+
+void Scene::DrawChunk(vk::CommandBuffer commandBuffer, uint32_t chunk, uint32_t chunkCount,
+                      Frustum const *culling) const
+{
+    check(chunkCount > 0 && chunk < chunkCount);
+
+    AssetsManager const *assetsManager = AssetsManager::Get();
+
+    // the instances in the frustum come from the bvh, in instance order so meshes stay bound between primitives
+    if (culling)
+    {
+        std::vector<uint32_t> instances;
+        Query(*culling, &instances);
+        std::sort(instances.begin(), instances.end());
+
+        size_t const begin = instances.size() * chunk / chunkCount;
+        size_t const end = instances.size() * (chunk + 1) / chunkCount;
+
+        Mesh const *boundMesh = nullptr;
+        for (size_t i = begin; i < end; i++)
+        {
+            uint32_t const index = _instanceDraws[instances[i]];
+            Mesh const *mesh = assetsManager->GetMesh(_drawList[index].second);
+            if (mesh != boundMesh)
+            {
+                mesh->Bind(commandBuffer);
+                boundMesh = mesh;
+            }
+            mesh->DrawInstance(commandBuffer, instances[i] - _firstBounds[index], instances[i]);
+        }
+        return;
+    }
+
+    size_t const begin = _drawList.size() * chunk / chunkCount;
+    size_t const end = _drawList.size() * (chunk + 1) / chunkCount;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        Mesh const *mesh = assetsManager->GetMesh(_drawList[i].second);
+
+        // meshes left out past MAX_INSTANCES have no instances
+        uint32_t const firstInstance = _firstBounds[i];
+        uint32_t const endInstance =
+            i + 1 < _drawList.size() ? _firstBounds[i + 1] : static_cast<uint32_t>(_instances.size());
+
+        if (firstInstance < endInstance)
         {
             mesh->Bind(commandBuffer);
-            mesh->Draw(commandBuffer, pipelineLayout, transform);
+        }
+        for (uint32_t instance = firstInstance; instance < endInstance; instance++)
+        {
+            mesh->DrawInstance(commandBuffer, instance - firstInstance, instance);
         }
     }
 }
@@ -1,7 +1,10 @@
 #ifndef WSP_SCENE
 #define WSP_SCENE
 
+#include <wsp_bounds.hpp>
+#include <wsp_bvh.hpp>
 #include <wsp_drawable.hpp>
+#include <wsp_global_ubo.hpp>
 #include <wsp_transform.hpp>
 
 #include <vector>
@@ -16,16 +19,103 @@ namespace wsp
 class Scene : public Drawable
 {
   public:
+    // what the vertex shaders and the culling pass read of a primitive, mirrored in instances.glsl
+    struct Instance
+    {
+        glm::mat4 modelMatrix;
+        glm::mat4 normalMatrix; // material id on normalMatrix[3][3]
+        glm::vec4 boundsMin;    // in world space
+        glm::vec4 boundsMax;
+        uint32_t indexCount;
+        uint32_t firstIndex;
+        int32_t vertexOffset;
+        uint32_t drawGroup;
+        uint32_t groupFirst; // the group's first command, instances of a group are drawn by one indirect draw
+        uint32_t isMoved;    // since the depth the culling pass tests occlusion against was drawn
+        uint32_t padding[2];
+    };
+
+    struct Hit
+    {
+        uint32_t index; // into the draw list
+        uint32_t primitive;
+        float distance; // along the ray, in lengths of its direction
+    };
+
     virtual void Bind(vk::CommandBuffer) const override;
     virtual void Draw(vk::CommandBuffer, vk::PipelineLayout, class Transform const &) const override;
+    void DrawChunk(vk::CommandBuffer, uint32_t chunk, uint32_t chunkCount,
+                   struct Frustum const *culling = nullptr) const;
+    // only the opaque and masked primitives whose material features, under featureMask, are exactly permutation
+    void DrawPermutationChunk(vk::CommandBuffer, uint32_t permutation, uint32_t chunk, uint32_t chunkCount,
+                              uint32_t featureMask = ~0u, class OcclusionBuffer const *occlusion = nullptr) const;
+    // only the blended primitives, back to front as of the last SortBlended
+    void DrawBlendedChunk(vk::CommandBuffer, uint32_t chunk, uint32_t chunkCount,
+                          class OcclusionBuffer const *occlusion = nullptr) const;
+    // from the commands and counts the culling pass wrote for view, at MAX_INSTANCES commands and counts per view
+    void DrawIndirectPermutationChunk(vk::CommandBuffer, vk::Buffer commands, vk::Buffer counts, uint32_t view,
+                                      uint32_t permutation, uint32_t chunk, uint32_t chunkCount,
+                                      uint32_t featureMask = ~0u) const;
+    void DrawIndirectChunk(vk::CommandBuffer, vk::Buffer commands, vk::Buffer counts, uint32_t view, uint32_t chunk,
+                           uint32_t chunkCount) const; // blended primitives too
+    void SortBlended(glm::vec3 const &viewPosition);
+    // the opaque primitives in view, largest on screen first, until MAX_OCCLUDER_TRIANGLES
+    void RenderOccluders(class OcclusionBuffer *, glm::mat4 const &viewProjection,
+                         glm::vec3 const &viewPosition) const;
+
+    // the nearest triangle hit within distance, for a ray in world space
+    bool Raycast(Ray const &, Hit *, float distance = FLT_MAX) const;
+    // appends the instances whose bounds overlap
+    void Query(Box const &, std::vector<uint32_t> *instances) const;
+    void Query(Frustum const &, std::vector<uint32_t> *instances) const;
+    // moves a draw list entry along with its instances, the instance buffer has to be written again after
+    // they're marked as moved until SettleTransform, and the bvh only follows them on the next Refit
+    void SetTransform(uint32_t index, Transform const &);
+    void SettleTransform(uint32_t index); // once a frame has drawn it where it is
+    void Refit();                         // the bvh, once after a batch of SetTransform
+    Transform const &GetTransform(uint32_t index) const;
+    std::pair<uint32_t, uint32_t> GetInstanceRange(uint32_t index) const; // first and end, of a draw list entry
+
+    void PopulateUbo(ubo::Ubo *) const;
+    std::vector<Instance> const &GetInstances() const; // indexed by gl_InstanceIndex
+    bool HasBlended() const;                           // primitives, which are drawn by DrawBlendedChunk
 
     static Scene *BuildGlTF(cgltf_scene const *, cgltf_mesh const *pMesh, std::vector<MeshID> const &meshes);
 
-    Scene(std::vector<std::pair<Transform, MeshID>> const &drawList);
+    Scene(std::vector<std::pair<Transform, MeshID>> const &drawList,
+          std::vector<ubo::PunctualLight> const &lights = {});
     ~Scene() = default;
 
   protected:
+    struct DrawGroup // the instances of a mesh sharing material features
+    {
+        MeshID mesh;
+        uint32_t features;
+        uint32_t instanceCount;
+        uint32_t groupFirst;
+    };
+
+    void DrawListChunk(vk::CommandBuffer, std::vector<std::pair<uint32_t, uint32_t>> const &, uint32_t chunk,
+                       uint32_t chunkCount, class OcclusionBuffer const *occlusion) const;
+    void DrawGroupsChunk(vk::CommandBuffer, vk::Buffer commands, vk::Buffer counts, uint32_t view,
+                         std::vector<uint32_t> const &groups, uint32_t chunk, uint32_t chunkCount) const;
+
     std::vector<std::pair<Transform, MeshID>> _drawList;
+    std::vector<ubo::PunctualLight> _lights; // in world space
+
+    // bucketed at import by material features, draw list index and primitive
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> _permutationDrawLists;
+    std::vector<std::pair<uint32_t, uint32_t>> _blendedDrawList;
+
+    std::vector<uint32_t> _firstBounds;   // per draw list index, into _primitiveBounds and _instances
+    std::vector<Box> _primitiveBounds;    // in world space
+    std::vector<uint32_t> _instanceDraws; // per instance, its draw list index
+    Bvh _instanceBvh;                     // over _primitiveBounds
+    bool _isBvhStale;                     // bounds moved since it was last fit
+    std::vector<std::pair<uint32_t, uint32_t>> _occluders;
+
+    std::vector<Instance> _instances;
+    std::vector<DrawGroup> _drawGroups;
 };
 
 } // namespace wsp
@@ -0,0 +1,155 @@
+#include <wsp_shader_watcher.hpp>
+
+#include <tracy/Tracy.hpp>
+
+#include <spdlog/fmt/bundled/base.h>
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <system_error>
+
+using namespace wsp;
+
+ShaderWatcher::ShaderWatcher(std::filesystem::path const &sourceDirectory,
+                             std::filesystem::path const &outputDirectory)
+    : _sourceDirectory{sourceDirectory}, _outputDirectory{outputDirectory}, _stopping{false}
+{
+    std::error_code error{};
+    for (std::filesystem::directory_entry const &entry :
+         std::filesystem::directory_iterator{_sourceDirectory, error})
+    {
+        _writeTimes[entry.path()] = entry.last_write_time(error);
+    }
+
+    if (error)
+    {
+        spdlog::warn("ShaderWatcher: failed to list '{}' : {}", _sourceDirectory.string(), error.message());
+    }
+
+    _thread = std::thread{&ShaderWatcher::Watch, this};
+
+    spdlog::debug("ShaderWatcher: watching {} files in '{}'", _writeTimes.size(), _sourceDirectory.string());
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        _stopping = true;
+    }
+    _stop.notify_all();
+
+    _thread.join();
+}
+
+std::set<std::string> ShaderWatcher::PopCompiled()
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+
+    std::set<std::string> compiled{};
+    compiled.swap(_compiled);
+
+    return compiled;
+}
+
+void ShaderWatcher::Watch()
+{
+    tracy::SetThreadName("shader watcher");
+
+    std::unique_lock<std::mutex> lock{_mutex};
+    while (!_stop.wait_for(lock, std::chrono::milliseconds{250}, [this]() { return _stopping; }))
+    {
+        lock.unlock();
+        Poll();
+        lock.lock();
+    }
+}
+
+void ShaderWatcher::Poll()
+{
+    std::set<std::filesystem::path> changed{};
+    bool isLibraryChanged = false;
+
+    std::error_code error{};
+    for (std::filesystem::directory_entry const &entry :
+         std::filesystem::directory_iterator{_sourceDirectory, error})
+    {
+        std::filesystem::file_time_type const writeTime = entry.last_write_time(error);
+        if (error)
+        {
+            continue; // being written to, caught on the next poll
+        }
+
+        auto const it = _writeTimes.find(entry.path());
+        if (it != _writeTimes.end() && it->second == writeTime)
+        {
+            continue;
+        }
+        _writeTimes[entry.path()] = writeTime;
+
+        if (IsStage(entry.path()))
+        {
+            changed.insert(entry.path());
+        }
+        else if (entry.path().extension() == ".glsl")
+        {
+            isLibraryChanged = true;
+        }
+    }
+
+    // includes aren't tracked, every stage may depend on a changed library
+    if (isLibraryChanged)
+    {
+        for (auto const &[path, writeTime] : _writeTimes)
+        {
+            if (IsStage(path))
+            {
+                changed.insert(path);
+            }
+        }
+    }
+
+    for (std::filesystem::path const &source : changed)
+    {
+        if (Compile(source))
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _compiled.insert(source.filename().string() + ".spv");
+        }
+    }
+}
+
+bool ShaderWatcher::Compile(std::filesystem::path const &source) const
+{
+    ZoneScopedN("compile shader");
+
+    std::filesystem::path const output = _outputDirectory / (source.filename().string() + ".spv");
+    std::filesystem::path const temporary = _outputDirectory / (source.filename().string() + ".spv.tmp");
+
+    std::string const command = fmt::format("glslc -I \"{}\" \"{}\" -o \"{}\"", _sourceDirectory.string(),
+                                            source.string(), temporary.string());
+
+    if (std::system(command.c_str()) != 0)
+    {
+        spdlog::error("ShaderWatcher: failed to compile '{}'", source.filename().string());
+        return false;
+    }
+
+    // readers never see a half written file
+    std::error_code error{};
+    std::filesystem::rename(temporary, output, error);
+    if (error)
+    {
+        spdlog::error("ShaderWatcher: failed to replace '{}' : {}", output.string(), error.message());
+        return false;
+    }
+
+    spdlog::info("ShaderWatcher: compiled '{}'", source.filename().string());
+    return true;
+}
+
+bool ShaderWatcher::IsStage(std::filesystem::path const &path)
+{
+    return path.extension() == ".vert" || path.extension() == ".frag" || path.extension() == ".comp";
+}
@@ -0,0 +1,48 @@
+#ifndef WSP_SHADER_WATCHER
+#define WSP_SHADER_WATCHER
+
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace wsp
+{
+
+// polls a directory of GLSL sources and recompiles the ones that change to SPIR-V, off the calling thread
+class ShaderWatcher
+{
+  public:
+    ShaderWatcher(std::filesystem::path const &sourceDirectory, std::filesystem::path const &outputDirectory);
+    ~ShaderWatcher();
+
+    ShaderWatcher(ShaderWatcher const &) = delete;
+    ShaderWatcher &operator=(ShaderWatcher const &) = delete;
+
+    std::set<std::string> PopCompiled(); // SPIR-V files written since the last call, as named in PassCreateInfo
+
+  protected:
+    void Watch();
+    void Poll();
+    bool Compile(std::filesystem::path const &source) const;
+
+    static bool IsStage(std::filesystem::path const &);
+
+    std::filesystem::path _sourceDirectory;
+    std::filesystem::path _outputDirectory;
+    std::map<std::filesystem::path, std::filesystem::file_time_type> _writeTimes;
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _stop;
+    bool _stopping;
+
+    std::set<std::string> _compiled;
+};
+
+} // namespace wsp
+
+#endif
@@ -0,0 +1,242 @@
+#include <wsp_static_buffer.hpp>
+
+#include <wsp_device.hpp>
+#include <wsp_devkit.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace wsp;
+
+StaticBuffer::StaticBuffer(vk::DeviceSize size, std::string const &name)
+    : _name{name}, _size{size}, _buffer{}, _deviceMemory{}, _stagingBuffers{}, _stagingDeviceMemories{},
+      _stagingMappedMemories{}, _descriptorPool{}, _descriptorSet{}, _descriptorSetLayout{}
+{
+    check(size > 0);
+
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    vk::BufferCreateInfo bufferInfo{};
+    bufferInfo.size = size;
+    bufferInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+    device->CreateBufferAndBindMemory(bufferInfo, &_buffer, &_deviceMemory, {vk::MemoryPropertyFlagBits::eDeviceLocal},
+                                      fmt::format("{}_buffer", name));
+
+    vk::DescriptorPoolSize descriptorPoolSize{};
+    descriptorPoolSize.descriptorCount = 1u;
+    descriptorPoolSize.type = vk::DescriptorType::eStorageBuffer;
+
+    vk::DescriptorPoolCreateInfo descriptorPoolInfo{};
+    descriptorPoolInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+    descriptorPoolInfo.maxSets = 1u;
+    descriptorPoolInfo.poolSizeCount = 1u;
+    descriptorPoolInfo.pPoolSizes = &descriptorPoolSize;
+
+    device->CreateDescriptorPool(descriptorPoolInfo, &_descriptorPool, fmt::format("{}<descriptor_pool>", name));
+
+    vk::DescriptorSetLayoutBinding descriptorSetLayoutBinding{};
+    descriptorSetLayoutBinding.descriptorCount = 1u;
+    descriptorSetLayoutBinding.stageFlags = vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute;
+    descriptorSetLayoutBinding.descriptorType = vk::DescriptorType::eStorageBuffer;
+
+    vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
+    descriptorSetLayoutInfo.bindingCount = 1u;
+    descriptorSetLayoutInfo.pBindings = &descriptorSetLayoutBinding;
+
+    device->CreateDescriptorSetLayout(descriptorSetLayoutInfo, &_descriptorSetLayout,
+                                      fmt::format("{}<descriptor_set_layout>", name));
+
+    vk::DescriptorSetAllocateInfo setAllocInfo{};
+    setAllocInfo.descriptorPool = _descriptorPool;
+    setAllocInfo.descriptorSetCount = 1u;
+    setAllocInfo.pSetLayouts = &_descriptorSetLayout;
+
+    device->AllocateDescriptorSet(setAllocInfo, &_descriptorSet, fmt::format("{}<descriptor_set>", name));
+
+    vk::DescriptorBufferInfo descriptorBufferInfo{};
+    descriptorBufferInfo.buffer = _buffer;
+    descriptorBufferInfo.offset = 0u;
+    descriptorBufferInfo.range = VK_WHOLE_SIZE;
+
+    vk::WriteDescriptorSet writeDescriptor{};
+    writeDescriptor.dstSet = _descriptorSet;
+    writeDescriptor.dstBinding = 0u;
+    writeDescriptor.dstArrayElement = 0u;
+    writeDescriptor.descriptorType = vk::DescriptorType::eStorageBuffer;
+    writeDescriptor.descriptorCount = 1u;
+    writeDescriptor.pBufferInfo = &descriptorBufferInfo;
+
+    device->UpdateDescriptorSets({writeDescriptor});
+
+    spdlog::debug("StaticBuffer: built '{}'", name);
+}
+
+StaticBuffer::~StaticBuffer()
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    device->FreeDescriptorSet(_descriptorPool, &_descriptorSet);
+    device->DestroyDescriptorPool(&_descriptorPool);
+    device->DestroyDescriptorSetLayout(&_descriptorSetLayout);
+    device->DestroyBuffer(&_buffer);
+    device->FreeDeviceMemory(&_deviceMemory);
+
+    if (!_pendingData.empty())
+    {
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            device->UnmapMemory(_stagingDeviceMemories[i]);
+            device->DestroyBuffer(&_stagingBuffers[i]);
+            device->FreeDeviceMemory(&_stagingDeviceMemories[i]);
+        }
+    }
+
+    spdlog::info("StaticBuffer: freed");
+}
+
+void StaticBuffer::Write(void const *data, vk::DeviceSize size)
+{
+    check(data);
+    check(size > 0 && size <= _size);
+
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    vk::Buffer stagingBuffer;
+    vk::DeviceMemory stagingDeviceMemory;
+
+    vk::BufferCreateInfo stagingBufferInfo{};
+    stagingBufferInfo.size = size;
+    stagingBufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+
+    device->CreateBufferAndBindMemory(
+        stagingBufferInfo, &stagingBuffer, &stagingDeviceMemory,
+        {vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent}, _name + "_staging");
+
+    void *mappedMemory;
+    device->MapMemory(stagingDeviceMemory, &mappedMemory);
+    memcpy(mappedMemory, data, size);
+    device->UnmapMemory(stagingDeviceMemory);
+
+    device->WaitIdle(); // written rarely, on scene changes
+    device->CopyBuffer(stagingBuffer, &_buffer, static_cast<uint32_t>(size));
+
+    device->DestroyBuffer(&stagingBuffer);
+    device->FreeDeviceMemory(&stagingDeviceMemory);
+
+    // ranges still pending copy from the latest data
+    if (!_pendingData.empty())
+    {
+        memcpy(_pendingData.data(), data, size);
+    }
+}
+
+void StaticBuffer::BuildStaging()
+{
+    Device const *device = SafeDeviceAccessor::Get();
+    check(device);
+
+    vk::BufferCreateInfo stagingBufferInfo{};
+    stagingBufferInfo.size = _size;
+    stagingBufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        device->CreateBufferAndBindMemory(
+            stagingBufferInfo, &_stagingBuffers[i], &_stagingDeviceMemories[i],
+            {vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent},
+            fmt::format("{}_staging_{}", _name, i));
+        device->MapMemory(_stagingDeviceMemories[i], &_stagingMappedMemories[i]);
+    }
+
+    _pendingData.resize(_size);
+}
+
+void StaticBuffer::WriteRange(void const *data, vk::DeviceSize offset, vk::DeviceSize size)
+{
+    check(data);
+    check(size > 0 && offset + size <= _size);
+
+    if (_pendingData.empty())
+    {
+        BuildStaging();
+    }
+
+    memcpy(_pendingData.data() + offset, data, size);
+
+    // kept disjoint, a copy's regions may not overlap
+    _pendingRanges.emplace_back(offset, size);
+    std::sort(_pendingRanges.begin(), _pendingRanges.end());
+
+    std::vector<std::pair<vk::DeviceSize, vk::DeviceSize>> merged{};
+    for (auto const &[rangeOffset, rangeSize] : _pendingRanges)
+    {
+        if (!merged.empty() && rangeOffset <= merged.back().first + merged.back().second)
+        {
+            merged.back().second = std::max(merged.back().second, rangeOffset + rangeSize - merged.back().first);
+        }
+        else
+        {
+            merged.emplace_back(rangeOffset, rangeSize);
+        }
+    }
+    _pendingRanges = std::move(merged);
+}
+
+void StaticBuffer::Flush(vk::CommandBuffer commandBuffer, int frameIndex) const
+{
+    if (_pendingRanges.empty())
+    {
+        return;
+    }
+
+    // the frame's fence was waited on, nothing in flight copies from its staging buffer anymore
+    std::vector<vk::BufferCopy> copies{};
+    for (auto const &[offset, size] : _pendingRanges)
+    {
+        memcpy(static_cast<char *>(_stagingMappedMemories[frameIndex]) + offset, _pendingData.data() + offset, size);
+        copies.emplace_back(offset, offset, size);
+    }
+    _pendingRanges.clear();
+
+    vk::PipelineStageFlags const readStages = vk::PipelineStageFlagBits::eVertexShader |
+                                              vk::PipelineStageFlagBits::eFragmentShader |
+                                              vk::PipelineStageFlagBits::eComputeShader;
+
+    // earlier frames only read it, waiting on their reads is enough
+    vk::BufferMemoryBarrier barrier{};
+    barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = _buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    commandBuffer.pipelineBarrier(readStages, vk::PipelineStageFlagBits::eTransfer, {}, {}, {barrier}, {});
+
+    commandBuffer.copyBuffer(_stagingBuffers[frameIndex], _buffer, copies);
+
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, readStages, {}, {}, {barrier}, {});
+}
+
+vk::DescriptorSetLayout StaticBuffer::GetDescriptorSetLayout() const
+{
+    return _descriptorSetLayout;
+}
+
+vk::DescriptorSet StaticBuffer::GetDescriptorSet() const
+{
+    return _descriptorSet;
+}
+
+vk::DeviceSize StaticBuffer::GetSize() const
+{
+    return _size;
+}
@@ -0,0 +1,57 @@
+#ifndef WSP_STATIC_BUFFER
+#define WSP_STATIC_BUFFER
+
+#include <wsp_constants.hpp>
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace wsp
+{
+
+// a device local storage buffer passes bind after their static textures, written from the cpu now and then
+class StaticBuffer
+{
+  public:
+    StaticBuffer(vk::DeviceSize size, std::string const &name = "");
+    ~StaticBuffer();
+
+    StaticBuffer(StaticBuffer const &) = delete;
+    StaticBuffer &operator=(StaticBuffer const &) = delete;
+
+    void Write(void const *data, vk::DeviceSize size); // waits on the device, frames in flight may read it
+    // copied in by the next frame that binds it, ahead of its passes, for small edits without waiting on anything
+    void WriteRange(void const *data, vk::DeviceSize offset, vk::DeviceSize size);
+    void Flush(vk::CommandBuffer, int frameIndex) const; // what WriteRange was given since, recorded by the graph
+
+    vk::DescriptorSetLayout GetDescriptorSetLayout() const;
+    vk::DescriptorSet GetDescriptorSet() const;
+    vk::DeviceSize GetSize() const;
+
+  protected:
+    std::string _name;
+    vk::DeviceSize _size;
+
+    vk::Buffer _buffer;
+    vk::DeviceMemory _deviceMemory;
+
+    void BuildStaging();
+    std::array<vk::Buffer, MAX_FRAMES_IN_FLIGHT> _stagingBuffers; // host visible, each only copied from by its frame
+    std::array<vk::DeviceMemory, MAX_FRAMES_IN_FLIGHT> _stagingDeviceMemories;
+    std::array<void *, MAX_FRAMES_IN_FLIGHT> _stagingMappedMemories;
+
+    std::vector<char> _pendingData; // the buffer as WriteRange and Write left it, empty until the first WriteRange
+    mutable std::vector<std::pair<vk::DeviceSize, vk::DeviceSize>> _pendingRanges; // offset and size, disjoint
+
+    vk::DescriptorPool _descriptorPool;
+    vk::DescriptorSet _descriptorSet;
+    vk::DescriptorSetLayout _descriptorSetLayout;
+};
+
+} // namespace wsp
+
+#endif
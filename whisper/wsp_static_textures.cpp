@@ -13,7 +13,7 @@
 using namespace wsp;
 
 StaticTextures::StaticTextures(uint32_t size, bool cubemap, std::string const &name)
-    : _name{name}, _size{size}, _offset{0u}, _descriptorSet{}, _descriptorPool{}
+    : _name{name}, _size{size}, _offset{0u}, _version{0u}, _descriptorSet{}, _descriptorPool{}
 {
     Device const *device = SafeDeviceAccessor::Get();
     check(device);
@@ -32,7 +32,7 @@ StaticTextures::StaticTextures(uint32_t size, bool cubemap, std::string const &n
 
     vk::DescriptorSetLayoutBinding descriptorSetLayoutBinding{};
     descriptorSetLayoutBinding.descriptorCount = size;
-    descriptorSetLayoutBinding.stageFlags = vk::ShaderStageFlagBits::eAllGraphics;
+    descriptorSetLayoutBinding.stageFlags = vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute;
     descriptorSetLayoutBinding.descriptorType = vk::DescriptorType::eCombinedImageSampler;
 
     vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
@@ -106,6 +106,7 @@ void StaticTextures::Push(std::vector<TextureID> const &textures)
     device->UpdateDescriptorSets({writeDescriptor});
 
     _offset += textures.size();
+    _version++;
 }
 
 vk::DescriptorSetLayout StaticTextures::GetDescriptorSetLayout() const
@@ -133,3 +134,8 @@ uint32_t StaticTextures::GetSize() const
 {
     return _size;
 }
+
+uint32_t StaticTextures::GetVersion() const
+{
+    return _version;
+}
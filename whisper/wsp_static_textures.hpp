@@ -26,11 +26,13 @@ class StaticTextures
 
     int GetID(TextureID) const;
     uint32_t GetSize() const;
+    uint32_t GetVersion() const; // bumped whenever the descriptor set is written to
 
   protected:
     std::string _name;
     uint32_t _size;
     uint32_t _offset;
+    uint32_t _version;
 
     std::unordered_map<TextureID, size_t> _staticTextures;
 
@@ -418,6 +418,12 @@ inline std::string FormatToString(vk::Format format)
     case vk::Format::eA8B8G8R8SrgbPack32:
         return std::string("eA8B8G8R8SrgbPack32");
         break;
+    case vk::Format::eA2B10G10R10UnormPack32:
+        return std::string("eA2B10G10R10UnormPack32");
+        break;
+    case vk::Format::eB10G11R11UfloatPack32:
+        return std::string("eB10G11R11UfloatPack32");
+        break;
     case vk::Format::eR16G16B16A16Sint:
         return std::string("eR16G16B16A16Sint");
         break;
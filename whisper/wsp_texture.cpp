@@ -74,19 +74,34 @@ Texture::Texture(Device const *device, CreateInfo const &createInfo) : _name{cre
     check(_image);
     check(createInfo.pSampler);
 
+    check(createInfo.baseMipLevel < _image->GetMipLevels());
+    check(createInfo.baseArrayLayer < _image->GetArrayLayers());
+
     vk::Format const format = _image->GetFormat();
-    bool const cubemap = _image->IsCubemap();
+    uint32_t const levelCount =
+        createInfo.mipLevels > 0u ? createInfo.mipLevels : _image->GetMipLevels() - createInfo.baseMipLevel;
+    uint32_t const layerCount =
+        createInfo.arrayLayers > 0u ? createInfo.arrayLayers : _image->GetArrayLayers() - createInfo.baseArrayLayer;
+    bool const cubemap = _image->IsCubemap() && layerCount == 6u;
 
     vk::ImageViewCreateInfo viewCreateInfo;
-    viewCreateInfo.viewType = cubemap ? vk::ImageViewType::eCube : vk::ImageViewType::e2D;
+    viewCreateInfo.viewType = vk::ImageViewType::e2D;
+    if (cubemap)
+    {
+        viewCreateInfo.viewType = vk::ImageViewType::eCube;
+    }
+    else if (layerCount > 1u)
+    {
+        viewCreateInfo.viewType = vk::ImageViewType::e2DArray;
+    }
     viewCreateInfo.format = format;
     viewCreateInfo.image = _image->GetImage();
     viewCreateInfo.subresourceRange.aspectMask =
         createInfo.depth ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
-    viewCreateInfo.subresourceRange.baseMipLevel = 0u;
-    viewCreateInfo.subresourceRange.levelCount = _image->GetMipLevels();
-    viewCreateInfo.subresourceRange.baseArrayLayer = 0u;
-    viewCreateInfo.subresourceRange.layerCount = cubemap ? 6u : 1u;
+    viewCreateInfo.subresourceRange.baseMipLevel = createInfo.baseMipLevel;
+    viewCreateInfo.subresourceRange.levelCount = levelCount;
+    viewCreateInfo.subresourceRange.baseArrayLayer = createInfo.baseArrayLayer;
+    viewCreateInfo.subresourceRange.layerCount = layerCount;
 
     _sampler = createInfo.pSampler;
 
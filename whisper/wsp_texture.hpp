@@ -27,6 +27,12 @@ class Texture
         Image::CreateInfo imageInfo{};
         bool deferredImageCreation{false};
 
+        // views part of the image, 0 counts run to its last mip or layer
+        uint32_t baseMipLevel{0u};
+        uint32_t mipLevels{0u};
+        uint32_t baseArrayLayer{0u};
+        uint32_t arrayLayers{0u};
+
         std::string name;
     };
 
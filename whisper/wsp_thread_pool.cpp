@@ -0,0 +1,111 @@
+#include <wsp_thread_pool.hpp>
+
+#include <wsp_devkit.hpp>
+
+#include <tracy/Tracy.hpp>
+
+#include <spdlog/fmt/bundled/base.h>
+#include <spdlog/spdlog.h>
+
+using namespace wsp;
+
+ThreadPool::ThreadPool(uint32_t threadCount) : _runningJobs{0}, _stopping{false}
+{
+    check(threadCount > 0);
+
+    _threads.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        _threads.emplace_back(&ThreadPool::Work, this, i);
+    }
+
+    spdlog::debug("ThreadPool: started {} threads", threadCount);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        _stopping = true;
+    }
+    _jobAvailable.notify_all();
+
+    for (std::thread &thread : _threads)
+    {
+        thread.join();
+    }
+
+    spdlog::debug("ThreadPool: joined {} threads", _threads.size());
+}
+
+uint32_t ThreadPool::GetThreadCount() const
+{
+    return static_cast<uint32_t>(_threads.size());
+}
+
+void ThreadPool::Push(Job const &job)
+{
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        _jobs.push(job);
+    }
+    _jobAvailable.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+    ZoneScopedN("wait for jobs");
+
+    std::unique_lock<std::mutex> lock{_mutex};
+    _jobsDone.wait(lock, [this]() { return _jobs.empty() && _runningJobs == 0; });
+
+    if (_exception)
+    {
+        std::exception_ptr const exception = _exception;
+        _exception = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+void ThreadPool::Work(uint32_t threadIndex)
+{
+    tracy::SetThreadName(fmt::format("worker {}", threadIndex).c_str());
+
+    while (true)
+    {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _jobAvailable.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+
+            if (_stopping && _jobs.empty())
+            {
+                return;
+            }
+
+            job = std::move(_jobs.front());
+            _jobs.pop();
+            _runningJobs++;
+        }
+
+        try
+        {
+            job(threadIndex);
+        }
+        catch (...)
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            if (!_exception)
+            {
+                _exception = std::current_exception();
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _runningJobs--;
+        }
+        _jobsDone.notify_all();
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef WSP_THREAD_POOL
+#define WSP_THREAD_POOL
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace wsp
+{
+
+class ThreadPool
+{
+  public:
+    using Job = std::function<void(uint32_t threadIndex)>;
+
+    ThreadPool(uint32_t threadCount);
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    uint32_t GetThreadCount() const;
+
+    void Push(Job const &);
+    void Wait(); // rethrows the first exception thrown by a job since the last Wait
+
+  protected:
+    void Work(uint32_t threadIndex);
+
+    std::vector<std::thread> _threads;
+    std::queue<Job> _jobs;
+
+    std::mutex _mutex;
+    std::condition_variable _jobAvailable;
+    std::condition_variable _jobsDone;
+
+    uint32_t _runningJobs;
+    bool _stopping;
+    std::exception_ptr _exception;
+};
+
+} // namespace wsp
+
+#endif
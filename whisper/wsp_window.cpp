@@ -131,14 +131,14 @@ vk::CommandBuffer Window::NextCommandBuffer(uint32_t *frameIndex)
     return _swapchain->NextCommandBuffer();
 }
 
-void Window::SwapchainOpen(vk::CommandBuffer commandBuffer, vk::Image blittedImage) const
+void Window::SwapchainOpen(vk::CommandBuffer commandBuffer, vk::Image blittedImage, vk::Extent2D blittedExtent) const
 {
     extern TracyVkCtx TRACY_CTX;
     TracyVkZone(TRACY_CTX, commandBuffer, "swapchain");
 
     if (blittedImage != VK_NULL_HANDLE)
     {
-        _swapchain->BlitImage(commandBuffer, blittedImage, GetExtent());
+        _swapchain->BlitImage(commandBuffer, blittedImage, blittedExtent);
         _swapchain->BeginRenderPass(commandBuffer, false);
     }
     else
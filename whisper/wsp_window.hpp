@@ -41,7 +41,9 @@ class Window
     vk::SurfaceKHR GetSurface() const;
 
     vk::CommandBuffer NextCommandBuffer(uint32_t *frameIndex);
-    void SwapchainOpen(vk::CommandBuffer, vk::Image blittedImage = VK_NULL_HANDLE) const;
+    // blittedExtent is the part of blittedImage stretched over the swapchain image
+    void SwapchainOpen(vk::CommandBuffer, vk::Image blittedImage = VK_NULL_HANDLE,
+                       vk::Extent2D blittedExtent = {}) const;
     void SwapchainFlush(vk::CommandBuffer);
 
     void BindResizeCallback(void *, void (*)(void *, uint32_t, uint32_t));